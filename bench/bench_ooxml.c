@@ -0,0 +1,559 @@
+/*
+ * bench_ooxml.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * times the ooxml_context api on a set of archives and prints the results as json.
+ * each measurement is the best of --iterations runs.
+ *
+ * worksheets are streamed with the row scanner (--row-scanner, auto by default), with libxml2 only,
+ * and twice more to compare the batch decoding of numeric cells (ooxml_cell_decode.h) with strtod().
+ * the text of documents is extracted with ooxml_document_stream_text().
+ *
+ * Usuage: bench_ooxml [--iterations=N] [--mmap] [--row-scanner=auto|scalar|sse42|avx2] [--output=<result.json>] <file> ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <json-c/json.h>
+
+#include "ooxml_context.h"
+#include "ooxml_private.h"
+#include "ooxml_spreadsheet.h"
+#include "ooxml_cell_decode.h"
+#include "ooxml_table.h"
+#include "ooxml_document.h"
+
+static double get_time_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+static long get_peak_rss_kb(void)
+{
+	struct rusage usage;
+	memset(&usage, 0, sizeof(usage));
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;	// kilobytes on linux
+}
+
+static int is_xml_part(const char *name)
+{
+	size_t cb_name = strlen(name);
+	return (cb_name > 4 && strcmp(name + cb_name - 4, ".xml") == 0)
+		|| (cb_name > 5 && strcmp(name + cb_name - 5, ".rels") == 0);
+}
+
+static int is_worksheet_part(const char *name)
+{
+	static const char prefix[] = "xl/worksheets/";
+	if(strncmp(name, prefix, sizeof(prefix) - 1) != 0) return 0;
+	return NULL == strchr(name + sizeof(prefix) - 1, '/') && is_xml_part(name);
+}
+
+static int on_row_count(void *user_data, const struct ooxml_row *row)
+{
+	int64_t *p_num_rows = user_data;
+	++*p_num_rows;
+	return 0;
+}
+
+struct document_counter
+{
+	int64_t num_paragraphs;
+	uint64_t text_bytes;
+};
+
+static int on_paragraph_count(void *user_data, const struct ooxml_paragraph *paragraph)
+{
+	struct document_counter *counter = user_data;
+	++counter->num_paragraphs;
+	counter->text_bytes += paragraph->length;
+	return 0;
+}
+
+/*
+ * the numeric cells of each row, decoded with ooxml_cells_decode_doubles() or one strtod() per cell
+ */
+struct row_decoder
+{
+	int use_strtod;
+	ssize_t max_cells;
+	double *values;
+	uint8_t *errors;
+	
+	int64_t num_values;
+	double sum;
+};
+
+static int on_row_decode(void *user_data, const struct ooxml_row *row)
+{
+	struct row_decoder *decoder = user_data;
+	if(decoder->use_strtod) {
+		for(ssize_t i = 0; i < row->num_cells; ++i) {
+			const struct ooxml_cell *cell = &row->cells[i];
+			if(cell->type != ooxml_cell_type_number || NULL == cell->value) continue;
+			decoder->sum += strtod(cell->value, NULL);
+			++decoder->num_values;
+		}
+		return 0;
+	}
+	
+	if(row->num_cells > decoder->max_cells) {
+		decoder->max_cells = row->num_cells;
+		decoder->values = realloc(decoder->values, row->num_cells * sizeof(*decoder->values));
+		decoder->errors = realloc(decoder->errors, row->num_cells * sizeof(*decoder->errors));
+		assert(decoder->values && decoder->errors);
+	}
+	ooxml_cells_decode_doubles(row->cells, row->num_cells, decoder->values, decoder->errors);
+	for(ssize_t i = 0; i < row->num_cells; ++i) {
+		if(row->cells[i].type != ooxml_cell_type_number || decoder->errors[i] != ooxml_decode_ok) continue;
+		decoder->sum += decoder->values[i];
+		++decoder->num_values;
+	}
+	return 0;
+}
+
+struct bench_result
+{
+	double open_ms;
+	double get_num_entries_ms;
+	double get_file_ms;			// fetch_data = 0
+	double get_file_data_ms;	// fetch_data = 1
+	double parse_ms;			// parse_zip_xml_file() on every xml part
+	double stream_rows_ms;		// ooxml_spreadsheet_stream_rows() on every worksheet
+	double stream_rows_libxml2_ms;	// the same with ooxml_row_scanner_libxml2
+	double decode_rows_ms;		// stream_rows + ooxml_cells_decode_doubles() on every row
+	double decode_rows_strtod_ms;	// stream_rows + strtod() on every numeric cell
+	double table_load_ms;		// ooxml_table_load() of every worksheet
+	double column_stats_ms;		// ooxml_column_get_stats() on every column of the tables
+	double save_libzip_ms;		// put_part() of every worksheet + save(), save_workers = 1
+	double save_parallel_ms;	// the same with save_workers = 0 (one deflate worker per cpu)
+	double document_text_ms;	// ooxml_document_stream_text() of every story (docx)
+	
+	ssize_t num_entries;
+	uint64_t uncompressed_bytes;
+	uint64_t xml_bytes;
+	int64_t num_rows;
+	int64_t num_values;
+	int64_t num_paragraphs;
+	uint64_t text_bytes;
+};
+
+static enum ooxml_row_scanner g_row_scanner = ooxml_row_scanner_auto;
+
+static double stream_worksheets(struct ooxml_private *priv, ssize_t num_entries, 
+	ooxml_row_callback on_row, void *user_data, int *p_num_sheets)
+{
+	int num_sheets = 0;
+	double start = get_time_ms();
+	for(ssize_t i = 0; i < num_entries; ++i) {
+		const struct ooxml_zip_file *file = &priv->entries[i];
+		if(NULL == file->filename || !is_worksheet_part(file->filename)) continue;
+		ooxml_spreadsheet_stream_rows(priv->archive, file->filename, on_row, user_data);
+		++num_sheets;
+	}
+	double end = get_time_ms();
+	
+	*p_num_sheets = num_sheets;
+	return end - start;
+}
+
+/*
+ * save(): every worksheet is put back unchanged into a copy of the archive, so all of them are deflated again
+ */
+struct part_buffer
+{
+	unsigned char *data;
+	size_t length;
+	size_t size;
+};
+
+static int on_part_data(void *user_data, const unsigned char *data, size_t length)
+{
+	struct part_buffer *buf = user_data;
+	if(buf->length + length > buf->size) {
+		size_t new_size = buf->size?(buf->size * 2):(1024 * 1024);
+		while(new_size < buf->length + length) new_size *= 2;
+		buf->data = realloc(buf->data, new_size);
+		assert(buf->data);
+		buf->size = new_size;
+	}
+	memcpy(buf->data + buf->length, data, length);
+	buf->length += length;
+	return 0;
+}
+
+static int copy_file(const char *src_path, int fd)
+{
+	FILE *src = fopen(src_path, "rb");
+	FILE *dst = fdopen(fd, "wb");
+	if(NULL == src || NULL == dst) {
+		if(src) fclose(src);
+		if(dst) fclose(dst);
+		return -1;
+	}
+	char buffer[65536];
+	size_t cb = 0;
+	int rc = 0;
+	while(0 == rc && (cb = fread(buffer, 1, sizeof(buffer), src)) > 0) {
+		if(fwrite(buffer, 1, cb, dst) != cb) rc = -1;
+	}
+	fclose(src);
+	if(fclose(dst) != 0) rc = -1;
+	return rc;
+}
+
+static double bench_save(struct ooxml_context *ooxml, const char *path, int save_workers)
+{
+	char temp_path[] = "/tmp/bench_ooxml_save-XXXXXX";
+	int fd = mkstemp(temp_path);
+	if(fd == -1 || copy_file(path, fd) != 0 || ooxml->open(ooxml, temp_path, 0) != 0) {
+		if(fd != -1) unlink(temp_path);
+		return -1;
+	}
+	
+	struct ooxml_private *priv = ooxml->priv;
+	ssize_t num_entries = ooxml->get_num_entries(ooxml);
+	struct part_buffer buf = { NULL };
+	int num_sheets = 0;
+	for(ssize_t i = 0; i < num_entries; ++i) {
+		const struct ooxml_zip_file *file = &priv->entries[i];
+		if(NULL == file->filename || !is_worksheet_part(file->filename)) continue;
+		buf.length = 0;
+		if(ooxml->read_entry(ooxml, i, on_part_data, &buf) < 0) continue;
+		ooxml->put_part(ooxml, file->filename, buf.data, buf.length);
+		++num_sheets;
+	}
+	free(buf.data);
+	
+	int saved_workers = ooxml->save_workers;
+	ooxml->save_workers = save_workers;
+	double start = get_time_ms();
+	int rc = ooxml->save(ooxml);
+	double end = get_time_ms();
+	ooxml->save_workers = saved_workers;
+	
+	ooxml->close(ooxml);
+	unlink(temp_path);
+	return (rc == 0 && num_sheets > 0)?(end - start):-1;
+}
+
+#define KEEP_MIN(dst, value) do { if((dst) <= 0 || (value) < (dst)) (dst) = (value); } while(0)
+
+static int bench_file(struct ooxml_context *ooxml, const char *path, struct bench_result *result)
+{
+	double start = get_time_ms();
+	int rc = ooxml->open(ooxml, path, 1);
+	double end = get_time_ms();
+	if(rc) return -1;
+	KEEP_MIN(result->open_ms, end - start);
+	
+	struct ooxml_private *priv = ooxml->priv;
+	
+	// the entry table has been built by open(), this only measures the cached path
+	start = get_time_ms();
+	ssize_t num_entries = ooxml->get_num_entries(ooxml);
+	end = get_time_ms();
+	KEEP_MIN(result->get_num_entries_ms, end - start);
+	result->num_entries = num_entries;
+	
+	start = get_time_ms();
+	for(ssize_t i = 0; i < num_entries; ++i) {
+		struct ooxml_zip_file file;
+		memset(&file, 0, sizeof(file));
+		ooxml->get_file(ooxml, i, &file, 0);
+		ooxml_zip_file_clear(&file);
+	}
+	end = get_time_ms();
+	KEEP_MIN(result->get_file_ms, end - start);
+	
+	uint64_t uncompressed_bytes = 0;
+	start = get_time_ms();
+	for(ssize_t i = 0; i < num_entries; ++i) {
+		struct ooxml_zip_file file;
+		memset(&file, 0, sizeof(file));
+		ooxml->get_file(ooxml, i, &file, 1);
+		uncompressed_bytes += file.cb_data;
+		ooxml_zip_file_clear(&file);
+	}
+	end = get_time_ms();
+	KEEP_MIN(result->get_file_data_ms, end - start);
+	result->uncompressed_bytes = uncompressed_bytes;
+	
+	uint64_t xml_bytes = 0;
+	start = get_time_ms();
+	for(ssize_t i = 0; i < num_entries; ++i) {
+		const struct ooxml_zip_file *file = &priv->entries[i];
+		if(NULL == file->filename || !is_xml_part(file->filename)) continue;
+		
+		xmlDocPtr doc = NULL;
+		if(0 == parse_zip_xml_file(priv->archive, file->filename, &doc)) xml_bytes += file->file_length;
+		if(doc) xmlFreeDoc(doc);
+	}
+	end = get_time_ms();
+	KEEP_MIN(result->parse_ms, end - start);
+	result->xml_bytes = xml_bytes;
+	
+	int64_t num_rows = 0;
+	int num_sheets = 0;
+	double stream_rows_ms = stream_worksheets(priv, num_entries, on_row_count, &num_rows, &num_sheets);
+	if(num_sheets > 0) KEEP_MIN(result->stream_rows_ms, stream_rows_ms);
+	result->num_rows = num_rows;
+	
+	struct row_decoder decoder[1];
+	memset(decoder, 0, sizeof(decoder));
+	stream_rows_ms = stream_worksheets(priv, num_entries, on_row_decode, decoder, &num_sheets);
+	if(num_sheets > 0) KEEP_MIN(result->decode_rows_ms, stream_rows_ms);
+	result->num_values = decoder->num_values;
+	free(decoder->values);
+	free(decoder->errors);
+	
+	memset(decoder, 0, sizeof(decoder));
+	decoder->use_strtod = 1;
+	stream_rows_ms = stream_worksheets(priv, num_entries, on_row_decode, decoder, &num_sheets);
+	if(num_sheets > 0) KEEP_MIN(result->decode_rows_strtod_ms, stream_rows_ms);
+	
+	struct ooxml_shared_strings *sst = ooxml->get_shared_strings(ooxml);
+	struct ooxml_styles *styles = ooxml->get_styles(ooxml);
+	double table_load_ms = 0, column_stats_ms = 0;
+	num_sheets = 0;
+	for(ssize_t i = 0; i < num_entries; ++i) {
+		const struct ooxml_zip_file *file = &priv->entries[i];
+		if(NULL == file->filename || !is_worksheet_part(file->filename)) continue;
+		
+		start = get_time_ms();
+		struct ooxml_table *table = ooxml_table_load(priv->archive, file->filename, sst, styles, NULL);
+		end = get_time_ms();
+		if(NULL == table) continue;
+		table_load_ms += end - start;
+		++num_sheets;
+		
+		start = get_time_ms();
+		for(int64_t col = 0; col < table->num_columns; ++col) {
+			struct ooxml_column_stats stats;
+			ooxml_column_get_stats(&table->columns[col], &stats);
+		}
+		end = get_time_ms();
+		column_stats_ms += end - start;
+		ooxml_table_free(table);
+	}
+	if(num_sheets > 0) {
+		KEEP_MIN(result->table_load_ms, table_load_ms);
+		KEEP_MIN(result->column_stats_ms, column_stats_ms);
+	}
+	
+	enum ooxml_row_scanner row_scanner = g_row_scanner;
+	ooxml_spreadsheet_set_row_scanner(ooxml_row_scanner_libxml2);
+	num_rows = 0;
+	stream_rows_ms = stream_worksheets(priv, num_entries, on_row_count, &num_rows, &num_sheets);
+	if(num_sheets > 0) KEEP_MIN(result->stream_rows_libxml2_ms, stream_rows_ms);
+	ooxml_spreadsheet_set_row_scanner(row_scanner);
+	
+	if(zip_name_locate(priv->archive, "word/document.xml", 0) >= 0) {
+		struct document_counter counter[1];
+		memset(counter, 0, sizeof(counter));
+		struct ooxml_document_sink sink;
+		memset(&sink, 0, sizeof(sink));
+		sink.user_data = counter;
+		sink.on_paragraph = on_paragraph_count;
+		
+		start = get_time_ms();
+		rc = ooxml_document_stream_text(priv->archive, OOXML_DOCUMENT_ALL_STORIES, &sink);
+		end = get_time_ms();
+		if(0 == rc) KEEP_MIN(result->document_text_ms, end - start);
+		result->num_paragraphs = counter->num_paragraphs;
+		result->text_bytes = counter->text_bytes;
+	}
+	
+	ooxml->close(ooxml);
+	
+	double save_ms = bench_save(ooxml, path, 1);
+	if(save_ms > 0) KEEP_MIN(result->save_libzip_ms, save_ms);
+	save_ms = bench_save(ooxml, path, 0);
+	if(save_ms > 0) KEEP_MIN(result->save_parallel_ms, save_ms);
+	return 0;
+}
+
+static double throughput(double amount, double ms)
+{
+	if(ms <= 0) return 0;
+	return amount / (ms / 1000.0);
+}
+
+static json_object *bench_result_to_json(const char *path, const struct bench_result *result)
+{
+	struct stat st[1];
+	memset(st, 0, sizeof(st));
+	stat(path, st);
+	
+	static const double MB = 1024.0 * 1024.0;
+	json_object *jresult = json_object_new_object();
+	json_object_object_add(jresult, "file", json_object_new_string(path));
+	json_object_object_add(jresult, "file_size", json_object_new_int64(st->st_size));
+	json_object_object_add(jresult, "num_entries", json_object_new_int64(result->num_entries));
+	json_object_object_add(jresult, "uncompressed_bytes", json_object_new_int64(result->uncompressed_bytes));
+	json_object_object_add(jresult, "num_rows", json_object_new_int64(result->num_rows));
+	json_object_object_add(jresult, "num_values", json_object_new_int64(result->num_values));
+	json_object_object_add(jresult, "num_paragraphs", json_object_new_int64(result->num_paragraphs));
+	json_object_object_add(jresult, "text_bytes", json_object_new_int64(result->text_bytes));
+	
+	json_object_object_add(jresult, "open_ms", json_object_new_double(result->open_ms));
+	json_object_object_add(jresult, "get_num_entries_ms", json_object_new_double(result->get_num_entries_ms));
+	json_object_object_add(jresult, "get_file_ms", json_object_new_double(result->get_file_ms));
+	json_object_object_add(jresult, "get_file_data_ms", json_object_new_double(result->get_file_data_ms));
+	json_object_object_add(jresult, "parse_ms", json_object_new_double(result->parse_ms));
+	json_object_object_add(jresult, "stream_rows_ms", json_object_new_double(result->stream_rows_ms));
+	json_object_object_add(jresult, "stream_rows_libxml2_ms", json_object_new_double(result->stream_rows_libxml2_ms));
+	json_object_object_add(jresult, "decode_rows_ms", json_object_new_double(result->decode_rows_ms));
+	json_object_object_add(jresult, "decode_rows_strtod_ms", json_object_new_double(result->decode_rows_strtod_ms));
+	json_object_object_add(jresult, "table_load_ms", json_object_new_double(result->table_load_ms));
+	json_object_object_add(jresult, "column_stats_ms", json_object_new_double(result->column_stats_ms));
+	json_object_object_add(jresult, "save_libzip_ms", json_object_new_double(result->save_libzip_ms));
+	json_object_object_add(jresult, "save_parallel_ms", json_object_new_double(result->save_parallel_ms));
+	json_object_object_add(jresult, "document_text_ms", json_object_new_double(result->document_text_ms));
+	
+	json_object_object_add(jresult, "get_file_data_mb_per_s",
+		json_object_new_double(throughput(result->uncompressed_bytes / MB, result->get_file_data_ms)));
+	json_object_object_add(jresult, "parse_mb_per_s",
+		json_object_new_double(throughput(result->xml_bytes / MB, result->parse_ms)));
+	json_object_object_add(jresult, "rows_per_s",
+		json_object_new_double(throughput(result->num_rows, result->stream_rows_ms)));
+	json_object_object_add(jresult, "rows_per_s_libxml2",
+		json_object_new_double(throughput(result->num_rows, result->stream_rows_libxml2_ms)));
+	json_object_object_add(jresult, "paragraphs_per_s",
+		json_object_new_double(throughput(result->num_paragraphs, result->document_text_ms)));
+	return jresult;
+}
+
+static void print_usuages(const char *app_name)
+{
+	fprintf(stderr, "Usuage: %s [--iterations=N] [--mmap] [--row-scanner=auto|scalar|sse42|avx2] [--output=<result.json>] <file> ...\n", app_name);
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 3;
+	int use_mmap = 0;
+	const char *output_file = NULL;
+	const char *row_scanner_name = "auto";
+	
+	static struct option options[] = {
+		{"iterations", required_argument, 0, 'n'},
+		{"mmap", no_argument, 0, 'm'},
+		{"output", required_argument, 0, 'o'},
+		{"row-scanner", required_argument, 0, 's'},
+		{"help", no_argument, 0, 'h'},
+		{NULL},
+	};
+	while(1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "n:mo:s:h", options, &option_index);
+		if(c == -1) break;
+		switch(c) {
+		case 'n': iterations = atoi(optarg); break;
+		case 'm': use_mmap = 1; break;
+		case 'o': output_file = optarg; break;
+		case 's':
+			row_scanner_name = optarg;
+			if(strcmp(optarg, "auto") == 0) g_row_scanner = ooxml_row_scanner_auto;
+			else if(strcmp(optarg, "scalar") == 0) g_row_scanner = ooxml_row_scanner_scalar;
+			else if(strcmp(optarg, "sse42") == 0) g_row_scanner = ooxml_row_scanner_sse42;
+			else if(strcmp(optarg, "avx2") == 0) g_row_scanner = ooxml_row_scanner_avx2;
+			else {
+				print_usuages(argv[0]);
+				return 1;
+			}
+			break;
+		default:
+			print_usuages(argv[0]);
+			return (c == 'h')?0:1;
+		}
+	}
+	if(optind >= argc) {
+		print_usuages(argv[0]);
+		return 1;
+	}
+	if(iterations < 1) iterations = 1;
+	if(ooxml_spreadsheet_set_row_scanner(g_row_scanner) != 0) {
+		fprintf(stderr, "row scanner '%s' is not supported by this cpu\n", row_scanner_name);
+		return 1;
+	}
+	
+	struct ooxml_context *ooxml = ooxml_context_init(NULL, NULL);
+	assert(ooxml);
+	ooxml->use_mmap = use_mmap;
+	
+	int num_failed = 0;
+	json_object *jfiles = json_object_new_array();
+	for(int i = optind; i < argc; ++i) {
+		const char *path = argv[i];
+		struct bench_result result;
+		memset(&result, 0, sizeof(result));
+		
+		int rc = 0;
+		for(int k = 0; k < iterations && 0 == rc; ++k) rc = bench_file(ooxml, path, &result);
+		if(rc) {
+			fprintf(stderr, "bench %s failed\n", path);
+			++num_failed;
+			continue;
+		}
+		json_object_array_add(jfiles, bench_result_to_json(path, &result));
+	}
+	
+	json_object *jreport = json_object_new_object();
+	json_object_object_add(jreport, "iterations", json_object_new_int(iterations));
+	json_object_object_add(jreport, "use_mmap", json_object_new_boolean(use_mmap));
+	json_object_object_add(jreport, "row_scanner", json_object_new_string(ooxml_spreadsheet_get_row_scanner_name()));
+	json_object_object_add(jreport, "files", jfiles);
+	json_object_object_add(jreport, "peak_rss_kb", json_object_new_int64(get_peak_rss_kb()));
+	
+	const char *report = json_object_to_json_string_ext(jreport, JSON_C_TO_STRING_PRETTY);
+	if(output_file) {
+		FILE *fp = fopen(output_file, "w");
+		if(NULL == fp) {
+			perror(output_file);
+			num_failed = 1;
+		}else {
+			fprintf(fp, "%s\n", report);
+			fclose(fp);
+		}
+	}
+	printf("%s\n", report);
+	json_object_put(jreport);
+	
+	ooxml_context_cleanup(ooxml);
+	free(ooxml);
+	return num_failed?1:0;
+}
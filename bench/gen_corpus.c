@@ -0,0 +1,464 @@
+/*
+ * gen_corpus.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * deterministic synthetic OOXML corpus generator.
+ * the same options (and seed) always produce byte-identical parts.
+ *
+ * Usuage: gen_corpus [--type=xlsx|docx] [--rows=N] [--cols=N] [--sst-ratio=0..1] [--unique-strings=N]
+ *                    [--parts=N] [--media=N] [--media-size=BYTES] [--seed=N] -o <output file>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include <getopt.h>
+#include <zip.h>
+
+struct corpus_options
+{
+	const char *type;		// xlsx | docx
+	const char *output_file;
+	long rows;				// rows per worksheet, paragraphs per document part
+	long cols;				// cells per row, runs per paragraph
+	double sst_ratio;		// fraction of cells that are shared strings
+	long unique_strings;	// size of the shared strings pool
+	long parts;				// worksheets (xlsx) or header parts (docx)
+	long media;				// number of media parts
+	long media_size;
+	uint64_t seed;
+};
+
+/******************************************************************************
+ * prng: xorshift64*
+******************************************************************************/
+static uint64_t s_prng_state = 0x9E3779B97F4A7C15ULL;
+static void prng_seed(uint64_t seed)
+{
+	s_prng_state = seed?seed:0x9E3779B97F4A7C15ULL;
+}
+static uint64_t prng_next(void)
+{
+	uint64_t x = s_prng_state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	s_prng_state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+static double prng_uniform(void)
+{
+	return (double)(prng_next() >> 11) / (double)(1ULL << 53);
+}
+
+/******************************************************************************
+ * text buffer
+******************************************************************************/
+struct text_buffer
+{
+	char *data;
+	size_t length;
+	size_t max_size;
+};
+
+static void text_buffer_reserve(struct text_buffer *buf, size_t size)
+{
+	if((buf->length + size + 1) <= buf->max_size) return;
+	size_t new_size = buf->max_size?buf->max_size:65536;
+	while(new_size < (buf->length + size + 1)) new_size *= 2;
+	char *data = realloc(buf->data, new_size);
+	assert(data);
+	buf->data = data;
+	buf->max_size = new_size;
+}
+static void text_buffer_append(struct text_buffer *buf, const char *text)
+{
+	size_t length = strlen(text);
+	text_buffer_reserve(buf, length);
+	memcpy(buf->data + buf->length, text, length + 1);
+	buf->length += length;
+}
+static void text_buffer_printf(struct text_buffer *buf, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	int length = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+	assert(length >= 0);
+	
+	text_buffer_reserve(buf, length);
+	va_start(args, fmt);
+	vsnprintf(buf->data + buf->length, length + 1, fmt, args);
+	va_end(args);
+	buf->length += length;
+}
+
+// the archive takes the ownership of buf->data
+static int add_part(zip_t *zip, const char *part_name, struct text_buffer *buf, int store)
+{
+	zip_source_t *src = zip_source_buffer(zip, buf->data, buf->length, 1);
+	if(NULL == src) {
+		fprintf(stderr, "zip_source_buffer(%s) failed: %s\n", part_name, zip_strerror(zip));
+		free(buf->data);
+		memset(buf, 0, sizeof(*buf));
+		return -1;
+	}
+	memset(buf, 0, sizeof(*buf));
+	
+	zip_int64_t index = zip_file_add(zip, part_name, src, ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8);
+	if(index < 0) {
+		fprintf(stderr, "zip_file_add(%s) failed: %s\n", part_name, zip_strerror(zip));
+		zip_source_free(src);
+		return -1;
+	}
+	// fixed mtime, so that the output does not depend on the time of the run
+	zip_file_set_mtime(zip, index, 1640995200, 0);
+	if(store) zip_set_file_compression(zip, index, ZIP_CM_STORE, 0);
+	return 0;
+}
+
+static int add_media_parts(zip_t *zip, const char *dir, const struct corpus_options *options)
+{
+	for(long i = 0; i < options->media; ++i) {
+		struct text_buffer buf[1];
+		memset(buf, 0, sizeof(buf));
+		text_buffer_reserve(buf, options->media_size);
+		
+		// incompressible payload behind a png signature
+		static const unsigned char png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		for(long k = 0; k < options->media_size; k += 8) {
+			uint64_t value = prng_next();
+			memcpy(buf->data + k, &value, ((options->media_size - k) < 8)?(options->media_size - k):8);
+		}
+		memcpy(buf->data, png_signature, (options->media_size < 8)?options->media_size:8);
+		buf->length = options->media_size;
+		
+		char part_name[256] = "";
+		snprintf(part_name, sizeof(part_name), "%s/image%ld.png", dir, i + 1);
+		if(add_part(zip, part_name, buf, 1)) return -1;
+	}
+	return 0;
+}
+
+/******************************************************************************
+ * words
+******************************************************************************/
+static const char *s_words[] = {
+	"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+	"india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+	"quebec", "romeo", "sierra", "tango", "uniform", "victor", "whiskey", "xray",
+	"yankee", "zulu", "lorem", "ipsum", "dolor", "sit", "amet", "&amp;",
+};
+#define NUM_WORDS (sizeof(s_words) / sizeof(s_words[0]))
+
+static void append_words(struct text_buffer *buf, long num_words)
+{
+	for(long i = 0; i < num_words; ++i) {
+		if(i > 0) text_buffer_append(buf, " ");
+		text_buffer_append(buf, s_words[prng_next() % NUM_WORDS]);
+	}
+}
+
+static void col_to_ref(long col, char ref[static 8])
+{
+	char letters[8] = "";
+	int length = 0;
+	++col;
+	while(col > 0 && length < 7) {
+		letters[length++] = 'A' + (col - 1) % 26;
+		col = (col - 1) / 26;
+	}
+	for(int i = 0; i < length; ++i) ref[i] = letters[length - 1 - i];
+	ref[length] = '\0';
+}
+
+/******************************************************************************
+ * xlsx
+******************************************************************************/
+static int generate_spreadsheet(zip_t *zip, const struct corpus_options *options)
+{
+	struct text_buffer buf[1];
+	memset(buf, 0, sizeof(buf));
+	
+	text_buffer_append(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+		"<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+		"<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+		"<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+		"<Default Extension=\"png\" ContentType=\"image/png\"/>"
+		"<Override PartName=\"/xl/workbook.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.sheet.main+xml\"/>"
+		"<Override PartName=\"/xl/sharedStrings.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.sharedStrings+xml\"/>");
+	for(long i = 0; i < options->parts; ++i) {
+		text_buffer_printf(buf, "<Override PartName=\"/xl/worksheets/sheet%ld.xml\" "
+			"ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.worksheet+xml\"/>", i + 1);
+	}
+	text_buffer_append(buf, "</Types>");
+	if(add_part(zip, "[Content_Types].xml", buf, 0)) return -1;
+	
+	text_buffer_append(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+		"<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+		"<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"xl/workbook.xml\"/>"
+		"</Relationships>");
+	if(add_part(zip, "_rels/.rels", buf, 0)) return -1;
+	
+	text_buffer_append(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+		"<workbook xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\" "
+		"xmlns:r=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships\"><sheets>");
+	for(long i = 0; i < options->parts; ++i) {
+		text_buffer_printf(buf, "<sheet name=\"Sheet%ld\" sheetId=\"%ld\" r:id=\"rId%ld\"/>", i + 1, i + 1, i + 1);
+	}
+	text_buffer_append(buf, "</sheets></workbook>");
+	if(add_part(zip, "xl/workbook.xml", buf, 0)) return -1;
+	
+	text_buffer_append(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+		"<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">");
+	for(long i = 0; i < options->parts; ++i) {
+		text_buffer_printf(buf, "<Relationship Id=\"rId%ld\" "
+			"Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/worksheet\" "
+			"Target=\"worksheets/sheet%ld.xml\"/>", i + 1, i + 1);
+	}
+	text_buffer_printf(buf, "<Relationship Id=\"rId%ld\" "
+		"Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/sharedStrings\" "
+		"Target=\"sharedStrings.xml\"/></Relationships>", options->parts + 1);
+	if(add_part(zip, "xl/_rels/workbook.xml.rels", buf, 0)) return -1;
+	
+	// shared strings pool
+	long unique_strings = options->unique_strings;
+	if(unique_strings <= 0) unique_strings = 1;
+	text_buffer_printf(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+		"<sst xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\" uniqueCount=\"%ld\">", unique_strings);
+	for(long i = 0; i < unique_strings; ++i) {
+		text_buffer_printf(buf, "<si><t>%ld ", i);
+		append_words(buf, 1 + prng_next() % 4);
+		text_buffer_append(buf, "</t></si>");
+	}
+	text_buffer_append(buf, "</sst>");
+	if(add_part(zip, "xl/sharedStrings.xml", buf, 0)) return -1;
+	
+	for(long part = 0; part < options->parts; ++part) {
+		char last_col[8] = "A";
+		col_to_ref((options->cols > 0)?(options->cols - 1):0, last_col);
+		text_buffer_printf(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+			"<worksheet xmlns=\"http://schemas.openxmlformats.org/spreadsheetml/2006/main\">"
+			"<dimension ref=\"A1:%s%ld\"/><sheetData>", last_col, options->rows);
+		
+		for(long row = 1; row <= options->rows; ++row) {
+			text_buffer_printf(buf, "<row r=\"%ld\">", row);
+			for(long col = 0; col < options->cols; ++col) {
+				char ref[8] = "";
+				col_to_ref(col, ref);
+				if(prng_uniform() < options->sst_ratio) {
+					text_buffer_printf(buf, "<c r=\"%s%ld\" t=\"s\"><v>%ld</v></c>", ref, row,
+						(long)(prng_next() % unique_strings));
+				}else if(prng_next() & 1) {
+					text_buffer_printf(buf, "<c r=\"%s%ld\"><v>%ld</v></c>", ref, row,
+						(long)(prng_next() % 1000000));
+				}else {
+					text_buffer_printf(buf, "<c r=\"%s%ld\" s=\"1\"><v>%.6f</v></c>", ref, row,
+						prng_uniform() * 100000.0);
+				}
+			}
+			text_buffer_append(buf, "</row>");
+		}
+		text_buffer_append(buf, "</sheetData></worksheet>");
+		
+		char part_name[256] = "";
+		snprintf(part_name, sizeof(part_name), "xl/worksheets/sheet%ld.xml", part + 1);
+		if(add_part(zip, part_name, buf, 0)) return -1;
+	}
+	
+	return add_media_parts(zip, "xl/media", options);
+}
+
+/******************************************************************************
+ * docx
+******************************************************************************/
+static void append_paragraphs(struct text_buffer *buf, long num_paragraphs, long num_runs)
+{
+	for(long i = 0; i < num_paragraphs; ++i) {
+		text_buffer_append(buf, "<w:p>");
+		for(long k = 0; k < num_runs; ++k) {
+			if(prng_next() % 8 == 0) text_buffer_append(buf, "<w:r><w:rPr><w:b/></w:rPr><w:t xml:space=\"preserve\">");
+			else text_buffer_append(buf, "<w:r><w:t xml:space=\"preserve\">");
+			append_words(buf, 1 + prng_next() % 6);
+			text_buffer_append(buf, " </w:t></w:r>");
+		}
+		text_buffer_append(buf, "</w:p>");
+	}
+}
+
+static int generate_document(zip_t *zip, const struct corpus_options *options)
+{
+	struct text_buffer buf[1];
+	memset(buf, 0, sizeof(buf));
+	
+	text_buffer_append(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+		"<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+		"<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+		"<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+		"<Default Extension=\"png\" ContentType=\"image/png\"/>"
+		"<Override PartName=\"/word/document.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.document.main+xml\"/>");
+	for(long i = 0; i < options->parts; ++i) {
+		text_buffer_printf(buf, "<Override PartName=\"/word/header%ld.xml\" "
+			"ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.header+xml\"/>", i + 1);
+	}
+	text_buffer_append(buf, "</Types>");
+	if(add_part(zip, "[Content_Types].xml", buf, 0)) return -1;
+	
+	text_buffer_append(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+		"<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+		"<Relationship Id=\"rId1\" Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/officeDocument\" Target=\"word/document.xml\"/>"
+		"</Relationships>");
+	if(add_part(zip, "_rels/.rels", buf, 0)) return -1;
+	
+	text_buffer_append(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+		"<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">");
+	for(long i = 0; i < options->parts; ++i) {
+		text_buffer_printf(buf, "<Relationship Id=\"rId%ld\" "
+			"Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/header\" "
+			"Target=\"header%ld.xml\"/>", i + 1, i + 1);
+	}
+	for(long i = 0; i < options->media; ++i) {
+		text_buffer_printf(buf, "<Relationship Id=\"rId%ld\" "
+			"Type=\"http://schemas.openxmlformats.org/officeDocument/2006/relationships/image\" "
+			"Target=\"media/image%ld.png\"/>", options->parts + i + 1, i + 1);
+	}
+	text_buffer_append(buf, "</Relationships>");
+	if(add_part(zip, "word/_rels/document.xml.rels", buf, 0)) return -1;
+	
+	static const char *w_namespace = "xmlns:w=\"http://schemas.openxmlformats.org/wordprocessingml/2006/main\"";
+	text_buffer_printf(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+		"<w:document %s><w:body>", w_namespace);
+	append_paragraphs(buf, options->rows, options->cols);
+	text_buffer_append(buf, "</w:body></w:document>");
+	if(add_part(zip, "word/document.xml", buf, 0)) return -1;
+	
+	for(long i = 0; i < options->parts; ++i) {
+		text_buffer_printf(buf, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n<w:hdr %s>", w_namespace);
+		append_paragraphs(buf, 1 + options->rows / 100, options->cols);
+		text_buffer_append(buf, "</w:hdr>");
+		
+		char part_name[256] = "";
+		snprintf(part_name, sizeof(part_name), "word/header%ld.xml", i + 1);
+		if(add_part(zip, part_name, buf, 0)) return -1;
+	}
+	
+	return add_media_parts(zip, "word/media", options);
+}
+
+/******************************************************************************
+ * main
+******************************************************************************/
+static void print_usuages(const char *app_name)
+{
+	fprintf(stderr, "Usuage: %s [--type=xlsx|docx] [--rows=N] [--cols=N] [--sst-ratio=0..1] [--unique-strings=N]\n"
+		"       [--parts=N] [--media=N] [--media-size=BYTES] [--seed=N] -o <output file>\n", app_name);
+}
+
+int main(int argc, char **argv)
+{
+	struct corpus_options options = {
+		.type = "xlsx",
+		.rows = 10000,
+		.cols = 10,
+		.sst_ratio = 0.3,
+		.unique_strings = 1000,
+		.parts = 1,
+		.media = 0,
+		.media_size = 65536,
+		.seed = 1,
+	};
+	
+	static struct option long_options[] = {
+		{"type", required_argument, 0, 't'},
+		{"rows", required_argument, 0, 'r'},
+		{"cols", required_argument, 0, 'c'},
+		{"sst-ratio", required_argument, 0, 's'},
+		{"unique-strings", required_argument, 0, 'u'},
+		{"parts", required_argument, 0, 'p'},
+		{"media", required_argument, 0, 'm'},
+		{"media-size", required_argument, 0, 'z'},
+		{"seed", required_argument, 0, 'S'},
+		{"output", required_argument, 0, 'o'},
+		{"help", no_argument, 0, 'h'},
+		{NULL},
+	};
+	
+	while(1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "t:r:c:s:u:p:m:z:S:o:h", long_options, &option_index);
+		if(c == -1) break;
+		switch(c) {
+		case 't': options.type = optarg; break;
+		case 'r': options.rows = atol(optarg); break;
+		case 'c': options.cols = atol(optarg); break;
+		case 's': options.sst_ratio = atof(optarg); break;
+		case 'u': options.unique_strings = atol(optarg); break;
+		case 'p': options.parts = atol(optarg); break;
+		case 'm': options.media = atol(optarg); break;
+		case 'z': options.media_size = atol(optarg); break;
+		case 'S': options.seed = strtoull(optarg, NULL, 10); break;
+		case 'o': options.output_file = optarg; break;
+		default:
+			print_usuages(argv[0]);
+			return (c == 'h')?0:1;
+		}
+	}
+	if(NULL == options.output_file) {
+		print_usuages(argv[0]);
+		return 1;
+	}
+	if(options.rows < 0) options.rows = 0;
+	if(options.cols < 0) options.cols = 0;
+	if(options.parts < 1) options.parts = 1;
+	if(options.media_size < 0) options.media_size = 0;
+	
+	prng_seed(options.seed);
+	
+	int err_code = 0;
+	zip_t *zip = zip_open(options.output_file, ZIP_CREATE | ZIP_TRUNCATE, &err_code);
+	if(NULL == zip) {
+		fprintf(stderr, "zip_open(%s) failed, err_code=%d\n", options.output_file, err_code);
+		return 1;
+	}
+	
+	int rc = 0;
+	if(strcmp(options.type, "docx") == 0) rc = generate_document(zip, &options);
+	else rc = generate_spreadsheet(zip, &options);
+	
+	if(rc) {
+		zip_discard(zip);
+		return 1;
+	}
+	if(zip_close(zip) != 0) {
+		fprintf(stderr, "zip_close(%s) failed: %s\n", options.output_file, zip_strerror(zip));
+		zip_discard(zip);
+		return 1;
+	}
+	return 0;
+}
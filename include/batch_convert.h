@@ -0,0 +1,56 @@
+#ifndef OOXML_BATCH_CONVERT_H_
+#define OOXML_BATCH_CONVERT_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <json-c/json.h>
+
+enum batch_convert_format
+{
+	batch_convert_format_csv,
+	batch_convert_format_json,
+	batch_convert_format_text,
+};
+
+struct batch_convert_options
+{
+	enum batch_convert_format format;
+	const char *output_dir;
+	int num_workers;		// <= 0: number of online cpus
+	json_object *jooxml;	// "ooxml" section of the app config, applied to every worker's context
+	volatile int *quit;		// set to non-zero to stop after the files in progress
+};
+
+enum batch_convert_format batch_convert_format_from_string(const char *format);
+
+// the .xlsx/.xlsm/.docx/.docm files of a path, directories are scanned recursively
+struct batch_file_list
+{
+	ssize_t count;
+	ssize_t max_size;
+	char **paths;
+	size_t *name_offsets;	// paths[i] + name_offsets[i]: the name of the file below its scanned root
+};
+void batch_file_list_collect(struct batch_file_list *list, const char *path);
+void batch_file_list_cleanup(struct batch_file_list *list);
+
+/*
+ * convert each .xlsx/.docx file (directories are scanned recursively) into options->output_dir:
+ *   xlsx: <name>.<sheet>.csv | <name>.<sheet>.txt (tab separated) | <name>.json
+ *   docx: <name>.txt | <name>.json
+ * <name> is the input path from the last component of its root without the extension
+ * ("in/2024/q1.xlsx" from root "in" => "in/2024/q1"), subdirectories are created as needed.
+ * an output path already written by this run gets a "~2", "~3", ... before the extension.
+ * <sheet> is the worksheet part name (xl/worksheets/sheet1.xml => "sheet1"),
+ * not the sheet name shown by Excel, the json output uses the same names.
+ * returns the number of files that failed, or -1 on error
+ */
+int batch_convert_run(int num_paths, char **paths, const struct batch_convert_options *options);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,44 @@
+#ifndef OOXML_ARROW_H_
+#define OOXML_ARROW_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <zip.h>
+
+struct ooxml_context;
+struct ooxml_shared_strings;
+struct ooxml_styles;
+
+/*
+ * export of a worksheet to an Arrow IPC file (the Feather v2 format), written without libarrow.
+ * the columns of ooxml_table_scan() become typed fields:
+ *   int64 => Int64, double => Float64, bool => Bool, date => Timestamp(ms) without timezone,
+ *   string => Dictionary<Int32, Utf8> (one dictionary: the shared strings followed by the sheet's inline strings),
+ *   mixed => Utf8, empty => Null.
+ * the rows are read in batches (ooxml_table_read_batches()), one record batch each,
+ * so memory is bounded by the batch size and the dictionary.
+ * buffers are 8-byte aligned, the file can be memory-mapped by arrow readers as is.
+ */
+struct ooxml_arrow_options
+{
+	int64_t batch_rows;	// rows per record batch, <= 0: OOXML_TABLE_DEFAULT_BATCH_ROWS
+	int64_t header_row;	// see struct ooxml_table_options
+};
+
+// returns the number of rows written, or -1 on error (the file is removed)
+int64_t ooxml_arrow_export_sheet(zip_t *zip, const char *sheet_name,
+	struct ooxml_shared_strings *sst, const struct ooxml_styles *styles,
+	const char *path, const struct ooxml_arrow_options *options);
+
+// the same with the shared strings and cell formats of an open spreadsheet
+int64_t ooxml_arrow_export(struct ooxml_context *ooxml, const char *sheet_name,
+	const char *path, const struct ooxml_arrow_options *options);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
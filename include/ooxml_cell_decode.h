@@ -0,0 +1,55 @@
+#ifndef OOXML_CELL_DECODE_H_
+#define OOXML_CELL_DECODE_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "ooxml_spreadsheet.h"
+
+/*
+ * batch decoding of cell values and references into typed arrays.
+ * the parsers are locale-independent and exact: doubles are correctly rounded
+ * (Clinger's fast path, strtod() for the rest), integers and references are checked for overflow.
+ * leading and trailing xml whitespace is ignored.
+ */
+enum ooxml_decode_error
+{
+	ooxml_decode_ok,
+	ooxml_decode_empty,		// no value / no reference
+	ooxml_decode_invalid,	// not a number / not an A1 reference
+	ooxml_decode_range,		// does not fit the result type
+};
+
+enum ooxml_decode_error ooxml_decode_double(const char *text, size_t length, double *p_value);
+enum ooxml_decode_error ooxml_decode_int64(const char *text, size_t length, int64_t *p_value);
+
+// "AB1234" => row 1234 (1-based), col 27 (0-based)
+enum ooxml_decode_error ooxml_decode_cell_ref(const char *ref, size_t length, int64_t *p_row, int64_t *p_col);
+
+/*
+ * decode all cells of a run (e.g. a row), errors (enum ooxml_decode_error) may be NULL.
+ * failed cells are set to NAN / 0 / (-1, -1). returns the number of failed cells.
+ */
+ssize_t ooxml_cells_decode_doubles(const struct ooxml_cell *cells, ssize_t num_cells, double *values, uint8_t *errors);
+ssize_t ooxml_cells_decode_int64s(const struct ooxml_cell *cells, ssize_t num_cells, int64_t *values, uint8_t *errors);
+
+// cells without r="..." are placed at (row_index, cell->col)
+ssize_t ooxml_cells_decode_refs(const struct ooxml_cell *cells, ssize_t num_cells, int64_t row_index,
+	int64_t *rows, int64_t *cols, uint8_t *errors);
+
+/*
+ * the reverse, locale-independent and nul-terminated, return the length. text: OOXML_ENCODE_BUFFER_SIZE bytes.
+ * doubles with %.15g, or %.17g if that does not convert back to the same value.
+ */
+#define OOXML_ENCODE_BUFFER_SIZE	(32)
+size_t ooxml_encode_double(double value, char *text);
+size_t ooxml_encode_int64(int64_t value, char *text);
+size_t ooxml_encode_cell_ref(int64_t row, int64_t col, char *text);	// (1234, 27) => "AB1234"
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -8,11 +8,63 @@ extern "C" {
 
 #include <libxml/parser.h>
 #include <zip.h>
+#include <json-c/json.h>
 
+struct ooxml_shared_strings;
+struct ooxml_styles;
 enum ooxml_file_type
 {
 	ooxml_file_document,
 	ooxml_file_spreadsheet,
+	ooxml_file_unknown,	// no wordprocessingml / spreadsheetml main part
+};
+
+/*
+ * parts are typed once by open() from [Content_Types].xml (an Override of the part name,
+ * or the Default of its extension), the kind decides how a part is handled.
+ */
+enum ooxml_part_kind
+{
+	ooxml_part_kind_unknown,	// directory entries
+	ooxml_part_kind_content_types,
+	ooxml_part_kind_relationships,
+	ooxml_part_kind_xml,		// any other xml part (properties, themes, drawings, charts ...)
+	ooxml_part_kind_workbook,
+	ooxml_part_kind_worksheet,
+	ooxml_part_kind_shared_strings,
+	ooxml_part_kind_styles,
+	ooxml_part_kind_document,
+	ooxml_part_kind_header,
+	ooxml_part_kind_footer,
+	ooxml_part_kind_footnotes,
+	ooxml_part_kind_endnotes,
+	ooxml_part_kind_comments,
+	ooxml_part_kind_media,		// image/*, audio/*, video/*
+	ooxml_part_kind_binary,		// vba projects, embedded ole objects, fonts ...
+};
+
+enum ooxml_part_handler
+{
+	ooxml_part_handler_dom,		// get_entry(..., fetch_data=1) inflates and parses it
+	ooxml_part_handler_stream,	// large xml parts, read by the streaming readers: fetch_data only inflates them
+	ooxml_part_handler_raw,		// never given to the xml parser
+};
+
+struct ooxml_part
+{
+	const char *name;			// as in the archive, no leading '/'
+	int64_t index;				// into the entry table
+	const char *content_type;	// NULL if [Content_Types].xml has none for it
+	enum ooxml_part_kind kind;
+	enum ooxml_part_handler handler;
+};
+
+struct ooxml_relationship
+{
+	const char *id;
+	const char *type;		// e.g. "http://schemas.openxmlformats.org/officeDocument/2006/relationships/worksheet"
+	const char *target;		// resolved part name (no leading '/'), the uri as is if is_external
+	int is_external;
 };
 
 
@@ -28,9 +80,34 @@ struct ooxml_zip_file
 	size_t cb_data;
 	
 	xmlDocPtr doc;
+	int is_loaded;	// 1: data and doc have been materialized
+	int is_mapped;	// 1: data points into the mmap-ed archive (stored entry), not nul-terminated
+	int in_arena;	// 1: filename, data and doc are owned by the archive's arena, released by close()
 };
 void ooxml_zip_file_clear(struct ooxml_zip_file *file);
 
+/*
+ * a directory of the archive, child arrays are in archive order.
+ * "xl/worksheets/sheet1.xml" is file 'sheet1.xml' of node { .name = "worksheets", .path = "xl/worksheets" }
+ */
+struct ooxml_dir_node
+{
+	const char *name;	// last path component, "" for the root
+	const char *path;	// full path without trailing '/', "" for the root
+	struct ooxml_dir_node *parent;
+	
+	ssize_t num_dirs;
+	struct ooxml_dir_node **dirs;
+	ssize_t num_files;
+	int64_t *files;		// indices into the entry table
+};
+
+
+// receives consecutive chunks of an entry's inflated data, returns non-zero to stop
+typedef int (*ooxml_data_callback)(void *user_data, const unsigned char *data, size_t length);
+
+// progress of load_entries(), called on the worker threads
+typedef void (*ooxml_progress_callback)(void *user_data, ssize_t num_done, ssize_t num_entries);
 
 struct ooxml_private;
 struct ooxml_context
@@ -39,18 +116,89 @@ struct ooxml_context
 	struct ooxml_private *priv;
 	enum ooxml_file_type type;
 	
+	/*
+	 * lazy_mode = 1 (default): open() only builds the entry table from the central directory,
+	 * the part data and xmlDocPtr are materialized by get_entry(..., fetch_data=1) on first access.
+	 * lazy_mode = 0: open() inflates every entry and parses the ones handled as DOM (see ooxml_part_handler).
+	 */
+	int lazy_mode;
+	int num_workers;	// size of the worker pool used by load_all(), <= 0: number of online cpus
+	int lazy_shared_strings;	// decode shared strings on first lookup
+	int use_mmap;	// readonly open maps the archive, stored entries are not copied
+	int use_arena;	// entries of the entry table (and their xml nodes) are allocated from a per-archive arena
+	int save_workers;	// save() deflates the changed parts on a worker pool, <= 0: number of online cpus, 1: serially by libzip
+	int deflate_level;	// -1 (default): zlib's default, 0: store, config "deflate_levels" sets it per content type
+	
 	int (* open)(struct ooxml_context *ooxml, const char *filename, int readonly);
 	void (*close)(struct ooxml_context *ooxml);
 	
 	ssize_t (*get_num_entries)(struct ooxml_context *ooxml);
 	int (*get_file)(struct ooxml_context *ooxml, int index, struct ooxml_zip_file *file, int fetch_data);
+	
+	// returns the entry owned by the context (valid until close()), or NULL
+	struct ooxml_zip_file *(*get_entry)(struct ooxml_context *ooxml, int index, int fetch_data);
+	
+	/*
+	 * stream the inflated data of an entry without loading it (no part buffer, no xmlDocPtr),
+	 * safe to call from any thread while the archive is open.
+	 * returns the number of bytes passed to on_data, or -1 on error.
+	 */
+	ssize_t (*read_entry)(struct ooxml_context *ooxml, int index, ooxml_data_callback on_data, void *user_data);
+	
+	// load all entries on a worker pool (see get_entry()), returns the number of loaded entries or -1 on error
+	ssize_t (*load_all)(struct ooxml_context *ooxml, int num_workers);
+	
+	/*
+	 * load_all() with progress and cancellation:
+	 * on_progress (optional) is called after each entry, 
+	 * the workers stop picking up entries once *cancel (optional) is non-zero.
+	 * the archive must stay open until it returns.
+	 */
+	ssize_t (*load_entries)(struct ooxml_context *ooxml, int num_workers, 
+		ooxml_progress_callback on_progress, void *user_data, volatile int *cancel);
+	
+	// shared strings table of a spreadsheet, loaded once per archive, NULL if there is none
+	struct ooxml_shared_strings *(*get_shared_strings)(struct ooxml_context *ooxml);
+	
+	// cell formats of a spreadsheet (xl/styles.xml), loaded once per archive, NULL if there are none
+	struct ooxml_styles *(*get_styles)(struct ooxml_context *ooxml);
+	
+	// directory tree of the entry table, built once per archive on first use (valid until close())
+	const struct ooxml_dir_node *(*get_dir_tree)(struct ooxml_context *ooxml);
+	const struct ooxml_dir_node *(*find_dir)(struct ooxml_context *ooxml, const char *path);
+	
+	/*
+	 * part registry, built by open() (valid until close()), all lookups are hashed:
+	 * get_part() returns NULL if there is no such part (part names are compared case-insensitively),
+	 * get_relationships() returns the relationships of a part in document order ("" for the package),
+	 * get_related_part() follows the first relationship of source whose type ends with "/type_suffix",
+	 * e.g. get_related_part(ooxml, "", "officeDocument") is the main part.
+	 */
+	const struct ooxml_part *(*get_part)(struct ooxml_context *ooxml, const char *name);
+	const struct ooxml_relationship *(*get_relationships)(struct ooxml_context *ooxml, const char *source, ssize_t *p_count);
+	const struct ooxml_relationship *(*find_relationship)(struct ooxml_context *ooxml, const char *source, const char *id);
+	const struct ooxml_part *(*get_related_part)(struct ooxml_context *ooxml, const char *source, const char *type_suffix);
+	
+	/*
+	 * update a writable archive (open(..., readonly=0)):
+	 * put_part() replaces or adds a part (the data is copied), remove_part() deletes one.
+	 * nothing is written before save(), reads see the archive as it was opened, close() discards the changes.
+	 * save() rewrites the archive (the compressed data of unchanged entries is copied verbatim) and reopens it,
+	 * the changed parts are compressed in parallel (see save_workers).
+	 * all return 0 or -1.
+	 */
+	int (*put_part)(struct ooxml_context *ooxml, const char *name, const void *data, size_t length);
+	int (*remove_part)(struct ooxml_context *ooxml, const char *name);
+	int (*save)(struct ooxml_context *ooxml);
 };
 
 struct ooxml_context *ooxml_context_init(struct ooxml_context *ooxml, void *user_data);
 void ooxml_context_cleanup(struct ooxml_context *ooxml);
+int ooxml_context_load_config(struct ooxml_context *ooxml, json_object *jconfig);
 
 
 int parse_zip_xml_file(zip_t *zip, const char *filename, xmlDocPtr *p_doc);
+int parse_zip_xml_stream(zip_t *zip, const char *filename, xmlSAXHandler *sax, void *user_data, xmlDocPtr *p_doc);
 #ifdef __cplusplus
 }
 #endif
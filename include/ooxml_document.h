@@ -0,0 +1,79 @@
+#ifndef OOXML_DOCUMENT_H_
+#define OOXML_DOCUMENT_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <zip.h>
+
+/*
+ * streaming text extraction of wordprocessingml parts (docx), without building a DOM.
+ * the parts are fed to a SAX parser chunk by chunk, memory is bounded by the longest paragraph
+ * (capped at max_paragraph_length).
+ */
+enum ooxml_document_story
+{
+	ooxml_document_story_body,		// the main document part
+	ooxml_document_story_header,
+	ooxml_document_story_footer,
+	ooxml_document_story_footnote,
+	ooxml_document_story_endnote,
+	ooxml_document_story_comment,
+	ooxml_document_stories_count
+};
+#define OOXML_DOCUMENT_STORY_FLAG(story)	(1u << (story))
+#define OOXML_DOCUMENT_ALL_STORIES			((1u << ooxml_document_stories_count) - 1)
+
+struct ooxml_paragraph
+{
+	enum ooxml_document_story story;
+	const char *part_name;	// e.g. "word/document.xml", "word/header1.xml"
+	int64_t index;			// 0-based, in the part
+	int64_t note_id;		// w:id of the footnote / endnote / comment, -1 otherwise
+	const char *style;		// w:pStyle, NULL if none
+	
+	int table_depth;		// 0: not in a table, 2: in a table nested in a table cell, ...
+	int64_t table_row;		// 0-based position in the innermost table
+	int64_t table_col;
+	
+	// the w:t of the runs, w:tab as '\t', w:br / w:cr as '\n'. utf-8, nul-terminated
+	const char *text;
+	size_t length;
+	int is_truncated;		// longer than max_paragraph_length, the rest has been dropped
+};
+
+/*
+ * the callbacks receive data that is only valid during the call, all but on_paragraph are optional.
+ * they return non-zero to stop the extraction.
+ * paragraphs of text boxes are reported before the paragraph that anchors them.
+ */
+struct ooxml_document_sink
+{
+	void *user_data;
+	size_t max_paragraph_length;	// 0: OOXML_DOCUMENT_MAX_PARAGRAPH_LENGTH
+	
+	int (*on_part)(void *user_data, const char *part_name, enum ooxml_document_story story, int is_end);
+	int (*on_paragraph)(void *user_data, const struct ooxml_paragraph *paragraph);
+	int (*on_table)(void *user_data, int depth, int is_end);
+	int (*on_table_row)(void *user_data, int depth, int64_t row, int is_end);
+};
+#define OOXML_DOCUMENT_MAX_PARAGRAPH_LENGTH	(1024 * 1024)
+
+// one part; returns 0, 1 if the sink stopped the extraction, or -1 on error
+int ooxml_document_stream_part(zip_t *zip, const char *part_name, enum ooxml_document_story story,
+	const struct ooxml_document_sink *sink);
+
+/*
+ * the main document part (officeDocument relationship of the package), then the parts of the requested
+ * stories (OOXML_DOCUMENT_STORY_FLAG() bits) in the order of its relationships.
+ * returns 0, 1 if the sink stopped the extraction, or -1 on error
+ */
+int ooxml_document_stream_text(zip_t *zip, unsigned int stories, const struct ooxml_document_sink *sink);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,68 @@
+#ifndef OOXML_INDEX_H_
+#define OOXML_INDEX_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <json-c/json.h>
+
+/*
+ * persistent inverted index of the text of a corpus of archives:
+ *   term => (archive, part, unit, sub) postings
+ *   docx: part = a document / header / footer / notes / comments part, unit = paragraph index, sub = 0
+ *   xlsx: part = a worksheet part, unit = row (1-based), sub = column (0-based)
+ *
+ * terms are the runs of letters and digits of the text (shared strings, cell values, paragraphs),
+ * with the '.' or ',' between two digits (3.14), ascii and latin-1 letters are lower-cased,
+ * terms longer than OOXML_INDEX_MAX_TERM_LENGTH bytes are truncated.
+ * kana and cjk ideographs are not separated by spaces: each one, and each pair of
+ * adjacent ones, is a term, so a query for a cjk word matches all of its bigrams.
+ *
+ * the index is one file: a sorted term table whose posting lists are delta + varint encoded,
+ * mapped read-only by queries.
+ */
+#define OOXML_INDEX_MAX_TERM_LENGTH	(64)
+
+struct ooxml_index_options
+{
+	int num_workers;		// <= 0: number of online cpus
+	json_object *jooxml;	// "ooxml" section of the app config, applied to every worker's context
+	volatile int *quit;		// set to non-zero to stop, the index file is left unchanged
+};
+
+/*
+ * create or update index_path with the .xlsx/.docx files of paths (directories are scanned recursively).
+ * the archives already in the index are kept: unchanged ones (same mtime and size, or same checksum of
+ * the central directory) keep their postings, changed ones are indexed again, deleted ones are dropped.
+ * returns the number of archives that failed, or -1 on error
+ */
+int ooxml_index_update(const char *index_path, int num_paths, char **paths, const struct ooxml_index_options *options);
+
+struct ooxml_index;
+struct ooxml_index *ooxml_index_open(const char *index_path);
+void ooxml_index_close(struct ooxml_index *index);
+
+struct ooxml_index_hit
+{
+	const char *archive;
+	const char *part;
+	int64_t unit;
+	int64_t sub;	// of the first term when several terms are in the unit
+};
+
+// return non-zero to stop the query
+typedef int (*ooxml_index_hit_callback)(void *user_data, const struct ooxml_index_hit *hit);
+
+/*
+ * the units (paragraphs, rows) that contain all the terms of query.
+ * returns the number of hits, or -1 on error
+ */
+ssize_t ooxml_index_query(struct ooxml_index *index, const char *query, ooxml_index_hit_callback on_hit, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
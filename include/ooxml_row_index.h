@@ -0,0 +1,55 @@
+#ifndef OOXML_ROW_INDEX_H_
+#define OOXML_ROW_INDEX_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "ooxml_spreadsheet.h"
+
+/*
+ * row-offset index of a worksheet part, for random access without inflating and parsing from the start:
+ * - one entry per row_interval rows: the row number and the offset of its <row> tag in the inflated part,
+ * - seek points of the deflate stream every ~span inflated bytes (block boundary + 32 KiB window),
+ * - the part's head up to <sheetData>, which is parsed before the rows of a seek point.
+ * built in one inflate pass over the part (the rows are located by a scan, not parsed).
+ */
+struct ooxml_row_index;
+
+#define OOXML_ROW_INDEX_DEFAULT_INTERVAL	(1024)
+#define OOXML_ROW_INDEX_DEFAULT_SPAN		(1024 * 1024)
+
+// row_interval, span: 0 for the defaults
+struct ooxml_row_index *ooxml_row_index_build(const char *archive_name, const char *sheet_name, int64_t row_interval, size_t span);
+void ooxml_row_index_free(struct ooxml_row_index *index);
+
+/*
+ * persisted next to the archive: "<archive_name>.<sheet_name with '/' as '_'>.rowidx".
+ * load() returns NULL if the file is missing or the part has changed since the index was saved.
+ */
+char *ooxml_row_index_get_path(const char *archive_name, const char *sheet_name);
+int ooxml_row_index_save(struct ooxml_row_index *index, const char *path);
+struct ooxml_row_index *ooxml_row_index_load(const char *path, const char *archive_name, const char *sheet_name);
+
+// load the saved index, or build and save it
+struct ooxml_row_index *ooxml_row_index_open(const char *archive_name, const char *sheet_name);
+
+int64_t ooxml_row_index_get_num_rows(const struct ooxml_row_index *index);
+
+/*
+ * stream rows [first_row, last_row] (1-based, inclusive, last_row < 0: to the end),
+ * only the part from the nearest seek point on is inflated and only rows from the nearest index entry are parsed.
+ */
+int ooxml_row_index_read_rows(struct ooxml_row_index *index, int64_t first_row, int64_t last_row,
+	ooxml_row_callback on_row, void *user_data);
+
+// rows and columns of an A1 range ("A900000:Z900100" or "B7"), cells outside the columns are left out
+int ooxml_row_index_read_range(struct ooxml_row_index *index, const char *range,
+	ooxml_row_callback on_row, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
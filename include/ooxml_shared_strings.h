@@ -0,0 +1,45 @@
+#ifndef OOXML_SHARED_STRINGS_H_
+#define OOXML_SHARED_STRINGS_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <zip.h>
+
+/*
+ * shared strings table (xl/sharedStrings.xml)
+ *
+ * eager mode: the <si> items are decoded once into a contiguous arena of UTF-8 strings,
+ *    string[i] = arena + offsets[i], length = offsets[i + 1] - offsets[i] - 1
+ * lazy mode: the inflated xml is kept, only the offset of every <si> is indexed,
+ *    an item is decoded on its first lookup.
+ *
+ * In both modes rich text runs (<r><t>) are concatenated and phonetic runs (<rPh>) are skipped.
+ * The returned strings are valid until the table is freed.
+ */
+struct ooxml_shared_strings_private;
+struct ooxml_shared_strings
+{
+	ssize_t count;
+	int lazy_mode;
+	
+	// eager mode
+	char *arena;
+	size_t cb_arena;
+	uint64_t *offsets;	// count + 1 items
+	
+	struct ooxml_shared_strings_private *priv;
+};
+
+struct ooxml_shared_strings *ooxml_shared_strings_load(zip_t *zip, const char *part_name, int lazy_mode);
+void ooxml_shared_strings_free(struct ooxml_shared_strings *sst);
+
+const char *ooxml_shared_strings_get(struct ooxml_shared_strings *sst, ssize_t index, size_t *p_length);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
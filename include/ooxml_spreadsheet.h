@@ -0,0 +1,103 @@
+#ifndef OOXML_SPREADSHEET_H_
+#define OOXML_SPREADSHEET_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <zip.h>
+
+enum ooxml_cell_type
+{
+	ooxml_cell_type_number,			// t="n" or no type
+	ooxml_cell_type_shared_string,	// t="s", value is the index into sharedStrings.xml
+	ooxml_cell_type_inline_string,	// t="inlineStr", value is the text of <is>
+	ooxml_cell_type_string,			// t="str", formula result
+	ooxml_cell_type_boolean,		// t="b"
+	ooxml_cell_type_error,			// t="e"
+	ooxml_cell_type_date,			// t="d", ISO 8601
+};
+
+struct ooxml_cell
+{
+	const char *ref;	// r="A1", NULL if not present
+	int64_t col;		// 0-based column index, from ref or the previous cell
+	enum ooxml_cell_type type;
+	int style;			// s="..."
+
+	const char *value;	// <v> or the text of <is>, NULL if empty
+	size_t cb_value;
+};
+
+struct ooxml_row
+{
+	int64_t row_index;	// 1-based, r="..." or the previous row + 1
+	ssize_t num_cells;
+	struct ooxml_cell *cells;
+};
+
+/*
+ * on_row is called once per <row>, the row and its strings are only valid during the call.
+ * return non-zero to stop the iteration.
+ */
+typedef int (*ooxml_row_callback)(void *user_data, const struct ooxml_row *row);
+
+/*
+ * stream the rows of a worksheet part (e.g. "xl/worksheets/sheet1.xml") without building a DOM,
+ * memory is bounded by the largest row.
+ */
+int ooxml_spreadsheet_stream_rows(zip_t *zip, const char *sheet_name, ooxml_row_callback on_row, void *user_data);
+
+/*
+ * push interface of the row reader, for worksheet data from other sources (e.g. a seek point of a row index).
+ * the data must start with the document (at least the start tags up to <sheetData>), 
+ * rows without r="..." are numbered from prev_row_index + 1.
+ */
+struct ooxml_row_stream;
+struct ooxml_row_stream *ooxml_row_stream_new(ooxml_row_callback on_row, void *user_data, int64_t prev_row_index, const char *name);
+void ooxml_row_stream_free(struct ooxml_row_stream *stream);
+
+// returns 0 to continue, 1 once on_row stopped the stream or </sheetData> was reached, -1 on a parse error
+int ooxml_row_stream_push(struct ooxml_row_stream *stream, const void *data, size_t length);
+
+int64_t ooxml_cell_ref_to_col(const char *ref, int64_t *p_row);
+
+// rows are 1-based, columns 0-based, both inclusive
+struct ooxml_cell_range
+{
+	int64_t first_row;
+	int64_t first_col;
+	int64_t last_row;
+	int64_t last_col;
+};
+
+// the used range of a worksheet from its <dimension ref="...">, -1 if the part has none (it is optional)
+int ooxml_spreadsheet_get_dimension(zip_t *zip, const char *sheet_name, struct ooxml_cell_range *range);
+
+/*
+ * 1 if the workbook uses the 1904 date system (<workbookPr date1904="1">): its date serials
+ * count days since 1904-01-01, 1462 days after the 1900 system. workbook_name NULL: "xl/workbook.xml"
+ */
+int ooxml_spreadsheet_is_date1904(zip_t *zip, const char *workbook_name);
+
+/*
+ * the row reader tokenizes worksheets itself (ooxml_sheet_scanner.c) and only hands a part over to libxml2
+ * when it contains something outside the usual shape. process-wide, set it before streaming any rows.
+ */
+enum ooxml_row_scanner
+{
+	ooxml_row_scanner_auto,		// the fastest one the cpu supports
+	ooxml_row_scanner_libxml2,	// always parse with libxml2
+	ooxml_row_scanner_scalar,
+	ooxml_row_scanner_sse42,
+	ooxml_row_scanner_avx2,
+};
+int ooxml_spreadsheet_set_row_scanner(enum ooxml_row_scanner scanner);	// -1 if not supported by the cpu
+const char *ooxml_spreadsheet_get_row_scanner_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,34 @@
+#ifndef OOXML_STYLES_H_
+#define OOXML_STYLES_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <zip.h>
+
+/*
+ * cell formats of a spreadsheet (xl/styles.xml), as far as needed to type cell values:
+ * the number format of each <xf> of <cellXfs> (the s="..." of a cell) and whether it shows a date or time.
+ */
+struct ooxml_styles
+{
+	ssize_t num_xfs;
+	int *num_fmt_ids;
+	uint8_t *is_date;
+};
+
+struct ooxml_styles *ooxml_styles_load(zip_t *zip, const char *part_name);
+void ooxml_styles_free(struct ooxml_styles *styles);
+
+int ooxml_styles_is_date(const struct ooxml_styles *styles, int style);
+
+// built-in date formats (14-22, 27-36, 45-47, 50-58), or a format code with date/time tokens outside of literals
+int ooxml_number_format_is_date(int num_fmt_id, const char *format_code);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
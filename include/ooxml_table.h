@@ -0,0 +1,138 @@
+#ifndef OOXML_TABLE_H_
+#define OOXML_TABLE_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <zip.h>
+
+struct ooxml_shared_strings;
+struct ooxml_styles;
+
+/*
+ * columnar in-memory table of a worksheet: one typed vector per column instead of a DOM.
+ * row i of the table is worksheet row (first_row + i), column j is worksheet column (first_col + j).
+ *
+ * a column takes the type of its values. numbers are int64 as long as every value is an integer,
+ * mixing integers, doubles and dates gives double, any other mix (e.g. numbers and strings) gives mixed:
+ * every value is stored as a string then (numbers with %.15g, or %.17g where needed to round-trip).
+ * empty and error cells are nulls.
+ */
+enum ooxml_column_type
+{
+	ooxml_column_type_empty,	// no values, no buffers
+	ooxml_column_type_double,	// f64
+	ooxml_column_type_int64,	// i64
+	ooxml_column_type_bool,		// bits, 1 bit per value (LSB first)
+	ooxml_column_type_date,		// f64, serial days since 1899-12-30 (the excel 1900 date system)
+	ooxml_column_type_string,	// ids, see ooxml_table_get_string()
+	ooxml_column_type_mixed,	// ids
+};
+
+/*
+ * dense columns (is_sparse = 0) have one slot per table row, validity is a bitmap (LSB first)
+ * of the slots with a value, or NULL if there are no nulls.
+ * sparse columns (few values compared to the number of rows) only store their values,
+ * rows[k] is the table row of value k, ascending.
+ */
+struct ooxml_column
+{
+	char *name;			// text of the header cell, or the column letters ("A", "B", ...)
+	int64_t col;		// 0-based worksheet column
+	enum ooxml_column_type type;
+	int is_sparse;
+	
+	int64_t length;		// number of slots: num_rows (dense) or number of values (sparse)
+	int64_t null_count;	// rows without a value, including errors
+	int64_t num_errors;	// t="e" cells and values that could not be decoded
+	
+	int64_t *rows;		// sparse
+	uint8_t *validity;	// dense
+	union
+	{
+		void *data;
+		double *f64;
+		int64_t *i64;
+		uint8_t *bits;
+		uint32_t *ids;
+	}values;
+};
+
+struct ooxml_table_private;
+struct ooxml_table
+{
+	char *sheet_name;
+	int64_t first_row;	// 1-based
+	int64_t num_rows;
+	int64_t first_col;	// 0-based
+	int64_t num_columns;
+	struct ooxml_column *columns;
+	
+	struct ooxml_shared_strings *sst;	// not owned, must outlive the table
+	struct ooxml_table_private *priv;
+};
+
+struct ooxml_table_options
+{
+	int64_t header_row;		// 1-based row with the column names, 0: none, data starts at the first row
+	double sparse_ratio;	// columns with fewer than num_rows * sparse_ratio values are sparse, <= 0: 0.25
+	int date1904;			// the workbook uses the 1904 date system (ooxml_spreadsheet_is_date1904()),
+							// its number dates are converted to 1900 serials
+};
+
+/*
+ * build the table from the rows of a worksheet part, the columns are presized from its <dimension ref="...">.
+ * sst and styles (dates are numbers with a date format) may be NULL, options may be NULL for the defaults.
+ */
+struct ooxml_table *ooxml_table_load(zip_t *zip, const char *sheet_name,
+	struct ooxml_shared_strings *sst, const struct ooxml_styles *styles,
+	const struct ooxml_table_options *options);
+void ooxml_table_free(struct ooxml_table *table);
+
+/*
+ * the same rows in batches with bounded memory, in two passes over the part:
+ * ooxml_table_scan() only determines the columns, their types and the table's strings (the columns have no values),
+ * ooxml_table_read_batches() then delivers the rows in dense tables of batch_rows rows (the last one may be shorter)
+ * which have exactly the columns and types of the scan. a batch and its columns are only valid during on_batch,
+ * its strings are looked up with ooxml_table_get_string() on the batch or the scanned table.
+ */
+#define OOXML_TABLE_DEFAULT_BATCH_ROWS	(65536)
+typedef int (*ooxml_table_batch_callback)(void *user_data, const struct ooxml_table *batch);	// non-zero to stop
+
+struct ooxml_table *ooxml_table_scan(zip_t *zip, const char *sheet_name,
+	struct ooxml_shared_strings *sst, const struct ooxml_styles *styles,
+	const struct ooxml_table_options *options);
+int ooxml_table_read_batches(struct ooxml_table *schema, zip_t *zip, int64_t batch_rows,
+	ooxml_table_batch_callback on_batch, void *user_data);
+
+// string and mixed columns: ids < sst->count are shared strings, the others are strings of the table
+const char *ooxml_table_get_string(const struct ooxml_table *table, uint32_t id, size_t *p_length);
+uint32_t ooxml_table_get_num_strings(const struct ooxml_table *table);	// ids are < this (it grows while mixed columns are read)
+
+// the slot of table row 'row' in the value arrays, returns 0 if the row has no value (null)
+int ooxml_column_find(const struct ooxml_column *column, int64_t row, int64_t *p_index);
+
+static inline int ooxml_column_is_valid(const struct ooxml_column *column, int64_t index)
+{
+	return (NULL == column->validity) || ((column->validity[index >> 3] >> (index & 7)) & 1);
+}
+
+struct ooxml_column_stats
+{
+	int64_t count;		// non-null values
+	int64_t null_count;
+	double sum;			// bool: number of true values
+	double min;
+	double max;
+};
+
+// numeric, date and bool columns, returns -1 for strings
+int ooxml_column_get_stats(const struct ooxml_column *column, struct ooxml_column_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
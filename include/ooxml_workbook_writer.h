@@ -0,0 +1,62 @@
+#ifndef OOXML_WORKBOOK_WRITER_H_
+#define OOXML_WORKBOOK_WRITER_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+struct ooxml_context;
+
+/*
+ * streaming xlsx writer: rows are appended to the sheets one by one and spooled to a temporary file per sheet
+ * (the xml of the row, nothing is kept in memory), strings go to the shared strings table once.
+ * finish() adds the parts to the archive and lets libzip pull the sheets from the spools while it deflates them,
+ * so memory depends on the number of distinct strings, not on the number of rows.
+ */
+struct ooxml_workbook_writer;
+
+enum ooxml_value_type
+{
+	ooxml_value_empty,		// no cell
+	ooxml_value_number,		// number
+	ooxml_value_int64,		// i64
+	ooxml_value_bool,		// i64 != 0
+	ooxml_value_date,		// number: serial days since 1899-12-30, written with a date format
+	ooxml_value_string,		// text, cb_text (0: nul-terminated), utf-8
+};
+
+struct ooxml_cell_value
+{
+	enum ooxml_value_type type;
+	double number;
+	int64_t i64;
+	const char *text;
+	size_t cb_text;
+};
+
+// creates (or truncates) the archive and attaches it to the context, like a writable open()
+struct ooxml_workbook_writer *ooxml_workbook_writer_new(struct ooxml_context *ooxml, const char *filename);
+
+// discards the archive if finish() has not been called, closes the context
+void ooxml_workbook_writer_free(struct ooxml_workbook_writer *writer);
+
+// sheet names are unique, 1 to 31 characters, without []:*?/\ ; returns the index of the sheet or -1
+int ooxml_workbook_writer_add_sheet(struct ooxml_workbook_writer *writer, const char *name);
+
+// the next row of the sheet, values[i] goes to column i
+int ooxml_workbook_writer_append_row(struct ooxml_workbook_writer *writer, int sheet,
+	const struct ooxml_cell_value *values, ssize_t num_values);
+
+/*
+ * write the archive (content types, rels, workbook, styles, sheets, shared strings), -1 on error.
+ * the parts are deflated on ooxml->save_workers threads (1: serially by libzip)
+ */
+int ooxml_workbook_writer_finish(struct ooxml_workbook_writer *writer);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,58 @@
+#ifndef OOXML_PERF_TRACE_H_
+#define OOXML_PERF_TRACE_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <json-c/json.h>
+
+enum perf_trace_counter
+{
+	perf_trace_counter_parts_loaded,
+	perf_trace_counter_parts_cached,	// parts loaded from the persistent part cache
+	perf_trace_counter_bytes_inflated,	// uncompressed bytes read from the archive
+	perf_trace_counter_nodes_parsed,	// DOM nodes built by xmlReadMemory
+	perf_trace_counter_parts_unparsed,	// parts loaded without a DOM (streamed xml, media, binaries)
+	perf_trace_counter_rows_streamed,
+	perf_trace_counter_scanner_fallbacks,	// worksheets handed over from the row scanner to libxml2
+	perf_trace_counters_count
+};
+
+extern volatile int g_perf_trace_enabled;
+
+/*
+ * config ("trace" section of the app config):
+ * {
+ *   "enabled": true,
+ *   "summary": true,                          // print the per-stage summary to stderr on cleanup
+ *   "chrome_trace_file": "tmp/trace.json",    // trace-event json (chrome://tracing, perfetto)
+ *   "max_events": 1000000                     // spans beyond this are only aggregated
+ * }
+ */
+int perf_trace_init(json_object *jconfig);
+void perf_trace_cleanup(void);	// writes the configured outputs
+
+uint64_t perf_trace_now(void);	// CLOCK_MONOTONIC, ns
+
+// stage must be a string with static storage, detail (e.g. the part name) is copied
+void perf_trace_add_span(const char *stage, const char *detail, uint64_t start_ns, uint64_t end_ns);
+void perf_trace_count(enum perf_trace_counter counter, int64_t value);
+
+void perf_trace_print_summary(FILE *fp);
+int perf_trace_write_chrome_trace(const char *filename);
+
+#define PERF_TRACE_BEGIN(span) uint64_t span = g_perf_trace_enabled?perf_trace_now():0
+#define PERF_TRACE_END(span, stage, detail) do { \
+			if(span) perf_trace_add_span(stage, detail, span, perf_trace_now()); \
+		} while(0)
+#define PERF_TRACE_COUNT(counter, value) do { \
+			if(g_perf_trace_enabled) perf_trace_count(perf_trace_counter_##counter, value); \
+		} while(0)
+
+#ifdef __cplusplus
+}
+#endif
+#endif
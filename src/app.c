@@ -32,6 +32,7 @@
 #include <unistd.h>
 #include <limits.h>
 #include <getopt.h>
+#include <time.h>
 #include <libgen.h>
 #include <json-c/json.h>
 
@@ -41,6 +42,9 @@
 #include "app.h"
 #include "shell.h"
 #include "ooxml_context.h"
+#include "batch_convert.h"
+#include "ooxml_index.h"
+#include "perf_trace.h"
 
 static int app_init(struct app_context *app, const char *conf_file);
 static int app_run(struct app_context *app);
@@ -61,6 +65,17 @@ struct app_private
 	char work_dir[PATH_MAX];
 	
 	struct ooxml_context *ooxml;
+	
+	// headless mode: convert the files / directories in argv, GTK is never initialized
+	int batch_mode;
+	const char *batch_format;		// csv | json | text
+	const char *batch_output_dir;
+	int batch_num_workers;
+	volatile int batch_quit;
+	
+	// headless mode too: update the index with the files / directories in argv, or query it
+	const char *index_path;
+	const char *index_query;
 };
 struct ooxml_context *app_get_ooxml_context(struct app_context *app)
 {
@@ -70,26 +85,55 @@ struct ooxml_context *app_get_ooxml_context(struct app_context *app)
 }
 static void print_usuages(struct app_context *app)
 {
-	fprintf(stderr, "Usuage: %s [--conf=<conf/app.json>]\n", app->app_name);
+	fprintf(stderr, "Usuage: %s [--conf=<conf/app.json>]\n"
+		"       %s --batch [--format=csv|json|text] [--jobs=<num_workers>] [--output-dir=<dir>] <file.xlsx|file.docx|dir> ...\n"
+		"       %s --index=<index file> [--jobs=<num_workers>] <file.xlsx|file.docx|dir> ...\n"
+		"       %s --index=<index file> --query=<terms>\n",
+		app->app_name, app->app_name, app->app_name, app->app_name);
 }
 static int app_private_parse_args(struct app_private *priv, int argc, char **argv)
 {
 	static struct option options[] = {
 		{"conf", required_argument, 0, 'c'},
 		{"help", no_argument, 0, 'h'},
+		{"batch", no_argument, 0, 'b'},
+		{"format", required_argument, 0, 'f'},
+		{"jobs", required_argument, 0, 'j'},
+		{"output-dir", required_argument, 0, 'o'},
+		{"index", required_argument, 0, 'i'},
+		{"query", required_argument, 0, 'q'},
 		{NULL},
 	};
 	
 	const char *conf_file = NULL;
 	while(1) {
 		int option_index = 0;
-		int c = getopt_long(argc, argv, "c:h", options, &option_index);
+		int c = getopt_long(argc, argv, "c:hbf:j:o:i:q:", options, &option_index);
 		if(c == -1) break;
 		
 		switch(c) {
 		case 'c': 
 			conf_file = optarg; 
 			break;
+		case 'b':
+			priv->batch_mode = 1;
+			break;
+		case 'f':
+			priv->batch_format = optarg;
+			break;
+		case 'j':
+			priv->batch_num_workers = atoi(optarg);
+			break;
+		case 'o':
+			priv->batch_output_dir = optarg;
+			break;
+		case 'i':
+			priv->batch_mode = 1;
+			priv->index_path = optarg;
+			break;
+		case 'q':
+			priv->index_query = optarg;
+			break;
 		
 		case 'h':
 		default:
@@ -110,10 +154,13 @@ static int app_private_parse_args(struct app_private *priv, int argc, char **arg
 		priv->argv = &argv[optind];
 	}
 	
-	// debug print
-	for(int i = 0; i < priv->argc; ++i)
-	{
-		fprintf(stderr, "argv[%d]: %s\n", i, priv->argv[i]);
+	// debug print, headless runs keep stdout / stderr for their own output
+	if(!priv->batch_mode) {
+		debug_printf("real path: %s", priv->app->app_path);
+		for(int i = 0; i < priv->argc; ++i)
+		{
+			debug_printf("argv[%d]: %s", i, priv->argv[i]);
+		}
 	}
 	return 0;
 }
@@ -128,8 +175,6 @@ static struct app_private *app_private_new(struct app_context *app, int argc, ch
 	if(NULL == app_path) {
 		perror("realpath()");
 		exit(1);
-	}else {
-		printf("real path: %s\n", app_path);
 	}
 	
 	app->app_path = app_path;
@@ -166,12 +211,12 @@ struct app_context *app_context_init(struct app_context *app, int argc, char **a
 	assert(priv);
 	app->priv = priv;
 	
-	gtk_init(&priv->argc, &priv->argv);
+	if(!priv->batch_mode) gtk_init(&priv->argc, &priv->argv);
 	
 	priv->ooxml = ooxml_context_init(NULL, app);
 	assert(priv->ooxml);
 	
-	
+	if(priv->batch_mode) return app;	// headless
 	
 	struct shell_context *shell = shell_context_init(NULL, app);
 	assert(shell);
@@ -183,6 +228,7 @@ struct app_context *app_context_init(struct app_context *app, int argc, char **a
 void app_context_cleanup(struct app_context *app)
 {
 	if(NULL == app) return;
+	perf_trace_cleanup();
 	app_private_free(app->priv);
 	///< @todo
 }
@@ -199,6 +245,38 @@ static int app_init(struct app_context *app, const char *conf_file)
 	json_object *jconfig = json_object_from_file(conf_file);
 	if(jconfig) {
 		app->jconfig = jconfig;
+		
+		json_object *jtrace = NULL;
+		if(json_object_object_get_ex(jconfig, "trace", &jtrace)) {
+			perf_trace_init(jtrace);
+		}
+		
+		json_object *jooxml = NULL;
+		if(json_object_object_get_ex(jconfig, "ooxml", &jooxml)) {
+			ooxml_context_load_config(priv->ooxml, jooxml);
+		}
+	}
+	
+	if(priv->batch_mode) {
+		// the command line overrides the "batch" section of the config
+		json_object *jbatch = NULL;
+		if(jconfig && json_object_object_get_ex(jconfig, "batch", &jbatch)) {
+			json_object *jvalue = NULL;
+			if(NULL == priv->batch_format && json_object_object_get_ex(jbatch, "format", &jvalue)) {
+				priv->batch_format = json_object_get_string(jvalue);
+			}
+			if(NULL == priv->batch_output_dir && json_object_object_get_ex(jbatch, "output_dir", &jvalue)) {
+				priv->batch_output_dir = json_object_get_string(jvalue);
+			}
+			if(0 == priv->batch_num_workers && json_object_object_get_ex(jbatch, "num_workers", &jvalue)) {
+				priv->batch_num_workers = json_object_get_int(jvalue);
+			}
+		}
+		if(priv->argc <= 0 && !(priv->index_path && priv->index_query)) {
+			print_usuages(app);
+			return -1;
+		}
+		return 0;
 	}
 	
 	struct shell_context *shell = app->shell;
@@ -210,9 +288,58 @@ static int app_init(struct app_context *app, const char *conf_file)
 	fprintf(stderr, "no shell\n");
 	return 0;
 }
+static int on_index_hit(void *user_data, const struct ooxml_index_hit *hit)
+{
+	printf("%s\t%s\t%ld\t%ld\n", hit->archive, hit->part, (long)hit->unit, (long)hit->sub);
+	return 0;
+}
+static int app_run_index(struct app_context *app)
+{
+	struct app_private *priv = app->priv;
+	if(priv->index_query) {
+		struct ooxml_index *index = ooxml_index_open(priv->index_path);
+		if(NULL == index) return 1;
+		
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ssize_t num_hits = ooxml_index_query(index, priv->index_query, on_index_hit, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ooxml_index_close(index);
+		
+		double elapsed = (double)(end.tv_sec - start.tv_sec) * 1000.0 + (double)(end.tv_nsec - start.tv_nsec) / 1000000.0;
+		fprintf(stderr, "[index] %ld hits, %.3f ms\n", (long)num_hits, elapsed);
+		return (num_hits >= 0)?0:1;
+	}
+	
+	struct ooxml_index_options options = {
+		.num_workers = priv->batch_num_workers,
+		.quit = &priv->batch_quit,
+	};
+	json_object *jconfig = app->jconfig;
+	if(jconfig) json_object_object_get_ex(jconfig, "ooxml", &options.jooxml);
+	
+	int rc = ooxml_index_update(priv->index_path, priv->argc, priv->argv, &options);
+	return (rc == 0)?0:1;
+}
 static int app_run(struct app_context *app)
 {
 	int rc = -1;
+	struct app_private *priv = app->priv;
+	if(priv->index_path) return app_run_index(app);
+	if(priv->batch_mode) {
+		struct batch_convert_options options = {
+			.format = batch_convert_format_from_string(priv->batch_format),
+			.output_dir = priv->batch_output_dir?priv->batch_output_dir:".",
+			.num_workers = priv->batch_num_workers,
+			.quit = &priv->batch_quit,
+		};
+		json_object *jconfig = app->jconfig;
+		if(jconfig) json_object_object_get_ex(jconfig, "ooxml", &options.jooxml);
+		
+		rc = batch_convert_run(priv->argc, priv->argv, &options);
+		return (rc == 0)?0:1;
+	}
+	
 	struct shell_context *shell = app->shell;
 	if(shell) rc = shell->run(shell);
 	return rc;
@@ -221,6 +348,12 @@ static int app_run(struct app_context *app)
 static int app_stop(struct app_context *app)
 {
 	int rc = -1;
+	struct app_private *priv = app->priv;
+	if(priv->batch_mode) {
+		priv->batch_quit = 1;
+		return 0;
+	}
+	
 	struct shell_context *shell = app->shell;
 	if(shell) {
 		rc = shell->stop(shell);
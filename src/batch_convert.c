@@ -0,0 +1,637 @@
+/*
+ * batch_convert.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <libxml/parser.h>
+#include <glib.h>
+
+#include "app.h"
+#include "ooxml_context.h"
+#include "ooxml_private.h"
+#include "ooxml_spreadsheet.h"
+#include "ooxml_shared_strings.h"
+#include "ooxml_cell_decode.h"
+#include "ooxml_document.h"
+#include "batch_convert.h"
+#include "perf_trace.h"
+
+enum batch_convert_format batch_convert_format_from_string(const char *format)
+{
+	if(NULL == format) return batch_convert_format_csv;
+	if(strcasecmp(format, "json") == 0) return batch_convert_format_json;
+	if(strcasecmp(format, "text") == 0 || strcasecmp(format, "txt") == 0) return batch_convert_format_text;
+	return batch_convert_format_csv;
+}
+
+/******************************************************************************
+ * file list
+******************************************************************************/
+static void batch_file_list_add(struct batch_file_list *list, const char *path, size_t name_offset)
+{
+	if(list->count >= list->max_size) {
+		ssize_t new_size = list->max_size * 2;
+		if(new_size < 1024) new_size = 1024;
+		char **paths = realloc(list->paths, new_size * sizeof(*paths));
+		assert(paths);
+		list->paths = paths;
+		size_t *name_offsets = realloc(list->name_offsets, new_size * sizeof(*name_offsets));
+		assert(name_offsets);
+		list->name_offsets = name_offsets;
+		list->max_size = new_size;
+	}
+	list->name_offsets[list->count] = name_offset;
+	list->paths[list->count++] = strdup(path);
+}
+
+void batch_file_list_cleanup(struct batch_file_list *list)
+{
+	for(ssize_t i = 0; i < list->count; ++i) free(list->paths[i]);
+	free(list->paths);
+	free(list->name_offsets);
+	memset(list, 0, sizeof(*list));
+}
+
+static int is_ooxml_filename(const char *name)
+{
+	if(name[0] == '~' && name[1] == '$') return 0;	// office lock files
+	const char *ext = strrchr(name, '.');
+	if(NULL == ext) return 0;
+	return (strcasecmp(ext, ".xlsx") == 0 || strcasecmp(ext, ".xlsm") == 0
+		|| strcasecmp(ext, ".docx") == 0 || strcasecmp(ext, ".docm") == 0);
+}
+
+static void collect_files(struct batch_file_list *list, const char *path, size_t name_offset)
+{
+	struct stat st[1];
+	if(stat(path, st) != 0) {
+		perror(path);
+		return;
+	}
+	if(!S_ISDIR(st->st_mode)) {
+		batch_file_list_add(list, path, name_offset);
+		return;
+	}
+	
+	DIR *dir = opendir(path);
+	if(NULL == dir) {
+		perror(path);
+		return;
+	}
+	struct dirent *entry = NULL;
+	while((entry = readdir(dir))) {
+		if(entry->d_name[0] == '.') continue;
+		
+		char child[PATH_MAX] = "";
+		snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+		if(entry->d_type == DT_DIR || entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+			if(stat(child, st) == 0 && S_ISDIR(st->st_mode)) {
+				collect_files(list, child, name_offset);
+				continue;
+			}
+		}
+		if(is_ooxml_filename(entry->d_name)) batch_file_list_add(list, child, name_offset);
+	}
+	closedir(dir);
+}
+
+void batch_file_list_collect(struct batch_file_list *list, const char *path)
+{
+	// the output name starts at the last component of path ("dir/a/b.xlsx" => "a/b"),
+	// or below path itself when it has no usable name (".", "..", "/")
+	char root[PATH_MAX] = "";
+	strncpy(root, path, sizeof(root) - 1);
+	size_t length = strlen(root);
+	while(length > 1 && root[length - 1] == '/') root[--length] = '\0';
+	
+	size_t name_offset = length;
+	while(name_offset > 0 && root[name_offset - 1] != '/') --name_offset;
+	const char *name = root + name_offset;
+	if(name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) name_offset = length + 1;
+	collect_files(list, root, name_offset);
+}
+
+/******************************************************************************
+ * output helpers
+******************************************************************************/
+struct batch_outputs
+{
+	pthread_mutex_t mutex;
+	GHashTable *paths;	// output paths claimed by this run
+};
+
+struct batch_job
+{
+	const struct batch_convert_options *options;
+	struct batch_outputs *outputs;
+	const char *path;
+	const char *name;	// path relative to the scanned root, mirrored under output_dir
+};
+
+static int make_parent_dirs(char *output_path, size_t cb_root)
+{
+	for(char *p = strchr(output_path + cb_root + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		int rc = mkdir(output_path, 0777);
+		if(rc && errno != EEXIST) {
+			perror(output_path);
+			*p = '/';
+			return -1;
+		}
+		*p = '/';
+	}
+	return 0;
+}
+
+/*
+ * <output_dir>/<name without extension>[.<suffix>].<ext>
+ * a path already claimed by another input of the run (same name under two roots,
+ * a.xlsx next to a.docx, ...) gets a "~<n>" before the extension.
+ */
+static FILE *open_output_file(const struct batch_job *job, const char *suffix, const char *ext)
+{
+	char name[PATH_MAX] = "";
+	strncpy(name, job->name, sizeof(name) - 1);
+	
+	char *dot = strrchr(name, '.');
+	if(dot && NULL == strchr(dot, '/')) *dot = '\0';
+	
+	char stem[PATH_MAX] = "";
+	if(suffix) snprintf(stem, sizeof(stem), "%s/%s.%s", job->options->output_dir, name, suffix);
+	else snprintf(stem, sizeof(stem), "%s/%s", job->options->output_dir, name);
+	
+	char output_path[PATH_MAX] = "";
+	struct batch_outputs *outputs = job->outputs;
+	pthread_mutex_lock(&outputs->mutex);
+	snprintf(output_path, sizeof(output_path), "%s.%s", stem, ext);
+	for(int n = 2; g_hash_table_lookup(outputs->paths, output_path); ++n) {
+		snprintf(output_path, sizeof(output_path), "%s~%d.%s", stem, n, ext);
+	}
+	g_hash_table_insert(outputs->paths, strdup(output_path), (gpointer)1);
+	pthread_mutex_unlock(&outputs->mutex);
+	
+	if(make_parent_dirs(output_path, strlen(job->options->output_dir))) return NULL;
+	FILE *fp = fopen(output_path, "w");
+	if(NULL == fp) {
+		perror(output_path);
+		return NULL;
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+	return fp;
+}
+
+static void write_json_string(FILE *fp, const char *text, size_t length)
+{
+	static const char hex[] = "0123456789abcdef";
+	fputc('"', fp);
+	const char *p = text;
+	const char *p_end = text + length;
+	const char *run = p;
+	for(; p < p_end; ++p) {
+		unsigned char c = *p;
+		if(c >= 0x20 && c != '"' && c != '\\') continue;
+		
+		if(p > run) fwrite(run, 1, p - run, fp);
+		run = p + 1;
+		switch(c) {
+		case '"': fputs("\\\"", fp); break;
+		case '\\': fputs("\\\\", fp); break;
+		case '\n': fputs("\\n", fp); break;
+		case '\r': fputs("\\r", fp); break;
+		case '\t': fputs("\\t", fp); break;
+		default:
+			fprintf(fp, "\\u00%c%c", hex[c >> 4], hex[c & 0x0F]);
+			break;
+		}
+	}
+	if(p > run) fwrite(run, 1, p - run, fp);
+	fputc('"', fp);
+}
+
+static int is_json_number(const char *text, size_t length)
+{
+	const char *p = text;
+	const char *p_end = text + length;
+	if(p < p_end && *p == '-') ++p;
+	if(p >= p_end || *p < '0' || *p > '9') return 0;
+	if(*p == '0') ++p;
+	else while(p < p_end && *p >= '0' && *p <= '9') ++p;
+	
+	if(p < p_end && *p == '.') {
+		++p;
+		if(p >= p_end || *p < '0' || *p > '9') return 0;
+		while(p < p_end && *p >= '0' && *p <= '9') ++p;
+	}
+	if(p < p_end && (*p == 'e' || *p == 'E')) {
+		++p;
+		if(p < p_end && (*p == '+' || *p == '-')) ++p;
+		if(p >= p_end || *p < '0' || *p > '9') return 0;
+		while(p < p_end && *p >= '0' && *p <= '9') ++p;
+	}
+	return p == p_end;
+}
+
+static void write_csv_field(FILE *fp, const char *text, size_t length)
+{
+	if(NULL == memchr(text, '"', length) && NULL == memchr(text, ',', length)
+		&& NULL == memchr(text, '\n', length) && NULL == memchr(text, '\r', length)) {
+		fwrite(text, 1, length, fp);
+		return;
+	}
+	
+	fputc('"', fp);
+	const char *p = text;
+	const char *p_end = text + length;
+	const char *quote = NULL;
+	while(p < p_end && (quote = memchr(p, '"', p_end - p))) {
+		fwrite(p, 1, quote - p + 1, fp);
+		fputc('"', fp);
+		p = quote + 1;
+	}
+	if(p < p_end) fwrite(p, 1, p_end - p, fp);
+	fputc('"', fp);
+}
+
+static void write_text_field(FILE *fp, const char *text, size_t length)
+{
+	for(size_t i = 0; i < length; ++i) {
+		char c = text[i];
+		if(c == '\t' || c == '\n' || c == '\r') c = ' ';
+		fputc(c, fp);
+	}
+}
+
+/******************************************************************************
+ * xlsx
+******************************************************************************/
+struct sheet_writer
+{
+	const struct batch_convert_options *options;
+	struct ooxml_shared_strings *sst;
+	FILE *fp;
+	int64_t last_row;
+};
+
+static const char *resolve_cell_value(struct ooxml_shared_strings *sst, const struct ooxml_cell *cell, size_t *p_length)
+{
+	*p_length = 0;
+	if(NULL == cell->value) return NULL;
+	
+	int64_t index = 0;
+	switch(cell->type) {
+	case ooxml_cell_type_shared_string:
+		if(ooxml_decode_int64(cell->value, cell->cb_value, &index) != ooxml_decode_ok) return NULL;
+		return ooxml_shared_strings_get(sst, index, p_length);
+	case ooxml_cell_type_boolean:
+		*p_length = (cell->value[0] == '1')?4:5;
+		return (cell->value[0] == '1')?"TRUE":"FALSE";
+	default:
+		break;
+	}
+	*p_length = cell->cb_value;
+	return cell->value;
+}
+
+static int on_sheet_row(void *user_data, const struct ooxml_row *row)
+{
+	struct sheet_writer *writer = user_data;
+	const struct batch_convert_options *options = writer->options;
+	FILE *fp = writer->fp;
+	int is_json = (options->format == batch_convert_format_json);
+	char separator = (options->format == batch_convert_format_csv)?',':'\t';
+	
+	// keep the row positions of the sheet
+	for(int64_t r = writer->last_row + 1; r < row->row_index; ++r) {
+		if(is_json) fputs((r > 1)?",\n[]":"\n[]", fp);
+		else fputc('\n', fp);
+	}
+	if(is_json) fputs((row->row_index > 1)?",\n[":"\n[", fp);
+	
+	int64_t col = 0;
+	for(ssize_t i = 0; i < row->num_cells; ++i) {
+		const struct ooxml_cell *cell = &row->cells[i];
+		if(cell->col < col) continue;
+		// the separator goes before each field: skipped cells leave no trailing one
+		for(; col < cell->col; ++col) {
+			if(is_json) fputs((col > 0)?",null":"null", fp);
+			else if(col > 0) fputc(separator, fp);
+		}
+		if(col > 0) fputc(is_json?',':separator, fp);
+		
+		size_t length = 0;
+		const char *value = resolve_cell_value(writer->sst, cell, &length);
+		if(is_json) {
+			if(NULL == value) fputs("null", fp);
+			else if(cell->type == ooxml_cell_type_boolean) fputs((value[0] == 'T')?"true":"false", fp);
+			else if(cell->type == ooxml_cell_type_number && is_json_number(value, length)) fwrite(value, 1, length, fp);
+			else write_json_string(fp, value, length);
+		}else if(value) {
+			if(options->format == batch_convert_format_csv) write_csv_field(fp, value, length);
+			else write_text_field(fp, value, length);
+		}
+		++col;
+	}
+	if(is_json) fputc(']', fp);
+	else fputc('\n', fp);
+	
+	writer->last_row = row->row_index;
+	return 0;
+}
+
+static int is_xml_part(const char *name)
+{
+	size_t cb_name = strlen(name);
+	return (cb_name > 4 && strcmp(name + cb_name - 4, ".xml") == 0);
+}
+
+static int convert_spreadsheet(struct ooxml_context *ooxml, const struct batch_job *job)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	const struct batch_convert_options *options = job->options;
+	const char *path = job->path;
+	struct sheet_writer writer[1];
+	memset(writer, 0, sizeof(writer));
+	writer->options = options;
+	writer->sst = ooxml->get_shared_strings(ooxml);
+	
+	int is_json = (options->format == batch_convert_format_json);
+	if(is_json) {
+		writer->fp = open_output_file(job, NULL, "json");
+		if(NULL == writer->fp) return -1;
+		fputs("{\"file\":", writer->fp);
+		write_json_string(writer->fp, path, strlen(path));
+		fputs(",\"sheets\":[", writer->fp);
+	}
+	
+	int rc = 0;
+	ssize_t num_sheets = 0;
+	const struct ooxml_dir_node *worksheets = ooxml->find_dir(ooxml, "xl/worksheets");
+	ssize_t num_files = worksheets?worksheets->num_files:0;
+	for(ssize_t i = 0; i < num_files; ++i) {
+		const char *part_name = priv->entries[worksheets->files[i]].filename;
+		if(!is_xml_part(part_name)) continue;
+		
+		char sheet_name[PATH_MAX] = "";
+		strncpy(sheet_name, strrchr(part_name, '/') + 1, sizeof(sheet_name) - 1);
+		sheet_name[strlen(sheet_name) - 4] = '\0';	// ".xml"
+		
+		if(is_json) {
+			fputs((num_sheets > 0)?",\n{\"name\":":"\n{\"name\":", writer->fp);
+			write_json_string(writer->fp, sheet_name, strlen(sheet_name));
+			fputs(",\"rows\":[", writer->fp);
+		}else {
+			writer->fp = open_output_file(job, sheet_name, 
+				(options->format == batch_convert_format_csv)?"csv":"txt");
+			if(NULL == writer->fp) {
+				rc = -1;
+				break;
+			}
+		}
+		
+		writer->last_row = 0;
+		rc = ooxml_spreadsheet_stream_rows(priv->archive, part_name, on_sheet_row, writer);
+		++num_sheets;
+		
+		if(is_json) {
+			fputs("]}", writer->fp);
+		}else {
+			fclose(writer->fp);
+			writer->fp = NULL;
+		}
+		if(rc) break;
+	}
+	
+	if(is_json) {
+		fputs("]}\n", writer->fp);
+		fclose(writer->fp);
+	}
+	return rc;
+}
+
+/******************************************************************************
+ * docx
+******************************************************************************/
+struct document_writer
+{
+	const struct batch_convert_options *options;
+	FILE *fp;
+	ssize_t num_paragraphs;
+};
+
+static int on_document_paragraph(void *user_data, const struct ooxml_paragraph *paragraph)
+{
+	struct document_writer *writer = user_data;
+	FILE *fp = writer->fp;
+	if(writer->options->format == batch_convert_format_json) {
+		if(writer->num_paragraphs > 0) fputc(',', fp);
+		fputc('\n', fp);
+		write_json_string(fp, paragraph->text, paragraph->length);
+	}else {
+		if(paragraph->length > 0) fwrite(paragraph->text, 1, paragraph->length, fp);
+		fputc('\n', fp);
+	}
+	++writer->num_paragraphs;
+	return 0;
+}
+
+static int convert_document(struct ooxml_context *ooxml, const struct batch_job *job)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	const struct batch_convert_options *options = job->options;
+	const char *path = job->path;
+	struct document_writer writer[1];
+	memset(writer, 0, sizeof(writer));
+	writer->options = options;
+	
+	int is_json = (options->format == batch_convert_format_json);
+	writer->fp = open_output_file(job, NULL, is_json?"json":"txt");
+	if(NULL == writer->fp) return -1;
+	if(is_json) {
+		fputs("{\"file\":", writer->fp);
+		write_json_string(writer->fp, path, strlen(path));
+		fputs(",\"paragraphs\":[", writer->fp);
+	}
+	
+	struct ooxml_document_sink sink;
+	memset(&sink, 0, sizeof(sink));
+	sink.user_data = writer;
+	sink.on_paragraph = on_document_paragraph;
+	
+	int rc = ooxml_document_stream_text(priv->archive, OOXML_DOCUMENT_ALL_STORIES, &sink);
+	
+	if(is_json) fputs("\n]}\n", writer->fp);
+	fclose(writer->fp);
+	return rc;
+}
+
+static int convert_file(struct ooxml_context *ooxml, const struct batch_job *job)
+{
+	const char *path = job->path;
+	int rc = ooxml->open(ooxml, path, 1);
+	if(rc) return -1;
+	
+	// typed by open() from the main part of the package
+	if(ooxml->type == ooxml_file_document) {
+		rc = convert_document(ooxml, job);
+	}else if(ooxml->type == ooxml_file_spreadsheet) {
+		rc = convert_spreadsheet(ooxml, job);
+	}else {
+		fprintf(stderr, "[batch] %s: unknown ooxml file type\n", path);
+		rc = -1;
+	}
+	
+	ooxml->close(ooxml);
+	return rc;
+}
+
+/******************************************************************************
+ * worker pool
+******************************************************************************/
+struct batch_worker
+{
+	pthread_t th;
+	const struct batch_convert_options *options;
+	struct batch_outputs *outputs;
+	struct batch_file_list *files;
+	volatile ssize_t *next_index;
+	ssize_t num_converted;
+	ssize_t num_failed;
+};
+
+static void *batch_worker_thread(void *user_data)
+{
+	struct batch_worker *worker = user_data;
+	const struct batch_convert_options *options = worker->options;
+	
+	struct ooxml_context *ooxml = ooxml_context_init(NULL, worker);
+	assert(ooxml);
+	if(options->jooxml) ooxml_context_load_config(ooxml, options->jooxml);
+	ooxml->lazy_mode = 1;
+	
+	while(!(options->quit && *options->quit)) {
+		ssize_t index = __sync_fetch_and_add(worker->next_index, 1);
+		if(index >= worker->files->count) break;
+		
+		const char *path = worker->files->paths[index];
+		struct batch_job job = {
+			.options = options,
+			.outputs = worker->outputs,
+			.path = path,
+			.name = path + worker->files->name_offsets[index],
+		};
+		PERF_TRACE_BEGIN(span);
+		int rc = convert_file(ooxml, &job);
+		PERF_TRACE_END(span, "batch_convert_file", path);
+		if(rc) {
+			fprintf(stderr, "[batch] convert %s failed\n", path);
+			++worker->num_failed;
+		}else {
+			++worker->num_converted;
+		}
+	}
+	
+	ooxml_context_cleanup(ooxml);
+	free(ooxml);
+	return NULL;
+}
+
+int batch_convert_run(int num_paths, char **paths, const struct batch_convert_options *options)
+{
+	assert(options && options->output_dir);
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	struct batch_file_list files[1];
+	memset(files, 0, sizeof(files));
+	for(int i = 0; i < num_paths; ++i) batch_file_list_collect(files, paths[i]);
+	if(files->count == 0) {
+		fprintf(stderr, "[batch] no input files\n");
+		return -1;
+	}
+	
+	int num_workers = options->num_workers;
+	if(num_workers <= 0) num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if(num_workers <= 0) num_workers = 1;
+	if(num_workers > files->count) num_workers = files->count;
+	
+	struct batch_outputs outputs[1];
+	memset(outputs, 0, sizeof(outputs));
+	pthread_mutex_init(&outputs->mutex, NULL);
+	outputs->paths = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+	assert(outputs->paths);
+	
+	volatile ssize_t next_index = 0;
+	struct batch_worker *workers = calloc(num_workers, sizeof(*workers));
+	assert(workers);
+	for(int i = 0; i < num_workers; ++i) {
+		struct batch_worker *worker = &workers[i];
+		worker->options = options;
+		worker->outputs = outputs;
+		worker->files = files;
+		worker->next_index = &next_index;
+		int rc = pthread_create(&worker->th, NULL, batch_worker_thread, worker);
+		assert(0 == rc);
+	}
+	
+	ssize_t num_converted = 0, num_failed = 0;
+	for(int i = 0; i < num_workers; ++i) {
+		pthread_join(workers[i].th, NULL);
+		num_converted += workers[i].num_converted;
+		num_failed += workers[i].num_failed;
+	}
+	free(workers);
+	g_hash_table_destroy(outputs->paths);
+	pthread_mutex_destroy(&outputs->mutex);
+	
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1000000000.0;
+	fprintf(stderr, "[batch] %ld files, %ld converted, %ld failed, num_workers=%d, %.3f s (%.1f files/s)\n",
+		(long)files->count, (long)num_converted, (long)num_failed, num_workers,
+		elapsed, (elapsed > 0)?(num_converted / elapsed):0.0);
+	
+	batch_file_list_cleanup(files);
+	return (int)num_failed;
+}
+
+
+#if defined(TEST_BATCH_CONVERT_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
@@ -0,0 +1,321 @@
+/*
+ * ooxml_arena.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+#include <libxml/xmlmemory.h>
+
+#include "ooxml_arena.h"
+
+#define ARENA_ALIGNMENT			(16)
+#define ARENA_ALIGN(size)		(((size) + (ARENA_ALIGNMENT - 1)) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define ARENA_MIN_BLOCK_SIZE	(4096)
+#define ARENA_MAX_BLOCK_SIZE	(64 * 1024 * 1024)
+
+struct ooxml_arena_block
+{
+	struct ooxml_arena_block *next;
+	size_t size;
+	size_t used;
+	size_t padding;	// keeps data 16-byte aligned
+	unsigned char data[];
+};
+
+struct ooxml_arena
+{
+	pthread_mutex_t mutex;	// only guards adopt()
+	struct ooxml_arena_block *head;	// allocations are served from the head block
+	size_t block_size;
+	size_t total_size;
+};
+
+static struct ooxml_arena_block *arena_block_new(size_t size)
+{
+	struct ooxml_arena_block *block = malloc(sizeof(*block) + size);
+	assert(block);
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+struct ooxml_arena *ooxml_arena_new(size_t block_size)
+{
+	if(block_size < ARENA_MIN_BLOCK_SIZE) block_size = ARENA_MIN_BLOCK_SIZE;
+	if(block_size > ARENA_MAX_BLOCK_SIZE) block_size = ARENA_MAX_BLOCK_SIZE;
+	block_size = ARENA_ALIGN(block_size);
+	
+	struct ooxml_arena *arena = calloc(1, sizeof(*arena));
+	assert(arena);
+	pthread_mutex_init(&arena->mutex, NULL);
+	arena->block_size = block_size;
+	return arena;
+}
+
+void ooxml_arena_free(struct ooxml_arena *arena)
+{
+	if(NULL == arena) return;
+	struct ooxml_arena_block *block = arena->head;
+	while(block) {
+		struct ooxml_arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+	pthread_mutex_destroy(&arena->mutex);
+	free(arena);
+}
+
+void *ooxml_arena_alloc(struct ooxml_arena *arena, size_t size)
+{
+	assert(arena);
+	size = ARENA_ALIGN(size?size:1);
+	
+	struct ooxml_arena_block *head = arena->head;
+	if(head && (head->used + size) <= head->size) {
+		void *ptr = head->data + head->used;
+		head->used += size;
+		return ptr;
+	}
+	
+	// large allocations get their own block, behind the head so that its free space stays usable
+	if(head && size > (arena->block_size / 4)) {
+		struct ooxml_arena_block *block = arena_block_new(size);
+		block->used = size;
+		block->next = head->next;
+		head->next = block;
+		arena->total_size += size;
+		return block->data;
+	}
+	
+	// grow the block size with the arena, a few blocks cover most parts
+	size_t block_size = arena->block_size;
+	if(arena->total_size > block_size && block_size < ARENA_MAX_BLOCK_SIZE) {
+		block_size *= 2;
+		arena->block_size = block_size;
+	}
+	if(block_size < size) block_size = size;
+	
+	struct ooxml_arena_block *block = arena_block_new(block_size);
+	block->used = size;
+	block->next = head;
+	arena->head = block;
+	arena->total_size += block_size;
+	return block->data;
+}
+
+char *ooxml_arena_strdup(struct ooxml_arena *arena, const char *text)
+{
+	if(NULL == text) return NULL;
+	size_t length = strlen(text);
+	char *dst = ooxml_arena_alloc(arena, length + 1);
+	memcpy(dst, text, length + 1);
+	return dst;
+}
+
+size_t ooxml_arena_get_size(struct ooxml_arena *arena)
+{
+	return arena?arena->total_size:0;
+}
+
+// grow the last allocation of the head block in place
+static int ooxml_arena_extend(struct ooxml_arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+	struct ooxml_arena_block *head = arena->head;
+	if(NULL == head) return 0;
+	
+	old_size = ARENA_ALIGN(old_size);
+	new_size = ARENA_ALIGN(new_size);
+	if((unsigned char *)ptr + old_size != head->data + head->used) return 0;
+	if((head->used - old_size + new_size) > head->size) return 0;
+	
+	head->used = head->used - old_size + new_size;
+	return 1;
+}
+
+void ooxml_arena_adopt(struct ooxml_arena *arena, struct ooxml_arena *child)
+{
+	assert(arena);
+	if(NULL == child) return;
+	
+	struct ooxml_arena_block *first = child->head;
+	if(first) {
+		struct ooxml_arena_block *last = first;
+		while(last->next) last = last->next;
+		
+		// keep the parent's head block in front, it is the one with free space
+		pthread_mutex_lock(&arena->mutex);
+		if(arena->head) {
+			last->next = arena->head->next;
+			arena->head->next = first;
+		}else {
+			arena->head = first;
+		}
+		arena->total_size += child->total_size;
+		pthread_mutex_unlock(&arena->mutex);
+	}
+	child->head = NULL;
+	ooxml_arena_free(child);
+}
+
+/******************************************************************************
+ * libxml2 memory hooks
+******************************************************************************/
+#define XML_BLOCK_MAGIC_HEAP	(0x706165685F6C6D78ULL)	// "xml_heap"
+#define XML_BLOCK_MAGIC_ARENA	(0x616E6572615F6C6DULL)	// "ml_arena"
+
+/*
+ * hook blocks: [8 bytes padding | xml_block_header | data], the base is 16-byte aligned (malloc, arena)
+ * so the data is at 8 mod 16, while malloc() returns 16-byte aligned blocks:
+ * a block allocated before the hooks were installed is recognized without reading outside of it.
+ */
+struct xml_block_header
+{
+	uint64_t magic;
+	uint64_t size;
+};
+#define XML_BLOCK_OFFSET	(sizeof(uint64_t) + sizeof(struct xml_block_header))
+
+static inline int is_xml_hook_block(const void *ptr)
+{
+	return ((uintptr_t)ptr & 15) == 8;
+}
+
+static inline struct xml_block_header *get_xml_block_header(void *ptr)
+{
+	return (struct xml_block_header *)ptr - 1;
+}
+
+static __thread struct ooxml_arena *s_current_arena;
+
+struct ooxml_arena *ooxml_arena_set_current(struct ooxml_arena *arena)
+{
+	if(arena) ooxml_arena_setup_xml_hooks();
+	struct ooxml_arena *prev = s_current_arena;
+	s_current_arena = arena;
+	return prev;
+}
+
+static void *xml_malloc_hook(size_t size)
+{
+	unsigned char *base = NULL;
+	uint64_t magic = XML_BLOCK_MAGIC_HEAP;
+	struct ooxml_arena *arena = s_current_arena;
+	if(arena) {
+		base = ooxml_arena_alloc(arena, XML_BLOCK_OFFSET + size);
+		magic = XML_BLOCK_MAGIC_ARENA;
+	}else {
+		base = malloc(XML_BLOCK_OFFSET + size);
+		if(NULL == base) return NULL;
+	}
+	void *ptr = base + XML_BLOCK_OFFSET;
+	struct xml_block_header *header = get_xml_block_header(ptr);
+	header->magic = magic;
+	header->size = size;
+	return ptr;
+}
+
+static void xml_free_hook(void *ptr)
+{
+	if(NULL == ptr) return;
+	if(!is_xml_hook_block(ptr)) {
+		free(ptr);	// allocated before the hooks were installed
+		return;
+	}
+	
+	struct xml_block_header *header = get_xml_block_header(ptr);
+	switch(header->magic) {
+	case XML_BLOCK_MAGIC_HEAP:
+		header->magic = 0;
+		free((unsigned char *)ptr - XML_BLOCK_OFFSET);
+		return;
+	case XML_BLOCK_MAGIC_ARENA:
+		return;	// released with the arena
+	default:
+		break;
+	}
+	free(ptr);
+}
+
+static void *xml_realloc_hook(void *ptr, size_t size)
+{
+	if(NULL == ptr) return xml_malloc_hook(size);
+	if(!is_xml_hook_block(ptr)) return realloc(ptr, size);	// allocated before the hooks were installed
+	
+	struct xml_block_header *header = get_xml_block_header(ptr);
+	unsigned char *base = (unsigned char *)ptr - XML_BLOCK_OFFSET;
+	if(header->magic == XML_BLOCK_MAGIC_HEAP) {
+		base = realloc(base, XML_BLOCK_OFFSET + size);
+		if(NULL == base) return NULL;
+		ptr = base + XML_BLOCK_OFFSET;
+		get_xml_block_header(ptr)->size = size;
+		return ptr;
+	}
+	if(header->magic != XML_BLOCK_MAGIC_ARENA) return realloc(ptr, size);
+	
+	struct ooxml_arena *arena = s_current_arena;
+	if(arena && ooxml_arena_extend(arena, base, XML_BLOCK_OFFSET + header->size, XML_BLOCK_OFFSET + size)) {
+		header->size = size;
+		return ptr;
+	}
+	
+	void *new_ptr = xml_malloc_hook(size);
+	if(NULL == new_ptr) return NULL;
+	memcpy(new_ptr, ptr, (header->size < size)?header->size:size);
+	return new_ptr;
+}
+
+static char *xml_strdup_hook(const char *text)
+{
+	if(NULL == text) return NULL;
+	size_t length = strlen(text);
+	char *dst = xml_malloc_hook(length + 1);
+	if(dst) memcpy(dst, text, length + 1);
+	return dst;
+}
+
+static void setup_xml_hooks(void)
+{
+	xmlMemSetup(xml_free_hook, xml_malloc_hook, xml_realloc_hook, xml_strdup_hook);
+}
+
+void ooxml_arena_setup_xml_hooks(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, setup_xml_hooks);
+}
+
+
+#if defined(TEST_OOXML_ARENA_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
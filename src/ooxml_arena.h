@@ -0,0 +1,43 @@
+#ifndef OOXML_ARENA_H_
+#define OOXML_ARENA_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * region allocator tied to the lifetime of an open archive:
+ * allocations are bump-pointer, nothing is freed individually, ooxml_arena_free() releases all blocks.
+ * an arena is used by one thread at a time, ooxml_arena_adopt() is the only thread-safe call.
+ */
+struct ooxml_arena;
+struct ooxml_arena *ooxml_arena_new(size_t block_size);
+void ooxml_arena_free(struct ooxml_arena *arena);
+
+void *ooxml_arena_alloc(struct ooxml_arena *arena, size_t size);
+char *ooxml_arena_strdup(struct ooxml_arena *arena, const char *text);
+size_t ooxml_arena_get_size(struct ooxml_arena *arena);	// bytes reserved by all blocks
+
+// move all blocks of child into arena and free child (e.g. a worker's arena into the archive's)
+void ooxml_arena_adopt(struct ooxml_arena *arena, struct ooxml_arena *child);
+
+/*
+ * libxml2 allocations (xmlMemSetup):
+ * while an arena is current on a thread, all libxml2 allocations of that thread come from it.
+ * the hooks are installed (once, process-wide) by the first ooxml_arena_set_current() of an arena,
+ * a program that never makes one current keeps libxml2's allocator or its own.
+ * their blocks carry a small header that tells heap blocks from arena blocks (which are not freed individually),
+ * a block allocated before the hooks has none and goes back to free() / realloc():
+ * an embedder with its own xmlMemSetup() must not enable the arena (use_arena = 0).
+ */
+void ooxml_arena_setup_xml_hooks(void);
+struct ooxml_arena *ooxml_arena_set_current(struct ooxml_arena *arena);	// returns the previous one
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,692 @@
+/*
+ * ooxml_arrow.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "app.h"
+#include "ooxml_context.h"
+#include "ooxml_private.h"
+#include "ooxml_spreadsheet.h"
+#include "ooxml_shared_strings.h"
+#include "ooxml_styles.h"
+#include "ooxml_table.h"
+#include "ooxml_arrow.h"
+#include "perf_trace.h"
+
+/*
+ * minimal flatbuffers builder for the arrow metadata (Schema.fbs, Message.fbs, File.fbs).
+ * it writes front to back: a table is followed by its vtable-less children, which are appended later
+ * and linked by patching the parent's offset field (flatbuffers offsets always point forward).
+ */
+struct fb_builder
+{
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+};
+
+struct fb_field
+{
+	uint8_t size;		// 0: not present
+	uint64_t value;		// scalars, offsets are patched with fb_link()
+};
+
+#define FB_ABSENT		{ 0, 0 }
+#define FB_U8(v)		{ 1, (uint64_t)(v) }
+#define FB_I16(v)		{ 2, (uint64_t)(v) }
+#define FB_I32(v)		{ 4, (uint64_t)(v) }
+#define FB_I64(v)		{ 8, (uint64_t)(v) }
+#define FB_OFFSET		{ 4, 0 }
+
+static size_t fb_reserve(struct fb_builder *fb, size_t size)
+{
+	if(fb->size + size > fb->capacity) {
+		size_t new_size = fb->capacity?(fb->capacity * 2):1024;
+		while(new_size < fb->size + size) new_size *= 2;
+		fb->data = realloc(fb->data, new_size);
+		assert(fb->data);
+		fb->capacity = new_size;
+	}
+	size_t pos = fb->size;
+	memset(fb->data + pos, 0, size);
+	fb->size += size;
+	return pos;
+}
+
+static void fb_align(struct fb_builder *fb, size_t alignment)
+{
+	size_t padding = (alignment - fb->size % alignment) % alignment;
+	if(padding) fb_reserve(fb, padding);
+}
+
+// little-endian hosts only, like the rest of the zip / xlsx code
+static void fb_put(struct fb_builder *fb, size_t pos, uint64_t value, size_t size)
+{
+	memcpy(fb->data + pos, &value, size);
+}
+
+static void fb_link(struct fb_builder *fb, size_t field_pos, size_t target_pos)
+{
+	assert(target_pos > field_pos);
+	fb_put(fb, field_pos, target_pos - field_pos, 4);
+}
+
+// the root offset, must be the first thing in the buffer
+static size_t fb_begin(struct fb_builder *fb)
+{
+	fb->size = 0;
+	return fb_reserve(fb, 4);
+}
+
+/*
+ * vtable + table, positions[i] receives the position of field i (to link offsets), returns the table position
+ */
+static size_t fb_add_table(struct fb_builder *fb, int num_fields, const struct fb_field *fields, size_t *positions)
+{
+	fb_align(fb, 2);
+	size_t vtable_size = 4 + 2 * num_fields;
+	size_t vtable_pos = fb_reserve(fb, vtable_size);
+	
+	fb_align(fb, 8);
+	size_t table_pos = fb_reserve(fb, 4);
+	fb_put(fb, table_pos, (uint32_t)(int32_t)(table_pos - vtable_pos), 4);
+	
+	for(int i = 0; i < num_fields; ++i) {
+		size_t pos = 0;
+		if(fields[i].size) {
+			fb_align(fb, fields[i].size);
+			pos = fb_reserve(fb, fields[i].size);
+			fb_put(fb, pos, fields[i].value, fields[i].size);
+			fb_put(fb, vtable_pos + 4 + 2 * i, pos - table_pos, 2);
+		}
+		if(positions) positions[i] = pos;
+	}
+	fb_put(fb, vtable_pos, vtable_size, 2);
+	fb_put(fb, vtable_pos + 2, fb->size - table_pos, 2);
+	return table_pos;
+}
+
+// returns the position of the length, the elements follow it
+static size_t fb_add_vector(struct fb_builder *fb, size_t count, size_t element_size, size_t alignment)
+{
+	if(alignment < 4) alignment = 4;
+	while((fb->size + 4) % alignment) fb_reserve(fb, 1);
+	size_t pos = fb_reserve(fb, 4 + count * element_size);
+	fb_put(fb, pos, count, 4);
+	return pos;
+}
+
+static size_t fb_add_string(struct fb_builder *fb, const char *text, size_t length)
+{
+	fb_align(fb, 4);
+	size_t pos = fb_reserve(fb, 4 + length + 1);
+	fb_put(fb, pos, length, 4);
+	memcpy(fb->data + pos + 4, text, length);
+	return pos;
+}
+
+
+/*
+ * arrow ids
+ */
+enum arrow_metadata_version { arrow_metadata_v5 = 4 };
+enum arrow_message_header { arrow_header_schema = 1, arrow_header_dictionary_batch = 2, arrow_header_record_batch = 3 };
+enum arrow_type
+{
+	arrow_type_null = 1,
+	arrow_type_int = 2,
+	arrow_type_floating_point = 3,
+	arrow_type_utf8 = 5,
+	arrow_type_bool = 6,
+	arrow_type_timestamp = 10,
+};
+enum arrow_precision { arrow_precision_double = 2 };
+enum arrow_time_unit { arrow_time_unit_millisecond = 1 };
+
+#define ARROW_ALIGNMENT		(8)
+#define ARROW_DICTIONARY_ID	(0)
+
+// milliseconds between 1899-12-30 (serial 0) and 1970-01-01 (serial 25569),
+// date columns are 1900 serials whatever the workbook's date system (ooxml_table_options.date1904)
+#define EXCEL_EPOCH_MS		(25569LL * 86400000LL)
+
+struct arrow_block
+{
+	int64_t offset;
+	int32_t metadata_length;
+	int64_t body_length;
+};
+
+struct arrow_buffer
+{
+	const void *data;
+	int64_t length;
+};
+
+struct arrow_writer
+{
+	FILE *fp;
+	int64_t offset;
+	int err;
+	
+	struct ooxml_table *schema;
+	int has_dictionary;
+	int64_t num_rows;
+	
+	struct fb_builder fb;
+	
+	struct arrow_block dictionary_block;
+	ssize_t num_batches;
+	ssize_t max_batches;
+	struct arrow_block *batches;
+	
+	// per record batch
+	int64_t num_nodes;
+	int64_t (*nodes)[2];	// length, null_count
+	int64_t num_buffers;
+	struct arrow_buffer *buffers;
+	void **scratch;		// converted buffers of the current batch
+	int64_t num_scratch;
+};
+
+static void arrow_writer_write(struct arrow_writer *writer, const void *data, size_t length)
+{
+	if(writer->err || 0 == length) return;
+	if(fwrite(data, 1, length, writer->fp) != length) {
+		perror("arrow: fwrite");
+		writer->err = 1;
+		return;
+	}
+	writer->offset += length;
+}
+
+static void arrow_writer_pad(struct arrow_writer *writer)
+{
+	static const uint8_t zeros[ARROW_ALIGNMENT];
+	size_t padding = (ARROW_ALIGNMENT - writer->offset % ARROW_ALIGNMENT) % ARROW_ALIGNMENT;
+	arrow_writer_write(writer, zeros, padding);
+}
+
+static inline int64_t padded_length(int64_t length)
+{
+	return (length + ARROW_ALIGNMENT - 1) / ARROW_ALIGNMENT * ARROW_ALIGNMENT;
+}
+
+/*
+ * encapsulated message: 0xFFFFFFFF, metadata length, the flatbuffer (padded), the body (buffers, each padded)
+ */
+static void arrow_writer_write_message(struct arrow_writer *writer, struct arrow_block *block)
+{
+	struct fb_builder *fb = &writer->fb;
+	fb_align(fb, ARROW_ALIGNMENT);
+	
+	uint32_t prefix[2] = { 0xFFFFFFFF, (uint32_t)fb->size };
+	block->offset = writer->offset;
+	block->metadata_length = (int32_t)(sizeof(prefix) + fb->size);
+	block->body_length = 0;
+	
+	arrow_writer_write(writer, prefix, sizeof(prefix));
+	arrow_writer_write(writer, fb->data, fb->size);
+	for(int64_t i = 0; i < writer->num_buffers; ++i) {
+		arrow_writer_write(writer, writer->buffers[i].data, writer->buffers[i].length);
+		arrow_writer_pad(writer);
+		block->body_length += padded_length(writer->buffers[i].length);
+	}
+}
+
+static size_t fb_add_int_type(struct fb_builder *fb, int bit_width)
+{
+	struct fb_field fields[] = { FB_I32(bit_width), FB_U8(1) };
+	return fb_add_table(fb, 2, fields, NULL);
+}
+
+static size_t fb_add_field(struct fb_builder *fb, const struct ooxml_column *column)
+{
+	enum arrow_type type = arrow_type_null;
+	switch(column->type) {
+	case ooxml_column_type_double: type = arrow_type_floating_point; break;
+	case ooxml_column_type_int64: type = arrow_type_int; break;
+	case ooxml_column_type_bool: type = arrow_type_bool; break;
+	case ooxml_column_type_date: type = arrow_type_timestamp; break;
+	case ooxml_column_type_string: case ooxml_column_type_mixed: type = arrow_type_utf8; break;
+	default: break;
+	}
+	int is_dictionary = (column->type == ooxml_column_type_string);
+	
+	// Field { name, nullable, type_type, type, dictionary, children, custom_metadata }
+	struct fb_field fields[] = {
+		FB_OFFSET, FB_U8(1), FB_U8(type), FB_OFFSET,
+		is_dictionary?(struct fb_field)FB_OFFSET:(struct fb_field)FB_ABSENT,
+		FB_OFFSET, FB_ABSENT,
+	};
+	size_t positions[7];
+	size_t field_pos = fb_add_table(fb, 7, fields, positions);
+	
+	const char *name = column->name?column->name:"";
+	fb_link(fb, positions[0], fb_add_string(fb, name, strlen(name)));
+	
+	size_t type_pos = 0;
+	switch(type) {
+	case arrow_type_int:
+		type_pos = fb_add_int_type(fb, 64);
+		break;
+	case arrow_type_floating_point:
+		{
+			struct fb_field precision[] = { FB_I16(arrow_precision_double) };
+			type_pos = fb_add_table(fb, 1, precision, NULL);
+		}
+		break;
+	case arrow_type_timestamp:
+		{
+			struct fb_field timestamp[] = { FB_I16(arrow_time_unit_millisecond), FB_ABSENT };
+			type_pos = fb_add_table(fb, 2, timestamp, NULL);
+		}
+		break;
+	default:	// Null, Bool, Utf8: no fields
+		type_pos = fb_add_table(fb, 0, NULL, NULL);
+		break;
+	}
+	fb_link(fb, positions[3], type_pos);
+	
+	if(is_dictionary) {
+		// DictionaryEncoding { id, indexType, isOrdered, dictionaryKind }
+		struct fb_field encoding[] = { FB_I64(ARROW_DICTIONARY_ID), FB_OFFSET, FB_ABSENT, FB_ABSENT };
+		size_t encoding_positions[4];
+		fb_link(fb, positions[4], fb_add_table(fb, 4, encoding, encoding_positions));
+		fb_link(fb, encoding_positions[1], fb_add_int_type(fb, 32));
+	}
+	
+	// readers require the children vector, even if it is empty
+	fb_link(fb, positions[5], fb_add_vector(fb, 0, 4, 4));
+	return field_pos;
+}
+
+// Schema { endianness, fields, custom_metadata, features }
+static size_t fb_add_schema(struct fb_builder *fb, const struct ooxml_table *schema)
+{
+	struct fb_field fields[] = { FB_ABSENT, FB_OFFSET, FB_ABSENT, FB_ABSENT };
+	size_t positions[4];
+	size_t schema_pos = fb_add_table(fb, 4, fields, positions);
+	
+	size_t vector_pos = fb_add_vector(fb, schema->num_columns, 4, 4);
+	fb_link(fb, positions[1], vector_pos);
+	for(int64_t i = 0; i < schema->num_columns; ++i) {
+		fb_link(fb, vector_pos + 4 + 4 * i, fb_add_field(fb, &schema->columns[i]));
+	}
+	return schema_pos;
+}
+
+// Message { version, header_type, header, bodyLength, custom_metadata }, returns the position of the header offset
+static size_t fb_begin_message(struct fb_builder *fb, enum arrow_message_header header_type, int64_t body_length)
+{
+	size_t root_pos = fb_begin(fb);
+	struct fb_field fields[] = { FB_I16(arrow_metadata_v5), FB_U8(header_type), FB_OFFSET, FB_I64(body_length), FB_ABSENT };
+	size_t positions[5];
+	fb_link(fb, root_pos, fb_add_table(fb, 5, fields, positions));
+	return positions[2];
+}
+
+static int64_t arrow_writer_get_body_length(const struct arrow_writer *writer)
+{
+	int64_t body_length = 0;
+	for(int64_t i = 0; i < writer->num_buffers; ++i) body_length += padded_length(writer->buffers[i].length);
+	return body_length;
+}
+
+// RecordBatch { length, nodes, buffers, compression, variadicBufferCounts } of the current nodes and buffers
+static size_t fb_add_record_batch(struct fb_builder *fb, const struct arrow_writer *writer, int64_t length)
+{
+	struct fb_field fields[] = { FB_I64(length), FB_OFFSET, FB_OFFSET, FB_ABSENT, FB_ABSENT };
+	size_t positions[5];
+	size_t batch_pos = fb_add_table(fb, 5, fields, positions);
+	
+	// struct FieldNode { length: long, null_count: long }
+	size_t nodes_pos = fb_add_vector(fb, writer->num_nodes, 16, 8);
+	fb_link(fb, positions[1], nodes_pos);
+	for(int64_t i = 0; i < writer->num_nodes; ++i) {
+		fb_put(fb, nodes_pos + 4 + 16 * i, writer->nodes[i][0], 8);
+		fb_put(fb, nodes_pos + 4 + 16 * i + 8, writer->nodes[i][1], 8);
+	}
+	
+	// struct Buffer { offset: long, length: long }, offsets into the body
+	size_t buffers_pos = fb_add_vector(fb, writer->num_buffers, 16, 8);
+	fb_link(fb, positions[2], buffers_pos);
+	int64_t offset = 0;
+	for(int64_t i = 0; i < writer->num_buffers; ++i) {
+		fb_put(fb, buffers_pos + 4 + 16 * i, offset, 8);
+		fb_put(fb, buffers_pos + 4 + 16 * i + 8, writer->buffers[i].length, 8);
+		offset += padded_length(writer->buffers[i].length);
+	}
+	return batch_pos;
+}
+
+static void arrow_writer_reset_batch(struct arrow_writer *writer)
+{
+	for(int64_t i = 0; i < writer->num_scratch; ++i) free(writer->scratch[i]);
+	writer->num_scratch = 0;
+	writer->num_nodes = 0;
+	writer->num_buffers = 0;
+}
+
+static void arrow_writer_add_node(struct arrow_writer *writer, int64_t length, int64_t null_count)
+{
+	writer->nodes[writer->num_nodes][0] = length;
+	writer->nodes[writer->num_nodes][1] = null_count;
+	++writer->num_nodes;
+}
+
+static void arrow_writer_add_buffer(struct arrow_writer *writer, const void *data, int64_t length)
+{
+	writer->buffers[writer->num_buffers].data = data;
+	writer->buffers[writer->num_buffers].length = length;
+	++writer->num_buffers;
+}
+
+static void *arrow_writer_alloc_scratch(struct arrow_writer *writer, size_t size)
+{
+	void *data = malloc(size?size:1);
+	assert(data);
+	writer->scratch[writer->num_scratch++] = data;
+	return data;
+}
+
+/*
+ * utf8 array: int32 offsets + data, with the strings of the given ids (skipped where validity is not set)
+ */
+static int arrow_writer_add_strings(struct arrow_writer *writer, const struct ooxml_table *table,
+	const uint32_t *ids, int64_t length, const uint8_t *validity)
+{
+	int32_t *offsets = arrow_writer_alloc_scratch(writer, (length + 1) * sizeof(*offsets));
+	size_t cb_data = 0;
+	for(int64_t i = 0; i < length; ++i) {
+		size_t cb_text = 0;
+		if(ids) {
+			if(validity && !((validity[i >> 3] >> (i & 7)) & 1)) continue;
+			ooxml_table_get_string(table, ids[i], &cb_text);
+		}else {
+			ooxml_table_get_string(table, (uint32_t)i, &cb_text);
+		}
+		cb_data += cb_text;
+	}
+	if(cb_data > INT32_MAX) {
+		fprintf(stderr, "arrow: %s: more than 2 GiB of strings in one array\n", table->sheet_name);
+		return -1;
+	}
+	
+	char *data = arrow_writer_alloc_scratch(writer, cb_data);
+	int32_t offset = 0;
+	for(int64_t i = 0; i < length; ++i) {
+		offsets[i] = offset;
+		if(ids && validity && !((validity[i >> 3] >> (i & 7)) & 1)) continue;
+		
+		size_t cb_text = 0;
+		const char *text = ooxml_table_get_string(table, ids?ids[i]:(uint32_t)i, &cb_text);
+		if(text && cb_text) {
+			memcpy(data + offset, text, cb_text);
+			offset += (int32_t)cb_text;
+		}
+	}
+	offsets[length] = offset;
+	
+	arrow_writer_add_buffer(writer, offsets, (length + 1) * sizeof(*offsets));
+	arrow_writer_add_buffer(writer, data, offset);
+	return 0;
+}
+
+static int arrow_writer_write_schema(struct arrow_writer *writer)
+{
+	struct fb_builder *fb = &writer->fb;
+	size_t header_pos = fb_begin_message(fb, arrow_header_schema, 0);
+	fb_link(fb, header_pos, fb_add_schema(fb, writer->schema));
+	
+	struct arrow_block block;
+	writer->num_buffers = 0;
+	arrow_writer_write_message(writer, &block);
+	return writer->err?-1:0;
+}
+
+// the values of the one dictionary: every shared string and string of the table known after the scan
+static int arrow_writer_write_dictionary(struct arrow_writer *writer)
+{
+	struct ooxml_table *schema = writer->schema;
+	int64_t num_strings = ooxml_table_get_num_strings(schema);
+	
+	arrow_writer_reset_batch(writer);
+	arrow_writer_add_node(writer, num_strings, 0);
+	arrow_writer_add_buffer(writer, NULL, 0);	// validity
+	if(arrow_writer_add_strings(writer, schema, NULL, num_strings, NULL)) return -1;
+	
+	// DictionaryBatch { id, data, isDelta }
+	struct fb_builder *fb = &writer->fb;
+	size_t header_pos = fb_begin_message(fb, arrow_header_dictionary_batch, arrow_writer_get_body_length(writer));
+	struct fb_field fields[] = { FB_I64(ARROW_DICTIONARY_ID), FB_OFFSET, FB_ABSENT };
+	size_t positions[3];
+	fb_link(fb, header_pos, fb_add_table(fb, 3, fields, positions));
+	fb_link(fb, positions[1], fb_add_record_batch(fb, writer, num_strings));
+	
+	arrow_writer_write_message(writer, &writer->dictionary_block);
+	arrow_writer_reset_batch(writer);
+	return writer->err?-1:0;
+}
+
+static int on_arrow_batch(void *user_data, const struct ooxml_table *batch)
+{
+	struct arrow_writer *writer = user_data;
+	arrow_writer_reset_batch(writer);
+	
+	int64_t length = batch->num_rows;
+	for(int64_t i = 0; i < batch->num_columns; ++i) {
+		const struct ooxml_column *column = &batch->columns[i];
+		assert(!column->is_sparse);
+		
+		arrow_writer_add_node(writer, length, column->null_count);
+		if(column->type == ooxml_column_type_empty) continue;	// Null arrays have no buffers
+		
+		arrow_writer_add_buffer(writer, column->validity, column->validity?((length + 7) / 8):0);
+		switch(column->type) {
+		case ooxml_column_type_double:
+			arrow_writer_add_buffer(writer, column->values.f64, length * sizeof(double));
+			break;
+		case ooxml_column_type_int64:
+			arrow_writer_add_buffer(writer, column->values.i64, length * sizeof(int64_t));
+			break;
+		case ooxml_column_type_bool:
+			arrow_writer_add_buffer(writer, column->values.bits, (length + 7) / 8);
+			break;
+		case ooxml_column_type_date:
+			{
+				int64_t *timestamps = arrow_writer_alloc_scratch(writer, length * sizeof(*timestamps));
+				for(int64_t row = 0; row < length; ++row) {
+					timestamps[row] = llround(column->values.f64[row] * 86400000.0) - EXCEL_EPOCH_MS;
+				}
+				arrow_writer_add_buffer(writer, timestamps, length * sizeof(*timestamps));
+			}
+			break;
+		case ooxml_column_type_string:
+			// the ids are the dictionary indices (int32)
+			arrow_writer_add_buffer(writer, column->values.ids, length * sizeof(uint32_t));
+			break;
+		case ooxml_column_type_mixed:
+			if(arrow_writer_add_strings(writer, batch, column->values.ids, length, column->validity)) {
+				writer->err = 1;
+				return 1;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	
+	struct fb_builder *fb = &writer->fb;
+	size_t header_pos = fb_begin_message(fb, arrow_header_record_batch, arrow_writer_get_body_length(writer));
+	fb_link(fb, header_pos, fb_add_record_batch(fb, writer, length));
+	
+	if(writer->num_batches >= writer->max_batches) {
+		ssize_t new_size = writer->max_batches?(writer->max_batches * 2):64;
+		writer->batches = realloc(writer->batches, new_size * sizeof(*writer->batches));
+		assert(writer->batches);
+		writer->max_batches = new_size;
+	}
+	arrow_writer_write_message(writer, &writer->batches[writer->num_batches++]);
+	arrow_writer_reset_batch(writer);
+	
+	writer->num_rows += length;
+	return writer->err;
+}
+
+static size_t fb_add_blocks(struct fb_builder *fb, const struct arrow_block *blocks, ssize_t count)
+{
+	// struct Block { offset: long, metaDataLength: int, (padding), bodyLength: long }
+	size_t pos = fb_add_vector(fb, count, 24, 8);
+	for(ssize_t i = 0; i < count; ++i) {
+		fb_put(fb, pos + 4 + 24 * i, blocks[i].offset, 8);
+		fb_put(fb, pos + 4 + 24 * i + 8, (uint32_t)blocks[i].metadata_length, 4);
+		fb_put(fb, pos + 4 + 24 * i + 16, blocks[i].body_length, 8);
+	}
+	return pos;
+}
+
+static int arrow_writer_write_footer(struct arrow_writer *writer)
+{
+	// end of the stream
+	static const uint32_t eos[2] = { 0xFFFFFFFF, 0 };
+	arrow_writer_write(writer, eos, sizeof(eos));
+	
+	// Footer { version, schema, dictionaries, recordBatches, custom_metadata }
+	struct fb_builder *fb = &writer->fb;
+	size_t root_pos = fb_begin(fb);
+	struct fb_field fields[] = { FB_I16(arrow_metadata_v5), FB_OFFSET, FB_OFFSET, FB_OFFSET, FB_ABSENT };
+	size_t positions[5];
+	fb_link(fb, root_pos, fb_add_table(fb, 5, fields, positions));
+	fb_link(fb, positions[1], fb_add_schema(fb, writer->schema));
+	fb_link(fb, positions[2], fb_add_blocks(fb, &writer->dictionary_block, writer->has_dictionary?1:0));
+	fb_link(fb, positions[3], fb_add_blocks(fb, writer->batches, writer->num_batches));
+	
+	int32_t cb_footer = (int32_t)fb->size;
+	arrow_writer_write(writer, fb->data, fb->size);
+	arrow_writer_write(writer, &cb_footer, sizeof(cb_footer));
+	arrow_writer_write(writer, "ARROW1", 6);
+	return writer->err?-1:0;
+}
+
+static void arrow_writer_cleanup(struct arrow_writer *writer)
+{
+	arrow_writer_reset_batch(writer);
+	free(writer->fb.data);
+	free(writer->batches);
+	free(writer->nodes);
+	free(writer->buffers);
+	free(writer->scratch);
+	if(writer->fp) fclose(writer->fp);
+	memset(writer, 0, sizeof(*writer));
+}
+
+int64_t ooxml_arrow_export_sheet(zip_t *zip, const char *sheet_name,
+	struct ooxml_shared_strings *sst, const struct ooxml_styles *styles,
+	const char *path, const struct ooxml_arrow_options *options)
+{
+	assert(zip && sheet_name && path);
+	struct ooxml_table_options table_options = {
+		.header_row = options?options->header_row:0,
+		.date1904 = ooxml_spreadsheet_is_date1904(zip, NULL),
+	};
+	int64_t batch_rows = (options && options->batch_rows > 0)?options->batch_rows:OOXML_TABLE_DEFAULT_BATCH_ROWS;
+	
+	PERF_TRACE_BEGIN(span);
+	struct ooxml_table *schema = ooxml_table_scan(zip, sheet_name, sst, styles, &table_options);
+	if(NULL == schema) return -1;
+	
+	struct arrow_writer writer[1];
+	memset(writer, 0, sizeof(writer));
+	writer->schema = schema;
+	writer->fp = fopen(path, "wb");
+	if(NULL == writer->fp) {
+		perror(path);
+		ooxml_table_free(schema);
+		return -1;
+	}
+	
+	// at most 3 buffers (validity, offsets, data) and 2 scratch buffers per column
+	int64_t num_columns = schema->num_columns;
+	writer->nodes = calloc(num_columns + 1, sizeof(*writer->nodes));
+	writer->buffers = calloc(3 * num_columns + 3, sizeof(*writer->buffers));
+	writer->scratch = calloc(2 * num_columns + 2, sizeof(*writer->scratch));
+	assert(writer->nodes && writer->buffers && writer->scratch);
+	
+	for(int64_t i = 0; i < num_columns; ++i) {
+		if(schema->columns[i].type == ooxml_column_type_string) writer->has_dictionary = 1;
+	}
+	
+	static const char magic[8] = "ARROW1";
+	arrow_writer_write(writer, magic, sizeof(magic));
+	int rc = arrow_writer_write_schema(writer);
+	if(0 == rc && writer->has_dictionary) rc = arrow_writer_write_dictionary(writer);
+	if(0 == rc) rc = ooxml_table_read_batches(schema, zip, batch_rows, on_arrow_batch, writer);
+	if(0 == rc && writer->err) rc = -1;
+	if(0 == rc) rc = arrow_writer_write_footer(writer);
+	if(0 == rc && fflush(writer->fp) != 0) {
+		perror(path);
+		rc = -1;
+	}
+	
+	int64_t num_rows = writer->num_rows;
+	debug_printf("%s => %s: %lld rows, %lld columns, %ld batches, %lld bytes", sheet_name, path,
+		(long long)num_rows, (long long)num_columns, (long)writer->num_batches, (long long)writer->offset);
+	arrow_writer_cleanup(writer);
+	ooxml_table_free(schema);
+	PERF_TRACE_END(span, "arrow_export", sheet_name);
+	
+	if(rc) {
+		remove(path);
+		return -1;
+	}
+	return num_rows;
+}
+
+int64_t ooxml_arrow_export(struct ooxml_context *ooxml, const char *sheet_name,
+	const char *path, const struct ooxml_arrow_options *options)
+{
+	assert(ooxml && ooxml->priv);
+	struct ooxml_private *priv = ooxml->priv;
+	if(NULL == priv->archive) return -1;
+	
+	return ooxml_arrow_export_sheet(priv->archive, sheet_name, 
+		ooxml->get_shared_strings(ooxml), ooxml->get_styles(ooxml),
+		path, options);
+}
+
+
+#if defined(TEST_OOXML_ARROW_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
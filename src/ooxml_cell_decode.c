@@ -0,0 +1,466 @@
+/*
+ * ooxml_cell_decode.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <locale.h>
+
+#include "ooxml_cell_decode.h"
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define CELL_DECODE_SWAR 1
+#endif
+
+#define MAX_MANTISSA_DIGITS	(19)	// always fits in an uint64_t
+
+static inline int is_xml_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline int is_digit(char c)
+{
+	return (unsigned char)(c - '0') < 10;
+}
+
+static void trim_spaces(const char **p_begin, const char **p_end)
+{
+	const char *p = *p_begin;
+	const char *end = *p_end;
+	while(p < end && is_xml_space(*p)) ++p;
+	while(end > p && is_xml_space(end[-1])) --end;
+	*p_begin = p;
+	*p_end = end;
+}
+
+#ifdef CELL_DECODE_SWAR
+/*
+ * eight ascii digits at once (little-endian), see
+ * https://lemire.me/blog/2022/01/21/swar-explained-parsing-eight-digits/
+ */
+static inline int is_eight_digits(const char *p)
+{
+	uint64_t chunk;
+	memcpy(&chunk, p, 8);
+	return ((chunk & 0xF0F0F0F0F0F0F0F0ULL)
+		| (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+}
+
+static inline uint32_t parse_eight_digits(const char *p)
+{
+	uint64_t chunk;
+	memcpy(&chunk, p, 8);
+	chunk = ((chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+	chunk = ((chunk & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+	return (uint32_t)(((chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32);
+}
+#endif
+
+/******************************************************************************
+ * doubles
+******************************************************************************/
+struct decimal
+{
+	uint64_t mantissa;	// the first MAX_MANTISSA_DIGITS significant digits
+	int num_digits;		// significant digits in mantissa (may count a few leading zeros)
+	int64_t exponent;
+	int truncated;		// non-zero digits have been dropped
+};
+
+static const char *scan_digits(struct decimal *d, const char *p, const char *end, int is_fraction)
+{
+#ifdef CELL_DECODE_SWAR
+	while(d->num_digits <= (MAX_MANTISSA_DIGITS - 8) && (end - p) >= 8 && is_eight_digits(p)) {
+		d->mantissa = d->mantissa * 100000000 + parse_eight_digits(p);
+		if(d->mantissa) d->num_digits += 8;
+		if(is_fraction) d->exponent -= 8;
+		p += 8;
+	}
+#endif
+	for(; p < end && is_digit(*p); ++p) {
+		unsigned int digit = *p - '0';
+		if(d->num_digits < MAX_MANTISSA_DIGITS) {
+			d->mantissa = d->mantissa * 10 + digit;
+			if(d->mantissa) ++d->num_digits;
+			if(is_fraction) --d->exponent;
+		}else {
+			if(digit) d->truncated = 1;
+			if(!is_fraction) ++d->exponent;
+		}
+	}
+	return p;
+}
+
+#ifdef __SIZEOF_INT128__
+static const uint64_t s_pow10_u64[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+	1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+/*
+ * mantissa * 10^exponent, |exponent| <= 19, correctly rounded with 128-bit integer arithmetic:
+ * the product is exact, the quotient keeps >= 62 bits plus a sticky bit for the remainder.
+ * covers the 16..19 digit values excel writes, which are too long for the fast path.
+ */
+static int decimal_to_double_u128(uint64_t mantissa, int64_t exponent, double *p_value)
+{
+	typedef unsigned __int128 uint128_t;
+	if(exponent > 19 || exponent < -19) return -1;
+	
+	if(exponent >= 0) {
+		*p_value = (double)((uint128_t)mantissa * s_pow10_u64[exponent]);
+		return 0;
+	}
+	
+	// numerator < 2^(63 + bits of the divisor), so that 2^62 <= quotient < 2^64
+	uint64_t divisor = s_pow10_u64[-exponent];
+	int shift = 63 + (64 - __builtin_clzll(divisor)) - (64 - __builtin_clzll(mantissa));
+	uint128_t numerator = (uint128_t)mantissa << shift;
+	uint64_t quotient = (uint64_t)(numerator / divisor);
+	if((numerator % divisor) != 0) quotient |= 1;
+	*p_value = ldexp((double)quotient, -shift);
+	return 0;
+}
+#endif
+
+// strtod() with '.' as the decimal point regardless of LC_NUMERIC
+static enum ooxml_decode_error decode_double_slow(const char *text, size_t length, double *p_value)
+{
+	const char *decimal_point = localeconv()->decimal_point;
+	size_t cb_point = decimal_point?strlen(decimal_point):0;
+	if(cb_point == 0) {
+		decimal_point = ".";
+		cb_point = 1;
+	}
+	
+	char local_buf[128];
+	size_t size = length * cb_point + 1;
+	char *buf = (size <= sizeof(local_buf))?local_buf:malloc(size);
+	assert(buf);
+	
+	char *dst = buf;
+	for(size_t i = 0; i < length; ++i) {
+		if(text[i] == '.') {
+			memcpy(dst, decimal_point, cb_point);
+			dst += cb_point;
+		}else {
+			*dst++ = text[i];
+		}
+	}
+	*dst = '\0';
+	
+	char *p_end = NULL;
+	errno = 0;
+	double value = strtod(buf, &p_end);
+	int consumed = (p_end == dst);
+	int overflow = (errno == ERANGE && isinf(value));
+	if(buf != local_buf) free(buf);
+	
+	if(!consumed) return ooxml_decode_invalid;
+	if(overflow) return ooxml_decode_range;
+	*p_value = value;
+	return ooxml_decode_ok;
+}
+
+enum ooxml_decode_error ooxml_decode_double(const char *text, size_t length, double *p_value)
+{
+	static const double s_pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+	assert(p_value);
+	*p_value = NAN;
+	if(NULL == text) return ooxml_decode_empty;
+	
+	const char *p = text;
+	const char *end = text + length;
+	trim_spaces(&p, &end);
+	if(p == end) return ooxml_decode_empty;
+	const char *number = p;
+	
+	int negative = 0;
+	if(*p == '-' || *p == '+') negative = (*p++ == '-');
+	
+	struct decimal d;
+	memset(&d, 0, sizeof(d));
+	const char *digits = p;
+	p = scan_digits(&d, p, end, 0);
+	int has_digits = (p > digits);
+	if(p < end && *p == '.') {
+		digits = ++p;
+		p = scan_digits(&d, p, end, 1);
+		has_digits |= (p > digits);
+	}
+	if(!has_digits) return ooxml_decode_invalid;
+	
+	if(p < end && (*p == 'e' || *p == 'E')) {
+		++p;
+		int exp_negative = 0;
+		if(p < end && (*p == '-' || *p == '+')) exp_negative = (*p++ == '-');
+		if(p == end || !is_digit(*p)) return ooxml_decode_invalid;
+		
+		int64_t exp_value = 0;
+		for(; p < end && is_digit(*p); ++p) {
+			if(exp_value < 100000) exp_value = exp_value * 10 + (*p - '0');
+		}
+		d.exponent += exp_negative?-exp_value:exp_value;
+	}
+	if(p != end) return ooxml_decode_invalid;
+	
+	if(d.mantissa == 0 && !d.truncated) {
+		*p_value = negative?-0.0:0.0;
+		return ooxml_decode_ok;
+	}
+
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+	// Clinger's fast path: both operands are exact, so is the (single) rounding
+	if(!d.truncated && d.mantissa <= (1ULL << 53)) {
+		int64_t e = d.exponent;
+		uint64_t mantissa = d.mantissa;
+		while(e > 22 && mantissa <= ((1ULL << 53) / 10)) {
+			mantissa *= 10;
+			--e;
+		}
+		if(e >= -22 && e <= 22) {
+			double value = (double)mantissa;
+			value = (e < 0)?(value / s_pow10[-e]):(value * s_pow10[e]);
+			*p_value = negative?-value:value;
+			return ooxml_decode_ok;
+		}
+	}
+#endif
+#ifdef __SIZEOF_INT128__
+	if(!d.truncated && 0 == decimal_to_double_u128(d.mantissa, d.exponent, p_value)) {
+		if(negative) *p_value = -*p_value;
+		return ooxml_decode_ok;
+	}
+#endif
+	return decode_double_slow(number, end - number, p_value);
+}
+
+/******************************************************************************
+ * integers
+******************************************************************************/
+// [p, end) are digits without leading zeros, at most 19 of them
+static uint64_t parse_digits_u64(const char *p, const char *end)
+{
+	uint64_t value = 0;
+#ifdef CELL_DECODE_SWAR
+	while((end - p) >= 8) {
+		value = value * 100000000 + parse_eight_digits(p);
+		p += 8;
+	}
+#endif
+	for(; p < end; ++p) value = value * 10 + (*p - '0');
+	return value;
+}
+
+static const char *skip_digits(const char *p, const char *end)
+{
+#ifdef CELL_DECODE_SWAR
+	while((end - p) >= 8 && is_eight_digits(p)) p += 8;
+#endif
+	while(p < end && is_digit(*p)) ++p;
+	return p;
+}
+
+enum ooxml_decode_error ooxml_decode_int64(const char *text, size_t length, int64_t *p_value)
+{
+	assert(p_value);
+	*p_value = 0;
+	if(NULL == text) return ooxml_decode_empty;
+	
+	const char *p = text;
+	const char *end = text + length;
+	trim_spaces(&p, &end);
+	if(p == end) return ooxml_decode_empty;
+	
+	int negative = 0;
+	if(*p == '-' || *p == '+') negative = (*p++ == '-');
+	if(p == end) return ooxml_decode_invalid;
+	
+	const char *digits_end = skip_digits(p, end);
+	if(digits_end != end) return ooxml_decode_invalid;
+	while(p < end && *p == '0') ++p;
+	if((end - p) > MAX_MANTISSA_DIGITS) return ooxml_decode_range;
+	
+	uint64_t value = parse_digits_u64(p, end);
+	if(value > (uint64_t)INT64_MAX + negative) return ooxml_decode_range;
+	*p_value = negative?(int64_t)(0 - value):(int64_t)value;
+	return ooxml_decode_ok;
+}
+
+/******************************************************************************
+ * cell references
+******************************************************************************/
+enum ooxml_decode_error ooxml_decode_cell_ref(const char *ref, size_t length, int64_t *p_row, int64_t *p_col)
+{
+	assert(p_row && p_col);
+	*p_row = -1;
+	*p_col = -1;
+	if(NULL == ref) return ooxml_decode_empty;
+	
+	const char *p = ref;
+	const char *end = ref + length;
+	trim_spaces(&p, &end);
+	if(p == end) return ooxml_decode_empty;
+	
+	// columns: bijective base-26, at most 13 letters fit in an int64_t
+	int64_t col = 0;
+	const char *letters = p;
+	for(; p < end && *p >= 'A' && *p <= 'Z'; ++p) {
+		if((p - letters) >= 13) return ooxml_decode_range;
+		col = col * 26 + (*p - 'A' + 1);
+	}
+	if(p == letters || p == end) return ooxml_decode_invalid;
+	
+	const char *digits = p;
+	if(skip_digits(p, end) != end) return ooxml_decode_invalid;
+	while(digits < end && *digits == '0') ++digits;
+	if(digits == end) return ooxml_decode_invalid;	// row 0
+	if((end - digits) > (MAX_MANTISSA_DIGITS - 1)) return ooxml_decode_range;
+	
+	*p_row = (int64_t)parse_digits_u64(digits, end);
+	*p_col = col - 1;
+	return ooxml_decode_ok;
+}
+
+/******************************************************************************
+ * batch
+******************************************************************************/
+ssize_t ooxml_cells_decode_doubles(const struct ooxml_cell *cells, ssize_t num_cells, double *values, uint8_t *errors)
+{
+	assert(num_cells <= 0 || (cells && values));
+	ssize_t num_failed = 0;
+	for(ssize_t i = 0; i < num_cells; ++i) {
+		enum ooxml_decode_error err = ooxml_decode_double(cells[i].value, cells[i].cb_value, &values[i]);
+		if(err != ooxml_decode_ok) ++num_failed;
+		if(errors) errors[i] = (uint8_t)err;
+	}
+	return num_failed;
+}
+
+ssize_t ooxml_cells_decode_int64s(const struct ooxml_cell *cells, ssize_t num_cells, int64_t *values, uint8_t *errors)
+{
+	assert(num_cells <= 0 || (cells && values));
+	ssize_t num_failed = 0;
+	for(ssize_t i = 0; i < num_cells; ++i) {
+		enum ooxml_decode_error err = ooxml_decode_int64(cells[i].value, cells[i].cb_value, &values[i]);
+		if(err != ooxml_decode_ok) ++num_failed;
+		if(errors) errors[i] = (uint8_t)err;
+	}
+	return num_failed;
+}
+
+ssize_t ooxml_cells_decode_refs(const struct ooxml_cell *cells, ssize_t num_cells, int64_t row_index,
+	int64_t *rows, int64_t *cols, uint8_t *errors)
+{
+	assert(num_cells <= 0 || (cells && rows && cols));
+	ssize_t num_failed = 0;
+	for(ssize_t i = 0; i < num_cells; ++i) {
+		enum ooxml_decode_error err = ooxml_decode_ok;
+		if(cells[i].ref) {
+			err = ooxml_decode_cell_ref(cells[i].ref, strlen(cells[i].ref), &rows[i], &cols[i]);
+		}else {
+			rows[i] = row_index;
+			cols[i] = cells[i].col;
+		}
+		if(err != ooxml_decode_ok) ++num_failed;
+		if(errors) errors[i] = (uint8_t)err;
+	}
+	return num_failed;
+}
+
+
+// snprintf() with '.' as the decimal point regardless of LC_NUMERIC
+static size_t format_double(char *text, const char *format, double value)
+{
+	int cb = snprintf(text, OOXML_ENCODE_BUFFER_SIZE, format, value);
+	const char *decimal_point = localeconv()->decimal_point;
+	if(NULL == decimal_point || strcmp(decimal_point, ".") == 0 || decimal_point[0] == '\0') return cb;
+	
+	char *p = strstr(text, decimal_point);
+	if(p) {
+		size_t cb_point = strlen(decimal_point);
+		*p = '.';
+		memmove(p + 1, p + cb_point, text + cb + 1 - (p + cb_point));
+		cb -= cb_point - 1;
+	}
+	return cb;
+}
+
+size_t ooxml_encode_double(double value, char *text)
+{
+	size_t cb = format_double(text, "%.15g", value);
+	double check = 0;
+	if(ooxml_decode_double(text, cb, &check) == ooxml_decode_ok && check == value) return cb;
+	return format_double(text, "%.17g", value);
+}
+
+size_t ooxml_encode_int64(int64_t value, char *text)
+{
+	char digits[24];
+	uint64_t u = (value < 0)?(0 - (uint64_t)value):(uint64_t)value;
+	size_t n = 0;
+	do {
+		digits[n++] = '0' + (u % 10);
+		u /= 10;
+	}while(u);
+	
+	size_t cb = 0;
+	if(value < 0) text[cb++] = '-';
+	while(n) text[cb++] = digits[--n];
+	text[cb] = '\0';
+	return cb;
+}
+
+size_t ooxml_encode_cell_ref(int64_t row, int64_t col, char *text)
+{
+	char letters[16];
+	size_t n = 0;
+	for(++col; col > 0 && n < sizeof(letters); col = (col - 1) / 26) {
+		letters[n++] = 'A' + (col - 1) % 26;
+	}
+	size_t cb = 0;
+	while(n) text[cb++] = letters[--n];
+	return cb + ooxml_encode_int64(row, text + cb);
+}
+
+#if defined(TEST_OOXML_CELL_DECODE_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
@@ -34,17 +34,44 @@
 #include <libxml/xmlerror.h>
 
 #include <libgen.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <zip.h>
 #include <glib.h>
 
 
 #include "ooxml_context.h"
 #include "ooxml_private.h"
+#include "ooxml_shared_strings.h"
+#include "ooxml_styles.h"
+#include "perf_trace.h"
+#include "zip_writer.h"
 
 static int ooxml_open(struct ooxml_context *ooxml, const char *filename, int readonly);
 static void ooxml_close(struct ooxml_context *ooxml);
 static ssize_t ooxml_get_num_entries(struct ooxml_context *ooxml);
 static int ooxml_get_file(struct ooxml_context *ooxml, int index, struct ooxml_zip_file *file, int fetch_data);
+static int ooxml_private_get_file(struct ooxml_private *priv, int index, struct ooxml_zip_file *p_file, int fetch_data, struct ooxml_arena *arena);
+static struct ooxml_zip_file *ooxml_get_entry(struct ooxml_context *ooxml, int index, int fetch_data);
+static ssize_t ooxml_read_entry(struct ooxml_context *ooxml, int index, ooxml_data_callback on_data, void *user_data);
+static ssize_t ooxml_load_all(struct ooxml_context *ooxml, int num_workers);
+static ssize_t ooxml_load_entries(struct ooxml_context *ooxml, int num_workers, 
+	ooxml_progress_callback on_progress, void *user_data, volatile int *cancel);
+static struct ooxml_shared_strings *ooxml_get_shared_strings(struct ooxml_context *ooxml);
+static struct ooxml_styles *ooxml_get_styles(struct ooxml_context *ooxml);
+static const struct ooxml_dir_node *ooxml_get_dir_tree(struct ooxml_context *ooxml);
+static const struct ooxml_dir_node *ooxml_find_dir(struct ooxml_context *ooxml, const char *path);
+static const struct ooxml_part *ooxml_get_part(struct ooxml_context *ooxml, const char *name);
+static const struct ooxml_relationship *ooxml_get_relationships(struct ooxml_context *ooxml, const char *source, ssize_t *p_count);
+static const struct ooxml_relationship *ooxml_find_relationship(struct ooxml_context *ooxml, const char *source, const char *id);
+static const struct ooxml_part *ooxml_get_related_part(struct ooxml_context *ooxml, const char *source, const char *type_suffix);
+static int ooxml_put_part(struct ooxml_context *ooxml, const char *name, const void *data, size_t length);
+static int ooxml_remove_part(struct ooxml_context *ooxml, const char *name);
+static int ooxml_save(struct ooxml_context *ooxml);
+static void ooxml_private_clear_pending_parts(struct ooxml_private *priv);
 
 struct ooxml_private *ooxml_private_new(struct ooxml_context *ooxml)
 {
@@ -53,12 +80,35 @@ struct ooxml_private *ooxml_private_new(struct ooxml_context *ooxml)
 	priv->ooxml = ooxml;
 	priv->num_entries = -1;
 	
+	pthread_mutex_init(&priv->mutex, NULL);
+	pthread_cond_init(&priv->cond, NULL);
+	
 	if(ooxml) ooxml->priv = priv;
 	return priv;
 }
+static void clear_deflate_levels(struct ooxml_private *priv)
+{
+	for(int i = 0; i < priv->num_deflate_levels; ++i) free(priv->deflate_levels[i].content_type);
+	free(priv->deflate_levels);
+	priv->deflate_levels = NULL;
+	priv->num_deflate_levels = 0;
+}
 void ooxml_private_free(struct ooxml_private *priv)
 {
-	///< @todo
+	if(NULL == priv) return;
+	
+	// the archive, entry table, mapping and everything loaded from them
+	if(priv->ooxml && priv->ooxml->priv == priv) ooxml_close(priv->ooxml);
+	
+	if(priv->part_cache) {
+		ooxml_part_cache_free(priv->part_cache);
+		priv->part_cache = NULL;
+	}
+	clear_deflate_levels(priv);
+	
+	pthread_cond_destroy(&priv->cond);
+	pthread_mutex_destroy(&priv->mutex);
+	free(priv);
 }
 
 
@@ -69,10 +119,31 @@ struct ooxml_context *ooxml_context_init(struct ooxml_context *ooxml, void *user
 	assert(ooxml);
 	
 	ooxml->user_data = user_data;
+	ooxml->lazy_mode = 1;
+	ooxml->use_arena = 1;
+	ooxml->deflate_level = -1;
 	ooxml->open = ooxml_open;
 	ooxml->close = ooxml_close;
 	ooxml->get_num_entries = ooxml_get_num_entries;
 	ooxml->get_file = ooxml_get_file;
+	ooxml->get_entry = ooxml_get_entry;
+	ooxml->read_entry = ooxml_read_entry;
+	ooxml->load_all = ooxml_load_all;
+	ooxml->load_entries = ooxml_load_entries;
+	ooxml->get_shared_strings = ooxml_get_shared_strings;
+	ooxml->get_styles = ooxml_get_styles;
+	ooxml->get_dir_tree = ooxml_get_dir_tree;
+	ooxml->find_dir = ooxml_find_dir;
+	ooxml->get_part = ooxml_get_part;
+	ooxml->get_relationships = ooxml_get_relationships;
+	ooxml->find_relationship = ooxml_find_relationship;
+	ooxml->get_related_part = ooxml_get_related_part;
+	ooxml->put_part = ooxml_put_part;
+	ooxml->remove_part = ooxml_remove_part;
+	ooxml->save = ooxml_save;
+	
+	// libxml2 must be initialized on the main thread before parsing in workers
+	xmlInitParser();
 	
 	ooxml->priv = ooxml_private_new(ooxml);
 	assert(ooxml->priv);
@@ -88,9 +159,74 @@ void ooxml_context_cleanup(struct ooxml_context *ooxml)
 	return;
 }
 
-int parse_zip_xml_file(zip_t *zip, const char *filename, xmlDocPtr *p_doc)
+int ooxml_context_load_config(struct ooxml_context *ooxml, json_object *jconfig)
+{
+	assert(ooxml);
+	if(NULL == jconfig) return -1;
+	
+	json_object *jvalue = NULL;
+	if(json_object_object_get_ex(jconfig, "lazy_mode", &jvalue)) {
+		ooxml->lazy_mode = json_object_get_boolean(jvalue);
+	}
+	if(json_object_object_get_ex(jconfig, "num_workers", &jvalue)) {
+		ooxml->num_workers = json_object_get_int(jvalue);
+	}
+	if(json_object_object_get_ex(jconfig, "lazy_shared_strings", &jvalue)) {
+		ooxml->lazy_shared_strings = json_object_get_boolean(jvalue);
+	}
+	if(json_object_object_get_ex(jconfig, "use_mmap", &jvalue)) {
+		ooxml->use_mmap = json_object_get_boolean(jvalue);
+	}
+	if(json_object_object_get_ex(jconfig, "use_arena", &jvalue)) {
+		ooxml->use_arena = json_object_get_boolean(jvalue);
+	}
+	if(json_object_object_get_ex(jconfig, "save_workers", &jvalue)) {
+		ooxml->save_workers = json_object_get_int(jvalue);
+	}
+	if(json_object_object_get_ex(jconfig, "deflate_level", &jvalue)) {
+		ooxml->deflate_level = json_object_get_int(jvalue);
+	}
+	
+	// per content type: { "image/*": 0, "application/vnd.openxmlformats-officedocument.spreadsheetml.worksheet+xml": 1 }
+	if(json_object_object_get_ex(jconfig, "deflate_levels", &jvalue) && json_object_is_type(jvalue, json_type_object)) {
+		struct ooxml_private *priv = ooxml->priv;
+		assert(priv);
+		clear_deflate_levels(priv);	// the rules of a reloaded config replace the previous ones
+		json_object_object_foreach(jvalue, content_type, jlevel) {
+			priv->deflate_levels = realloc(priv->deflate_levels, (priv->num_deflate_levels + 1) * sizeof(*priv->deflate_levels));
+			assert(priv->deflate_levels);
+			priv->deflate_levels[priv->num_deflate_levels].content_type = strdup(content_type);
+			priv->deflate_levels[priv->num_deflate_levels].level = json_object_get_int(jlevel);
+			++priv->num_deflate_levels;
+		}
+	}
+	
+	// persistent part cache: "cache_dir" (disabled if not set), "cache_max_size" (bytes, default 1 GiB)
+	if(json_object_object_get_ex(jconfig, "cache_dir", &jvalue)) {
+		struct ooxml_private *priv = ooxml->priv;
+		assert(priv);
+		
+		int64_t max_size = 1LL << 30;
+		json_object *jmax_size = NULL;
+		if(json_object_object_get_ex(jconfig, "cache_max_size", &jmax_size)) {
+			max_size = json_object_get_int64(jmax_size);
+		}
+		
+		ooxml_part_cache_free(priv->part_cache);
+		priv->part_cache = ooxml_part_cache_new(json_object_get_string(jvalue), max_size);
+	}
+	return 0;
+}
+
+/*
+ * feed the (inflated) part to a push parser chunk by chunk.
+ * if sax is NULL, a DOM is built and returned in *p_doc,
+ * otherwise the SAX callbacks receive the parser context as their ctx, 
+ * and user_data is available in ctxt->_private. A callback can stop the parser with xmlStopParser().
+ */
+int parse_zip_xml_stream(zip_t *zip, const char *filename, xmlSAXHandler *sax, void *user_data, xmlDocPtr *p_doc)
 {
-	char buffer[4096] = "";
+	char buffer[65536] = "";
 	ssize_t cb_data = 0;
 	xmlParserCtxtPtr parser = NULL;
 	
@@ -102,21 +238,24 @@ int parse_zip_xml_file(zip_t *zip, const char *filename, xmlDocPtr *p_doc)
 		return -1;
 	}
 	
+	PERF_TRACE_BEGIN(span);
+	
 	// read a few bytes to check the format */
 	cb_data = zip_fread(zfp, buffer, 8);
-	parser = xmlCreatePushParserCtxt(NULL, NULL, buffer, cb_data, filename);
+	parser = xmlCreatePushParserCtxt(sax, NULL, buffer, cb_data, filename);
 	if(NULL == parser) {
 		fprintf(stderr, "xmlCreatePushParserCtxt() failed\n");
 		zip_fclose(zfp);
 		return -1;
 	}
+	parser->_private = user_data;
 	
 	xmlParserErrors err_code = XML_ERR_OK;
 	while((cb_data = zip_fread(zfp, buffer, sizeof(buffer) - 1))  > 0)
 	{
 		err_code = xmlParseChunk(parser, buffer, cb_data, 0);
 		if(err_code != XML_ERR_OK) {
-			fprintf(stderr, "xmlParseChunk() failed.\n");
+			if(err_code != XML_ERR_USER_STOP) fprintf(stderr, "xmlParseChunk() failed.\n");
 			break;
 		}
 	}
@@ -130,15 +269,195 @@ int parse_zip_xml_file(zip_t *zip, const char *filename, xmlDocPtr *p_doc)
 	int wellFormed = parser->wellFormed;
 	xmlFreeParserCtxt(parser);
 	
+	PERF_TRACE_END(span, "parse_zip_xml_stream", filename);
+	
+	if(err_code == XML_ERR_USER_STOP) wellFormed = 1;
 	if(wellFormed) {
-		*p_doc = doc;
+		if(p_doc) *p_doc = doc;
+		else if(doc) xmlFreeDoc(doc);
 		return 0;
 	}
 	
-	xmlFreeDoc(doc);
+	if(doc) xmlFreeDoc(doc);
 	return -1;
 }
 
+int parse_zip_xml_file(zip_t *zip, const char *filename, xmlDocPtr *p_doc)
+{
+	return parse_zip_xml_stream(zip, filename, NULL, NULL, p_doc);
+}
+
+
+/*
+ * map the whole archive and open it from a buffer source,
+ * the central directory is parsed once more to locate the data of each entry.
+ */
+static zip_t *ooxml_private_map_archive(struct ooxml_private *priv, const char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if(fd == -1) {
+		perror("open()");
+		return NULL;
+	}
+	
+	struct stat st[1];
+	memset(st, 0, sizeof(st));
+	if(fstat(fd, st) != 0 || st->st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+	
+	unsigned char *map = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		perror("mmap()");
+		return NULL;
+	}
+	
+	zip_error_t error;
+	zip_error_init(&error);
+	zip_source_t *src = zip_source_buffer_create(map, st->st_size, 0, &error);
+	zip_t *zip = NULL;
+	if(src) {
+		zip = zip_open_from_source(src, ZIP_RDONLY, &error);
+		if(NULL == zip) zip_source_free(src);
+	}
+	if(NULL == zip) {
+		fprintf(stderr, "zip_open_from_source(%s) failed: %s\n", filename, zip_error_strerror(&error));
+		zip_error_fini(&error);
+		munmap(map, st->st_size);
+		return NULL;
+	}
+	zip_error_fini(&error);
+	
+	priv->map = map;
+	priv->cb_map = st->st_size;
+	priv->num_dir_entries = zip_directory_parse(map, st->st_size, &priv->dir_entries);
+	if(priv->num_dir_entries < 0) priv->dir_entries = NULL;
+	return zip;
+}
+
+/*
+ * open another handle on the current archive (libzip handles are not thread-safe)
+ */
+static zip_t *ooxml_private_open_archive(struct ooxml_private *priv)
+{
+	zip_t *zip = NULL;
+	if(priv->map) {
+		zip_source_t *src = zip_source_buffer_create(priv->map, priv->cb_map, 0, NULL);
+		if(src) {
+			zip = zip_open_from_source(src, ZIP_RDONLY, NULL);
+			if(NULL == zip) zip_source_free(src);
+		}
+	}else {
+		int err_code = 0;
+		zip = zip_open(priv->filename, ZIP_RDONLY, &err_code);
+	}
+	return zip;
+}
+
+/*
+ * part registry: [Content_Types].xml and the relationship parts are parsed once,
+ * the type of the archive is the kind of its main part (officeDocument relationship).
+ */
+struct part_buffer
+{
+	char *data;
+	size_t length;
+	size_t max_size;
+};
+
+static void part_buffer_reserve(struct part_buffer *buffer, size_t size)
+{
+	if(size <= buffer->max_size) return;
+	size_t new_size = (size + 4095) & ~(size_t)4095;
+	char *p = realloc(buffer->data, new_size);
+	assert(p);
+	buffer->data = p;
+	buffer->max_size = new_size;
+}
+
+static int on_read_part(void *user_data, const unsigned char *data, size_t length)
+{
+	struct part_buffer *buffer = user_data;
+	part_buffer_reserve(buffer, buffer->length + length);
+	memcpy(buffer->data + buffer->length, data, length);
+	buffer->length += length;
+	return 0;
+}
+
+static ssize_t ooxml_read_entry_mapped(struct ooxml_private *priv, const struct ooxml_zip_file *file, 
+	ooxml_data_callback on_data, void *user_data);
+
+/*
+ * open() is single-threaded: the parts are read from the mapping, or through the archive's own handle
+ * (read_entry() would open a new handle, and parse the central directory again, per part)
+ */
+static int ooxml_private_read_part(struct ooxml_private *priv, const struct ooxml_zip_file *file, struct part_buffer *buffer)
+{
+	buffer->length = 0;
+	if(file->file_length == 0) return 0;
+	if(ooxml_read_entry_mapped(priv, file, on_read_part, buffer) >= 0) return 0;
+	
+	buffer->length = 0;
+	zip_file_t *zfp = zip_fopen_index(priv->archive, file->index, ZIP_FL_UNCHANGED);
+	if(NULL == zfp) {
+		fprintf(stderr, "%s(%s) failed: %s\n", __FUNCTION__, file->filename, zip_strerror(priv->archive));
+		return -1;
+	}
+	part_buffer_reserve(buffer, file->file_length);
+	ssize_t cb_data = zip_fread(zfp, buffer->data, file->file_length);
+	zip_fclose(zfp);
+	if(cb_data < 0 || (size_t)cb_data != file->file_length) return -1;
+	
+	buffer->length = cb_data;
+	return 0;
+}
+
+static int is_relationships_part_name(const char *name)
+{
+	size_t length = strlen(name);
+	if(length < sizeof(".rels") - 1 || strcasecmp(name + length - (sizeof(".rels") - 1), ".rels") != 0) return 0;
+	return strncmp(name, "_rels/", 6) == 0 || strstr(name, "/_rels/") != NULL;
+}
+
+static void ooxml_private_build_part_registry(struct ooxml_private *priv)
+{
+	struct ooxml_context *ooxml = priv->ooxml;
+	PERF_TRACE_BEGIN(span);
+	struct ooxml_part_registry *registry = ooxml_part_registry_new();
+	struct part_buffer buffer;
+	memset(&buffer, 0, sizeof(buffer));
+	
+	// the content types first, the kind of every part depends on them
+	for(int pass = 0; pass < 2; ++pass) {
+		for(ssize_t i = 0; i < priv->num_entries; ++i) {
+			const char *name = priv->entries[i].filename;
+			if(NULL == name) continue;
+			if(0 == pass && strcmp(name, "[Content_Types].xml") != 0) continue;
+			if(1 == pass && !is_relationships_part_name(name)) continue;
+			
+			if(ooxml_private_read_part(priv, &priv->entries[i], &buffer) != 0) continue;
+			if(0 == pass) ooxml_part_registry_load_content_types(registry, buffer.data, buffer.length);
+			else ooxml_part_registry_load_relationships(registry, name, buffer.data, buffer.length);
+		}
+	}
+	free(buffer.data);
+	
+	ooxml_part_registry_add_parts(registry, priv->num_entries, priv->entries);
+	priv->part_registry = registry;
+	
+	const struct ooxml_part *main_part = ooxml_get_related_part(ooxml, "", "officeDocument");
+	enum ooxml_part_kind kind = main_part?main_part->kind:ooxml_part_kind_unknown;
+	if(kind != ooxml_part_kind_document && kind != ooxml_part_kind_workbook) {	// not declared, the usual names
+		if(ooxml_get_part(ooxml, "word/document.xml")) kind = ooxml_part_kind_document;
+		else if(ooxml_get_part(ooxml, "xl/workbook.xml")) kind = ooxml_part_kind_workbook;
+	}
+	ooxml->type = (kind == ooxml_part_kind_document)?ooxml_file_document
+		:(kind == ooxml_part_kind_workbook)?ooxml_file_spreadsheet
+		:ooxml_file_unknown;
+	PERF_TRACE_END(span, "part_registry_build", priv->filename);
+}
 
 static int ooxml_open(struct ooxml_context *ooxml, const char *filename, int readonly)
 {
@@ -149,8 +468,13 @@ static int ooxml_open(struct ooxml_context *ooxml, const char *filename, int rea
 		ooxml->close(ooxml);
 	}
 	
+	PERF_TRACE_BEGIN(span);
 	int err_code = 0;
-	zip_t *zip = zip_open(filename, readonly?ZIP_RDONLY:0, &err_code);
+	zip_t *zip = NULL;
+	if(readonly && ooxml->use_mmap) {
+		zip = ooxml_private_map_archive(priv, filename);
+	}
+	if(NULL == zip) zip = zip_open(filename, readonly?ZIP_RDONLY:0, &err_code);
 	if(NULL == zip || err_code) {
 		fprintf(stderr, "zip_open(%s) failed, err_code=%d\n", 
 			filename,
@@ -160,6 +484,33 @@ static int ooxml_open(struct ooxml_context *ooxml, const char *filename, int rea
 	}
 	
 	priv->archive = zip;
+	priv->filename = strdup(filename);
+	priv->readonly = readonly;
+	if(priv->part_cache) priv->archive_id = ooxml_part_cache_archive_id(filename);
+	if(ooxml->use_arena) priv->arena = ooxml_arena_new(64 * 1024);
+	
+	// build the entry table (central directory only)
+	ssize_t num_entries = ooxml_get_num_entries(ooxml);
+	if(num_entries > 0) {
+		struct ooxml_zip_file *entries = calloc(num_entries, sizeof(*entries));
+		assert(entries);
+		priv->entries = entries;
+		
+		priv->entry_states = calloc(num_entries, sizeof(*priv->entry_states));
+		assert(priv->entry_states);
+		
+		for(ssize_t i = 0; i < num_entries; ++i) {
+			ooxml_private_get_file(priv, i, &entries[i], 0, priv->arena);
+		}
+	}
+	ooxml_private_build_part_registry(priv);
+	
+	if(num_entries > 0) {
+		if(!ooxml->lazy_mode) {
+			ooxml_load_all(ooxml, ooxml->num_workers);
+		}
+	}
+	PERF_TRACE_END(span, "ooxml_open", filename);
 	return 0;
 }
 static void ooxml_close(struct ooxml_context *ooxml)
@@ -167,9 +518,61 @@ static void ooxml_close(struct ooxml_context *ooxml)
 	struct ooxml_private *priv = ooxml->priv;
 	assert(priv);
 	if(priv->archive) {
+		// nothing is staged in the handle, unsaved changes are dropped (see save())
 		zip_close(priv->archive);
 		priv->archive = NULL;
 	}
+	ooxml_private_clear_pending_parts(priv);
+	
+	if(priv->entries) {
+		for(ssize_t i = 0; i < priv->num_entries; ++i) {
+			ooxml_zip_file_clear(&priv->entries[i]);
+		}
+		free(priv->entries);
+		priv->entries = NULL;
+	}
+	if(priv->arena) {
+		ooxml_arena_free(priv->arena);
+		priv->arena = NULL;
+	}
+	if(priv->dir_index) {
+		ooxml_dir_index_free(priv->dir_index);
+		priv->dir_index = NULL;
+	}
+	if(priv->part_registry) {
+		ooxml_part_registry_free(priv->part_registry);
+		priv->part_registry = NULL;
+	}
+	if(priv->shared_strings) {
+		ooxml_shared_strings_free(priv->shared_strings);
+		priv->shared_strings = NULL;
+	}
+	if(priv->styles) {
+		ooxml_styles_free(priv->styles);
+		priv->styles = NULL;
+	}
+	if(priv->entry_states) {
+		free(priv->entry_states);
+		priv->entry_states = NULL;
+	}
+	if(priv->filename) {
+		free(priv->filename);
+		priv->filename = NULL;
+	}
+	if(priv->archive_id) {
+		free(priv->archive_id);
+		priv->archive_id = NULL;
+	}
+	if(priv->dir_entries) {
+		free(priv->dir_entries);
+		priv->dir_entries = NULL;
+	}
+	if(priv->map) {
+		munmap(priv->map, priv->cb_map);
+		priv->map = NULL;
+		priv->cb_map = 0;
+	}
+	priv->num_dir_entries = 0;
 	
 	if(priv->file_stats) free(priv->file_stats);
 	priv->num_entries = -1;
@@ -185,6 +588,7 @@ static ssize_t ooxml_get_num_entries(struct ooxml_context *ooxml)
 	if(NULL == zip) return -1;
 	
 	if(priv->num_entries < 0) {
+		PERF_TRACE_BEGIN(span);
 		ssize_t num_entries = zip_get_num_entries(zip, ZIP_FL_UNCHANGED);
 		if(num_entries > 0) {
 			struct zip_stat *stats = calloc(num_entries, sizeof(*stats));
@@ -196,6 +600,7 @@ static ssize_t ooxml_get_num_entries(struct ooxml_context *ooxml)
 			}
 		}
 		priv->num_entries = num_entries;
+		PERF_TRACE_END(span, "zip_stat_index", priv->filename);
 	}
 	return priv->num_entries;
 }
@@ -203,18 +608,195 @@ static ssize_t ooxml_get_num_entries(struct ooxml_context *ooxml)
 void ooxml_zip_file_clear(struct ooxml_zip_file *file)
 {
 	if(NULL == file) return;
+	if(file->in_arena) {	// bulk freed with the arena
+		memset(file, 0, sizeof(*file));
+		return;
+	}
 	if(file->filename) free(file->filename);
-	if(file->data) free(file->data);
+	if(file->data && !file->is_mapped) free(file->data);
 	if(file->doc) {
 		xmlFreeDoc(file->doc);
 	}
 	memset(file, 0, sizeof(*file));
 }
 
-static int ooxml_get_file(struct ooxml_context *ooxml, int index, struct ooxml_zip_file *p_file, int fetch_data)
+/*
+ * mmap mode: stored entries point into the mapping, deflated entries are inflated straight from it.
+ * returns -1 if the entry must be read through libzip.
+ */
+static int ooxml_zip_file_load_mapped(struct ooxml_private *priv, struct ooxml_zip_file *file, struct ooxml_arena *arena)
+{
+	if(NULL == priv->map || NULL == priv->dir_entries) return -1;
+	if(file->index >= priv->num_dir_entries) return -1;
+	
+	const struct zip_directory_entry *entry = &priv->dir_entries[file->index];
+	if(entry->flags & 0x01) return -1;	// encrypted
+	if(entry->size != file->file_length) return -1;
+	if(entry->cb_name != strlen(file->filename) || memcmp(entry->name, file->filename, entry->cb_name) != 0) return -1;
+	
+	const unsigned char *comp_data = zip_directory_get_data(priv->map, priv->cb_map, entry);
+	if(NULL == comp_data) return -1;
+	
+	if(entry->method == 0) {
+		if(entry->comp_size != entry->size) return -1;
+		file->data = (unsigned char *)comp_data;
+		file->cb_data = entry->size;
+		file->is_mapped = 1;
+		return 0;
+	}
+	if(entry->method != 8) return -1;
+	
+	unsigned char *data = arena?ooxml_arena_alloc(arena, entry->size + 1):malloc(entry->size + 1);
+	assert(data);
+	if(zip_directory_inflate(comp_data, entry, data) != 0) {
+		fprintf(stderr, "inflate(%s) failed\n", file->filename);
+		if(NULL == arena) free(data);
+		return -1;
+	}
+	data[entry->size] = '\0';
+	file->data = data;
+	file->cb_data = entry->size;
+	return 0;
+}
+
+static int64_t count_xml_nodes(xmlNodePtr node)
+{
+	int64_t num_nodes = 0;
+	while(node) {
+		++num_nodes;
+		if(node->children) {
+			node = node->children;
+			continue;
+		}
+		while(node && NULL == node->next) node = node->parent;
+		if(node) node = node->next;
+	}
+	return num_nodes;
+}
+
+static int ooxml_part_cache_key_init(struct ooxml_private *priv, const struct ooxml_zip_file *file, struct ooxml_part_cache_key *key)
+{
+	if(NULL == priv->part_cache || NULL == priv->archive_id) return -1;
+	if(file->index >= (uint64_t)priv->num_entries) return -1;
+	
+	const zip_stat_t *stats = &priv->file_stats[file->index];
+	if(0 == (stats->valid & ZIP_STAT_CRC)) return -1;
+	
+	key->archive = priv->archive_id;
+	key->name = file->filename;
+	key->crc = stats->crc;
+	key->size = file->file_length;
+	return 0;
+}
+
+static int ooxml_zip_file_load_cached(struct ooxml_private *priv, struct ooxml_zip_file *file, struct ooxml_arena *arena)
+{
+	struct ooxml_part_cache_key key;
+	if(ooxml_part_cache_key_init(priv, file, &key) != 0) return -1;
+	
+	struct ooxml_arena *prev_arena = NULL;
+	if(arena) {
+		xmlGetLastError();
+		prev_arena = ooxml_arena_set_current(arena);
+	}
+	
+	PERF_TRACE_BEGIN(span);
+	int rc = ooxml_part_cache_load(priv->part_cache, &key, &file->data, &file->cb_data, &file->doc, arena);
+	if(0 == rc) PERF_TRACE_END(span, "part_cache_load", file->filename);
+	
+	if(arena) {
+		xmlResetLastError();
+		ooxml_arena_set_current(prev_arena);
+	}
+	return rc;
+}
+
+// only the parts handled as DOM are given to the xml parser (and the ones the registry does not know)
+static int ooxml_private_is_dom_part(struct ooxml_private *priv, const struct ooxml_zip_file *file)
+{
+	const struct ooxml_part *part = ooxml_part_registry_get_part_by_index(priv->part_registry, file->index);
+	return NULL == part || part->handler == ooxml_part_handler_dom;
+}
+
+/*
+ * if arena is not NULL, the part data and all libxml2 allocations of the parse come from it.
+ * the arena is used by the calling thread only.
+ * with a part cache, a hit is neither inflated nor parsed, a miss is stored after parsing.
+ * streamed xml parts, media and binaries are only inflated.
+ */
+static int ooxml_zip_file_load(struct ooxml_private *priv, zip_t *zip, struct ooxml_zip_file *file, struct ooxml_arena *arena)
+{
+	if(file->is_loaded) return 0;
+	if(file->file_length > 0 && ooxml_zip_file_load_cached(priv, file, arena) == 0) {
+		file->is_loaded = 1;
+		PERF_TRACE_COUNT(parts_loaded, 1);
+		PERF_TRACE_COUNT(parts_cached, 1);
+		return 0;
+	}
+	if(file->file_length > 0) {
+		PERF_TRACE_BEGIN(read_span);
+		if(ooxml_zip_file_load_mapped(priv, file, arena) == 0) {
+			PERF_TRACE_END(read_span, "inflate_mapped", file->filename);
+		}else {
+			unsigned char *data = arena?ooxml_arena_alloc(arena, file->file_length + 1):malloc(file->file_length + 1);
+			assert(data);
+			
+			zip_file_t *zfp = zip_fopen_index(zip, file->index, ZIP_FL_UNCHANGED);
+			assert(zfp);
+			
+			ssize_t cb_data = zip_fread(zfp, data, file->file_length);
+			assert(cb_data == file->file_length);
+			data[cb_data] = '\0';
+			zip_fclose(zfp);
+			
+			file->data = data;
+			file->cb_data = cb_data;
+			PERF_TRACE_END(read_span, "zip_fread", file->filename);
+		}
+		PERF_TRACE_COUNT(bytes_inflated, file->cb_data);
+		
+		if(ooxml_private_is_dom_part(priv, file)) {
+			struct ooxml_arena *prev_arena = NULL;
+			if(arena) {
+				xmlGetLastError();	// the thread's libxml2 state must not be allocated from the arena
+				prev_arena = ooxml_arena_set_current(arena);
+			}
+			
+			PERF_TRACE_BEGIN(parse_span);
+			file->doc = xmlReadMemory((const char *)file->data, file->cb_data, file->filename, "utf-8", XML_PARSE_NONET);
+			PERF_TRACE_END(parse_span, "xmlReadMemory", file->filename);
+			
+			if(arena) {
+				xmlResetLastError();	// its message was allocated from the arena
+				ooxml_arena_set_current(prev_arena);
+			}
+			if(g_perf_trace_enabled && file->doc) {
+				PERF_TRACE_COUNT(nodes_parsed, count_xml_nodes(file->doc->children));
+			}
+		}else {
+			PERF_TRACE_COUNT(parts_unparsed, 1);
+		}
+		
+		// stored parts of a mapped archive are not copied, only their DOM is worth caching
+		struct ooxml_part_cache_key key;
+		if((file->doc || !file->is_mapped) && ooxml_part_cache_key_init(priv, file, &key) == 0) {
+			PERF_TRACE_BEGIN(store_span);
+			if(ooxml_part_cache_store(priv->part_cache, &key, file->data, file->cb_data, file->doc) == 0) {
+				PERF_TRACE_END(store_span, "part_cache_store", file->filename);
+			}
+		}
+	}
+	file->is_loaded = 1;
+	PERF_TRACE_COUNT(parts_loaded, 1);
+	return 0;
+}
+
+/*
+ * fill *p_file from the central directory,
+ * with an arena, the filename (and the data if fetch_data) are allocated from it.
+ */
+static int ooxml_private_get_file(struct ooxml_private *priv, int index, struct ooxml_zip_file *p_file, int fetch_data, struct ooxml_arena *arena)
 {
-	struct ooxml_private *priv = ooxml->priv;
-	assert(priv);
 	zip_t *zip = priv->archive;
 	if(NULL == zip) return -1;
 	if(priv->num_entries <= 0) return -1;
@@ -233,40 +815,664 @@ static int ooxml_get_file(struct ooxml_context *ooxml, int index, struct ooxml_z
 		return -1;
 	}
 	
-	file.filename = strdup(stats->name);
+	file.filename = arena?ooxml_arena_strdup(arena, stats->name):strdup(stats->name);
 	file.file_length = stats->size;
+	file.in_arena = (NULL != arena);
 	
 	if(stats->valid & ZIP_STAT_MTIME) file.mtime = stats->mtime;
+	file.index = index;
 	if(stats->valid & ZIP_STAT_INDEX) file.index = stats->index;
 	
-	if(fetch_data && (file.file_length > 0)) {
-		unsigned char *data = malloc(file.file_length + 1);
-		assert(data);
-		
-		zip_file_t *zfp = zip_fopen_index(zip, index, ZIP_FL_UNCHANGED);
-		assert(zfp);
+	if(fetch_data) ooxml_zip_file_load(priv, zip, &file, arena);
+	
+	if(p_file) *p_file = file;
+	else ooxml_zip_file_clear(&file);
+	
+	return 0;
+}
+
+static int ooxml_get_file(struct ooxml_context *ooxml, int index, struct ooxml_zip_file *p_file, int fetch_data)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	
+	// the caller owns *p_file, it is not tied to the archive's arena
+	return ooxml_private_get_file(priv, index, p_file, fetch_data, NULL);
+}
+
+/*
+ * claim an entry for loading.
+ * returns 1 if the caller owns the entry and must load it, 0 if it is already loaded.
+ * if wait == 0, also returns 0 when another thread is loading it.
+ */
+static int ooxml_private_claim_entry(struct ooxml_private *priv, int index, int wait)
+{
+	int claimed = 0;
+	pthread_mutex_lock(&priv->mutex);
+	while(wait && priv->entry_states[index] == ooxml_entry_state_loading) {
+		pthread_cond_wait(&priv->cond, &priv->mutex);
+	}
+	if(priv->entry_states[index] == ooxml_entry_state_unloaded) {
+		priv->entry_states[index] = ooxml_entry_state_loading;
+		claimed = 1;
+	}
+	pthread_mutex_unlock(&priv->mutex);
+	return claimed;
+}
+static void ooxml_private_release_entry(struct ooxml_private *priv, int index)
+{
+	pthread_mutex_lock(&priv->mutex);
+	priv->entry_states[index] = ooxml_entry_state_loaded;
+	pthread_cond_broadcast(&priv->cond);
+	pthread_mutex_unlock(&priv->mutex);
+}
+
+static struct ooxml_zip_file *ooxml_get_entry(struct ooxml_context *ooxml, int index, int fetch_data)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	if(NULL == priv->archive || NULL == priv->entries) return NULL;
+	if(index < 0 || index >= priv->num_entries) return NULL;
+	
+	struct ooxml_zip_file *file = &priv->entries[index];
+	if(fetch_data && ooxml_private_claim_entry(priv, index, 1)) {
+		// a private arena for this load, merged into the archive's one afterwards
+		struct ooxml_arena *arena = priv->arena?ooxml_arena_new(file->file_length * 4):NULL;
+		ooxml_zip_file_load(priv, priv->archive, file, arena);
+		if(arena) ooxml_arena_adopt(priv->arena, arena);
+		ooxml_private_release_entry(priv, index);
+	}
+	return file;
+}
+
+/******************************************************************************
+ * read_entry: chunked read of a single entry
+******************************************************************************/
+#define OOXML_READ_CHUNK_SIZE	(64 * 1024)
+
+static ssize_t read_buffer_chunks(const unsigned char *data, size_t length, ooxml_data_callback on_data, void *user_data)
+{
+	size_t offset = 0;
+	while(offset < length) {
+		size_t cb_chunk = length - offset;
+		if(cb_chunk > OOXML_READ_CHUNK_SIZE) cb_chunk = OOXML_READ_CHUNK_SIZE;
+		offset += cb_chunk;
+		if(on_data(user_data, data + offset - cb_chunk, cb_chunk)) break;
+	}
+	return offset;
+}
+
+static ssize_t ooxml_read_entry_mapped(struct ooxml_private *priv, const struct ooxml_zip_file *file, 
+	ooxml_data_callback on_data, void *user_data)
+{
+	if(NULL == priv->map || NULL == priv->dir_entries) return -1;
+	if(file->index >= priv->num_dir_entries) return -1;
+	
+	const struct zip_directory_entry *entry = &priv->dir_entries[file->index];
+	if(entry->flags & 0x01) return -1;	// encrypted
+	if(entry->cb_name != strlen(file->filename) || memcmp(entry->name, file->filename, entry->cb_name) != 0) return -1;
+	
+	const unsigned char *comp_data = zip_directory_get_data(priv->map, priv->cb_map, entry);
+	if(NULL == comp_data) return -1;
+	
+	if(entry->method == 0) {
+		if(entry->comp_size != entry->size) return -1;
+		return read_buffer_chunks(comp_data, entry->size, on_data, user_data);
+	}
+	if(entry->method != 8) return -1;
+	
+	unsigned char *buffer = malloc(OOXML_READ_CHUNK_SIZE);
+	assert(buffer);
+	ssize_t cb_total = zip_directory_inflate_chunks(comp_data, entry, buffer, OOXML_READ_CHUNK_SIZE, on_data, user_data);
+	free(buffer);
+	return cb_total;
+}
+
+// counts what has reached the caller's callback
+struct read_counter
+{
+	ooxml_data_callback on_data;
+	void *user_data;
+	size_t cb_delivered;
+};
+
+static int on_counted_data(void *user_data, const unsigned char *data, size_t length)
+{
+	struct read_counter *counter = user_data;
+	counter->cb_delivered += length;
+	return counter->on_data(counter->user_data, data, length);
+}
+
+static ssize_t ooxml_read_entry(struct ooxml_context *ooxml, int index, ooxml_data_callback on_data, void *user_data)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv && on_data);
+	if(NULL == priv->archive || NULL == priv->entries) return -1;
+	if(index < 0 || index >= priv->num_entries) return -1;
+	
+	const struct ooxml_zip_file *file = &priv->entries[index];
+	if(file->file_length == 0) return 0;
+	
+	pthread_mutex_lock(&priv->mutex);
+	int is_loaded = (priv->entry_states[index] == ooxml_entry_state_loaded);
+	pthread_mutex_unlock(&priv->mutex);
+	
+	PERF_TRACE_BEGIN(span);
+	ssize_t cb_total = -1;
+	if(is_loaded && file->data) {
+		cb_total = read_buffer_chunks(file->data, file->cb_data, on_data, user_data);
+	}else {
+		struct read_counter counter = { .on_data = on_data, .user_data = user_data };
+		cb_total = ooxml_read_entry_mapped(priv, file, on_counted_data, &counter);
 		
-		ssize_t cb_data = zip_fread(zfp, data, file.file_length);
-		assert(cb_data == file.file_length);
-		data[cb_data] = '\0';
+		// a corrupt stream (or crc mismatch) found after some data was delivered: reading again would repeat it
+		if(cb_total < 0 && counter.cb_delivered > 0) {
+			fprintf(stderr, "read_entry(%s) failed after %lu bytes\n", file->filename, (unsigned long)counter.cb_delivered);
+			return -1;
+		}
+	}
+	
+	if(cb_total < 0) {
+		// libzip handles are not thread-safe, use a private one
+		zip_t *zip = ooxml_private_open_archive(priv);
+		zip_file_t *zfp = zip?zip_fopen_index(zip, file->index, ZIP_FL_UNCHANGED):NULL;
+		if(zfp) {
+			unsigned char *buffer = malloc(OOXML_READ_CHUNK_SIZE);
+			assert(buffer);
+			
+			ssize_t cb_data = 0;
+			cb_total = 0;
+			while((cb_data = zip_fread(zfp, buffer, OOXML_READ_CHUNK_SIZE)) > 0) {
+				cb_total += cb_data;
+				if(on_data(user_data, buffer, cb_data)) break;
+			}
+			if(cb_data < 0) cb_total = -1;
+			free(buffer);
+			zip_fclose(zfp);
+		}else {
+			fprintf(stderr, "read_entry(%s) failed\n", file->filename);
+		}
+		if(zip) zip_close(zip);
+	}
+	PERF_TRACE_END(span, "read_entry", file->filename);
+	if(cb_total > 0) PERF_TRACE_COUNT(bytes_inflated, cb_total);
+	return cb_total;
+}
+
+/******************************************************************************
+ * load_all: parallel inflate and parse
+ * 
+ * libzip handles are not thread-safe, each worker opens its own zip_t 
+ * and picks the next unclaimed entry from a shared counter.
+******************************************************************************/
+struct load_worker_context
+{
+	struct ooxml_private *priv;
+	pthread_t th;
+	volatile int *next_index;
+	volatile ssize_t *num_done;
+	ssize_t num_loaded;
+	int err_code;
+	
+	ooxml_progress_callback on_progress;
+	void *user_data;
+	volatile int *cancel;
+};
+
+static void *load_worker_thread(void *user_data)
+{
+	struct load_worker_context *worker = user_data;
+	struct ooxml_private *priv = worker->priv;
+	
+	zip_t *zip = ooxml_private_open_archive(priv);
+	if(NULL == zip) {
+		fprintf(stderr, "[worker]::open archive(%s) failed\n", priv->filename);
+		worker->err_code = -1;
+		pthread_exit((void *)(long)-1);
+	}
+	
+	// one arena per worker, no allocator contention between workers
+	struct ooxml_arena *arena = priv->arena?ooxml_arena_new(1024 * 1024):NULL;
+	while(NULL == worker->cancel || !*worker->cancel) {
+		int index = __sync_fetch_and_add(worker->next_index, 1);
+		if(index >= priv->num_entries) break;
+		if(ooxml_private_claim_entry(priv, index, 0)) {
+			ooxml_zip_file_load(priv, zip, &priv->entries[index], arena);
+			ooxml_private_release_entry(priv, index);
+			++worker->num_loaded;
+		}
 		
-		file.data = data;
-		file.cb_data = cb_data;
+		ssize_t num_done = __sync_add_and_fetch(worker->num_done, 1);
+		if(worker->on_progress) worker->on_progress(worker->user_data, num_done, priv->num_entries);
+	}
+	if(arena) ooxml_arena_adopt(priv->arena, arena);
+	
+	zip_close(zip);
+	pthread_exit((void *)(long)0);
+}
+
+static ssize_t ooxml_load_all(struct ooxml_context *ooxml, int num_workers)
+{
+	return ooxml_load_entries(ooxml, num_workers, NULL, NULL, NULL);
+}
+
+static ssize_t ooxml_load_entries(struct ooxml_context *ooxml, int num_workers, 
+	ooxml_progress_callback on_progress, void *user_data, volatile int *cancel)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	if(NULL == priv->archive || NULL == priv->filename) return -1;
+	if(priv->num_entries <= 0) return 0;
+	
+	if(num_workers <= 0) num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if(num_workers <= 0) num_workers = 1;
+	if(num_workers > priv->num_entries) num_workers = priv->num_entries;
+	
+	PERF_TRACE_BEGIN(span);
+	volatile int next_index = 0;
+	volatile ssize_t num_done = 0;
+	struct load_worker_context *workers = calloc(num_workers, sizeof(*workers));
+	assert(workers);
+	
+	int rc = 0;
+	for(int i = 0; i < num_workers; ++i) {
+		workers[i].priv = priv;
+		workers[i].next_index = &next_index;
+		workers[i].num_done = &num_done;
+		workers[i].on_progress = on_progress;
+		workers[i].user_data = user_data;
+		workers[i].cancel = cancel;
+		rc = pthread_create(&workers[i].th, NULL, load_worker_thread, &workers[i]);
+		assert(0 == rc);
+	}
+	
+	ssize_t num_loaded = 0;
+	int err_code = 0;
+	for(int i = 0; i < num_workers; ++i) {
+		void *exit_code = NULL;
+		pthread_join(workers[i].th, &exit_code);
+		num_loaded += workers[i].num_loaded;
+		if(workers[i].err_code) err_code = workers[i].err_code;
+	}
+	free(workers);
+	PERF_TRACE_END(span, "load_all", priv->filename);
+	
+	debug_printf("load_all: num_workers=%d, num_loaded=%ld", num_workers, (long)num_loaded);
+	if(err_code && 0 == num_loaded) return -1;
+	return num_loaded;
+}
+
+/*
+ * name of a part related to the main part (e.g. "sharedStrings" of the workbook),
+ * default_name if the package does not declare it.
+ */
+static const char *ooxml_private_get_main_related_part_name(struct ooxml_private *priv, const char *type_suffix, const char *default_name)
+{
+	const struct ooxml_part *main_part = ooxml_get_related_part(priv->ooxml, "", "officeDocument");
+	const struct ooxml_part *part = main_part?ooxml_get_related_part(priv->ooxml, main_part->name, type_suffix):NULL;
+	return part?part->name:default_name;
+}
+
+static struct ooxml_shared_strings *ooxml_get_shared_strings(struct ooxml_context *ooxml)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	if(NULL == priv->archive) return NULL;
+	const char *part_name = ooxml_private_get_main_related_part_name(priv, "sharedStrings", "xl/sharedStrings.xml");
+	
+	pthread_mutex_lock(&priv->mutex);
+	if(NULL == priv->shared_strings && zip_name_locate(priv->archive, part_name, 0) >= 0) {
+		PERF_TRACE_BEGIN(span);
+		priv->shared_strings = ooxml_shared_strings_load(priv->archive, part_name, ooxml->lazy_shared_strings);
+		PERF_TRACE_END(span, "shared_strings_load", part_name);
+	}
+	pthread_mutex_unlock(&priv->mutex);
+	return priv->shared_strings;
+}
+
+static struct ooxml_styles *ooxml_get_styles(struct ooxml_context *ooxml)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	if(NULL == priv->archive) return NULL;
+	const char *part_name = ooxml_private_get_main_related_part_name(priv, "styles", "xl/styles.xml");
+	
+	pthread_mutex_lock(&priv->mutex);
+	if(NULL == priv->styles && zip_name_locate(priv->archive, part_name, 0) >= 0) {
+		PERF_TRACE_BEGIN(span);
+		priv->styles = ooxml_styles_load(priv->archive, part_name);
+		PERF_TRACE_END(span, "styles_load", part_name);
+	}
+	pthread_mutex_unlock(&priv->mutex);
+	return priv->styles;
+}
+
+static const struct ooxml_dir_node *ooxml_get_dir_tree(struct ooxml_context *ooxml)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	if(NULL == priv->archive || NULL == priv->entries) return NULL;
+	
+	pthread_mutex_lock(&priv->mutex);
+	if(NULL == priv->dir_index) {
+		PERF_TRACE_BEGIN(span);
+		priv->dir_index = ooxml_dir_index_build(priv->num_entries, priv->entries);
+		PERF_TRACE_END(span, "dir_index_build", priv->filename);
+	}
+	pthread_mutex_unlock(&priv->mutex);
+	return ooxml_dir_index_get_root(priv->dir_index);
+}
+
+static const struct ooxml_dir_node *ooxml_find_dir(struct ooxml_context *ooxml, const char *path)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	if(NULL == ooxml_get_dir_tree(ooxml)) return NULL;
+	return ooxml_dir_index_find(priv->dir_index, path);
+}
+
+static const struct ooxml_part *ooxml_get_part(struct ooxml_context *ooxml, const char *name)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	return ooxml_part_registry_get_part(priv->part_registry, name);
+}
+
+static const struct ooxml_relationship *ooxml_get_relationships(struct ooxml_context *ooxml, const char *source, ssize_t *p_count)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	return ooxml_part_registry_get_relationships(priv->part_registry, source, p_count);
+}
+
+static const struct ooxml_relationship *ooxml_find_relationship(struct ooxml_context *ooxml, const char *source, const char *id)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	return ooxml_part_registry_find_relationship(priv->part_registry, source, id);
+}
+
+static const struct ooxml_part *ooxml_get_related_part(struct ooxml_context *ooxml, const char *source, const char *type_suffix)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	const struct ooxml_relationship *relationship = ooxml_part_registry_find_relationship_by_type(priv->part_registry,
+		source, type_suffix);
+	if(NULL == relationship || relationship->is_external) return NULL;
+	return ooxml_part_registry_get_part(priv->part_registry, relationship->target);
+}
+
+/*
+ * part updates: put_part() / remove_part() collect the changes, save() writes them
+ * either through libzip (save_workers == 1) or through zip_writer, which deflates the changed parts on a worker pool.
+ * both copy the compressed data of unchanged entries verbatim.
+ */
+static zip_t *ooxml_private_get_writable_archive(struct ooxml_private *priv, const char *caller)
+{
+	if(NULL == priv->archive) return NULL;
+	if(priv->readonly) {
+		fprintf(stderr, "%s(%s): the archive is opened readonly\n", caller, priv->filename);
+		return NULL;
+	}
+	return priv->archive;
+}
+
+static struct ooxml_pending_part *ooxml_private_find_pending_part(struct ooxml_private *priv, const char *name, size_t cb_name)
+{
+	for(int i = 0; i < priv->num_pending_parts; ++i) {
+		struct ooxml_pending_part *part = &priv->pending_parts[i];
+		if(strncmp(part->name, name, cb_name) == 0 && part->name[cb_name] == '\0') return part;
+	}
+	return NULL;
+}
+
+static struct ooxml_pending_part *ooxml_private_add_pending_part(struct ooxml_private *priv, const char *name)
+{
+	struct ooxml_pending_part *part = ooxml_private_find_pending_part(priv, name, strlen(name));
+	if(part) {
+		free(part->data);
+		part->data = NULL;
+		part->length = 0;
+		return part;
+	}
+	priv->pending_parts = realloc(priv->pending_parts, (priv->num_pending_parts + 1) * sizeof(*priv->pending_parts));
+	assert(priv->pending_parts);
+	part = &priv->pending_parts[priv->num_pending_parts++];
+	memset(part, 0, sizeof(*part));
+	part->name = strdup(name);
+	return part;
+}
+
+static void ooxml_private_clear_pending_parts(struct ooxml_private *priv)
+{
+	for(int i = 0; i < priv->num_pending_parts; ++i) {
+		free(priv->pending_parts[i].name);
+		free(priv->pending_parts[i].data);
+	}
+	free(priv->pending_parts);
+	priv->pending_parts = NULL;
+	priv->num_pending_parts = 0;
+}
+
+static int ooxml_put_part(struct ooxml_context *ooxml, const char *name, const void *data, size_t length)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv && name);
+	assert(data || length == 0);
+	if(NULL == ooxml_private_get_writable_archive(priv, __FUNCTION__)) return -1;
+	if(name[0] == '\0' || name[0] == '/') {
+		fprintf(stderr, "%s(): invalid part name '%s'\n", __FUNCTION__, name);
+		return -1;
+	}
+	
+	struct ooxml_pending_part *part = ooxml_private_add_pending_part(priv, name);
+	part->data = malloc(length?length:1);
+	assert(part->data);
+	if(length) memcpy(part->data, data, length);
+	part->length = length;
+	part->is_removed = 0;
+	debug_printf("put %s: %zu bytes", name, length);
+	return 0;
+}
+
+static int ooxml_remove_part(struct ooxml_context *ooxml, const char *name)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv && name);
+	zip_t *zip = ooxml_private_get_writable_archive(priv, __FUNCTION__);
+	if(NULL == zip) return -1;
+	
+	int is_in_archive = (zip_name_locate(zip, name, 0) >= 0);
+	struct ooxml_pending_part *part = ooxml_private_find_pending_part(priv, name, strlen(name));
+	if(part && !is_in_archive) {
+		// a part added since open(): forget it
+		free(part->name);
+		free(part->data);
+		int index = part - priv->pending_parts;
+		memmove(part, part + 1, (priv->num_pending_parts - index - 1) * sizeof(*part));
+		--priv->num_pending_parts;
+		return 0;
+	}
+	if(!is_in_archive || (part && part->is_removed)) {
+		fprintf(stderr, "%s(%s): no such part\n", __FUNCTION__, name);
+		return -1;
+	}
+	part = ooxml_private_add_pending_part(priv, name);
+	part->is_removed = 1;
+	return 0;
+}
+
+int ooxml_private_get_deflate_level(struct ooxml_private *priv, const char *content_type)
+{
+	assert(priv && priv->ooxml);
+	int level = priv->ooxml->deflate_level;
+	if(NULL == content_type) return level;
+	
+	// exact match, or the first "type/*" rule
+	int is_wildcard_match = 0;
+	for(int i = 0; i < priv->num_deflate_levels; ++i) {
+		const char *rule = priv->deflate_levels[i].content_type;
+		size_t cb_rule = strlen(rule);
+		if(strcasecmp(rule, content_type) == 0) return priv->deflate_levels[i].level;
+		if(!is_wildcard_match && cb_rule >= 2 && strcmp(rule + cb_rule - 2, "/*") == 0
+			&& strncasecmp(rule, content_type, cb_rule - 1) == 0) {
+			level = priv->deflate_levels[i].level;
+			is_wildcard_match = 1;
+		}
+	}
+	return level;
+}
+
+// content types of a [Content_Types].xml put since open(), NULL if it is unchanged (see priv->part_registry)
+static struct ooxml_part_registry *ooxml_private_load_changed_content_types(struct ooxml_private *priv)
+{
+	static const char *part_name = "[Content_Types].xml";
+	struct ooxml_pending_part *part = ooxml_private_find_pending_part(priv, part_name, strlen(part_name));
+	if(NULL == part) return NULL;
+	
+	struct ooxml_part_registry *content_types = ooxml_part_registry_new();
+	if(!part->is_removed) ooxml_part_registry_load_content_types(content_types, (char *)part->data, part->length);
+	return content_types;
+}
+
+static int ooxml_private_get_part_deflate_level(struct ooxml_private *priv, struct ooxml_part_registry *content_types, const char *name)
+{
+	return ooxml_private_get_deflate_level(priv, ooxml_part_registry_get_content_type(content_types, name));
+}
+
+static int ooxml_private_save_libzip(struct ooxml_private *priv, struct ooxml_part_registry *content_types)
+{
+	zip_t *zip = priv->archive;
+	int rc = 0;
+	for(int i = 0; 0 == rc && i < priv->num_pending_parts; ++i) {
+		struct ooxml_pending_part *part = &priv->pending_parts[i];
+		zip_int64_t index = zip_name_locate(zip, part->name, 0);
+		if(part->is_removed) {
+			rc = (index >= 0)?zip_delete(zip, index):0;
+			continue;
+		}
 		
-		file.doc = xmlReadMemory((const char *)data, cb_data, file.filename, "utf-8", XML_PARSE_NONET);
-		zip_fclose(zfp);
+		// the data stays owned by the pending part until zip_close() has read it
+		zip_source_t *src = zip_source_buffer(zip, part->data, part->length, 0);
+		if(NULL == src) {
+			rc = -1;
+			break;
+		}
+		if(index >= 0) {
+			rc = zip_file_replace(zip, index, src, 0);
+		}else {
+			index = zip_file_add(zip, part->name, src, ZIP_FL_ENC_UTF_8);
+			rc = (index < 0)?-1:0;
+		}
+		if(rc) {
+			zip_source_free(src);
+			break;
+		}
+		int level = ooxml_private_get_part_deflate_level(priv, content_types, part->name);
+		zip_set_file_compression(zip, index, (0 == level)?ZIP_CM_STORE:ZIP_CM_DEFLATE, (level < 0)?0:level);
+	}
+	if(0 == rc && zip_close(zip) == 0) {
+		priv->archive = NULL;
+		return 0;
 	}
 	
-	if(p_file) *p_file = file;
-	else ooxml_zip_file_clear(&file);
+	// drop what has been staged in the handle, the pending parts are kept for another save()
+	fprintf(stderr, "%s(%s) failed: %s\n", __FUNCTION__, priv->filename, zip_strerror(zip));
+	zip_discard(zip);
+	int err_code = 0;
+	priv->archive = zip_open(priv->filename, 0, &err_code);
+	return -1;
+}
 
+static int ooxml_private_save_parallel(struct ooxml_private *priv, struct ooxml_part_registry *content_types, int num_workers)
+{
+	// unchanged entries are copied from a mapping of the archive
+	int fd = open(priv->filename, O_RDONLY);
+	if(fd == -1) {
+		perror(priv->filename);
+		return -1;
+	}
+	struct stat st[1];
+	memset(st, 0, sizeof(st));
+	unsigned char *map = MAP_FAILED;
+	if(fstat(fd, st) == 0 && st->st_size > 0) map = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		perror("mmap()");
+		return -1;
+	}
+	
+	struct zip_directory_entry *entries = NULL;
+	ssize_t num_entries = zip_directory_parse(map, st->st_size, &entries);
+	struct zip_writer *writer = (num_entries >= 0)?zip_writer_new(priv->filename):NULL;
+	int rc = writer?0:-1;
+	
+	char *is_written = calloc(priv->num_pending_parts + 1, 1);
+	assert(is_written);
+	for(ssize_t i = 0; 0 == rc && i < num_entries; ++i) {
+		const struct zip_directory_entry *entry = &entries[i];
+		struct ooxml_pending_part *part = ooxml_private_find_pending_part(priv, entry->name, entry->cb_name);
+		if(NULL == part) {
+			const unsigned char *comp_data = zip_directory_get_data(map, st->st_size, entry);
+			rc = comp_data?zip_writer_add_raw(writer, entry, comp_data):-1;
+			continue;
+		}
+		is_written[part - priv->pending_parts] = 1;
+		if(part->is_removed) continue;
+		rc = zip_writer_add_buffer(writer, part->name, part->data, part->length,
+			ooxml_private_get_part_deflate_level(priv, content_types, part->name), 0);
+	}
+	for(int i = 0; 0 == rc && i < priv->num_pending_parts; ++i) {
+		struct ooxml_pending_part *part = &priv->pending_parts[i];
+		if(is_written[i] || part->is_removed) continue;
+		rc = zip_writer_add_buffer(writer, part->name, part->data, part->length,
+			ooxml_private_get_part_deflate_level(priv, content_types, part->name), 0);
+	}
+	if(0 == rc) rc = zip_writer_finish(writer, num_workers);
+	
+	zip_writer_free(writer);
+	free(is_written);
+	free(entries);
+	munmap(map, st->st_size);
+	if(rc) return -1;
+	
+	// nothing has been staged in the libzip handle
+	zip_discard(priv->archive);
+	priv->archive = NULL;
 	return 0;
 }
 
+static int ooxml_save(struct ooxml_context *ooxml)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	assert(priv);
+	if(NULL == ooxml_private_get_writable_archive(priv, __FUNCTION__)) return -1;
+	if(0 == priv->num_pending_parts) return 0;
+	
+	PERF_TRACE_BEGIN(span);
+	int num_changes = priv->num_pending_parts;
+	struct ooxml_part_registry *changed_content_types = ooxml_private_load_changed_content_types(priv);
+	struct ooxml_part_registry *content_types = changed_content_types?changed_content_types:priv->part_registry;
+	int rc = (ooxml->save_workers == 1)?ooxml_private_save_libzip(priv, content_types)
+		:ooxml_private_save_parallel(priv, content_types, ooxml->save_workers);
+	ooxml_part_registry_free(changed_content_types);
+	if(rc) return -1;
+	debug_printf("%s: %d changes saved", priv->filename, num_changes);
+	
+	// the entry table, shared strings and styles describe the old archive
+	char *filename = priv->filename;
+	priv->filename = NULL;
+	ooxml->close(ooxml);
+	rc = ooxml->open(ooxml, filename, 0);
+	PERF_TRACE_END(span, "ooxml_save", filename);
+	free(filename);
+	return rc;
+}
+
 #if defined(TEST_OOXML_CONTEXT_) && defined(_STAND_ALONE)
 int main(int argc, char **argv)
 {
-	
+
 	return 0;
 }
 #endif
@@ -0,0 +1,202 @@
+/*
+ * ooxml_dir_index.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <glib.h>
+
+#include "ooxml_context.h"
+#include "ooxml_arena.h"
+#include "ooxml_dir_index.h"
+
+struct ooxml_dir_index
+{
+	struct ooxml_arena *arena;
+	GHashTable *dirs;	// path => struct ooxml_dir_node *, the root is not in the table
+	struct ooxml_dir_node *root;
+	
+	// build state
+	GPtrArray *nodes;	// in creation order
+	char *scratch;		// nul-terminated copy of the path being looked up
+	size_t cb_scratch;
+};
+
+static struct ooxml_dir_node *get_or_create_dir(struct ooxml_dir_index *index, const char *path, size_t length)
+{
+	if(0 == length) return index->root;
+	
+	if(length >= index->cb_scratch) {
+		size_t new_size = (length + 1 + 255) & ~(size_t)255;
+		char *scratch = realloc(index->scratch, new_size);
+		assert(scratch);
+		index->scratch = scratch;
+		index->cb_scratch = new_size;
+	}
+	memcpy(index->scratch, path, length);
+	index->scratch[length] = '\0';
+	
+	struct ooxml_dir_node *node = g_hash_table_lookup(index->dirs, index->scratch);
+	if(node) return node;
+	
+	size_t parent_length = length;
+	while(parent_length > 0 && path[parent_length - 1] != '/') --parent_length;
+	struct ooxml_dir_node *parent = get_or_create_dir(index, path, (parent_length > 0)?(parent_length - 1):0);
+	
+	node = ooxml_arena_alloc(index->arena, sizeof(*node));
+	memset(node, 0, sizeof(*node));
+	
+	char *node_path = ooxml_arena_alloc(index->arena, length + 1);
+	memcpy(node_path, path, length);
+	node_path[length] = '\0';
+	
+	node->path = node_path;
+	node->name = node_path + parent_length;
+	node->parent = parent;
+	++parent->num_dirs;
+	
+	g_hash_table_insert(index->dirs, node_path, node);
+	g_ptr_array_add(index->nodes, node);
+	return node;
+}
+
+struct ooxml_dir_index *ooxml_dir_index_build(ssize_t num_entries, const struct ooxml_zip_file *entries)
+{
+	struct ooxml_dir_index *index = calloc(1, sizeof(*index));
+	assert(index);
+	index->arena = ooxml_arena_new(64 * 1024);
+	index->dirs = g_hash_table_new(g_str_hash, g_str_equal);
+	index->nodes = g_ptr_array_new();
+	
+	index->root = ooxml_arena_alloc(index->arena, sizeof(*index->root));
+	memset(index->root, 0, sizeof(*index->root));
+	index->root->name = "";
+	index->root->path = "";
+	
+	// pass 1: create the directories and count the children of each one
+	struct ooxml_dir_node **entry_dirs = calloc(num_entries + 1, sizeof(*entry_dirs));
+	assert(entry_dirs);
+	
+	const char *last_dir = NULL;
+	size_t last_length = 0;
+	struct ooxml_dir_node *last_node = index->root;
+	for(ssize_t i = 0; i < num_entries; ++i) {
+		const char *filename = entries[i].filename;
+		if(NULL == filename) continue;
+		while(*filename == '/') ++filename;
+		
+		size_t cb_filename = strlen(filename);
+		int is_dir = (cb_filename > 0 && filename[cb_filename - 1] == '/');
+		if(is_dir) {	// explicit directory entry, e.g. "xl/"
+			get_or_create_dir(index, filename, cb_filename - 1);
+			continue;
+		}
+		
+		const char *slash = strrchr(filename, '/');
+		size_t length = slash?(size_t)(slash - filename):0;
+		
+		// entries of the same directory are usually adjacent
+		struct ooxml_dir_node *dir = NULL;
+		if(last_dir && length == last_length && strncmp(filename, last_dir, length) == 0) {
+			dir = last_node;
+		}else {
+			dir = get_or_create_dir(index, filename, length);
+			last_dir = filename;
+			last_length = length;
+			last_node = dir;
+		}
+		entry_dirs[i] = dir;
+		++dir->num_files;
+	}
+	
+	// pass 2: exact-size child arrays, in archive order
+	guint num_nodes = index->nodes->len;
+	for(guint i = 0; i <= num_nodes; ++i) {
+		struct ooxml_dir_node *node = (i == num_nodes)?index->root:g_ptr_array_index(index->nodes, i);
+		if(node->num_dirs > 0) node->dirs = ooxml_arena_alloc(index->arena, node->num_dirs * sizeof(*node->dirs));
+		if(node->num_files > 0) node->files = ooxml_arena_alloc(index->arena, node->num_files * sizeof(*node->files));
+		node->num_dirs = 0;
+		node->num_files = 0;
+	}
+	for(guint i = 0; i < num_nodes; ++i) {
+		struct ooxml_dir_node *node = g_ptr_array_index(index->nodes, i);
+		node->parent->dirs[node->parent->num_dirs++] = node;
+	}
+	for(ssize_t i = 0; i < num_entries; ++i) {
+		struct ooxml_dir_node *dir = entry_dirs[i];
+		if(dir) dir->files[dir->num_files++] = i;
+	}
+	
+	free(entry_dirs);
+	g_ptr_array_free(index->nodes, TRUE);
+	index->nodes = NULL;
+	free(index->scratch);
+	index->scratch = NULL;
+	index->cb_scratch = 0;
+	return index;
+}
+
+void ooxml_dir_index_free(struct ooxml_dir_index *index)
+{
+	if(NULL == index) return;
+	if(index->dirs) g_hash_table_destroy(index->dirs);
+	ooxml_arena_free(index->arena);
+	free(index);
+}
+
+const struct ooxml_dir_node *ooxml_dir_index_get_root(struct ooxml_dir_index *index)
+{
+	return index?index->root:NULL;
+}
+
+const struct ooxml_dir_node *ooxml_dir_index_find(struct ooxml_dir_index *index, const char *path)
+{
+	if(NULL == index) return NULL;
+	if(NULL == path) return index->root;
+	
+	while(*path == '/') ++path;
+	size_t length = strlen(path);
+	while(length > 0 && path[length - 1] == '/') --length;
+	if(0 == length || (length == 1 && path[0] == '.')) return index->root;
+	if(path[length] == '\0') return g_hash_table_lookup(index->dirs, path);
+	
+	char *key = strndup(path, length);
+	assert(key);
+	const struct ooxml_dir_node *node = g_hash_table_lookup(index->dirs, key);
+	free(key);
+	return node;
+}
+
+
+#if defined(TEST_OOXML_DIR_INDEX_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
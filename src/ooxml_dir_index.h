@@ -0,0 +1,25 @@
+#ifndef OOXML_DIR_INDEX_H_
+#define OOXML_DIR_INDEX_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ooxml_context.h"
+
+/*
+ * directory tree of an entry table:
+ * directories are hashed by their full path, nodes and strings live in one arena.
+ */
+struct ooxml_dir_index;
+struct ooxml_dir_index *ooxml_dir_index_build(ssize_t num_entries, const struct ooxml_zip_file *entries);
+void ooxml_dir_index_free(struct ooxml_dir_index *index);
+
+const struct ooxml_dir_node *ooxml_dir_index_get_root(struct ooxml_dir_index *index);
+const struct ooxml_dir_node *ooxml_dir_index_find(struct ooxml_dir_index *index, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
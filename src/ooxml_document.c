@@ -0,0 +1,559 @@
+/*
+ * ooxml_document.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <libxml/parser.h>
+
+#include "app.h"
+#include "ooxml_context.h"
+#include "ooxml_document.h"
+#include "ooxml_part_registry.h"
+
+#define WORDPROCESSINGML_NS			"http://schemas.openxmlformats.org/wordprocessingml/2006/main"
+#define WORDPROCESSINGML_STRICT_NS	"http://purl.oclc.org/ooxml/wordprocessingml/main"
+#define MARKUP_COMPATIBILITY_NS		"http://schemas.openxmlformats.org/markup-compatibility/2006"
+
+#define MAX_NESTED_PARAGRAPHS	(16)	// text boxes in text boxes ...
+#define MAX_NESTED_TABLES		(64)
+#define MAX_STYLE_LENGTH		(256)
+
+/******************************************************************************
+ * document_parser: SAX state of one part
+******************************************************************************/
+struct paragraph_state
+{
+	size_t start;		// offset of its text in parser->text
+	int is_truncated;
+	int outer_run_depth;	// run_depth of the enclosing paragraph (text boxes sit in a run)
+	char style[MAX_STYLE_LENGTH];
+};
+
+struct table_state
+{
+	int64_t row;
+	int64_t col;
+};
+
+struct document_parser
+{
+	const struct ooxml_document_sink *sink;
+	const char *part_name;
+	enum ooxml_document_story story;
+	size_t max_length;
+	int is_stopped;
+	
+	int depth;			// element depth
+	int skip_depth;		// > 0: skip the content of the element opened at this depth
+	int run_depth;		// inside <w:r> of the innermost paragraph
+	int ppr_depth;		// > 0: inside the <w:pPr> opened at this depth
+	int in_text;		// inside <w:t>
+	int64_t note_id;
+	
+	char *text;			// text of the open paragraphs, the innermost one last
+	size_t cb_text;
+	size_t max_size;
+	
+	int num_paragraphs;	// open paragraphs, may exceed MAX_NESTED_PARAGRAPHS
+	struct paragraph_state paragraphs[MAX_NESTED_PARAGRAPHS];
+	int64_t paragraph_index;
+	
+	int num_tables;		// open tables, may exceed MAX_NESTED_TABLES
+	struct table_state tables[MAX_NESTED_TABLES];
+};
+
+static void document_parser_stop(struct document_parser *parser, xmlParserCtxtPtr ctxt)
+{
+	parser->is_stopped = 1;
+	xmlStopParser(ctxt);
+}
+
+static int is_wordprocessingml(const xmlChar *URI)
+{
+	if(NULL == URI) return 0;
+	return strcmp((const char *)URI, WORDPROCESSINGML_NS) == 0
+		|| strcmp((const char *)URI, WORDPROCESSINGML_STRICT_NS) == 0;
+}
+
+// SAX2 attributes: (localname, prefix, URI, value, end) tuples, the value is not nul-terminated
+static const xmlChar *get_attribute(const xmlChar **attributes, int nb_attributes, const char *name, size_t *p_length)
+{
+	for(int i = 0; i < nb_attributes; ++i, attributes += 5) {
+		if(strcmp((const char *)attributes[0], name) != 0) continue;
+		*p_length = attributes[4] - attributes[3];
+		return attributes[3];
+	}
+	return NULL;
+}
+
+static int attribute_equals(const xmlChar *value, size_t length, const char *text)
+{
+	return value && length == strlen(text) && memcmp(value, text, length) == 0;
+}
+
+static void document_parser_append(struct document_parser *parser, const char *text, size_t length)
+{
+	if(parser->num_paragraphs <= 0) return;
+	
+	int level = parser->num_paragraphs;
+	if(level > MAX_NESTED_PARAGRAPHS) level = MAX_NESTED_PARAGRAPHS;
+	struct paragraph_state *paragraph = &parser->paragraphs[level - 1];
+	if(paragraph->is_truncated) return;
+	
+	size_t cb_paragraph = parser->cb_text - paragraph->start;
+	if((cb_paragraph + length) > parser->max_length) {
+		// keep whole utf-8 sequences
+		length = parser->max_length - cb_paragraph;
+		while(length > 0 && (text[length] & 0xC0) == 0x80) --length;
+		paragraph->is_truncated = 1;
+	}
+	if(0 == length) return;
+	
+	if((parser->cb_text + length + 1) > parser->max_size) {
+		size_t new_size = (parser->cb_text + length + 1 + 4095) & ~(size_t)4095;
+		char *buffer = realloc(parser->text, new_size);
+		assert(buffer);
+		parser->text = buffer;
+		parser->max_size = new_size;
+	}
+	memcpy(parser->text + parser->cb_text, text, length);
+	parser->cb_text += length;
+}
+
+static void on_paragraph_start(struct document_parser *parser)
+{
+	int level = parser->num_paragraphs++;
+	if(level >= MAX_NESTED_PARAGRAPHS) return;	// too deep, the text goes to the enclosing paragraph
+	
+	struct paragraph_state *paragraph = &parser->paragraphs[level];
+	paragraph->start = parser->cb_text;
+	paragraph->is_truncated = 0;
+	paragraph->outer_run_depth = parser->run_depth;
+	paragraph->style[0] = '\0';
+	parser->run_depth = 0;
+}
+
+static int on_paragraph_end(struct document_parser *parser)
+{
+	int level = --parser->num_paragraphs;
+	if(level >= MAX_NESTED_PARAGRAPHS) return 0;
+	
+	struct paragraph_state *state = &parser->paragraphs[level];
+	if(NULL == parser->text) {
+		parser->text = malloc(4096);
+		assert(parser->text);
+		parser->max_size = 4096;
+	}
+	parser->text[parser->cb_text] = '\0';
+	
+	struct ooxml_paragraph paragraph;
+	memset(&paragraph, 0, sizeof(paragraph));
+	paragraph.story = parser->story;
+	paragraph.part_name = parser->part_name;
+	paragraph.index = parser->paragraph_index++;
+	paragraph.note_id = parser->note_id;
+	paragraph.style = state->style[0]?state->style:NULL;
+	paragraph.text = parser->text + state->start;
+	paragraph.length = parser->cb_text - state->start;
+	paragraph.is_truncated = state->is_truncated;
+	
+	paragraph.table_row = -1;
+	paragraph.table_col = -1;
+	paragraph.table_depth = parser->num_tables;
+	if(parser->num_tables > 0 && parser->num_tables <= MAX_NESTED_TABLES) {
+		const struct table_state *table = &parser->tables[parser->num_tables - 1];
+		paragraph.table_row = table->row;
+		paragraph.table_col = table->col;
+	}
+	
+	int rc = parser->sink->on_paragraph(parser->sink->user_data, &paragraph);
+	parser->cb_text = state->start;
+	parser->run_depth = state->outer_run_depth;
+	return rc;
+}
+
+static int on_table_start(struct document_parser *parser)
+{
+	int level = parser->num_tables++;
+	if(level < MAX_NESTED_TABLES) {
+		parser->tables[level].row = -1;
+		parser->tables[level].col = -1;
+	}
+	if(parser->sink->on_table) return parser->sink->on_table(parser->sink->user_data, parser->num_tables, 0);
+	return 0;
+}
+
+static int on_table_end(struct document_parser *parser)
+{
+	int rc = 0;
+	if(parser->sink->on_table) rc = parser->sink->on_table(parser->sink->user_data, parser->num_tables, 1);
+	--parser->num_tables;
+	return rc;
+}
+
+static struct table_state *get_table(struct document_parser *parser)
+{
+	if(parser->num_tables <= 0 || parser->num_tables > MAX_NESTED_TABLES) return NULL;
+	return &parser->tables[parser->num_tables - 1];
+}
+
+static int on_table_row(struct document_parser *parser, int is_end)
+{
+	struct table_state *table = get_table(parser);
+	if(NULL == table) return 0;
+	if(!is_end) {
+		++table->row;
+		table->col = -1;
+	}
+	if(parser->sink->on_table_row) return parser->sink->on_table_row(parser->sink->user_data, parser->num_tables, table->row, is_end);
+	return 0;
+}
+
+static void on_note_start(struct document_parser *parser, const xmlChar **attributes, int nb_attributes)
+{
+	size_t length = 0;
+	const xmlChar *type = get_attribute(attributes, nb_attributes, "type", &length);
+	if(attribute_equals(type, length, "separator")
+		|| attribute_equals(type, length, "continuationSeparator")
+		|| attribute_equals(type, length, "continuationNotice"))
+	{
+		parser->skip_depth = parser->depth;
+		return;
+	}
+	
+	parser->note_id = -1;
+	const xmlChar *id = get_attribute(attributes, nb_attributes, "id", &length);
+	if(id && length > 0 && length < 32) {
+		char sz_id[32] = "";
+		memcpy(sz_id, id, length);
+		parser->note_id = strtoll(sz_id, NULL, 10);
+	}
+}
+
+static void on_document_start_element(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI,
+	int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+	xmlParserCtxtPtr ctxt = ctx;
+	struct document_parser *parser = ctxt->_private;
+	++parser->depth;
+	if(parser->skip_depth > 0 || parser->is_stopped) return;
+	
+	const char *name = (const char *)localname;
+	if(!is_wordprocessingml(URI)) {
+		// the fallback of mc:AlternateContent duplicates the content of mc:Choice (e.g. vml text boxes)
+		if(URI && strcmp((const char *)URI, MARKUP_COMPATIBILITY_NS) == 0 && strcmp(name, "Fallback") == 0) {
+			parser->skip_depth = parser->depth;
+		}
+		return;
+	}
+	
+	int rc = 0;
+	switch(name[0]) {
+	case 'b':
+		if(strcmp(name, "br") == 0 && parser->run_depth > 0) document_parser_append(parser, "\n", 1);
+		break;
+	case 'c':
+		if(strcmp(name, "cr") == 0 && parser->run_depth > 0) document_parser_append(parser, "\n", 1);
+		else if(strcmp(name, "comment") == 0) on_note_start(parser, attributes, nb_attributes);
+		break;
+	case 'e':
+		if(strcmp(name, "endnote") == 0) on_note_start(parser, attributes, nb_attributes);
+		break;
+	case 'f':
+		if(strcmp(name, "footnote") == 0) on_note_start(parser, attributes, nb_attributes);
+		break;
+	case 'p':
+		if(name[1] == '\0') on_paragraph_start(parser);
+		else if(strcmp(name, "pPr") == 0) parser->ppr_depth = parser->depth;
+		else if(strcmp(name, "pStyle") == 0 && parser->ppr_depth > 0
+			&& parser->num_paragraphs > 0 && parser->num_paragraphs <= MAX_NESTED_PARAGRAPHS)
+		{
+			size_t length = 0;
+			const xmlChar *value = get_attribute(attributes, nb_attributes, "val", &length);
+			if(value) {
+				char *style = parser->paragraphs[parser->num_paragraphs - 1].style;
+				if(length >= MAX_STYLE_LENGTH) length = MAX_STYLE_LENGTH - 1;
+				memcpy(style, value, length);
+				style[length] = '\0';
+			}
+		}
+		break;
+	case 'r':
+		if(name[1] == '\0') ++parser->run_depth;
+		break;
+	case 't':
+		if(name[1] == '\0') parser->in_text = 1;
+		else if(strcmp(name, "tab") == 0) {
+			// <w:tab> is also a tab stop definition in <w:pPr><w:tabs>
+			if(parser->run_depth > 0 && 0 == parser->ppr_depth) document_parser_append(parser, "\t", 1);
+		}
+		else if(strcmp(name, "tbl") == 0) rc = on_table_start(parser);
+		else if(strcmp(name, "tr") == 0) rc = on_table_row(parser, 0);
+		else if(strcmp(name, "tc") == 0) {
+			struct table_state *table = get_table(parser);
+			if(table) ++table->col;
+		}
+		break;
+	default:
+		break;
+	}
+	if(rc) document_parser_stop(parser, ctxt);
+}
+
+static void on_document_end_element(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI)
+{
+	xmlParserCtxtPtr ctxt = ctx;
+	struct document_parser *parser = ctxt->_private;
+	int depth = parser->depth--;
+	if(parser->is_stopped) return;
+	if(parser->skip_depth > 0) {
+		if(depth == parser->skip_depth) parser->skip_depth = 0;
+		return;
+	}
+	if(!is_wordprocessingml(URI)) return;
+	
+	const char *name = (const char *)localname;
+	int rc = 0;
+	switch(name[0]) {
+	case 'c':
+		if(strcmp(name, "comment") == 0) parser->note_id = -1;
+		break;
+	case 'e':
+		if(strcmp(name, "endnote") == 0) parser->note_id = -1;
+		break;
+	case 'f':
+		if(strcmp(name, "footnote") == 0) parser->note_id = -1;
+		break;
+	case 'p':
+		if(name[1] == '\0' && parser->num_paragraphs > 0) rc = on_paragraph_end(parser);
+		else if(depth == parser->ppr_depth) parser->ppr_depth = 0;
+		break;
+	case 'r':
+		if(name[1] == '\0' && parser->run_depth > 0) --parser->run_depth;
+		break;
+	case 't':
+		if(name[1] == '\0') parser->in_text = 0;
+		else if(strcmp(name, "tbl") == 0 && parser->num_tables > 0) rc = on_table_end(parser);
+		else if(strcmp(name, "tr") == 0) rc = on_table_row(parser, 1);
+		break;
+	default:
+		break;
+	}
+	if(rc) document_parser_stop(parser, ctxt);
+}
+
+static void on_document_characters(void *ctx, const xmlChar *ch, int len)
+{
+	struct document_parser *parser = ((xmlParserCtxtPtr)ctx)->_private;
+	if(parser->in_text && 0 == parser->skip_depth) document_parser_append(parser, (const char *)ch, len);
+}
+
+int ooxml_document_stream_part(zip_t *zip, const char *part_name, enum ooxml_document_story story,
+	const struct ooxml_document_sink *sink)
+{
+	assert(zip && part_name && sink && sink->on_paragraph);
+	
+	struct document_parser parser;
+	memset(&parser, 0, sizeof(parser));
+	parser.sink = sink;
+	parser.part_name = part_name;
+	parser.story = story;
+	parser.note_id = -1;
+	parser.max_length = sink->max_paragraph_length?sink->max_paragraph_length:OOXML_DOCUMENT_MAX_PARAGRAPH_LENGTH;
+	
+	if(sink->on_part && sink->on_part(sink->user_data, part_name, story, 0)) return 1;
+	
+	xmlSAXHandler sax;
+	memset(&sax, 0, sizeof(sax));
+	sax.initialized = XML_SAX2_MAGIC;
+	sax.startElementNs = on_document_start_element;
+	sax.endElementNs = on_document_end_element;
+	sax.characters = on_document_characters;
+	
+	int rc = parse_zip_xml_stream(zip, part_name, &sax, &parser, NULL);
+	free(parser.text);
+	if(parser.is_stopped) return 1;
+	if(rc) return -1;
+	
+	if(sink->on_part && sink->on_part(sink->user_data, part_name, story, 1)) return 1;
+	return 0;
+}
+
+/******************************************************************************
+ * part discovery: _rels/.rels, then the relationships of the main part
+******************************************************************************/
+struct document_relationship
+{
+	enum ooxml_document_story story;	// ooxml_document_stories_count: not a text part
+	char *part_name;
+};
+
+struct relationships_parser
+{
+	const char *source_part;	// targets are relative to its folder, "" for the package
+	int find_main_part;
+	char *main_part;
+	
+	ssize_t count;
+	ssize_t max_size;
+	struct document_relationship *items;
+};
+
+#define RELATIONSHIPS_NS	"http://schemas.openxmlformats.org/package/2006/relationships"
+
+static enum ooxml_document_story story_from_relationship_type(const char *type)
+{
+	const char *p = strrchr(type, '/');
+	if(NULL == p) return ooxml_document_stories_count;
+	++p;
+	if(strcmp(p, "header") == 0) return ooxml_document_story_header;
+	if(strcmp(p, "footer") == 0) return ooxml_document_story_footer;
+	if(strcmp(p, "footnotes") == 0) return ooxml_document_story_footnote;
+	if(strcmp(p, "endnotes") == 0) return ooxml_document_story_endnote;
+	if(strcmp(p, "comments") == 0) return ooxml_document_story_comment;
+	return ooxml_document_stories_count;
+}
+
+static void on_relationship(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI,
+	int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+	struct relationships_parser *parser = ((xmlParserCtxtPtr)ctx)->_private;
+	if(strcmp((const char *)localname, "Relationship") != 0) return;
+	if(NULL == URI || strcmp((const char *)URI, RELATIONSHIPS_NS) != 0) return;
+	
+	size_t cb_type = 0, cb_target = 0, cb_mode = 0;
+	const xmlChar *type = get_attribute(attributes, nb_attributes, "Type", &cb_type);
+	const xmlChar *target = get_attribute(attributes, nb_attributes, "Target", &cb_target);
+	const xmlChar *mode = get_attribute(attributes, nb_attributes, "TargetMode", &cb_mode);
+	if(NULL == type || NULL == target || attribute_equals(mode, cb_mode, "External")) return;
+	
+	char sz_type[256] = "";
+	if(cb_type >= sizeof(sz_type)) return;
+	memcpy(sz_type, type, cb_type);
+	
+	if(parser->find_main_part) {
+		const char *p = strrchr(sz_type, '/');
+		if(NULL == parser->main_part && p && strcmp(p, "/officeDocument") == 0) {
+			parser->main_part = ooxml_resolve_part_target(parser->source_part, (const char *)target, cb_target);
+		}
+		return;
+	}
+	
+	enum ooxml_document_story story = story_from_relationship_type(sz_type);
+	if(story == ooxml_document_stories_count) return;
+	
+	if(parser->count >= parser->max_size) {
+		ssize_t new_size = parser->max_size?(parser->max_size * 2):16;
+		struct document_relationship *items = realloc(parser->items, new_size * sizeof(*items));
+		assert(items);
+		parser->items = items;
+		parser->max_size = new_size;
+	}
+	struct document_relationship *item = &parser->items[parser->count++];
+	item->story = story;
+	item->part_name = ooxml_resolve_part_target(parser->source_part, (const char *)target, cb_target);
+}
+
+// the relationships part of source_part, e.g. "word/_rels/document.xml.rels"
+static char *get_relationships_part_name(const char *source_part)
+{
+	const char *slash = strrchr(source_part, '/');
+	size_t cb_folder = slash?(size_t)(slash - source_part + 1):0;
+	size_t length = strlen(source_part);
+	
+	char *rels_name = malloc(length + sizeof("_rels/") + sizeof(".rels"));
+	assert(rels_name);
+	memcpy(rels_name, source_part, cb_folder);
+	sprintf(rels_name + cb_folder, "_rels/%s.rels", source_part + cb_folder);
+	return rels_name;
+}
+
+static int load_relationships(zip_t *zip, const char *rels_name, struct relationships_parser *parser)
+{
+	if(zip_name_locate(zip, rels_name, 0) < 0) return 0;	// no relationships
+	
+	xmlSAXHandler sax;
+	memset(&sax, 0, sizeof(sax));
+	sax.initialized = XML_SAX2_MAGIC;
+	sax.startElementNs = on_relationship;
+	return parse_zip_xml_stream(zip, rels_name, &sax, parser, NULL);
+}
+
+int ooxml_document_stream_text(zip_t *zip, unsigned int stories, const struct ooxml_document_sink *sink)
+{
+	assert(zip && sink && sink->on_paragraph);
+	
+	struct relationships_parser parser;
+	memset(&parser, 0, sizeof(parser));
+	parser.source_part = "";
+	parser.find_main_part = 1;
+	load_relationships(zip, "_rels/.rels", &parser);
+	
+	char *main_part = parser.main_part;
+	if(NULL == main_part) main_part = strdup("word/document.xml");
+	assert(main_part);
+	
+	int rc = 0;
+	if(stories & OOXML_DOCUMENT_STORY_FLAG(ooxml_document_story_body)) {
+		rc = ooxml_document_stream_part(zip, main_part, ooxml_document_story_body, sink);
+	}
+	
+	if(0 == rc && (stories & ~OOXML_DOCUMENT_STORY_FLAG(ooxml_document_story_body))) {
+		memset(&parser, 0, sizeof(parser));
+		parser.source_part = main_part;
+		
+		char *rels_name = get_relationships_part_name(main_part);
+		rc = load_relationships(zip, rels_name, &parser);
+		free(rels_name);
+		
+		for(ssize_t i = 0; 0 == rc && i < parser.count; ++i) {
+			const struct document_relationship *item = &parser.items[i];
+			if(!(stories & OOXML_DOCUMENT_STORY_FLAG(item->story))) continue;
+			if(zip_name_locate(zip, item->part_name, 0) < 0) {
+				debug_printf("%s: missing part %s", __FUNCTION__, item->part_name);
+				continue;
+			}
+			rc = ooxml_document_stream_part(zip, item->part_name, item->story, sink);
+		}
+		for(ssize_t i = 0; i < parser.count; ++i) free(parser.items[i].part_name);
+		free(parser.items);
+	}
+	
+	free(main_part);
+	return rc;
+}
+
+
+#if defined(TEST_OOXML_DOCUMENT_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
@@ -0,0 +1,516 @@
+/*
+ * ooxml_dom_codec.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include <glib.h>
+#include <libxml/tree.h>
+#include <libxml/parserInternals.h>	// xmlStringText
+
+#include "ooxml_dom_codec.h"
+
+/*
+ * stream:
+ *   doc:       string(version) string(encoding) varint(standalone + 2) node* END
+ *   element:   ELEMENT string(name) varint(num_ns_defs) { string(prefix) string(href) }*
+ *              ns_ref varint(num_attrs) { string(name) ns_ref bytes(value) }* node* END
+ *   text:      TEXT bytes, CDATA bytes, COMMENT bytes, PI string(name) bytes(content)
+ *
+ *   string:    0: NULL, 1: new string (bytes) that gets the next id, n >= 2: string id n - 2
+ *   ns_ref:    0: no namespace, 1: string(prefix) string(href) looked up by href (e.g. the implicit xml: namespace),
+ *              n >= 2: the (n - 2)-th namespace definition of the stream
+ *   bytes:     varint(length) followed by length bytes
+ */
+enum dom_op
+{
+	dom_op_end,
+	dom_op_element,
+	dom_op_text,
+	dom_op_cdata,
+	dom_op_comment,
+	dom_op_pi,
+};
+
+struct dom_writer
+{
+	unsigned char *data;
+	size_t length;
+	size_t size;
+	
+	GHashTable *strings;	// const xmlChar * => id + 1, names come from the doc's dict, equal names share a pointer
+	guint num_strings;
+	GHashTable *namespaces;	// xmlNsPtr => ordinal + 1
+	guint num_namespaces;
+};
+
+static void writer_reserve(struct dom_writer *w, size_t length)
+{
+	if(w->length + length <= w->size) return;
+	size_t new_size = w->size?w->size:4096;
+	while(new_size < w->length + length) new_size *= 2;
+	unsigned char *data = realloc(w->data, new_size);
+	assert(data);
+	w->data = data;
+	w->size = new_size;
+}
+
+static void write_varint(struct dom_writer *w, uint64_t value)
+{
+	writer_reserve(w, 10);
+	unsigned char *p = w->data + w->length;
+	while(value >= 0x80) {
+		*p++ = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = (unsigned char)value;
+	w->length = p - w->data;
+}
+
+static void write_bytes(struct dom_writer *w, const xmlChar *bytes)
+{
+	size_t length = bytes?strlen((const char *)bytes):0;
+	write_varint(w, length);
+	writer_reserve(w, length);
+	if(length) memcpy(w->data + w->length, bytes, length);
+	w->length += length;
+}
+
+static void write_string(struct dom_writer *w, const xmlChar *string)
+{
+	if(NULL == string) {
+		write_varint(w, 0);
+		return;
+	}
+	guint id = GPOINTER_TO_UINT(g_hash_table_lookup(w->strings, string));
+	if(id) {
+		write_varint(w, (uint64_t)id + 1);
+		return;
+	}
+	g_hash_table_insert(w->strings, (gpointer)string, GUINT_TO_POINTER(++w->num_strings));
+	write_varint(w, 1);
+	write_bytes(w, string);
+}
+
+static void write_ns_ref(struct dom_writer *w, xmlNsPtr ns)
+{
+	if(NULL == ns) {
+		write_varint(w, 0);
+		return;
+	}
+	guint ordinal = GPOINTER_TO_UINT(g_hash_table_lookup(w->namespaces, ns));
+	if(ordinal) {
+		write_varint(w, (uint64_t)ordinal + 1);
+		return;
+	}
+	write_varint(w, 1);
+	write_string(w, ns->prefix);
+	write_string(w, ns->href);
+}
+
+static int encode_element(struct dom_writer *w, xmlNodePtr node);
+static int encode_nodes(struct dom_writer *w, xmlNodePtr node)
+{
+	for(; node; node = node->next) {
+		switch(node->type) {
+		case XML_ELEMENT_NODE:
+			if(encode_element(w, node) != 0) return -1;
+			break;
+		case XML_TEXT_NODE:
+			write_varint(w, dom_op_text);
+			write_bytes(w, node->content);
+			break;
+		case XML_CDATA_SECTION_NODE:
+			write_varint(w, dom_op_cdata);
+			write_bytes(w, node->content);
+			break;
+		case XML_COMMENT_NODE:
+			write_varint(w, dom_op_comment);
+			write_bytes(w, node->content);
+			break;
+		case XML_PI_NODE:
+			write_varint(w, dom_op_pi);
+			write_string(w, node->name);
+			write_bytes(w, node->content);
+			break;
+		default:	// dtd, entity references, ...
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int encode_element(struct dom_writer *w, xmlNodePtr node)
+{
+	write_varint(w, dom_op_element);
+	write_string(w, node->name);
+	
+	uint64_t num_ns_defs = 0;
+	for(xmlNsPtr ns = node->nsDef; ns; ns = ns->next) ++num_ns_defs;
+	write_varint(w, num_ns_defs);
+	for(xmlNsPtr ns = node->nsDef; ns; ns = ns->next) {
+		g_hash_table_insert(w->namespaces, ns, GUINT_TO_POINTER(++w->num_namespaces));
+		write_string(w, ns->prefix);
+		write_string(w, ns->href);
+	}
+	write_ns_ref(w, node->ns);
+	
+	uint64_t num_attrs = 0;
+	for(xmlAttrPtr attr = node->properties; attr; attr = attr->next) {
+		// the parser stores an attribute value as a single text node
+		xmlNodePtr value = attr->children;
+		if(value && (value->type != XML_TEXT_NODE || value->next)) return -1;
+		++num_attrs;
+	}
+	write_varint(w, num_attrs);
+	for(xmlAttrPtr attr = node->properties; attr; attr = attr->next) {
+		write_string(w, attr->name);
+		write_ns_ref(w, attr->ns);
+		write_bytes(w, attr->children?attr->children->content:NULL);
+	}
+	
+	if(encode_nodes(w, node->children) != 0) return -1;
+	write_varint(w, dom_op_end);
+	return 0;
+}
+
+int ooxml_dom_encode(xmlDocPtr doc, unsigned char **p_data, size_t *p_length)
+{
+	assert(doc && p_data && p_length);
+	
+	struct dom_writer w;
+	memset(&w, 0, sizeof(w));
+	w.strings = g_hash_table_new(g_direct_hash, g_direct_equal);
+	w.namespaces = g_hash_table_new(g_direct_hash, g_direct_equal);
+	
+	write_string(&w, doc->version);
+	write_string(&w, doc->encoding);
+	write_varint(&w, (uint64_t)(doc->standalone + 2));
+	int rc = encode_nodes(&w, doc->children);
+	write_varint(&w, dom_op_end);
+	
+	g_hash_table_destroy(w.strings);
+	g_hash_table_destroy(w.namespaces);
+	if(rc != 0) {
+		free(w.data);
+		return -1;
+	}
+	*p_data = w.data;
+	*p_length = w.length;
+	return 0;
+}
+
+
+struct dom_reader
+{
+	const unsigned char *p;
+	const unsigned char *end;
+	xmlDocPtr doc;
+	
+	const xmlChar **strings;	// interned in the doc's dict
+	size_t num_strings;
+	size_t max_strings;
+	xmlNsPtr *namespaces;
+	size_t num_namespaces;
+	size_t max_namespaces;
+};
+
+static int read_varint(struct dom_reader *r, uint64_t *p_value)
+{
+	uint64_t value = 0;
+	for(int shift = 0; shift < 64 && r->p < r->end; shift += 7) {
+		unsigned char c = *r->p++;
+		value |= (uint64_t)(c & 0x7f) << shift;
+		if(0 == (c & 0x80)) {
+			*p_value = value;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int read_bytes(struct dom_reader *r, const unsigned char **p_bytes, size_t *p_length)
+{
+	uint64_t length = 0;
+	if(read_varint(r, &length) != 0) return -1;
+	if(length > (uint64_t)(r->end - r->p)) return -1;
+	*p_bytes = r->p;
+	*p_length = length;
+	r->p += length;
+	return 0;
+}
+
+static int read_string(struct dom_reader *r, const xmlChar **p_string)
+{
+	uint64_t id = 0;
+	if(read_varint(r, &id) != 0) return -1;
+	if(0 == id) {
+		*p_string = NULL;
+		return 0;
+	}
+	if(id >= 2) {
+		if(id - 2 >= r->num_strings) return -1;
+		*p_string = r->strings[id - 2];
+		return 0;
+	}
+	
+	const unsigned char *bytes = NULL;
+	size_t length = 0;
+	if(read_bytes(r, &bytes, &length) != 0) return -1;
+	const xmlChar *string = xmlDictLookup(r->doc->dict, bytes, (int)length);
+	if(NULL == string) return -1;
+	
+	if(r->num_strings >= r->max_strings) {
+		size_t new_size = r->max_strings?(r->max_strings * 2):256;
+		const xmlChar **strings = realloc(r->strings, new_size * sizeof(*strings));
+		assert(strings);
+		r->strings = strings;
+		r->max_strings = new_size;
+	}
+	r->strings[r->num_strings++] = string;
+	*p_string = string;
+	return 0;
+}
+
+static int read_ns_ref(struct dom_reader *r, xmlNodePtr node, xmlNsPtr *p_ns)
+{
+	uint64_t ref = 0;
+	if(read_varint(r, &ref) != 0) return -1;
+	if(0 == ref) {
+		*p_ns = NULL;
+		return 0;
+	}
+	if(ref >= 2) {
+		if(ref - 2 >= r->num_namespaces) return -1;
+		*p_ns = r->namespaces[ref - 2];
+		return 0;
+	}
+	
+	const xmlChar *prefix = NULL, *href = NULL;
+	if(read_string(r, &prefix) != 0 || read_string(r, &href) != 0 || NULL == href) return -1;
+	*p_ns = xmlSearchNsByHref(r->doc, node, href);
+	return (*p_ns)?0:-1;
+}
+
+static void append_child(xmlNodePtr parent, xmlNodePtr node)
+{
+	node->parent = parent;
+	if(parent->last) {
+		parent->last->next = node;
+		node->prev = parent->last;
+	}else {
+		parent->children = node;
+	}
+	parent->last = node;
+}
+
+/*
+ * like xmlNewDocTextLen(), but short content is stored inside the node (as libxml2's SAX2 tree builder does),
+ * most cell values and attribute values of a part fit and need no allocation of their own.
+ */
+static xmlNodePtr new_text_node(xmlDocPtr doc, const unsigned char *content, size_t length)
+{
+	xmlNodePtr node = xmlMalloc(sizeof(*node));
+	if(NULL == node) return NULL;
+	memset(node, 0, sizeof(*node));
+	node->type = XML_TEXT_NODE;
+	node->name = xmlStringText;
+	node->doc = doc;
+	
+	if(length < 2 * sizeof(void *)) {
+		xmlChar *intern = (xmlChar *)&node->properties;	// properties and nsDef, see xmlFreeNode()
+		memcpy(intern, content, length);
+		intern[length] = '\0';
+		node->content = intern;
+		return node;
+	}
+	node->content = xmlStrndup(content, (int)length);
+	if(NULL == node->content) {
+		xmlFree(node);
+		return NULL;
+	}
+	return node;
+}
+
+static xmlNodePtr decode_element(struct dom_reader *r, xmlNodePtr parent)
+{
+	const xmlChar *name = NULL;
+	if(read_string(r, &name) != 0 || NULL == name) return NULL;
+	
+	// the name is owned by the doc's dict
+	xmlNodePtr node = xmlNewDocNodeEatName(r->doc, NULL, (xmlChar *)name, NULL);
+	if(NULL == node) return NULL;
+	append_child(parent, node);
+	
+	uint64_t num_ns_defs = 0;
+	if(read_varint(r, &num_ns_defs) != 0) return NULL;
+	for(uint64_t i = 0; i < num_ns_defs; ++i) {
+		const xmlChar *prefix = NULL, *href = NULL;
+		if(read_string(r, &prefix) != 0 || read_string(r, &href) != 0) return NULL;
+		
+		xmlNsPtr ns = xmlNewNs(node, href, prefix);
+		if(NULL == ns) return NULL;
+		if(r->num_namespaces >= r->max_namespaces) {
+			size_t new_size = r->max_namespaces?(r->max_namespaces * 2):16;
+			xmlNsPtr *namespaces = realloc(r->namespaces, new_size * sizeof(*namespaces));
+			assert(namespaces);
+			r->namespaces = namespaces;
+			r->max_namespaces = new_size;
+		}
+		r->namespaces[r->num_namespaces++] = ns;
+	}
+	if(read_ns_ref(r, node, &node->ns) != 0) return NULL;
+	
+	uint64_t num_attrs = 0;
+	if(read_varint(r, &num_attrs) != 0) return NULL;
+	xmlAttrPtr last_attr = NULL;
+	for(uint64_t i = 0; i < num_attrs; ++i) {
+		const xmlChar *attr_name = NULL;
+		xmlNsPtr ns = NULL;
+		const unsigned char *value = NULL;
+		size_t cb_value = 0;
+		if(read_string(r, &attr_name) != 0 || NULL == attr_name) return NULL;
+		if(read_ns_ref(r, node, &ns) != 0) return NULL;
+		if(read_bytes(r, &value, &cb_value) != 0) return NULL;
+		
+		xmlAttrPtr attr = xmlMalloc(sizeof(*attr));
+		if(NULL == attr) return NULL;
+		memset(attr, 0, sizeof(*attr));
+		attr->type = XML_ATTRIBUTE_NODE;
+		attr->name = attr_name;
+		attr->ns = ns;
+		attr->parent = node;
+		attr->doc = r->doc;
+		if(last_attr) {
+			last_attr->next = attr;
+			attr->prev = last_attr;
+		}else {
+			node->properties = attr;
+		}
+		last_attr = attr;
+		
+		if(cb_value > 0) {
+			xmlNodePtr text = new_text_node(r->doc, value, cb_value);
+			if(NULL == text) return NULL;
+			append_child((xmlNodePtr)attr, text);
+		}
+	}
+	return node;
+}
+
+static xmlNodePtr decode_content(struct dom_reader *r, uint64_t op)
+{
+	const xmlChar *name = NULL;
+	if(op == dom_op_pi && (read_string(r, &name) != 0 || NULL == name)) return NULL;
+	
+	const unsigned char *content = NULL;
+	size_t length = 0;
+	if(read_bytes(r, &content, &length) != 0) return NULL;
+	
+	if(op == dom_op_text) return new_text_node(r->doc, content, length);
+	if(op == dom_op_cdata) return xmlNewCDataBlock(r->doc, content, (int)length);
+	
+	xmlChar *string = xmlStrndup(content, (int)length);
+	if(NULL == string) return NULL;
+	xmlNodePtr node = (op == dom_op_pi)?xmlNewDocPI(r->doc, name, string):xmlNewDocComment(r->doc, string);
+	xmlFree(string);
+	return node;
+}
+
+xmlDocPtr ooxml_dom_decode(const unsigned char *data, size_t length, const char *url)
+{
+	struct dom_reader r;
+	memset(&r, 0, sizeof(r));
+	r.p = data;
+	r.end = data + length;
+	
+	xmlDocPtr doc = xmlNewDoc(NULL);
+	if(NULL == doc) return NULL;
+	doc->dict = xmlDictCreate();
+	r.doc = doc;
+	
+	int rc = -1;
+	const xmlChar *version = NULL, *encoding = NULL;
+	uint64_t standalone = 0;
+	if(NULL == doc->dict) goto label_final;
+	if(read_string(&r, &version) != 0 || read_string(&r, &encoding) != 0) goto label_final;
+	if(read_varint(&r, &standalone) != 0) goto label_final;
+	
+	if(version) {
+		xmlFree((xmlChar *)doc->version);
+		doc->version = xmlStrdup(version);
+	}
+	if(encoding) doc->encoding = xmlStrdup(encoding);
+	doc->standalone = (int)standalone - 2;
+	if(url) doc->URL = xmlStrdup((const xmlChar *)url);
+	
+	xmlNodePtr parent = (xmlNodePtr)doc;
+	while(r.p < r.end) {
+		uint64_t op = 0;
+		if(read_varint(&r, &op) != 0) goto label_final;
+		
+		if(op == dom_op_end) {
+			if(parent == (xmlNodePtr)doc) {
+				rc = (r.p == r.end)?0:-1;
+				break;
+			}
+			parent = parent->parent;
+			continue;
+		}
+		if(op == dom_op_element) {
+			xmlNodePtr node = decode_element(&r, parent);
+			if(NULL == node) goto label_final;
+			parent = node;
+			continue;
+		}
+		if(op > dom_op_pi) goto label_final;
+		
+		xmlNodePtr node = decode_content(&r, op);
+		if(NULL == node) goto label_final;
+		append_child(parent, node);
+	}
+
+label_final:
+	free(r.strings);
+	free(r.namespaces);
+	if(rc != 0) {
+		xmlFreeDoc(doc);
+		return NULL;
+	}
+	return doc;
+}
+
+
+#if defined(TEST_OOXML_DOM_CODEC_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
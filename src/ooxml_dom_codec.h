@@ -0,0 +1,28 @@
+#ifndef OOXML_DOM_CODEC_H_
+#define OOXML_DOM_CODEC_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <libxml/tree.h>
+
+/*
+ * compact binary form of a parsed part (see ooxml_part_cache.h):
+ * a pre-order stream of nodes, names and namespace uris are written once and then referenced by id.
+ * only the node types the parser builds for ooxml parts are supported
+ * (elements, attributes, text, cdata, comments, processing instructions).
+ */
+
+// returns -1 if the document contains anything else (e.g. a dtd), *p_data must be released with free()
+int ooxml_dom_encode(xmlDocPtr doc, unsigned char **p_data, size_t *p_length);
+
+// all nodes are allocated through libxml2 (i.e. from the current arena), returns NULL if the data is invalid
+xmlDocPtr ooxml_dom_decode(const unsigned char *data, size_t length, const char *url);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
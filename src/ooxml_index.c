@@ -0,0 +1,1261 @@
+/*
+ * ooxml_index.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include "app.h"
+#include "ooxml_context.h"
+#include "ooxml_private.h"
+#include "ooxml_spreadsheet.h"
+#include "ooxml_shared_strings.h"
+#include "ooxml_cell_decode.h"
+#include "ooxml_document.h"
+#include "ooxml_string_pool.h"
+#include "ooxml_index.h"
+#include "batch_convert.h"
+#include "perf_trace.h"
+
+/******************************************************************************
+ * file format, host byte order
+ *   header | docs | parts | terms | postings | strings
+******************************************************************************/
+#define OOXML_INDEX_MAGIC	"OOXIDX01"
+#define OOXML_INDEX_VERSION	(3)		// 2: cjk unigrams and bigrams, truncated long terms; 3: 64-bit posting list sizes
+
+struct index_file_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t num_docs;
+	uint32_t num_parts;
+	uint32_t num_terms;
+	uint64_t docs_offset;		// struct index_file_doc[num_docs]
+	uint64_t parts_offset;		// uint64_t[num_parts]: offsets of the part names in the strings
+	uint64_t terms_offset;		// struct index_file_term[num_terms], sorted by term
+	uint64_t postings_offset;
+	uint64_t strings_offset;	// nul-terminated strings
+	uint64_t file_size;
+};
+
+struct index_file_doc
+{
+	uint64_t path;			// offset in the strings
+	int64_t mtime;			// ns
+	int64_t size;
+	uint32_t checksum;		// archive_checksum()
+	uint32_t num_parts;
+	uint64_t first_part;	// index in the parts table
+};
+
+struct index_file_term
+{
+	uint64_t term;			// offset in the strings
+	uint64_t postings;		// offset in the postings
+	uint64_t cb_postings;
+	uint64_t num_postings;
+};
+
+/******************************************************************************
+ * postings: sorted by (doc, part, unit), each one is
+ *   varint(doc - prev.doc)
+ *   zigzag(part - prev.part) in the same doc, varint(part) otherwise
+ *   zigzag(unit - prev.unit) in the same part, varint(unit) otherwise
+ *   varint(sub)
+******************************************************************************/
+struct posting
+{
+	uint32_t doc;
+	uint32_t part;
+	int64_t unit;
+	int64_t sub;
+};
+
+static size_t varint_encode(unsigned char *p, uint64_t value)
+{
+	size_t length = 0;
+	while(value >= 0x80) {
+		p[length++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	p[length++] = (unsigned char)value;
+	return length;
+}
+
+static const unsigned char *varint_decode(const unsigned char *p, const unsigned char *p_end, uint64_t *p_value)
+{
+	uint64_t value = 0;
+	for(int shift = 0; p < p_end && shift < 64; shift += 7) {
+		unsigned char c = *p++;
+		value |= (uint64_t)(c & 0x7F) << shift;
+		if(0 == (c & 0x80)) {
+			*p_value = value;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static inline uint64_t zigzag_encode(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+struct posting_list
+{
+	unsigned char *data;
+	size_t cb_data;
+	size_t max_size;
+	uint64_t num_postings;
+	struct posting last;
+};
+
+static void posting_list_append(struct posting_list *list, const struct posting *posting)
+{
+	const struct posting *last = &list->last;
+	int same_doc = (list->num_postings > 0 && posting->doc == last->doc);
+	int same_part = (same_doc && posting->part == last->part);
+	if(same_part && posting->unit == last->unit && posting->sub == last->sub) return;
+	
+	unsigned char buffer[4 * 10];
+	size_t length = 0;
+	length += varint_encode(buffer + length, posting->doc - (list->num_postings?last->doc:0));
+	length += varint_encode(buffer + length, same_doc?zigzag_encode((int64_t)posting->part - last->part):posting->part);
+	length += varint_encode(buffer + length, same_part?zigzag_encode(posting->unit - last->unit):(uint64_t)posting->unit);
+	length += varint_encode(buffer + length, posting->sub);
+	
+	if((list->cb_data + length) > list->max_size) {
+		size_t new_size = list->max_size?(list->max_size * 2):16;
+		while(new_size < (list->cb_data + length)) new_size *= 2;
+		unsigned char *data = realloc(list->data, new_size);
+		assert(data);
+		list->data = data;
+		list->max_size = new_size;
+	}
+	memcpy(list->data + list->cb_data, buffer, length);
+	list->cb_data += length;
+	++list->num_postings;
+	list->last = *posting;
+}
+
+struct posting_cursor
+{
+	const unsigned char *p;
+	const unsigned char *p_end;
+	uint64_t num_remaining;
+	int has_current;
+	struct posting current;
+};
+
+static void posting_cursor_init(struct posting_cursor *cursor, const unsigned char *data, uint64_t cb_data, uint64_t num_postings)
+{
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->p = data;
+	cursor->p_end = data + cb_data;
+	cursor->num_remaining = num_postings;
+}
+
+// returns 1 and moves to the next posting, 0 at the end, -1 if the list is corrupted
+static int posting_cursor_next(struct posting_cursor *cursor)
+{
+	if(0 == cursor->num_remaining) return 0;
+	
+	uint64_t values[4];
+	const unsigned char *p = cursor->p;
+	for(int i = 0; i < 4; ++i) {
+		p = varint_decode(p, cursor->p_end, &values[i]);
+		if(NULL == p) return -1;
+	}
+	
+	struct posting *current = &cursor->current;
+	int same_doc = (cursor->has_current && 0 == values[0]);
+	current->doc = cursor->has_current?(current->doc + values[0]):values[0];
+	uint32_t part = same_doc?(uint32_t)(current->part + zigzag_decode(values[1])):(uint32_t)values[1];
+	int same_part = (same_doc && part == current->part);
+	current->unit = same_part?(current->unit + zigzag_decode(values[2])):(int64_t)values[2];
+	current->part = part;
+	current->sub = values[3];
+	
+	cursor->p = p;
+	cursor->has_current = 1;
+	--cursor->num_remaining;
+	return 1;
+}
+
+static int posting_compare_unit(const struct posting *a, const struct posting *b)
+{
+	if(a->doc != b->doc) return (a->doc < b->doc)?-1:1;
+	if(a->part != b->part) return (a->part < b->part)?-1:1;
+	if(a->unit != b->unit) return (a->unit < b->unit)?-1:1;
+	return 0;
+}
+
+/******************************************************************************
+ * tokenizer
+******************************************************************************/
+typedef void (*term_callback)(void *user_data, const char *term, size_t length);
+
+/*
+ * decode one utf-8 sequence, invalid bytes are returned as themselves (length 1).
+ * returns its length
+ */
+static size_t utf8_decode(const unsigned char *p, const unsigned char *p_end, uint32_t *p_code)
+{
+	unsigned char c = p[0];
+	size_t length = (c >= 0xF0)?4:(c >= 0xE0)?3:(c >= 0xC0)?2:1;
+	if(length == 1 || (size_t)(p_end - p) < length) {
+		*p_code = c;
+		return 1;
+	}
+	uint32_t code = c & (0x7F >> length);
+	for(size_t i = 1; i < length; ++i) {
+		if((p[i] & 0xC0) != 0x80) {
+			*p_code = c;
+			return 1;
+		}
+		code = (code << 6) | (p[i] & 0x3F);
+	}
+	*p_code = code;
+	return length;
+}
+
+static int is_term_char(uint32_t code)
+{
+	if(code < 0x80) return (code >= '0' && code <= '9') || (code >= 'a' && code <= 'z') || (code >= 'A' && code <= 'Z');
+	if(code < 0xC0) return code == 0xAA || code == 0xB5 || code == 0xBA;	// latin-1 symbols, but ª µ º
+	if(code == 0xD7 || code == 0xF7) return 0;	// × ÷
+	if(code >= 0x2000 && code <= 0x206F) return 0;	// general punctuation
+	if(code >= 0x3000 && code <= 0x303F) return 0;	// cjk symbols and punctuation
+	if(code >= 0xFF01 && code <= 0xFF0F) return 0;	// fullwidth punctuation
+	if(code == 0xFEFF) return 0;
+	return 1;
+}
+
+// scripts written without spaces: kana and cjk ideographs
+static int is_cjk_char(uint32_t code)
+{
+	return (code >= 0x3040 && code <= 0x30FF)
+		|| (code >= 0x3400 && code <= 0x4DBF)
+		|| (code >= 0x4E00 && code <= 0x9FFF)
+		|| (code >= 0xF900 && code <= 0xFAFF)
+		|| (code >= 0x20000 && code <= 0x2FA1F);
+}
+
+static void tokenize(const char *text, size_t length, term_callback on_term, void *user_data)
+{
+	const unsigned char *p = (const unsigned char *)text;
+	const unsigned char *p_end = p + length;
+	char term[OOXML_INDEX_MAX_TERM_LENGTH + 4];
+	size_t cb_term = 0;
+	int is_too_long = 0;
+	const unsigned char *cjk_prev = NULL;	// the previous character when it is a cjk one
+	size_t cb_cjk_prev = 0;
+	
+	while(p < p_end) {
+		uint32_t code = 0;
+		size_t cb_char = utf8_decode(p, p_end, &code);
+		
+		// cjk runs: every character and every pair of adjacent characters is a term
+		if(is_cjk_char(code)) {
+			if(cb_term > 0) on_term(user_data, term, cb_term);
+			cb_term = 0;
+			is_too_long = 0;
+			
+			on_term(user_data, (const char *)p, cb_char);
+			if(cjk_prev) {
+				memcpy(term, cjk_prev, cb_cjk_prev);
+				memcpy(term + cb_cjk_prev, p, cb_char);
+				on_term(user_data, term, cb_cjk_prev + cb_char);
+			}
+			cjk_prev = p;
+			cb_cjk_prev = cb_char;
+			p += cb_char;
+			continue;
+		}
+		cjk_prev = NULL;
+		
+		// keep decimal separators between digits: 3.14, 1,000
+		int is_separator = (code == '.' || code == ',') && cb_term > 0 && term[cb_term - 1] >= '0' && term[cb_term - 1] <= '9'
+			&& (p + 1) < p_end && p[1] >= '0' && p[1] <= '9';
+		if(!is_separator && !is_term_char(code)) {
+			if(cb_term > 0) on_term(user_data, term, cb_term);
+			cb_term = 0;
+			is_too_long = 0;
+			p += cb_char;
+			continue;
+		}
+		
+		// over-long terms are truncated to their first OOXML_INDEX_MAX_TERM_LENGTH bytes (whole characters)
+		if(is_too_long || (cb_term + cb_char) > OOXML_INDEX_MAX_TERM_LENGTH) is_too_long = 1;
+		else if(cb_char == 1) {
+			char c = (char)code;
+			if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+			term[cb_term++] = c;
+		}else if(cb_char == 2 && code >= 0xC0 && code <= 0xDE) {
+			code += 0x20;	// latin-1 upper case
+			term[cb_term++] = (char)(0xC0 | (code >> 6));
+			term[cb_term++] = (char)(0x80 | (code & 0x3F));
+		}else {
+			memcpy(term + cb_term, p, cb_char);
+			cb_term += cb_char;
+		}
+		p += cb_char;
+	}
+	if(cb_term > 0) on_term(user_data, term, cb_term);
+}
+
+/******************************************************************************
+ * index_builder: the postings of all the archives, merged by the workers
+******************************************************************************/
+struct index_doc
+{
+	char *path;
+	int64_t mtime;
+	int64_t size;
+	uint32_t checksum;
+	uint32_t num_parts;
+	char **parts;
+};
+
+struct index_builder
+{
+	pthread_mutex_t mutex;
+	
+	struct ooxml_string_pool terms;
+	struct posting_list *postings;	// terms.count items
+	uint32_t max_postings;
+	
+	struct index_doc *docs;
+	uint32_t num_docs;
+	uint32_t max_docs;
+};
+
+static void index_builder_init(struct index_builder *builder)
+{
+	memset(builder, 0, sizeof(*builder));
+	pthread_mutex_init(&builder->mutex, NULL);
+}
+
+static void index_builder_cleanup(struct index_builder *builder)
+{
+	for(uint32_t i = 0; i < builder->terms.count; ++i) free(builder->postings[i].data);
+	free(builder->postings);
+	ooxml_string_pool_cleanup(&builder->terms);
+	
+	for(uint32_t i = 0; i < builder->num_docs; ++i) {
+		struct index_doc *doc = &builder->docs[i];
+		for(uint32_t part = 0; part < doc->num_parts; ++part) free(doc->parts[part]);
+		free(doc->parts);
+		free(doc->path);
+	}
+	free(builder->docs);
+	pthread_mutex_destroy(&builder->mutex);
+	memset(builder, 0, sizeof(*builder));
+}
+
+// returns the index of the term in builder->terms and builder->postings
+static uint32_t index_builder_intern_term(struct index_builder *builder, const char *term, size_t length)
+{
+	uint32_t index = ooxml_string_pool_intern(&builder->terms, term, length);
+	if(index >= builder->max_postings) {
+		uint32_t new_size = builder->max_postings?(builder->max_postings * 2):4096;
+		struct posting_list *postings = realloc(builder->postings, new_size * sizeof(*postings));
+		assert(postings);
+		memset(postings + builder->max_postings, 0, (new_size - builder->max_postings) * sizeof(*postings));
+		builder->postings = postings;
+		builder->max_postings = new_size;
+	}
+	return index;
+}
+
+// takes the ownership of the parts
+static uint32_t index_builder_add_doc(struct index_builder *builder, const char *path, int64_t mtime, int64_t size,
+	uint32_t checksum, uint32_t num_parts, char **parts)
+{
+	if(builder->num_docs >= builder->max_docs) {
+		uint32_t new_size = builder->max_docs?(builder->max_docs * 2):1024;
+		struct index_doc *docs = realloc(builder->docs, new_size * sizeof(*docs));
+		assert(docs);
+		builder->docs = docs;
+		builder->max_docs = new_size;
+	}
+	struct index_doc *doc = &builder->docs[builder->num_docs];
+	doc->path = strdup(path);
+	assert(doc->path);
+	doc->mtime = mtime;
+	doc->size = size;
+	doc->checksum = checksum;
+	doc->num_parts = num_parts;
+	doc->parts = parts;
+	return builder->num_docs++;
+}
+
+struct sorted_term
+{
+	const char *term;
+	uint32_t index;
+};
+
+static int sorted_term_compare(const void *a, const void *b)
+{
+	return strcmp(((const struct sorted_term *)a)->term, ((const struct sorted_term *)b)->term);
+}
+
+static int write_all(FILE *fp, const void *data, size_t length)
+{
+	if(0 == length) return 0;
+	return (fwrite(data, 1, length, fp) == length)?0:-1;
+}
+
+/*
+ * write the index to a temporary file next to index_path, then replace index_path
+ */
+static int index_builder_write(struct index_builder *builder, const char *index_path)
+{
+	uint32_t num_terms = builder->terms.count;
+	struct sorted_term *sorted = calloc(num_terms + 1, sizeof(*sorted));
+	assert(sorted);
+	for(uint32_t i = 0; i < num_terms; ++i) {
+		sorted[i].term = ooxml_string_pool_get(&builder->terms, i, NULL);
+		sorted[i].index = i;
+	}
+	qsort(sorted, num_terms, sizeof(*sorted), sorted_term_compare);
+	
+	// the strings section: paths, part names and terms, each one once
+	struct ooxml_string_pool strings;
+	memset(&strings, 0, sizeof(strings));
+	uint32_t num_parts = 0;
+	uint32_t *doc_paths = calloc(builder->num_docs + 1, sizeof(*doc_paths));
+	assert(doc_paths);
+	for(uint32_t i = 0; i < builder->num_docs; ++i) {
+		const struct index_doc *doc = &builder->docs[i];
+		doc_paths[i] = ooxml_string_pool_intern(&strings, doc->path, strlen(doc->path));
+		num_parts += doc->num_parts;
+	}
+	uint32_t *part_names = calloc(num_parts + 1, sizeof(*part_names));
+	assert(part_names);
+	for(uint32_t i = 0, part = 0; i < builder->num_docs; ++i) {
+		const struct index_doc *doc = &builder->docs[i];
+		for(uint32_t j = 0; j < doc->num_parts; ++j) {
+			part_names[part++] = ooxml_string_pool_intern(&strings, doc->parts[j], strlen(doc->parts[j]));
+		}
+	}
+	uint32_t *term_names = calloc(num_terms + 1, sizeof(*term_names));
+	assert(term_names);
+	for(uint32_t i = 0; i < num_terms; ++i) {
+		term_names[i] = ooxml_string_pool_intern(&strings, sorted[i].term, strlen(sorted[i].term));
+	}
+	
+	struct index_file_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, OOXML_INDEX_MAGIC, sizeof(header.magic));
+	header.version = OOXML_INDEX_VERSION;
+	header.num_docs = builder->num_docs;
+	header.num_parts = num_parts;
+	header.num_terms = num_terms;
+	header.docs_offset = sizeof(header);
+	header.parts_offset = header.docs_offset + (uint64_t)header.num_docs * sizeof(struct index_file_doc);
+	header.terms_offset = header.parts_offset + (uint64_t)num_parts * sizeof(uint64_t);
+	header.postings_offset = header.terms_offset + (uint64_t)num_terms * sizeof(struct index_file_term);
+	uint64_t cb_postings = 0;
+	for(uint32_t i = 0; i < num_terms; ++i) cb_postings += builder->postings[i].cb_data;
+	header.strings_offset = header.postings_offset + cb_postings;
+	header.file_size = header.strings_offset + strings.cb_arena;
+	
+	size_t cb_path = strlen(index_path);
+	char *temp_path = malloc(cb_path + sizeof(".XXXXXX"));
+	assert(temp_path);
+	memcpy(temp_path, index_path, cb_path);
+	memcpy(temp_path + cb_path, ".XXXXXX", sizeof(".XXXXXX"));
+	
+	int rc = -1;
+	FILE *fp = NULL;
+	int fd = mkstemp(temp_path);
+	if(fd == -1) {
+		perror(temp_path);
+		goto label_final;
+	}
+	
+	// mkstemp() creates the file with 0600, keep the mode of the file that gets replaced
+	struct stat st;
+	if(stat(index_path, &st) == 0) {
+		fchmod(fd, st.st_mode & 07777);
+	}else {
+		mode_t mask = umask(0);
+		umask(mask);
+		fchmod(fd, 0666 & ~mask);
+	}
+	fp = fdopen(fd, "wb");
+	assert(fp);
+	setvbuf(fp, NULL, _IOFBF, 1024 * 1024);
+	
+	rc = write_all(fp, &header, sizeof(header));
+	for(uint32_t i = 0, part = 0; 0 == rc && i < builder->num_docs; ++i) {
+		const struct index_doc *doc = &builder->docs[i];
+		struct index_file_doc record;
+		memset(&record, 0, sizeof(record));
+		record.path = strings.offsets[doc_paths[i]];
+		record.mtime = doc->mtime;
+		record.size = doc->size;
+		record.checksum = doc->checksum;
+		record.num_parts = doc->num_parts;
+		record.first_part = part;
+		part += doc->num_parts;
+		rc = write_all(fp, &record, sizeof(record));
+	}
+	for(uint32_t i = 0; 0 == rc && i < num_parts; ++i) {
+		uint64_t offset = strings.offsets[part_names[i]];
+		rc = write_all(fp, &offset, sizeof(offset));
+	}
+	uint64_t postings_offset = 0;
+	for(uint32_t i = 0; 0 == rc && i < num_terms; ++i) {
+		const struct posting_list *list = &builder->postings[sorted[i].index];
+		struct index_file_term record;
+		memset(&record, 0, sizeof(record));
+		record.term = strings.offsets[term_names[i]];
+		record.postings = postings_offset;
+		record.cb_postings = list->cb_data;
+		record.num_postings = list->num_postings;
+		postings_offset += list->cb_data;
+		rc = write_all(fp, &record, sizeof(record));
+	}
+	for(uint32_t i = 0; 0 == rc && i < num_terms; ++i) {
+		const struct posting_list *list = &builder->postings[sorted[i].index];
+		rc = write_all(fp, list->data, list->cb_data);
+	}
+	if(0 == rc) rc = write_all(fp, strings.arena, strings.cb_arena);
+	
+	if(fclose(fp) != 0) rc = -1;
+	if(0 == rc && rename(temp_path, index_path) != 0) {
+		perror("rename");
+		rc = -1;
+	}
+	if(rc) {
+		fprintf(stderr, "%s(%s) failed: %s\n", __FUNCTION__, index_path, strerror(errno));
+		unlink(temp_path);
+	}
+
+label_final:
+	free(temp_path);
+	free(term_names);
+	free(part_names);
+	free(doc_paths);
+	ooxml_string_pool_cleanup(&strings);
+	free(sorted);
+	return rc;
+}
+
+/******************************************************************************
+ * ooxml_index: a mapped index file
+******************************************************************************/
+struct ooxml_index
+{
+	unsigned char *data;
+	size_t size;
+	
+	const struct index_file_header *header;
+	const struct index_file_doc *docs;
+	const uint64_t *parts;
+	const struct index_file_term *terms;
+	const unsigned char *postings;
+	const char *strings;
+	uint64_t cb_strings;
+};
+
+static int is_valid_string(const struct ooxml_index *index, uint64_t offset)
+{
+	return offset < index->cb_strings && memchr(index->strings + offset, '\0', index->cb_strings - offset);
+}
+
+static int ooxml_index_validate(const struct ooxml_index *index)
+{
+	const struct index_file_header *header = index->header;
+	if(index->size < sizeof(*header) || memcmp(header->magic, OOXML_INDEX_MAGIC, sizeof(header->magic)) != 0) return -1;
+	if(header->version != OOXML_INDEX_VERSION || header->file_size != index->size) return -1;
+	
+	if(header->docs_offset != sizeof(*header)
+		|| header->parts_offset != header->docs_offset + (uint64_t)header->num_docs * sizeof(struct index_file_doc)
+		|| header->terms_offset != header->parts_offset + (uint64_t)header->num_parts * sizeof(uint64_t)
+		|| header->postings_offset != header->terms_offset + (uint64_t)header->num_terms * sizeof(struct index_file_term)
+		|| header->postings_offset > header->strings_offset
+		|| header->strings_offset > header->file_size)
+	{
+		return -1;
+	}
+	
+	uint64_t cb_postings = header->strings_offset - header->postings_offset;
+	for(uint32_t i = 0; i < header->num_terms; ++i) {
+		const struct index_file_term *term = &index->terms[i];
+		if(!is_valid_string(index, term->term)) return -1;
+		if(term->postings > cb_postings || term->cb_postings > (cb_postings - term->postings)) return -1;
+	}
+	for(uint32_t i = 0; i < header->num_parts; ++i) {
+		if(!is_valid_string(index, index->parts[i])) return -1;
+	}
+	for(uint32_t i = 0; i < header->num_docs; ++i) {
+		const struct index_file_doc *doc = &index->docs[i];
+		if(!is_valid_string(index, doc->path)) return -1;
+		if(doc->first_part > header->num_parts || doc->num_parts > (header->num_parts - doc->first_part)) return -1;
+	}
+	return 0;
+}
+
+// the version of an index file, or -1 if it is not one
+static int index_file_version(const char *index_path)
+{
+	struct index_file_header header;
+	FILE *fp = fopen(index_path, "rb");
+	if(NULL == fp) return -1;
+	size_t cb = fread(&header, 1, sizeof(header), fp);
+	fclose(fp);
+	if(cb != sizeof(header) || memcmp(header.magic, OOXML_INDEX_MAGIC, sizeof(header.magic)) != 0) return -1;
+	return (int)header.version;
+}
+
+struct ooxml_index *ooxml_index_open(const char *index_path)
+{
+	int fd = open(index_path, O_RDONLY);
+	if(fd == -1) {
+		perror(index_path);
+		return NULL;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct index_file_header)) {
+		fprintf(stderr, "%s: not an index file\n", index_path);
+		close(fd);
+		return NULL;
+	}
+	
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	
+	struct ooxml_index *index = calloc(1, sizeof(*index));
+	assert(index);
+	index->data = data;
+	index->size = st.st_size;
+	index->header = data;
+	
+	const struct index_file_header *header = index->header;
+	if(index->size >= sizeof(*header) && header->strings_offset <= index->size && header->terms_offset <= index->size) {
+		index->docs = (const void *)(index->data + header->docs_offset);
+		index->parts = (const void *)(index->data + header->parts_offset);
+		index->terms = (const void *)(index->data + header->terms_offset);
+		index->postings = index->data + header->postings_offset;
+		index->strings = (const char *)index->data + header->strings_offset;
+		index->cb_strings = index->size - header->strings_offset;
+	}
+	if(NULL == index->terms || ooxml_index_validate(index) != 0) {
+		fprintf(stderr, "%s: invalid or incompatible index file\n", index_path);
+		ooxml_index_close(index);
+		return NULL;
+	}
+	return index;
+}
+
+void ooxml_index_close(struct ooxml_index *index)
+{
+	if(NULL == index) return;
+	if(index->data) munmap(index->data, index->size);
+	free(index);
+}
+
+static const struct index_file_term *ooxml_index_find_term(const struct ooxml_index *index, const char *term)
+{
+	uint32_t low = 0, high = index->header->num_terms;
+	while(low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		int cmp = strcmp(index->strings + index->terms[mid].term, term);
+		if(0 == cmp) return &index->terms[mid];
+		if(cmp < 0) low = mid + 1;
+		else high = mid;
+	}
+	return NULL;
+}
+
+static void posting_cursor_init_term(struct posting_cursor *cursor, const struct ooxml_index *index, const struct index_file_term *term)
+{
+	posting_cursor_init(cursor, index->postings + term->postings, term->cb_postings, term->num_postings);
+}
+
+struct query_terms
+{
+	int count;
+	char terms[16][OOXML_INDEX_MAX_TERM_LENGTH + 1];
+	int is_truncated;
+};
+
+static void on_query_term(void *user_data, const char *term, size_t length)
+{
+	struct query_terms *query = user_data;
+	for(int i = 0; i < query->count; ++i) {
+		if(strlen(query->terms[i]) == length && memcmp(query->terms[i], term, length) == 0) return;
+	}
+	if(query->count >= (int)(sizeof(query->terms) / sizeof(query->terms[0]))) {
+		query->is_truncated = 1;
+		return;
+	}
+	memcpy(query->terms[query->count], term, length);
+	query->terms[query->count][length] = '\0';
+	++query->count;
+}
+
+static int ooxml_index_report_hit(const struct ooxml_index *index, const struct posting *posting,
+	ooxml_index_hit_callback on_hit, void *user_data)
+{
+	if(posting->doc >= index->header->num_docs) return -1;
+	const struct index_file_doc *doc = &index->docs[posting->doc];
+	if(posting->part >= doc->num_parts) return -1;
+	
+	struct ooxml_index_hit hit;
+	memset(&hit, 0, sizeof(hit));
+	hit.archive = index->strings + doc->path;
+	hit.part = index->strings + index->parts[doc->first_part + posting->part];
+	hit.unit = posting->unit;
+	hit.sub = posting->sub;
+	return on_hit?on_hit(user_data, &hit):0;
+}
+
+ssize_t ooxml_index_query(struct ooxml_index *index, const char *query, ooxml_index_hit_callback on_hit, void *user_data)
+{
+	assert(index && query);
+	struct query_terms terms;
+	memset(&terms, 0, sizeof(terms));
+	tokenize(query, strlen(query), on_query_term, &terms);
+	if(terms.is_truncated) fprintf(stderr, "%s: only the first %d terms are used\n", __FUNCTION__, terms.count);
+	if(0 == terms.count) return 0;
+	
+	struct posting_cursor cursors[16];
+	for(int i = 0; i < terms.count; ++i) {
+		const struct index_file_term *term = ooxml_index_find_term(index, terms.terms[i]);
+		if(NULL == term) return 0;
+		posting_cursor_init_term(&cursors[i], index, term);
+		if(posting_cursor_next(&cursors[i]) <= 0) return 0;
+	}
+	
+	// intersect the lists on (doc, part, unit)
+	ssize_t num_hits = 0;
+	while(1) {
+		int num_matches = 1;
+		struct posting *target = &cursors[0].current;
+		for(int i = 1; i < terms.count; ++i) {
+			int cmp = posting_compare_unit(&cursors[i].current, target);
+			if(cmp == 0) ++num_matches;
+			else if(cmp > 0) {
+				target = &cursors[i].current;
+				num_matches = 1;
+			}
+		}
+		
+		if(num_matches == terms.count) {
+			int rc = ooxml_index_report_hit(index, &cursors[0].current, on_hit, user_data);
+			if(rc < 0) return -1;
+			++num_hits;
+			if(rc) break;
+		}
+		
+		// move every list past the target
+		struct posting key = *target;
+		int cmp_limit = (num_matches == terms.count)?0:-1;
+		for(int i = 0; i < terms.count; ++i) {
+			while(posting_compare_unit(&cursors[i].current, &key) <= cmp_limit) {
+				int rc = posting_cursor_next(&cursors[i]);
+				if(rc < 0) return -1;
+				if(rc == 0) return num_hits;
+			}
+		}
+	}
+	return num_hits;
+}
+
+/******************************************************************************
+ * index_collector: the terms of one archive, collected by a worker
+******************************************************************************/
+struct index_hit
+{
+	uint32_t term;
+	uint32_t part;
+	int64_t unit;
+	int64_t sub;
+};
+
+struct index_collector
+{
+	struct ooxml_string_pool terms;
+	struct index_hit *hits;
+	size_t num_hits;
+	size_t max_hits;
+	
+	char **parts;
+	uint32_t num_parts;
+	uint32_t max_parts;
+	
+	// location of the text being tokenized
+	uint32_t part;
+	int64_t unit;
+	int64_t sub;
+	
+	struct ooxml_shared_strings *sst;
+};
+
+static void index_collector_reset(struct index_collector *collector)
+{
+	ooxml_string_pool_cleanup(&collector->terms);
+	free(collector->hits);
+	for(uint32_t i = 0; i < collector->num_parts; ++i) free(collector->parts[i]);
+	free(collector->parts);
+	memset(collector, 0, sizeof(*collector));
+}
+
+static void on_collector_term(void *user_data, const char *term, size_t length)
+{
+	struct index_collector *collector = user_data;
+	if(collector->num_hits >= collector->max_hits) {
+		size_t new_size = collector->max_hits?(collector->max_hits * 2):4096;
+		struct index_hit *hits = realloc(collector->hits, new_size * sizeof(*hits));
+		assert(hits);
+		collector->hits = hits;
+		collector->max_hits = new_size;
+	}
+	struct index_hit *hit = &collector->hits[collector->num_hits++];
+	hit->term = ooxml_string_pool_intern(&collector->terms, term, length);
+	hit->part = collector->part;
+	hit->unit = collector->unit;
+	hit->sub = collector->sub;
+}
+
+static void index_collector_add_part(struct index_collector *collector, const char *part_name)
+{
+	if(collector->num_parts >= collector->max_parts) {
+		uint32_t new_size = collector->max_parts?(collector->max_parts * 2):16;
+		char **parts = realloc(collector->parts, new_size * sizeof(*parts));
+		assert(parts);
+		collector->parts = parts;
+		collector->max_parts = new_size;
+	}
+	collector->part = collector->num_parts;
+	collector->parts[collector->num_parts++] = strdup(part_name);
+}
+
+static int on_index_part(void *user_data, const char *part_name, enum ooxml_document_story story, int is_end)
+{
+	if(!is_end) index_collector_add_part(user_data, part_name);
+	return 0;
+}
+
+static int on_index_paragraph(void *user_data, const struct ooxml_paragraph *paragraph)
+{
+	struct index_collector *collector = user_data;
+	collector->unit = paragraph->index;
+	collector->sub = 0;
+	tokenize(paragraph->text, paragraph->length, on_collector_term, collector);
+	return 0;
+}
+
+static int on_index_row(void *user_data, const struct ooxml_row *row)
+{
+	struct index_collector *collector = user_data;
+	collector->unit = row->row_index;
+	for(ssize_t i = 0; i < row->num_cells; ++i) {
+		const struct ooxml_cell *cell = &row->cells[i];
+		if(NULL == cell->value || cell->type == ooxml_cell_type_boolean || cell->type == ooxml_cell_type_error) continue;
+		
+		const char *text = cell->value;
+		size_t length = cell->cb_value;
+		if(cell->type == ooxml_cell_type_shared_string) {
+			int64_t index = 0;
+			if(ooxml_decode_int64(cell->value, cell->cb_value, &index) != ooxml_decode_ok) continue;
+			text = ooxml_shared_strings_get(collector->sst, index, &length);
+			if(NULL == text) continue;
+		}
+		collector->sub = cell->col;
+		tokenize(text, length, on_collector_term, collector);
+	}
+	return 0;
+}
+
+static int is_xml_part(const char *name)
+{
+	size_t cb_name = strlen(name);
+	return (cb_name > 4 && strcmp(name + cb_name - 4, ".xml") == 0);
+}
+
+static int collect_archive(struct ooxml_context *ooxml, const char *path, struct index_collector *collector)
+{
+	struct ooxml_private *priv = ooxml->priv;
+	if(ooxml->type == ooxml_file_document) {
+		struct ooxml_document_sink sink;
+		memset(&sink, 0, sizeof(sink));
+		sink.user_data = collector;
+		sink.on_part = on_index_part;
+		sink.on_paragraph = on_index_paragraph;
+		return ooxml_document_stream_text(priv->archive, OOXML_DOCUMENT_ALL_STORIES, &sink);
+	}
+	if(ooxml->type != ooxml_file_spreadsheet) {
+		fprintf(stderr, "[index] %s: unknown ooxml file type\n", path);
+		return -1;
+	}
+	
+	collector->sst = ooxml->get_shared_strings(ooxml);
+	const struct ooxml_dir_node *worksheets = ooxml->find_dir(ooxml, "xl/worksheets");
+	ssize_t num_files = worksheets?worksheets->num_files:0;
+	for(ssize_t i = 0; i < num_files; ++i) {
+		const char *part_name = priv->entries[worksheets->files[i]].filename;
+		if(!is_xml_part(part_name)) continue;
+		
+		index_collector_add_part(collector, part_name);
+		int rc = ooxml_spreadsheet_stream_rows(priv->archive, part_name, on_index_row, collector);
+		if(rc) return rc;
+	}
+	return 0;
+}
+
+/*
+ * crc32 of the names, crc32 and sizes of the central directory:
+ * detects a changed archive without inflating it
+ */
+static uint32_t archive_checksum(zip_t *zip)
+{
+	uLong crc = crc32(0L, Z_NULL, 0);
+	zip_int64_t num_entries = zip_get_num_entries(zip, 0);
+	for(zip_int64_t i = 0; i < num_entries; ++i) {
+		zip_stat_t st;
+		zip_stat_init(&st);
+		if(zip_stat_index(zip, i, 0, &st) != 0 || !(st.valid & ZIP_STAT_NAME)) continue;
+		
+		uint64_t values[2] = { st.crc, st.size };
+		crc = crc32(crc, (const Bytef *)st.name, strlen(st.name) + 1);
+		crc = crc32(crc, (const Bytef *)values, sizeof(values));
+	}
+	return (uint32_t)crc;
+}
+
+/******************************************************************************
+ * update
+******************************************************************************/
+enum index_entry_state
+{
+	index_entry_state_unchanged,	// keep the postings of the old index
+	index_entry_state_check,		// mtime or size changed, compare the checksums
+	index_entry_state_index,		// new or changed archive
+	index_entry_state_removed,
+};
+
+struct index_entry
+{
+	const char *path;
+	int64_t old_doc;	// -1: not in the old index
+	enum index_entry_state state;
+	int64_t mtime;
+	int64_t size;
+	uint32_t checksum;
+};
+
+struct index_worker
+{
+	pthread_t th;
+	const struct ooxml_index_options *options;
+	struct index_builder *builder;
+	struct index_entry **entries;
+	ssize_t num_entries;
+	volatile ssize_t *next_index;
+	ssize_t num_indexed;
+	ssize_t num_failed;
+};
+
+static void index_builder_merge(struct index_builder *builder, const struct index_entry *entry, struct index_collector *collector)
+{
+	uint32_t *term_map = calloc(collector->terms.count + 1, sizeof(*term_map));
+	assert(term_map);
+	
+	pthread_mutex_lock(&builder->mutex);
+	uint32_t doc = index_builder_add_doc(builder, entry->path, entry->mtime, entry->size, entry->checksum,
+		collector->num_parts, collector->parts);
+	collector->parts = NULL;
+	collector->num_parts = 0;
+	
+	for(uint32_t i = 0; i < collector->terms.count; ++i) {
+		size_t length = 0;
+		const char *term = ooxml_string_pool_get(&collector->terms, i, &length);
+		term_map[i] = index_builder_intern_term(builder, term, length);
+	}
+	for(size_t i = 0; i < collector->num_hits; ++i) {
+		const struct index_hit *hit = &collector->hits[i];
+		struct posting posting = { .doc = doc, .part = hit->part, .unit = hit->unit, .sub = hit->sub };
+		posting_list_append(&builder->postings[term_map[hit->term]], &posting);
+	}
+	pthread_mutex_unlock(&builder->mutex);
+	free(term_map);
+}
+
+static void *index_worker_thread(void *user_data)
+{
+	struct index_worker *worker = user_data;
+	const struct ooxml_index_options *options = worker->options;
+	
+	struct ooxml_context *ooxml = ooxml_context_init(NULL, worker);
+	assert(ooxml);
+	if(options->jooxml) ooxml_context_load_config(ooxml, options->jooxml);
+	ooxml->lazy_mode = 1;
+	
+	struct index_collector collector[1];
+	memset(collector, 0, sizeof(collector));
+	while(!(options->quit && *options->quit)) {
+		ssize_t index = __sync_fetch_and_add(worker->next_index, 1);
+		if(index >= worker->num_entries) break;
+		
+		struct index_entry *entry = worker->entries[index];
+		PERF_TRACE_BEGIN(span);
+		int rc = ooxml->open(ooxml, entry->path, 1);
+		if(0 == rc) {
+			entry->checksum = archive_checksum(((struct ooxml_private *)ooxml->priv)->archive);
+			rc = collect_archive(ooxml, entry->path, collector);
+			ooxml->close(ooxml);
+		}
+		if(0 == rc) index_builder_merge(worker->builder, entry, collector);
+		index_collector_reset(collector);
+		PERF_TRACE_END(span, "index_archive", entry->path);
+		
+		if(rc) {
+			fprintf(stderr, "[index] %s failed\n", entry->path);
+			++worker->num_failed;
+		}else {
+			++worker->num_indexed;
+		}
+	}
+	
+	ooxml_context_cleanup(ooxml);
+	free(ooxml);
+	return NULL;
+}
+
+// the postings of the unchanged archives of the old index, in the same order
+static void index_builder_copy_unchanged(struct index_builder *builder, const struct ooxml_index *old_index,
+	const struct index_entry *entries, uint32_t num_old_docs)
+{
+	uint32_t *doc_map = calloc(num_old_docs + 1, sizeof(*doc_map));
+	assert(doc_map);
+	for(uint32_t i = 0; i < num_old_docs; ++i) {
+		const struct index_entry *entry = &entries[i];
+		doc_map[i] = UINT32_MAX;
+		if(entry->state != index_entry_state_unchanged) continue;
+		
+		const struct index_file_doc *old_doc = &old_index->docs[i];
+		char **parts = calloc(old_doc->num_parts + 1, sizeof(*parts));
+		assert(parts);
+		for(uint32_t part = 0; part < old_doc->num_parts; ++part) {
+			parts[part] = strdup(old_index->strings + old_index->parts[old_doc->first_part + part]);
+		}
+		doc_map[i] = index_builder_add_doc(builder, entry->path, entry->mtime, entry->size, entry->checksum,
+			old_doc->num_parts, parts);
+	}
+	
+	for(uint32_t i = 0; i < old_index->header->num_terms; ++i) {
+		const struct index_file_term *term = &old_index->terms[i];
+		struct posting_cursor cursor;
+		posting_cursor_init_term(&cursor, old_index, term);
+		
+		int64_t index = -1;
+		while(posting_cursor_next(&cursor) > 0) {
+			struct posting posting = cursor.current;
+			if(posting.doc >= num_old_docs || doc_map[posting.doc] == UINT32_MAX) continue;
+			posting.doc = doc_map[posting.doc];
+			if(index < 0) {
+				const char *text = old_index->strings + term->term;
+				index = index_builder_intern_term(builder, text, strlen(text));
+			}
+			posting_list_append(&builder->postings[index], &posting);
+		}
+	}
+	free(doc_map);
+}
+
+int ooxml_index_update(const char *index_path, int num_paths, char **paths, const struct ooxml_index_options *options)
+{
+	assert(index_path && options);
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	struct ooxml_index *old_index = NULL;
+	if(access(index_path, F_OK) == 0) {
+		int version = index_file_version(index_path);
+		if(version > 0 && version < OOXML_INDEX_VERSION) {
+			// older tokenizer: the postings can not be kept, index everything again
+			fprintf(stderr, "[index] %s: version %d index, rebuilding\n", index_path, version);
+		}else {
+			old_index = ooxml_index_open(index_path);
+			if(NULL == old_index) return -1;
+		}
+	}
+	uint32_t num_old_docs = old_index?old_index->header->num_docs:0;
+	
+	// archives are identified by their real path, the ones of the old index first
+	struct ooxml_string_pool path_pool;
+	memset(&path_pool, 0, sizeof(path_pool));
+	for(uint32_t i = 0; i < num_old_docs; ++i) {
+		const char *path = old_index->strings + old_index->docs[i].path;
+		ooxml_string_pool_intern(&path_pool, path, strlen(path));
+	}
+	if(path_pool.count != num_old_docs) {
+		fprintf(stderr, "%s: invalid index file (duplicated archives)\n", index_path);
+		ooxml_string_pool_cleanup(&path_pool);
+		ooxml_index_close(old_index);
+		return -1;
+	}
+	struct batch_file_list files[1];
+	memset(files, 0, sizeof(files));
+	for(int i = 0; i < num_paths; ++i) batch_file_list_collect(files, paths[i]);
+	for(ssize_t i = 0; i < files->count; ++i) {
+		char real_path[PATH_MAX] = "";
+		if(NULL == realpath(files->paths[i], real_path)) continue;
+		ooxml_string_pool_intern(&path_pool, real_path, strlen(real_path));
+	}
+	batch_file_list_cleanup(files);
+	
+	ssize_t num_entries = path_pool.count;
+	struct index_entry *entries = calloc(num_entries + 1, sizeof(*entries));
+	struct index_entry **to_index = calloc(num_entries + 1, sizeof(*to_index));
+	assert(entries && to_index);
+	
+	ssize_t num_unchanged = 0, num_removed = 0, num_to_index = 0;
+	for(ssize_t i = 0; i < num_entries; ++i) {
+		struct index_entry *entry = &entries[i];
+		entry->path = ooxml_string_pool_get(&path_pool, i, NULL);
+		entry->old_doc = (i < num_old_docs)?i:-1;
+		entry->state = index_entry_state_index;
+		
+		struct stat st;
+		if(stat(entry->path, &st) != 0) {
+			entry->state = index_entry_state_removed;
+			++num_removed;
+			continue;
+		}
+		entry->mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+		entry->size = st.st_size;
+		if(entry->old_doc >= 0) {
+			const struct index_file_doc *old_doc = &old_index->docs[entry->old_doc];
+			entry->checksum = old_doc->checksum;
+			if(old_doc->mtime == entry->mtime && old_doc->size == entry->size) entry->state = index_entry_state_unchanged;
+			else entry->state = index_entry_state_check;
+		}
+		
+		// touched but not modified (copied, restored from a backup ...)
+		if(entry->state == index_entry_state_check) {
+			int err = 0;
+			zip_t *zip = zip_open(entry->path, ZIP_RDONLY, &err);
+			entry->state = index_entry_state_index;
+			if(zip) {
+				if(archive_checksum(zip) == entry->checksum) entry->state = index_entry_state_unchanged;
+				zip_discard(zip);
+			}
+		}
+		if(entry->state == index_entry_state_unchanged) ++num_unchanged;
+		else to_index[num_to_index++] = entry;
+	}
+	
+	struct index_builder builder[1];
+	index_builder_init(builder);
+	if(old_index) index_builder_copy_unchanged(builder, old_index, entries, num_old_docs);
+	
+	int num_workers = options->num_workers;
+	if(num_workers <= 0) num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if(num_workers <= 0) num_workers = 1;
+	if(num_workers > num_to_index) num_workers = num_to_index;
+	
+	ssize_t num_indexed = 0, num_failed = 0;
+	volatile ssize_t next_index = 0;
+	struct index_worker *workers = calloc(num_workers + 1, sizeof(*workers));
+	assert(workers);
+	for(int i = 0; i < num_workers; ++i) {
+		struct index_worker *worker = &workers[i];
+		worker->options = options;
+		worker->builder = builder;
+		worker->entries = to_index;
+		worker->num_entries = num_to_index;
+		worker->next_index = &next_index;
+		int rc = pthread_create(&worker->th, NULL, index_worker_thread, worker);
+		assert(0 == rc);
+	}
+	for(int i = 0; i < num_workers; ++i) {
+		pthread_join(workers[i].th, NULL);
+		num_indexed += workers[i].num_indexed;
+		num_failed += workers[i].num_failed;
+	}
+	free(workers);
+	
+	// the old index is mapped until its postings have been copied
+	ooxml_index_close(old_index);
+	
+	int rc = 0;
+	if(options->quit && *options->quit) {
+		fprintf(stderr, "[index] stopped, %s is unchanged\n", index_path);
+		rc = -1;
+	}else {
+		rc = index_builder_write(builder, index_path);
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1000000000.0;
+	fprintf(stderr, "[index] %ld archives: %ld unchanged, %ld indexed, %ld removed, %ld failed, %u terms, num_workers=%d, %.3f s\n",
+		(long)(num_entries - num_removed), (long)num_unchanged, (long)num_indexed, (long)num_removed, (long)num_failed,
+		builder->terms.count, num_workers, elapsed);
+	
+	index_builder_cleanup(builder);
+	free(to_index);
+	free(entries);
+	ooxml_string_pool_cleanup(&path_pool);
+	if(rc) return -1;
+	return (int)num_failed;
+}
+
+
+#if defined(TEST_OOXML_INDEX_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
@@ -0,0 +1,409 @@
+/*
+ * ooxml_part_cache.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "app.h"
+#include "ooxml_part_cache.h"
+#include "ooxml_dom_codec.h"
+
+/*
+ * cache file "<dir>/<fnv1a-64 of the key>.part":
+ *   header, key, data (cb_data bytes), encoded DOM (cb_dom bytes)
+ * the full key is compared on load (hash collisions), the data must match the entry's crc32
+ * and the DOM the checksum of the header, so a stale or torn file is just a miss.
+ * files are written under a temporary name and renamed into place, a hit touches the mtime (lru order).
+ */
+#define PART_CACHE_MAGIC "OXPCACHE"
+#define PART_CACHE_VERSION 1
+#define PART_CACHE_SUFFIX ".part"
+#define PART_CACHE_TMP_MAX_AGE (3600)	// seconds, leftovers of crashed writers
+
+struct part_cache_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t cb_key;
+	uint64_t cb_data;
+	uint64_t cb_dom;
+	uint32_t dom_checksum;	// crc32 of the encoded DOM
+	uint32_t has_doc;		// 0: the part is not xml (cb_dom == 0)
+};
+
+struct ooxml_part_cache
+{
+	char *dir;
+	int64_t max_size;
+	
+	pthread_mutex_t mutex;
+	int64_t total_size;	// -1: the directory has not been scanned yet
+	unsigned int tmp_counter;
+};
+
+struct part_cache_file
+{
+	char *name;
+	struct timespec mtime;
+	int64_t size;
+};
+
+static int make_dirs(const char *dir)
+{
+	char path[PATH_MAX] = "";
+	size_t length = strlen(dir);
+	if(0 == length || length >= sizeof(path)) return -1;
+	memcpy(path, dir, length + 1);
+	
+	for(char *p = path + 1; ; ++p) {
+		if(*p != '/' && *p != '\0') continue;
+		char c = *p;
+		*p = '\0';
+		if(mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+		*p = c;
+		if('\0' == c) break;
+	}
+	return 0;
+}
+
+struct ooxml_part_cache *ooxml_part_cache_new(const char *dir, int64_t max_size)
+{
+	if(NULL == dir || !dir[0]) return NULL;
+	if(make_dirs(dir) != 0) {
+		fprintf(stderr, "ooxml_part_cache: can not create '%s': %s\n", dir, strerror(errno));
+		return NULL;
+	}
+	
+	struct ooxml_part_cache *cache = calloc(1, sizeof(*cache));
+	assert(cache);
+	cache->dir = strdup(dir);
+	cache->max_size = max_size;
+	cache->total_size = -1;
+	pthread_mutex_init(&cache->mutex, NULL);
+	return cache;
+}
+
+void ooxml_part_cache_free(struct ooxml_part_cache *cache)
+{
+	if(NULL == cache) return;
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache->dir);
+	free(cache);
+}
+
+char *ooxml_part_cache_archive_id(const char *filename)
+{
+	struct stat st;
+	if(stat(filename, &st) != 0) return NULL;
+	char *path = realpath(filename, NULL);
+	if(NULL == path) return NULL;
+	
+	size_t size = strlen(path) + 64;
+	char *id = malloc(size);
+	assert(id);
+	snprintf(id, size, "%s:%lld:%lld.%09ld", path, (long long)st.st_size,
+		(long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+	free(path);
+	return id;
+}
+
+static char *make_key(const struct ooxml_part_cache_key *key, size_t *p_length)
+{
+	int length = snprintf(NULL, 0, "%s\n%s\n%08x\n%" PRIu64, key->archive, key->name, key->crc, key->size);
+	char *string = malloc(length + 1);
+	assert(string);
+	snprintf(string, length + 1, "%s\n%s\n%08x\n%" PRIu64, key->archive, key->name, key->crc, key->size);
+	*p_length = length;
+	return string;
+}
+
+static void make_path(const struct ooxml_part_cache *cache, const char *key, size_t length, char path[static PATH_MAX])
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;	// fnv-1a
+	for(size_t i = 0; i < length; ++i) {
+		hash ^= (unsigned char)key[i];
+		hash *= 0x100000001b3ULL;
+	}
+	snprintf(path, PATH_MAX, "%s/%016" PRIx64 PART_CACHE_SUFFIX, cache->dir, hash);
+}
+
+static uint32_t checksum(const unsigned char *data, size_t length)
+{
+	uLong crc = crc32(0, Z_NULL, 0);
+	while(length > 0) {
+		uInt cb = (length > (1u << 30))?(1u << 30):(uInt)length;
+		crc = crc32(crc, data, cb);
+		data += cb;
+		length -= cb;
+	}
+	return (uint32_t)crc;
+}
+
+static int read_all(int fd, void *buffer, size_t length)
+{
+	unsigned char *p = buffer;
+	while(length > 0) {
+		ssize_t cb = read(fd, p, length);
+		if(cb < 0 && errno == EINTR) continue;
+		if(cb <= 0) return -1;
+		p += cb;
+		length -= cb;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const void *buffer, size_t length)
+{
+	const unsigned char *p = buffer;
+	while(length > 0) {
+		ssize_t cb = write(fd, p, length);
+		if(cb < 0 && errno == EINTR) continue;
+		if(cb <= 0) return -1;
+		p += cb;
+		length -= cb;
+	}
+	return 0;
+}
+
+int ooxml_part_cache_load(struct ooxml_part_cache *cache, const struct ooxml_part_cache_key *key,
+	unsigned char **p_data, size_t *p_cb_data, xmlDocPtr *p_doc, struct ooxml_arena *arena)
+{
+	if(NULL == cache || NULL == key->archive) return -1;
+	
+	size_t cb_key = 0;
+	char *key_string = make_key(key, &cb_key);
+	char path[PATH_MAX] = "";
+	make_path(cache, key_string, cb_key, path);
+	
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		free(key_string);
+		return -1;
+	}
+	
+	int rc = -1;
+	struct part_cache_header hdr;
+	struct stat st;
+	char *stored_key = NULL;
+	unsigned char *data = NULL;
+	unsigned char *dom = NULL;
+	xmlDocPtr doc = NULL;
+	
+	if(fstat(fd, &st) != 0 || read_all(fd, &hdr, sizeof(hdr)) != 0) goto label_final;
+	if(memcmp(hdr.magic, PART_CACHE_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != PART_CACHE_VERSION) goto label_final;
+	if(hdr.cb_key != cb_key || hdr.cb_data != key->size) goto label_final;
+	if((uint64_t)st.st_size != sizeof(hdr) + hdr.cb_key + hdr.cb_data + hdr.cb_dom) goto label_final;
+	
+	stored_key = malloc(cb_key);
+	assert(stored_key);
+	if(read_all(fd, stored_key, cb_key) != 0 || memcmp(stored_key, key_string, cb_key) != 0) goto label_final;
+	
+	data = arena?ooxml_arena_alloc(arena, hdr.cb_data + 1):malloc(hdr.cb_data + 1);
+	assert(data);
+	if(read_all(fd, data, hdr.cb_data) != 0) goto label_final;
+	data[hdr.cb_data] = '\0';
+	if(checksum(data, hdr.cb_data) != key->crc) goto label_final;
+	
+	if(hdr.has_doc) {
+		dom = malloc(hdr.cb_dom);
+		assert(dom);
+		if(read_all(fd, dom, hdr.cb_dom) != 0) goto label_final;
+		if(checksum(dom, hdr.cb_dom) != hdr.dom_checksum) goto label_final;
+		doc = ooxml_dom_decode(dom, hdr.cb_dom, key->name);
+		if(NULL == doc) goto label_final;
+	}
+	
+	futimens(fd, NULL);	// most recently used
+	
+	*p_data = data;
+	*p_cb_data = hdr.cb_data;
+	*p_doc = doc;
+	data = NULL;
+	rc = 0;
+
+label_final:
+	if(rc != 0) debug_printf("part cache: ignore '%s' (%s)", path, key->name);
+	close(fd);
+	if(data && NULL == arena) free(data);
+	free(dom);
+	free(stored_key);
+	free(key_string);
+	return rc;
+}
+
+static int compare_mtime(const void *a, const void *b)
+{
+	const struct part_cache_file *file_a = a;
+	const struct part_cache_file *file_b = b;
+	if(file_a->mtime.tv_sec != file_b->mtime.tv_sec) return (file_a->mtime.tv_sec < file_b->mtime.tv_sec)?-1:1;
+	if(file_a->mtime.tv_nsec != file_b->mtime.tv_nsec) return (file_a->mtime.tv_nsec < file_b->mtime.tv_nsec)?-1:1;
+	return 0;
+}
+
+// returns the total size of the cache files, removes the least recently used ones down to 90% of max_size (evict)
+static int64_t part_cache_scan(struct ooxml_part_cache *cache, int evict)
+{
+	DIR *dir = opendir(cache->dir);
+	if(NULL == dir) return 0;
+	
+	int dir_fd = dirfd(dir);
+	time_t now = time(NULL);
+	int64_t total_size = 0;
+	size_t num_files = 0, max_files = 0;
+	struct part_cache_file *files = NULL;
+	
+	struct dirent *entry = NULL;
+	while((entry = readdir(dir))) {
+		const char *name = entry->d_name;
+		size_t length = strlen(name);
+		struct stat st;
+		
+		if(strstr(name, PART_CACHE_SUFFIX ".tmp.")) {
+			if(fstatat(dir_fd, name, &st, 0) == 0 && now - st.st_mtim.tv_sec > PART_CACHE_TMP_MAX_AGE) {
+				unlinkat(dir_fd, name, 0);
+			}
+			continue;
+		}
+		if(length <= sizeof(PART_CACHE_SUFFIX) - 1 || strcmp(name + length - (sizeof(PART_CACHE_SUFFIX) - 1), PART_CACHE_SUFFIX) != 0) continue;
+		if(fstatat(dir_fd, name, &st, 0) != 0 || !S_ISREG(st.st_mode)) continue;
+		
+		total_size += st.st_size;
+		if(!evict) continue;
+		
+		if(num_files >= max_files) {
+			size_t new_size = max_files?(max_files * 2):256;
+			struct part_cache_file *new_files = realloc(files, new_size * sizeof(*new_files));
+			assert(new_files);
+			files = new_files;
+			max_files = new_size;
+		}
+		files[num_files].name = strdup(name);
+		files[num_files].mtime = st.st_mtim;
+		files[num_files].size = st.st_size;
+		++num_files;
+	}
+	
+	if(evict && total_size > cache->max_size) {
+		qsort(files, num_files, sizeof(*files), compare_mtime);
+		int64_t low_watermark = cache->max_size / 10 * 9;
+		for(size_t i = 0; i < num_files && total_size > low_watermark; ++i) {
+			if(unlinkat(dir_fd, files[i].name, 0) == 0) total_size -= files[i].size;
+		}
+	}
+	
+	for(size_t i = 0; i < num_files; ++i) free(files[i].name);
+	free(files);
+	closedir(dir);
+	return total_size;
+}
+
+int ooxml_part_cache_store(struct ooxml_part_cache *cache, const struct ooxml_part_cache_key *key,
+	const unsigned char *data, size_t cb_data, xmlDocPtr doc)
+{
+	if(NULL == cache || NULL == key->archive) return -1;
+	if(cb_data != key->size) return -1;
+	
+	unsigned char *dom = NULL;
+	size_t cb_dom = 0;
+	if(doc && ooxml_dom_encode(doc, &dom, &cb_dom) != 0) return -1;
+	
+	size_t cb_key = 0;
+	char *key_string = make_key(key, &cb_key);
+	int64_t cb_file = sizeof(struct part_cache_header) + cb_key + cb_data + cb_dom;
+	if(cb_file > cache->max_size) {
+		free(dom);
+		free(key_string);
+		return -1;
+	}
+	
+	struct part_cache_header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PART_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = PART_CACHE_VERSION;
+	hdr.cb_key = cb_key;
+	hdr.cb_data = cb_data;
+	hdr.cb_dom = cb_dom;
+	hdr.dom_checksum = checksum(dom, cb_dom);
+	hdr.has_doc = (NULL != doc);
+	
+	char path[PATH_MAX] = "";
+	char tmp_path[PATH_MAX + 64] = "";
+	make_path(cache, key_string, cb_key, path);
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%ld.%u", path,
+		(long)getpid(), __sync_add_and_fetch(&cache->tmp_counter, 1));
+	
+	int rc = -1;
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if(fd >= 0) {
+		if(write_all(fd, &hdr, sizeof(hdr)) == 0
+			&& write_all(fd, key_string, cb_key) == 0
+			&& write_all(fd, data, cb_data) == 0
+			&& write_all(fd, dom, cb_dom) == 0)
+		{
+			rc = 0;
+		}
+		if(close(fd) != 0) rc = -1;
+		if(0 == rc) rc = rename(tmp_path, path);
+		if(rc != 0) unlink(tmp_path);
+	}
+	free(dom);
+	free(key_string);
+	if(rc != 0) return -1;
+	
+	pthread_mutex_lock(&cache->mutex);
+	if(cache->total_size < 0) cache->total_size = part_cache_scan(cache, 0);
+	else cache->total_size += cb_file;	// an overwritten file is counted twice until the next scan
+	if(cache->total_size > cache->max_size) {
+		cache->total_size = part_cache_scan(cache, 1);
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	return 0;
+}
+
+
+#if defined(TEST_OOXML_PART_CACHE_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
@@ -0,0 +1,48 @@
+#ifndef OOXML_PART_CACHE_H_
+#define OOXML_PART_CACHE_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <libxml/tree.h>
+#include "ooxml_arena.h"
+
+/*
+ * persistent cache of loaded parts ("cache_dir" of the ooxml config):
+ * one file per part with its inflated data and the encoded DOM (ooxml_dom_codec.h),
+ * so that reopening an unchanged archive skips both inflate and xml parsing.
+ * the total size of the directory is kept below max_size by removing the least recently used files.
+ * safe to use from several threads and processes.
+ */
+struct ooxml_part_cache;
+
+struct ooxml_part_cache_key
+{
+	const char *archive;	// ooxml_part_cache_archive_id()
+	const char *name;		// entry name
+	uint32_t crc;			// ZIP_STAT_CRC
+	uint64_t size;			// ZIP_STAT_SIZE
+};
+
+struct ooxml_part_cache *ooxml_part_cache_new(const char *dir, int64_t max_size);
+void ooxml_part_cache_free(struct ooxml_part_cache *cache);
+
+// "realpath:size:mtime" of the archive file, NULL if it can not be stat-ed, release with free()
+char *ooxml_part_cache_archive_id(const char *filename);
+
+/*
+ * on a hit: *p_data (nul-terminated, from the arena or malloc) and *p_doc (NULL if the part is not xml)
+ * are set and 0 is returned. the DOM is allocated through libxml2, i.e. from the arena current on the thread.
+ */
+int ooxml_part_cache_load(struct ooxml_part_cache *cache, const struct ooxml_part_cache_key *key,
+	unsigned char **p_data, size_t *p_cb_data, xmlDocPtr *p_doc, struct ooxml_arena *arena);
+int ooxml_part_cache_store(struct ooxml_part_cache *cache, const struct ooxml_part_cache_key *key,
+	const unsigned char *data, size_t cb_data, xmlDocPtr doc);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,459 @@
+/*
+ * ooxml_part_registry.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <glib.h>
+
+#include "ooxml_context.h"
+#include "ooxml_arena.h"
+#include "ooxml_part_registry.h"
+
+struct relationship_set
+{
+	ssize_t count;
+	struct ooxml_relationship *items;	// in document order
+	GHashTable *ids;	// id => struct ooxml_relationship *
+	GHashTable *types;	// last segment of the type => first relationship of that type
+};
+
+struct ooxml_part_registry
+{
+	struct ooxml_arena *arena;
+	GHashTable *overrides;	// part name => content type
+	GHashTable *defaults;	// extension => content type
+	
+	ssize_t num_parts;
+	struct ooxml_part *parts;	// in entry table order
+	GHashTable *part_names;		// part name => struct ooxml_part *
+	
+	GHashTable *sources;		// source part name => struct relationship_set *
+};
+
+// opc part names (and extensions) are compared case-insensitively
+static guint ascii_case_hash(gconstpointer key)
+{
+	guint hash = 5381;
+	for(const char *p = key; *p; ++p) hash = hash * 33 + (guint)tolower((unsigned char)*p);
+	return hash;
+}
+
+static gboolean ascii_case_equal(gconstpointer a, gconstpointer b)
+{
+	return strcasecmp(a, b) == 0;
+}
+
+static void relationship_set_free(gpointer data)
+{
+	struct relationship_set *set = data;
+	g_hash_table_destroy(set->ids);
+	g_hash_table_destroy(set->types);
+}
+
+struct ooxml_part_registry *ooxml_part_registry_new(void)
+{
+	struct ooxml_part_registry *registry = calloc(1, sizeof(*registry));
+	assert(registry);
+	registry->arena = ooxml_arena_new(16 * 1024);
+	registry->overrides = g_hash_table_new(ascii_case_hash, ascii_case_equal);
+	registry->defaults = g_hash_table_new(ascii_case_hash, ascii_case_equal);
+	registry->part_names = g_hash_table_new(ascii_case_hash, ascii_case_equal);
+	registry->sources = g_hash_table_new_full(ascii_case_hash, ascii_case_equal, NULL, relationship_set_free);
+	return registry;
+}
+
+void ooxml_part_registry_free(struct ooxml_part_registry *registry)
+{
+	if(NULL == registry) return;
+	g_hash_table_destroy(registry->overrides);
+	g_hash_table_destroy(registry->defaults);
+	g_hash_table_destroy(registry->part_names);
+	g_hash_table_destroy(registry->sources);
+	ooxml_arena_free(registry->arena);
+	free(registry);
+}
+
+// copy of an attribute in the arena, NULL if it is missing
+static const char *get_attribute(struct ooxml_part_registry *registry, xmlNodePtr node, const char *name)
+{
+	xmlChar *value = xmlGetProp(node, BAD_CAST name);
+	if(NULL == value) return NULL;
+	char *text = ooxml_arena_strdup(registry->arena, (char *)value);
+	xmlFree(value);
+	return text;
+}
+
+static xmlNodePtr parse_part(const char *name, const char *data, size_t length, xmlDocPtr *p_doc)
+{
+	xmlDocPtr doc = xmlReadMemory(data, length, name, NULL, XML_PARSE_NONET);
+	xmlNodePtr root = doc?xmlDocGetRootElement(doc):NULL;
+	if(NULL == root) {
+		fprintf(stderr, "%s: invalid xml\n", name);
+		if(doc) xmlFreeDoc(doc);
+		return NULL;
+	}
+	*p_doc = doc;
+	return root;
+}
+
+int ooxml_part_registry_load_content_types(struct ooxml_part_registry *registry, const char *data, size_t length)
+{
+	xmlDocPtr doc = NULL;
+	xmlNodePtr root = parse_part("[Content_Types].xml", data, length, &doc);
+	if(NULL == root) return -1;
+	
+	for(xmlNodePtr node = root->children; node; node = node->next) {
+		if(node->type != XML_ELEMENT_NODE) continue;
+		
+		int is_override = (xmlStrcmp(node->name, BAD_CAST "Override") == 0);
+		if(!is_override && xmlStrcmp(node->name, BAD_CAST "Default") != 0) continue;
+		
+		const char *key = get_attribute(registry, node, is_override?"PartName":"Extension");
+		const char *content_type = get_attribute(registry, node, "ContentType");
+		if(NULL == key || NULL == content_type) continue;
+		
+		if(is_override) {
+			if(key[0] == '/') ++key;
+			g_hash_table_insert(registry->overrides, (gpointer)key, (gpointer)content_type);
+		}else {
+			g_hash_table_insert(registry->defaults, (gpointer)key, (gpointer)content_type);
+		}
+	}
+	xmlFreeDoc(doc);
+	return 0;
+}
+
+/*
+ * the part described by a relationships part:
+ * "_rels/.rels" => "" (the package), "word/_rels/document.xml.rels" => "word/document.xml"
+ */
+static char *get_source_part_name(struct ooxml_part_registry *registry, const char *rels_name)
+{
+	static const char suffix[] = ".rels";
+	const char *slash = strrchr(rels_name, '/');
+	size_t cb_folder = slash?(size_t)(slash - rels_name + 1):0;
+	if(cb_folder < sizeof("_rels/") - 1 || strncmp(slash - 5, "_rels", 5) != 0) return NULL;
+	if(cb_folder > sizeof("_rels/") - 1 && slash[-6] != '/') return NULL;
+	
+	const char *base_name = slash + 1;
+	size_t cb_base_name = strlen(base_name);
+	if(cb_base_name < sizeof(suffix) - 1 || strcasecmp(base_name + cb_base_name - (sizeof(suffix) - 1), suffix) != 0) return NULL;
+	cb_base_name -= sizeof(suffix) - 1;
+	cb_folder -= sizeof("_rels/") - 1;
+	
+	char *source = ooxml_arena_alloc(registry->arena, cb_folder + cb_base_name + 1);
+	memcpy(source, rels_name, cb_folder);
+	memcpy(source + cb_folder, base_name, cb_base_name);
+	source[cb_folder + cb_base_name] = '\0';
+	return source;
+}
+
+int ooxml_part_registry_load_relationships(struct ooxml_part_registry *registry, const char *rels_name, const char *data, size_t length)
+{
+	const char *source = get_source_part_name(registry, rels_name);
+	if(NULL == source) {
+		fprintf(stderr, "%s: not a relationships part name\n", rels_name);
+		return -1;
+	}
+	if(g_hash_table_lookup(registry->sources, source)) return 0;	// already loaded
+	
+	xmlDocPtr doc = NULL;
+	xmlNodePtr root = parse_part(rels_name, data, length, &doc);
+	if(NULL == root) return -1;
+	
+	ssize_t max_count = 0;
+	for(xmlNodePtr node = root->children; node; node = node->next) {
+		if(node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, BAD_CAST "Relationship") == 0) ++max_count;
+	}
+	
+	struct relationship_set *set = ooxml_arena_alloc(registry->arena, sizeof(*set));
+	memset(set, 0, sizeof(*set));
+	if(max_count > 0) set->items = ooxml_arena_alloc(registry->arena, max_count * sizeof(*set->items));
+	set->ids = g_hash_table_new(g_str_hash, g_str_equal);
+	set->types = g_hash_table_new(g_str_hash, g_str_equal);
+	
+	for(xmlNodePtr node = root->children; node; node = node->next) {
+		if(node->type != XML_ELEMENT_NODE || xmlStrcmp(node->name, BAD_CAST "Relationship") != 0) continue;
+		
+		struct ooxml_relationship *relationship = &set->items[set->count];
+		memset(relationship, 0, sizeof(*relationship));
+		relationship->id = get_attribute(registry, node, "Id");
+		relationship->type = get_attribute(registry, node, "Type");
+		const char *target = get_attribute(registry, node, "Target");
+		if(NULL == relationship->id || NULL == relationship->type || NULL == target) continue;
+		
+		xmlChar *mode = xmlGetProp(node, BAD_CAST "TargetMode");
+		relationship->is_external = (mode && xmlStrcmp(mode, BAD_CAST "External") == 0);
+		xmlFree(mode);
+		
+		if(relationship->is_external) {
+			relationship->target = target;
+		}else {
+			char *part_name = ooxml_resolve_part_target(source, target, strlen(target));
+			relationship->target = ooxml_arena_strdup(registry->arena, part_name);
+			free(part_name);
+		}
+		++set->count;
+		
+		if(NULL == g_hash_table_lookup(set->ids, relationship->id)) {
+			g_hash_table_insert(set->ids, (gpointer)relationship->id, relationship);
+		}
+		const char *p = strrchr(relationship->type, '/');
+		const char *type_suffix = p?(p + 1):relationship->type;
+		if(NULL == g_hash_table_lookup(set->types, type_suffix)) {
+			g_hash_table_insert(set->types, (gpointer)type_suffix, relationship);
+		}
+	}
+	xmlFreeDoc(doc);
+	
+	g_hash_table_insert(registry->sources, (gpointer)source, set);
+	return 0;
+}
+
+static const struct
+{
+	const char *suffix;
+	enum ooxml_part_kind kind;
+}s_content_type_kinds[] = {
+	{ "package.relationships+xml", ooxml_part_kind_relationships },
+	
+	{ "spreadsheetml.sheet.main+xml", ooxml_part_kind_workbook },
+	{ "spreadsheetml.template.main+xml", ooxml_part_kind_workbook },
+	{ "ms-excel.sheet.macroEnabled.main+xml", ooxml_part_kind_workbook },
+	{ "ms-excel.template.macroEnabled.main+xml", ooxml_part_kind_workbook },
+	{ "spreadsheetml.worksheet+xml", ooxml_part_kind_worksheet },
+	{ "spreadsheetml.sharedStrings+xml", ooxml_part_kind_shared_strings },
+	{ "spreadsheetml.styles+xml", ooxml_part_kind_styles },
+	{ "spreadsheetml.comments+xml", ooxml_part_kind_comments },
+	
+	{ "wordprocessingml.document.main+xml", ooxml_part_kind_document },
+	{ "wordprocessingml.template.main+xml", ooxml_part_kind_document },
+	{ "ms-word.document.macroEnabled.main+xml", ooxml_part_kind_document },
+	{ "ms-word.template.macroEnabledTemplate.main+xml", ooxml_part_kind_document },
+	{ "wordprocessingml.header+xml", ooxml_part_kind_header },
+	{ "wordprocessingml.footer+xml", ooxml_part_kind_footer },
+	{ "wordprocessingml.footnotes+xml", ooxml_part_kind_footnotes },
+	{ "wordprocessingml.endnotes+xml", ooxml_part_kind_endnotes },
+	{ "wordprocessingml.comments+xml", ooxml_part_kind_comments },
+	{ "wordprocessingml.styles+xml", ooxml_part_kind_styles },
+};
+
+static int ends_with(const char *text, size_t length, const char *suffix)
+{
+	size_t cb_suffix = strlen(suffix);
+	return length >= cb_suffix && strcasecmp(text + length - cb_suffix, suffix) == 0;
+}
+
+static enum ooxml_part_kind get_part_kind(const char *name, const char *content_type)
+{
+	if(strcmp(name, "[Content_Types].xml") == 0) return ooxml_part_kind_content_types;
+	
+	if(NULL == content_type) {	// not declared, guess from the extension
+		const char *base_name = strrchr(name, '/');
+		const char *ext = strrchr(base_name?base_name:name, '.');
+		if(ext && strcasecmp(ext, ".rels") == 0) return ooxml_part_kind_relationships;
+		if(ext && strcasecmp(ext, ".xml") == 0) return ooxml_part_kind_xml;
+		return ooxml_part_kind_binary;
+	}
+	
+	size_t length = strlen(content_type);
+	for(size_t i = 0; i < sizeof(s_content_type_kinds) / sizeof(s_content_type_kinds[0]); ++i) {
+		if(ends_with(content_type, length, s_content_type_kinds[i].suffix)) return s_content_type_kinds[i].kind;
+	}
+	if(ends_with(content_type, length, "+xml") || strcasecmp(content_type, "application/xml") == 0
+		|| strcasecmp(content_type, "text/xml") == 0) return ooxml_part_kind_xml;
+	if(strncasecmp(content_type, "image/", 6) == 0 || strncasecmp(content_type, "audio/", 6) == 0
+		|| strncasecmp(content_type, "video/", 6) == 0) return ooxml_part_kind_media;
+	return ooxml_part_kind_binary;
+}
+
+static enum ooxml_part_handler get_part_handler(enum ooxml_part_kind kind)
+{
+	switch(kind) {
+	case ooxml_part_kind_content_types:
+	case ooxml_part_kind_relationships:
+	case ooxml_part_kind_xml:
+	case ooxml_part_kind_workbook:
+	case ooxml_part_kind_styles:
+		return ooxml_part_handler_dom;
+	case ooxml_part_kind_worksheet:
+	case ooxml_part_kind_shared_strings:
+	case ooxml_part_kind_document:
+	case ooxml_part_kind_header:
+	case ooxml_part_kind_footer:
+	case ooxml_part_kind_footnotes:
+	case ooxml_part_kind_endnotes:
+	case ooxml_part_kind_comments:
+		return ooxml_part_handler_stream;
+	default:
+		break;
+	}
+	return ooxml_part_handler_raw;
+}
+
+void ooxml_part_registry_add_parts(struct ooxml_part_registry *registry, ssize_t num_entries, const struct ooxml_zip_file *entries)
+{
+	assert(NULL == registry->parts);
+	if(num_entries <= 0) return;
+	
+	registry->parts = ooxml_arena_alloc(registry->arena, num_entries * sizeof(*registry->parts));
+	memset(registry->parts, 0, num_entries * sizeof(*registry->parts));
+	registry->num_parts = num_entries;
+	
+	for(ssize_t i = 0; i < num_entries; ++i) {
+		struct ooxml_part *part = &registry->parts[i];
+		part->index = i;
+		part->kind = ooxml_part_kind_unknown;
+		part->handler = ooxml_part_handler_raw;
+		
+		const char *filename = entries[i].filename;
+		if(NULL == filename) continue;
+		size_t cb_filename = strlen(filename);
+		part->name = ooxml_arena_strdup(registry->arena, filename);
+		if(cb_filename == 0 || filename[cb_filename - 1] == '/') continue;	// directory entry
+		
+		part->content_type = ooxml_part_registry_get_content_type(registry, part->name);
+		part->kind = get_part_kind(part->name, part->content_type);
+		part->handler = get_part_handler(part->kind);
+		if(NULL == g_hash_table_lookup(registry->part_names, part->name)) {
+			g_hash_table_insert(registry->part_names, (gpointer)part->name, part);
+		}
+	}
+}
+
+const char *ooxml_part_registry_get_content_type(struct ooxml_part_registry *registry, const char *name)
+{
+	if(NULL == registry || NULL == name) return NULL;
+	if(name[0] == '/') ++name;
+	
+	const char *content_type = g_hash_table_lookup(registry->overrides, name);
+	if(content_type) return content_type;
+	
+	const char *base_name = strrchr(name, '/');
+	const char *ext = strrchr(base_name?base_name:name, '.');
+	return ext?g_hash_table_lookup(registry->defaults, ext + 1):NULL;
+}
+
+const struct ooxml_part *ooxml_part_registry_get_part(struct ooxml_part_registry *registry, const char *name)
+{
+	if(NULL == registry || NULL == name) return NULL;
+	if(name[0] == '/') ++name;
+	return g_hash_table_lookup(registry->part_names, name);
+}
+
+const struct ooxml_part *ooxml_part_registry_get_part_by_index(struct ooxml_part_registry *registry, int64_t index)
+{
+	if(NULL == registry || index < 0 || index >= registry->num_parts) return NULL;
+	return &registry->parts[index];
+}
+
+static struct relationship_set *get_relationship_set(struct ooxml_part_registry *registry, const char *source)
+{
+	if(NULL == registry) return NULL;
+	if(NULL == source) source = "";
+	if(source[0] == '/') ++source;
+	return g_hash_table_lookup(registry->sources, source);
+}
+
+const struct ooxml_relationship *ooxml_part_registry_get_relationships(struct ooxml_part_registry *registry,
+	const char *source, ssize_t *p_count)
+{
+	struct relationship_set *set = get_relationship_set(registry, source);
+	if(p_count) *p_count = set?set->count:0;
+	return (set && set->count > 0)?set->items:NULL;
+}
+
+const struct ooxml_relationship *ooxml_part_registry_find_relationship(struct ooxml_part_registry *registry,
+	const char *source, const char *id)
+{
+	struct relationship_set *set = get_relationship_set(registry, source);
+	if(NULL == set || NULL == id) return NULL;
+	return g_hash_table_lookup(set->ids, id);
+}
+
+const struct ooxml_relationship *ooxml_part_registry_find_relationship_by_type(struct ooxml_part_registry *registry,
+	const char *source, const char *type_suffix)
+{
+	struct relationship_set *set = get_relationship_set(registry, source);
+	if(NULL == set || NULL == type_suffix) return NULL;
+	if(type_suffix[0] == '/') ++type_suffix;
+	return g_hash_table_lookup(set->types, type_suffix);
+}
+
+char *ooxml_resolve_part_target(const char *source_part, const char *target, size_t cb_target)
+{
+	size_t cb_folder = 0;
+	if(cb_target > 0 && target[0] == '/') {
+		++target;
+		--cb_target;
+	}else {
+		const char *slash = strrchr(source_part, '/');
+		if(slash) cb_folder = slash - source_part + 1;
+	}
+	
+	char *part_name = malloc(cb_folder + cb_target + 1);
+	assert(part_name);
+	memcpy(part_name, source_part, cb_folder);
+	size_t length = cb_folder;
+	
+	// append the segments, "." is ignored, ".." removes the previous one
+	const char *p_end = target + cb_target;
+	while(target < p_end) {
+		const char *slash = memchr(target, '/', p_end - target);
+		size_t cb_segment = slash?(size_t)(slash - target):(size_t)(p_end - target);
+		
+		if(cb_segment == 2 && target[0] == '.' && target[1] == '.') {
+			if(length > 0) --length;	// the trailing '/'
+			while(length > 0 && part_name[length - 1] != '/') --length;
+		}else if(cb_segment > 0 && !(cb_segment == 1 && target[0] == '.')) {
+			memcpy(part_name + length, target, cb_segment);
+			length += cb_segment;
+			if(slash) part_name[length++] = '/';
+		}
+		target += cb_segment + (slash?1:0);
+	}
+	part_name[length] = '\0';
+	return part_name;
+}
+
+
+#if defined(TEST_OOXML_PART_REGISTRY_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
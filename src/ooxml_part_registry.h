@@ -0,0 +1,49 @@
+#ifndef OOXML_PART_REGISTRY_H_
+#define OOXML_PART_REGISTRY_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ooxml_context.h"
+
+/*
+ * typed parts and relationships of a package:
+ * parts are hashed by name, content types by part name (Override) and extension (Default),
+ * relationships by source part, by (source, id) and by (source, type).
+ * strings live in one arena, the registry is read-only (and thread-safe) once built.
+ *
+ * building: load the content types, then the relationship parts, then add the entry table.
+ */
+struct ooxml_part_registry;
+struct ooxml_part_registry *ooxml_part_registry_new(void);
+void ooxml_part_registry_free(struct ooxml_part_registry *registry);
+
+// both return 0 or -1 if the part is not well-formed
+int ooxml_part_registry_load_content_types(struct ooxml_part_registry *registry, const char *data, size_t length);
+int ooxml_part_registry_load_relationships(struct ooxml_part_registry *registry, const char *rels_name, const char *data, size_t length);
+
+void ooxml_part_registry_add_parts(struct ooxml_part_registry *registry, ssize_t num_entries, const struct ooxml_zip_file *entries);
+
+const char *ooxml_part_registry_get_content_type(struct ooxml_part_registry *registry, const char *name);
+const struct ooxml_part *ooxml_part_registry_get_part(struct ooxml_part_registry *registry, const char *name);
+const struct ooxml_part *ooxml_part_registry_get_part_by_index(struct ooxml_part_registry *registry, int64_t index);
+
+const struct ooxml_relationship *ooxml_part_registry_get_relationships(struct ooxml_part_registry *registry,
+	const char *source, ssize_t *p_count);
+const struct ooxml_relationship *ooxml_part_registry_find_relationship(struct ooxml_part_registry *registry,
+	const char *source, const char *id);
+const struct ooxml_relationship *ooxml_part_registry_find_relationship_by_type(struct ooxml_part_registry *registry,
+	const char *source, const char *type_suffix);
+
+/*
+ * resolve a relationship target to a part name (no leading '/', malloc-ed),
+ * relative targets start from the folder of the source part.
+ */
+char *ooxml_resolve_part_target(const char *source_part, const char *target, size_t cb_target);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -11,15 +11,83 @@ extern "C" {
 #include "ooxml_context.h"
 
 #include <zip.h>
+#include <pthread.h>
+#include "zip_directory.h"
+#include "ooxml_arena.h"
+#include "ooxml_dir_index.h"
+#include "ooxml_part_registry.h"
+#include "ooxml_part_cache.h"
+
+enum ooxml_entry_state
+{
+	ooxml_entry_state_unloaded,
+	ooxml_entry_state_loading,
+	ooxml_entry_state_loaded,
+};
+
+struct ooxml_pending_part
+{
+	char *name;
+	unsigned char *data;
+	size_t length;
+	int is_removed;
+};
+
+struct ooxml_deflate_level
+{
+	char *content_type;	// "type/subtype" or "type/*"
+	int level;
+};
+
 struct ooxml_private
 {
 	struct ooxml_context *ooxml;
 	zip_t *archive;
+	char *filename;
+	int readonly;
+	
+	// parts put or removed since open(), written by save()
+	int num_pending_parts;
+	struct ooxml_pending_part *pending_parts;
 	
 	int num_entries;
 	struct zip_stat *file_stats;
+	struct ooxml_zip_file *entries;	// entry table, built from file_stats on open
+	
+	// mmap mode
+	unsigned char *map;
+	size_t cb_map;
+	ssize_t num_dir_entries;
+	struct zip_directory_entry *dir_entries;
+	
+	// guards entry_states, entries are loaded by one thread at a time
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	enum ooxml_entry_state *entry_states;
+	
+	struct ooxml_shared_strings *shared_strings;
+	struct ooxml_styles *styles;
+	
+	// owns the entry table's filenames, part data and xml nodes (use_arena)
+	struct ooxml_arena *arena;
+	
+	struct ooxml_dir_index *dir_index;
+	
+	// content types and relationships, built by open()
+	struct ooxml_part_registry *part_registry;
+	
+	// persistent part cache ("cache_dir"), NULL if disabled
+	struct ooxml_part_cache *part_cache;
+	char *archive_id;	// cache key of the open archive
+	
+	// config "deflate_levels"
+	int num_deflate_levels;
+	struct ooxml_deflate_level *deflate_levels;
 };
 
+// compression level of parts of a content type (NULL: ooxml->deflate_level), 0: stored
+int ooxml_private_get_deflate_level(struct ooxml_private *priv, const char *content_type);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,903 @@
+/*
+ * ooxml_row_index.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <ctype.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "app.h"
+#include "ooxml_row_index.h"
+#include "zip_directory.h"
+#include "perf_trace.h"
+
+#define ROW_INDEX_WINDOW_SIZE	(32768)			// deflate history
+#define ROW_INDEX_BUFFER_SIZE	(1024 * 1024)	// inflate output of the builder, >= 2 windows
+#define ROW_INDEX_MIN_OUTPUT	(65536)
+#define ROW_INDEX_READ_SIZE		(256 * 1024)
+
+#define ROW_INDEX_MAGIC "OXROWIDX"
+#define ROW_INDEX_VERSION 1
+
+// a deflate block boundary to resume inflating from (see zlib's examples/zran.c)
+struct row_index_point
+{
+	uint64_t out;	// offset in the inflated part
+	uint64_t in;	// offset of the next full byte in the compressed data
+	int bits;		// bits of the byte at in - 1 that belong to the block, 0 if none
+	size_t cb_window;
+	unsigned char *window;	// the last (up to 32 KiB) inflated bytes before out
+};
+
+struct row_index_entry
+{
+	int64_t row_index;
+	uint64_t offset;	// of the '<' of the <row> tag in the inflated part
+};
+
+struct ooxml_row_index
+{
+	char *sheet_name;
+	
+	// the archive, mapped
+	unsigned char *map;
+	size_t cb_map;
+	struct zip_directory_entry entry;	// the worksheet part, name points into the mapping
+	const unsigned char *comp_data;
+	
+	int64_t row_interval;
+	size_t span;
+	int64_t num_rows;
+	
+	unsigned char *head;	// the part up to and including the <sheetData> start tag
+	size_t cb_head;
+	
+	size_t num_points;
+	size_t max_points;
+	struct row_index_point *points;
+	
+	size_t num_entries;
+	size_t max_entries;
+	struct row_index_entry *entries;
+};
+
+struct row_index_file_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t cb_sheet_name;
+	
+	// the part the index was built from
+	uint32_t crc;
+	uint32_t method;
+	uint64_t comp_size;
+	uint64_t size;
+	uint64_t local_header_offset;
+	
+	int64_t row_interval;
+	uint64_t span;
+	int64_t num_rows;
+	uint64_t cb_head;
+	uint64_t num_points;
+	uint64_t num_entries;
+};
+
+struct row_index_file_point
+{
+	uint64_t out;
+	uint64_t in;
+	uint32_t bits;
+	uint32_t cb_window;
+	uint32_t cb_packed;		// the window is stored compress()-ed
+	uint32_t reserved;
+};
+
+void ooxml_row_index_free(struct ooxml_row_index *index)
+{
+	if(NULL == index) return;
+	for(size_t i = 0; i < index->num_points; ++i) free(index->points[i].window);
+	free(index->points);
+	free(index->entries);
+	free(index->head);
+	free(index->sheet_name);
+	if(index->map) munmap(index->map, index->cb_map);
+	free(index);
+}
+
+static struct ooxml_row_index *row_index_new(const char *archive_name, const char *sheet_name)
+{
+	int fd = open(archive_name, O_RDONLY);
+	if(fd == -1) {
+		perror("open()");
+		return NULL;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+	unsigned char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		perror("mmap()");
+		return NULL;
+	}
+	
+	struct ooxml_row_index *index = calloc(1, sizeof(*index));
+	assert(index);
+	index->map = map;
+	index->cb_map = st.st_size;
+	index->sheet_name = strdup(sheet_name);
+	
+	struct zip_directory_entry *entries = NULL;
+	ssize_t num_entries = zip_directory_parse(map, st.st_size, &entries);
+	size_t cb_name = strlen(sheet_name);
+	ssize_t i = 0;
+	for(; i < num_entries; ++i) {
+		if(entries[i].cb_name == cb_name && memcmp(entries[i].name, sheet_name, cb_name) == 0) break;
+	}
+	if(i >= num_entries) {
+		fprintf(stderr, "ooxml_row_index: %s not found in %s\n", sheet_name, archive_name);
+		free(entries);
+		ooxml_row_index_free(index);
+		return NULL;
+	}
+	index->entry = entries[i];
+	free(entries);
+	
+	if((index->entry.flags & 0x01) || (index->entry.method != 0 && index->entry.method != 8)) {
+		fprintf(stderr, "ooxml_row_index: %s: unsupported entry (flags=0x%x, method=%d)\n",
+			sheet_name, index->entry.flags, index->entry.method);
+		ooxml_row_index_free(index);
+		return NULL;
+	}
+	index->comp_data = zip_directory_get_data(map, st.st_size, &index->entry);
+	if(NULL == index->comp_data) {
+		ooxml_row_index_free(index);
+		return NULL;
+	}
+	return index;
+}
+
+static void row_index_add_entry(struct ooxml_row_index *index, int64_t row_index, uint64_t offset)
+{
+	if(index->num_entries >= index->max_entries) {
+		size_t new_size = index->max_entries?(index->max_entries * 2):1024;
+		struct row_index_entry *entries = realloc(index->entries, new_size * sizeof(*entries));
+		assert(entries);
+		index->entries = entries;
+		index->max_entries = new_size;
+	}
+	index->entries[index->num_entries++] = (struct row_index_entry){ row_index, offset };
+}
+
+static struct row_index_point *row_index_add_point(struct ooxml_row_index *index)
+{
+	if(index->num_points >= index->max_points) {
+		size_t new_size = index->max_points?(index->max_points * 2):64;
+		struct row_index_point *points = realloc(index->points, new_size * sizeof(*points));
+		assert(points);
+		index->points = points;
+		index->max_points = new_size;
+	}
+	struct row_index_point *point = &index->points[index->num_points++];
+	memset(point, 0, sizeof(*point));
+	return point;
+}
+
+/******************************************************************************
+ * builder: locate the <row> tags in the inflated part (no xml parsing)
+******************************************************************************/
+struct row_scanner
+{
+	struct ooxml_row_index *index;
+	int in_sheet_data;
+	int done;	// </sheetData> reached, the rest of the part is not needed
+	int64_t row_index;
+};
+
+static inline int is_name_char(unsigned char c)
+{
+	return isalnum(c) || c == '_' || c == '-' || c == '.' || c == ':' || c >= 0x80;
+}
+
+// end of a tag (after '>'), quoted attribute values may contain '>', NULL if the tag is incomplete
+static const unsigned char *find_tag_end(const unsigned char *p, const unsigned char *end)
+{
+	unsigned char quote = 0;
+	for(; p < end; ++p) {
+		if(quote) {
+			if(*p == quote) quote = 0;
+		}else if(*p == '"' || *p == '\'') {
+			quote = *p;
+		}else if(*p == '>') {
+			return p + 1;
+		}
+	}
+	return NULL;
+}
+
+static const unsigned char *find_string(const unsigned char *p, const unsigned char *end, const char *string)
+{
+	size_t length = strlen(string);
+	while(p < end && (p = memchr(p, string[0], end - p))) {
+		if((size_t)(end - p) < length) return NULL;
+		if(memcmp(p, string, length) == 0) return p;
+		++p;
+	}
+	return NULL;
+}
+
+static int local_name_equals(const unsigned char *name, const unsigned char *name_end, const char *local_name)
+{
+	const unsigned char *colon = memchr(name, ':', name_end - name);
+	if(colon) name = colon + 1;
+	size_t length = strlen(local_name);
+	return (size_t)(name_end - name) == length && memcmp(name, local_name, length) == 0;
+}
+
+// value of r="..." of a <row> tag, -1 if not present
+static int64_t parse_row_number(const unsigned char *p, const unsigned char *end)
+{
+	while(p < end) {
+		while(p < end && isspace(*p)) ++p;
+		const unsigned char *name = p;
+		while(p < end && is_name_char(*p)) ++p;
+		size_t cb_name = p - name;
+		while(p < end && isspace(*p)) ++p;
+		if(0 == cb_name || p >= end || *p != '=') return -1;
+		++p;
+		while(p < end && isspace(*p)) ++p;
+		if(p >= end || (*p != '"' && *p != '\'')) return -1;
+		
+		unsigned char quote = *p++;
+		const unsigned char *value = p;
+		while(p < end && *p != quote) ++p;
+		if(cb_name == 1 && name[0] == 'r') {
+			int64_t row_index = 0;
+			for(; value < p && *value >= '0' && *value <= '9'; ++value) row_index = row_index * 10 + (*value - '0');
+			return row_index;
+		}
+		++p;
+	}
+	return -1;
+}
+
+static void row_scanner_append_head(struct row_scanner *scanner, const unsigned char *data, size_t length)
+{
+	struct ooxml_row_index *index = scanner->index;
+	if(0 == length) return;
+	unsigned char *head = realloc(index->head, index->cb_head + length);
+	assert(head);
+	memcpy(head + index->cb_head, data, length);
+	index->head = head;
+	index->cb_head += length;
+}
+
+/*
+ * scan data (at offset base of the part), returns the number of bytes consumed:
+ * a tag that is not complete yet is left for the next call unless at_end.
+ */
+static size_t row_scanner_scan(struct row_scanner *scanner, const unsigned char *data, size_t length, uint64_t base, int at_end)
+{
+	struct ooxml_row_index *index = scanner->index;
+	const unsigned char *p = data;
+	const unsigned char *end = data + length;
+	const unsigned char *consumed = data;
+	int collect_head = !scanner->in_sheet_data && !scanner->done;
+	const unsigned char *head_end = NULL;
+	
+	while(!scanner->done) {
+		const unsigned char *lt = memchr(p, '<', end - p);
+		if(NULL == lt) {
+			consumed = end;
+			break;
+		}
+		
+		const unsigned char *tag_end = NULL;
+		if((end - lt) >= 4 && memcmp(lt, "<!--", 4) == 0) {
+			const unsigned char *comment_end = find_string(lt + 4, end, "-->");
+			if(comment_end) tag_end = comment_end + 3;
+		}else if((end - lt) >= 9 && memcmp(lt, "<![CDATA[", 9) == 0) {
+			const unsigned char *cdata_end = find_string(lt + 9, end, "]]>");
+			if(cdata_end) tag_end = cdata_end + 3;
+		}else if((end - lt) >= 9 || at_end) {
+			tag_end = find_tag_end(lt + 1, end);
+		}
+		if(NULL == tag_end) {
+			consumed = at_end?end:lt;
+			break;
+		}
+		p = tag_end;
+		consumed = tag_end;
+		
+		const unsigned char *name = lt + 1;
+		int is_end_tag = (*name == '/');
+		if(is_end_tag) ++name;
+		if(!is_name_char(*name)) continue;	// <? ?>, <! >
+		const unsigned char *name_end = name;
+		while(name_end < tag_end && is_name_char(*name_end)) ++name_end;
+		
+		if(!scanner->in_sheet_data) {
+			if(!is_end_tag && local_name_equals(name, name_end, "sheetData")) {
+				head_end = tag_end;
+				if(tag_end[-2] == '/') scanner->done = 1;	// <sheetData/>
+				else scanner->in_sheet_data = 1;
+			}
+			continue;
+		}
+		
+		if(!is_end_tag && local_name_equals(name, name_end, "row")) {
+			int64_t row_index = parse_row_number(name_end, tag_end - 1);
+			scanner->row_index = (row_index > 0)?row_index:(scanner->row_index + 1);
+			if(0 == (index->num_rows % index->row_interval)) {
+				row_index_add_entry(index, scanner->row_index, base + (lt - data));
+			}
+			++index->num_rows;
+		}else if(is_end_tag && local_name_equals(name, name_end, "sheetData")) {
+			scanner->done = 1;
+		}
+	}
+	
+	if(collect_head) row_scanner_append_head(scanner, data, (head_end?head_end:consumed) - data);
+	return consumed - data;
+}
+
+static int row_index_build_deflated(struct ooxml_row_index *index, struct row_scanner *scanner)
+{
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	if(inflateInit2(&strm, -MAX_WBITS) != Z_OK) return -1;
+	
+	size_t cb_buffer = ROW_INDEX_BUFFER_SIZE;
+	unsigned char *buffer = malloc(cb_buffer);
+	assert(buffer);
+	size_t length = 0;		// inflated bytes in the buffer
+	size_t scan_pos = 0;	// bytes of the buffer passed to the scanner
+	uint64_t base = 0;		// offset of buffer[0] in the part
+	uint64_t last_point = 0;
+	
+	const unsigned char *p = index->comp_data;
+	uint64_t comp_left = index->entry.comp_size;
+	int rc = Z_OK;
+	
+	while(!scanner->done) {
+		if(strm.avail_in == 0 && comp_left > 0) {
+			strm.next_in = (unsigned char *)p;
+			strm.avail_in = (comp_left > 0x40000000)?0x40000000:comp_left;
+			p += strm.avail_in;
+			comp_left -= strm.avail_in;
+		}
+		
+		if((cb_buffer - length) < ROW_INDEX_MIN_OUTPUT) {
+			// keep the unscanned tail and the window of the next seek point
+			size_t keep_from = scan_pos;
+			if(length - keep_from < ROW_INDEX_WINDOW_SIZE) keep_from = (length > ROW_INDEX_WINDOW_SIZE)?(length - ROW_INDEX_WINDOW_SIZE):0;
+			memmove(buffer, buffer + keep_from, length - keep_from);
+			length -= keep_from;
+			scan_pos -= keep_from;
+			base += keep_from;
+			
+			if((cb_buffer - length) < ROW_INDEX_MIN_OUTPUT) {	// a huge tag
+				cb_buffer *= 2;
+				buffer = realloc(buffer, cb_buffer);
+				assert(buffer);
+			}
+		}
+		
+		strm.next_out = buffer + length;
+		strm.avail_out = cb_buffer - length;
+		rc = inflate(&strm, Z_BLOCK);
+		if(rc != Z_OK && rc != Z_STREAM_END) {
+			if(rc != Z_BUF_ERROR || (strm.avail_in == 0 && comp_left == 0)) break;
+		}
+		length = strm.next_out - buffer;
+		
+		int at_end = (rc == Z_STREAM_END);
+		scan_pos += row_scanner_scan(scanner, buffer + scan_pos, length - scan_pos, base + scan_pos, at_end);
+		if(at_end) break;
+		
+		// end of a (non-final) block
+		uint64_t total_out = base + length;
+		if((strm.data_type & 128) && !(strm.data_type & 64) && total_out > 0 && (total_out - last_point) >= index->span) {
+			struct row_index_point *point = row_index_add_point(index);
+			point->out = total_out;
+			point->in = strm.total_in;
+			point->bits = strm.data_type & 7;
+			point->cb_window = (total_out > ROW_INDEX_WINDOW_SIZE)?ROW_INDEX_WINDOW_SIZE:total_out;
+			point->window = malloc(point->cb_window);
+			assert(point->window);
+			memcpy(point->window, buffer + length - point->cb_window, point->cb_window);
+			last_point = total_out;
+		}
+	}
+	
+	inflateEnd(&strm);
+	free(buffer);
+	if(!scanner->done && rc != Z_STREAM_END) {
+		fprintf(stderr, "ooxml_row_index: inflate(%s) failed: %d\n", index->sheet_name, rc);
+		return -1;
+	}
+	return 0;
+}
+
+struct ooxml_row_index *ooxml_row_index_build(const char *archive_name, const char *sheet_name, int64_t row_interval, size_t span)
+{
+	assert(archive_name && sheet_name);
+	struct ooxml_row_index *index = row_index_new(archive_name, sheet_name);
+	if(NULL == index) return NULL;
+	
+	PERF_TRACE_BEGIN(span_build);
+	index->row_interval = (row_interval > 0)?row_interval:OOXML_ROW_INDEX_DEFAULT_INTERVAL;
+	index->span = (span > 0)?span:OOXML_ROW_INDEX_DEFAULT_SPAN;
+	
+	struct row_scanner scanner;
+	memset(&scanner, 0, sizeof(scanner));
+	scanner.index = index;
+	
+	int rc = 0;
+	if(index->entry.method == 0) {	// stored: the entry data is the part, offsets are relative to its first byte
+		row_scanner_scan(&scanner, index->comp_data, index->entry.size, 0, 1);
+	}else {
+		rc = row_index_build_deflated(index, &scanner);
+	}
+	if(0 == rc && !scanner.in_sheet_data && !scanner.done) rc = -1;	// no <sheetData>, not a worksheet
+	
+	PERF_TRACE_END(span_build, "ooxml_row_index_build", sheet_name);
+	if(rc != 0) {
+		ooxml_row_index_free(index);
+		return NULL;
+	}
+	return index;
+}
+
+int64_t ooxml_row_index_get_num_rows(const struct ooxml_row_index *index)
+{
+	return index?index->num_rows:-1;
+}
+
+/******************************************************************************
+ * random access
+******************************************************************************/
+struct row_filter
+{
+	int64_t first_row;
+	int64_t last_row;	// < 0: to the end
+	int64_t first_col;	// < 0: all columns
+	int64_t last_col;
+	
+	ooxml_row_callback on_row;
+	void *user_data;
+	
+	struct ooxml_cell *cells;
+	ssize_t max_cells;
+};
+
+static int on_filter_row(void *user_data, const struct ooxml_row *row)
+{
+	struct row_filter *filter = user_data;
+	if(row->row_index < filter->first_row) return 0;
+	if(filter->last_row >= 0 && row->row_index > filter->last_row) return 1;
+	
+	int rc = 0;
+	if(filter->first_col < 0) {
+		rc = filter->on_row(filter->user_data, row);
+	}else {
+		if(row->num_cells > filter->max_cells) {
+			struct ooxml_cell *cells = realloc(filter->cells, row->num_cells * sizeof(*cells));
+			assert(cells);
+			filter->cells = cells;
+			filter->max_cells = row->num_cells;
+		}
+		struct ooxml_row columns = { .row_index = row->row_index, .cells = filter->cells };
+		for(ssize_t i = 0; i < row->num_cells; ++i) {
+			const struct ooxml_cell *cell = &row->cells[i];
+			if(cell->col >= filter->first_col && cell->col <= filter->last_col) filter->cells[columns.num_cells++] = *cell;
+		}
+		rc = filter->on_row(filter->user_data, &columns);
+	}
+	if(rc) return rc;
+	return (filter->last_row >= 0 && row->row_index >= filter->last_row);
+}
+
+// feed the part from offset on into the row stream
+static int row_index_push_part(struct ooxml_row_index *index, uint64_t offset, struct ooxml_row_stream *stream)
+{
+	if(index->entry.method == 0) {
+		if(offset > index->entry.size) return -1;
+		
+		// in slices: the libxml2 fallback of the stream copies what it is given
+		int rc = 0;
+		while(0 == rc && offset < index->entry.size) {
+			uint64_t length = index->entry.size - offset;
+			if(length > ROW_INDEX_READ_SIZE) length = ROW_INDEX_READ_SIZE;
+			rc = ooxml_row_stream_push(stream, index->comp_data + offset, length);
+			offset += length;
+		}
+		return (rc < 0)?-1:0;
+	}
+	
+	// the last seek point before offset, or the start of the part
+	const struct row_index_point *point = NULL;
+	size_t lo = 0, hi = index->num_points;
+	while(lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if(index->points[mid].out <= offset) lo = mid + 1;
+		else hi = mid;
+	}
+	if(lo > 0) point = &index->points[lo - 1];
+	
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	if(inflateInit2(&strm, -MAX_WBITS) != Z_OK) return -1;
+	
+	uint64_t in = 0, out = 0;
+	if(point) {
+		in = point->in;
+		out = point->out;
+		if(point->bits) inflatePrime(&strm, point->bits, index->comp_data[in - 1] >> (8 - point->bits));
+		inflateSetDictionary(&strm, point->window, point->cb_window);
+	}
+	
+	unsigned char *buffer = malloc(ROW_INDEX_READ_SIZE);
+	assert(buffer);
+	const unsigned char *p = index->comp_data + in;
+	uint64_t comp_left = index->entry.comp_size - in;
+	int rc = Z_OK;
+	int stream_rc = 0;
+	
+	while(0 == stream_rc) {
+		if(strm.avail_in == 0 && comp_left > 0) {
+			strm.next_in = (unsigned char *)p;
+			strm.avail_in = (comp_left > 0x40000000)?0x40000000:comp_left;
+			p += strm.avail_in;
+			comp_left -= strm.avail_in;
+		}
+		strm.next_out = buffer;
+		strm.avail_out = ROW_INDEX_READ_SIZE;
+		rc = inflate(&strm, Z_NO_FLUSH);
+		if(rc != Z_OK && rc != Z_STREAM_END) break;
+		
+		size_t length = ROW_INDEX_READ_SIZE - strm.avail_out;
+		if(out + length > offset) {	// skip the inflated bytes before offset
+			size_t skip = (out < offset)?(offset - out):0;
+			stream_rc = ooxml_row_stream_push(stream, buffer + skip, length - skip);
+		}
+		out += length;
+		if(rc == Z_STREAM_END) break;
+	}
+	
+	free(buffer);
+	inflateEnd(&strm);
+	if(stream_rc < 0) return -1;
+	if(0 == stream_rc && rc != Z_STREAM_END) {
+		fprintf(stderr, "ooxml_row_index: inflate(%s) failed: %d\n", index->sheet_name, rc);
+		return -1;
+	}
+	return 0;
+}
+
+static int row_index_read(struct ooxml_row_index *index, struct row_filter *filter)
+{
+	if(0 == index->num_entries) return 0;
+	
+	// the last indexed row before first_row
+	size_t lo = 0, hi = index->num_entries;
+	while(lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if(index->entries[mid].row_index <= filter->first_row) lo = mid + 1;
+		else hi = mid;
+	}
+	const struct row_index_entry *entry = &index->entries[(lo > 0)?(lo - 1):0];
+	
+	PERF_TRACE_BEGIN(span);
+	struct ooxml_row_stream *stream = ooxml_row_stream_new(on_filter_row, filter, entry->row_index - 1, index->sheet_name);
+	if(NULL == stream) return -1;
+	
+	int rc = ooxml_row_stream_push(stream, index->head, index->cb_head);
+	if(0 == rc) rc = row_index_push_part(index, entry->offset, stream);
+	ooxml_row_stream_free(stream);
+	free(filter->cells);
+	filter->cells = NULL;
+	PERF_TRACE_END(span, "ooxml_row_index_read", index->sheet_name);
+	return (rc < 0)?-1:0;
+}
+
+int ooxml_row_index_read_rows(struct ooxml_row_index *index, int64_t first_row, int64_t last_row,
+	ooxml_row_callback on_row, void *user_data)
+{
+	assert(index && on_row);
+	struct row_filter filter = {
+		.first_row = first_row,
+		.last_row = last_row,
+		.first_col = -1,
+		.last_col = -1,
+		.on_row = on_row,
+		.user_data = user_data,
+	};
+	return row_index_read(index, &filter);
+}
+
+static const char *parse_cell_ref(const char *ref, int64_t *p_col, int64_t *p_row)
+{
+	char buf[32] = "";
+	size_t length = 0;
+	for(; *ref && *ref != ':' && length < sizeof(buf) - 1; ++ref) {
+		if(*ref != '$') buf[length++] = toupper((unsigned char)*ref);
+	}
+	*p_row = 0;
+	*p_col = ooxml_cell_ref_to_col(buf, p_row);
+	return (*p_col < 0 || *p_row <= 0)?NULL:ref;
+}
+
+int ooxml_row_index_read_range(struct ooxml_row_index *index, const char *range,
+	ooxml_row_callback on_row, void *user_data)
+{
+	assert(index && range && on_row);
+	int64_t first_col = -1, first_row = -1, last_col = -1, last_row = -1;
+	
+	const char *p = parse_cell_ref(range, &first_col, &first_row);
+	if(NULL == p) return -1;
+	if(*p == ':') {
+		if(NULL == parse_cell_ref(p + 1, &last_col, &last_row)) return -1;
+	}else {
+		last_col = first_col;
+		last_row = first_row;
+	}
+	if(last_col < first_col || last_row < first_row) return -1;
+	
+	struct row_filter filter = {
+		.first_row = first_row,
+		.last_row = last_row,
+		.first_col = first_col,
+		.last_col = last_col,
+		.on_row = on_row,
+		.user_data = user_data,
+	};
+	return row_index_read(index, &filter);
+}
+
+/******************************************************************************
+ * persistence
+******************************************************************************/
+char *ooxml_row_index_get_path(const char *archive_name, const char *sheet_name)
+{
+	size_t cb_archive_name = strlen(archive_name);
+	size_t cb_sheet_name = strlen(sheet_name);
+	char *path = malloc(cb_archive_name + cb_sheet_name + sizeof(".rowidx") + 1);
+	assert(path);
+	
+	char *p = path;
+	memcpy(p, archive_name, cb_archive_name);
+	p += cb_archive_name;
+	*p++ = '.';
+	for(size_t i = 0; i < cb_sheet_name; ++i) *p++ = (sheet_name[i] == '/')?'_':sheet_name[i];
+	strcpy(p, ".rowidx");
+	return path;
+}
+
+int ooxml_row_index_save(struct ooxml_row_index *index, const char *path)
+{
+	assert(index && path);
+	
+	struct row_index_file_header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, ROW_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = ROW_INDEX_VERSION;
+	hdr.cb_sheet_name = strlen(index->sheet_name);
+	hdr.crc = index->entry.crc;
+	hdr.method = index->entry.method;
+	hdr.comp_size = index->entry.comp_size;
+	hdr.size = index->entry.size;
+	hdr.local_header_offset = index->entry.local_header_offset;
+	hdr.row_interval = index->row_interval;
+	hdr.span = index->span;
+	hdr.num_rows = index->num_rows;
+	hdr.cb_head = index->cb_head;
+	hdr.num_points = index->num_points;
+	hdr.num_entries = index->num_entries;
+	
+	// a unique file next to path: concurrent savers of the same index never share it
+	size_t cb_path = strlen(path);
+	char *tmp_path = malloc(cb_path + sizeof(".XXXXXX"));
+	assert(tmp_path);
+	memcpy(tmp_path, path, cb_path);
+	memcpy(tmp_path + cb_path, ".XXXXXX", sizeof(".XXXXXX"));
+	
+	int fd = mkstemp(tmp_path);
+	if(fd == -1) {
+		perror(tmp_path);
+		free(tmp_path);
+		return -1;
+	}
+	
+	// mkstemp() creates the file with 0600, keep the mode of the file that gets replaced
+	struct stat st;
+	if(stat(path, &st) == 0) {
+		fchmod(fd, st.st_mode & 07777);
+	}else {
+		mode_t mask = umask(0);
+		umask(mask);
+		fchmod(fd, 0666 & ~mask);
+	}
+	FILE *fp = fdopen(fd, "wb");
+	assert(fp);
+	
+	int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+		&& fwrite(index->sheet_name, 1, hdr.cb_sheet_name, fp) == hdr.cb_sheet_name
+		&& fwrite(index->head, 1, index->cb_head, fp) == index->cb_head;
+	
+	uLong cb_packed_max = compressBound(ROW_INDEX_WINDOW_SIZE);
+	unsigned char *packed = malloc(cb_packed_max);
+	assert(packed);
+	for(size_t i = 0; ok && i < index->num_points; ++i) {
+		const struct row_index_point *point = &index->points[i];
+		uLong cb_packed = cb_packed_max;
+		if(compress2(packed, &cb_packed, point->window, point->cb_window, 1) != Z_OK) {
+			ok = 0;
+			break;
+		}
+		struct row_index_file_point file_point = {
+			.out = point->out,
+			.in = point->in,
+			.bits = point->bits,
+			.cb_window = point->cb_window,
+			.cb_packed = cb_packed,
+		};
+		ok = fwrite(&file_point, sizeof(file_point), 1, fp) == 1
+			&& fwrite(packed, 1, cb_packed, fp) == cb_packed;
+	}
+	free(packed);
+	
+	if(ok && index->num_entries > 0) ok = fwrite(index->entries, sizeof(*index->entries), index->num_entries, fp) == index->num_entries;
+	if(fclose(fp) != 0) ok = 0;
+	if(ok) ok = (rename(tmp_path, path) == 0);
+	if(!ok) {
+		fprintf(stderr, "ooxml_row_index: failed to save %s\n", path);
+		unlink(tmp_path);
+	}
+	free(tmp_path);
+	return ok?0:-1;
+}
+
+struct ooxml_row_index *ooxml_row_index_load(const char *path, const char *archive_name, const char *sheet_name)
+{
+	assert(path && archive_name && sheet_name);
+	FILE *fp = fopen(path, "rb");
+	if(NULL == fp) return NULL;
+	
+	struct stat st;
+	struct row_index_file_header hdr;
+	size_t cb_sheet_name = strlen(sheet_name);
+	char *stored_name = NULL;
+	struct ooxml_row_index *index = NULL;
+	unsigned char *packed = NULL;
+	int ok = 0;
+	
+	if(fstat(fileno(fp), &st) != 0 || fread(&hdr, sizeof(hdr), 1, fp) != 1) goto label_final;
+	if(memcmp(hdr.magic, ROW_INDEX_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != ROW_INDEX_VERSION) goto label_final;
+	if(hdr.cb_sheet_name != cb_sheet_name || hdr.row_interval <= 0) goto label_final;
+	
+	// all arrays must fit in the file
+	uint64_t cb_min = sizeof(hdr) + hdr.cb_sheet_name;
+	if(hdr.cb_head > (uint64_t)st.st_size || hdr.num_points > (uint64_t)st.st_size || hdr.num_entries > (uint64_t)st.st_size) goto label_final;
+	cb_min += hdr.cb_head + hdr.num_points * sizeof(struct row_index_file_point) + hdr.num_entries * sizeof(struct row_index_entry);
+	if(cb_min > (uint64_t)st.st_size) goto label_final;
+	
+	stored_name = malloc(cb_sheet_name + 1);
+	assert(stored_name);
+	if(fread(stored_name, 1, cb_sheet_name, fp) != cb_sheet_name || memcmp(stored_name, sheet_name, cb_sheet_name) != 0) goto label_final;
+	
+	// the part must not have changed
+	index = row_index_new(archive_name, sheet_name);
+	if(NULL == index) goto label_final;
+	if(index->entry.crc != hdr.crc || index->entry.method != hdr.method
+		|| index->entry.comp_size != hdr.comp_size || index->entry.size != hdr.size
+		|| index->entry.local_header_offset != hdr.local_header_offset)
+	{
+		debug_printf("%s: %s has changed", path, sheet_name);
+		goto label_final;
+	}
+	
+	index->row_interval = hdr.row_interval;
+	index->span = hdr.span;
+	index->num_rows = hdr.num_rows;
+	index->cb_head = hdr.cb_head;
+	index->head = malloc(hdr.cb_head);
+	assert(index->head);
+	if(fread(index->head, 1, hdr.cb_head, fp) != hdr.cb_head) goto label_final;
+	
+	packed = malloc(compressBound(ROW_INDEX_WINDOW_SIZE));
+	assert(packed);
+	for(uint64_t i = 0; i < hdr.num_points; ++i) {
+		struct row_index_file_point file_point;
+		if(fread(&file_point, sizeof(file_point), 1, fp) != 1) goto label_final;
+		if(file_point.cb_window > ROW_INDEX_WINDOW_SIZE || file_point.cb_packed > compressBound(ROW_INDEX_WINDOW_SIZE)) goto label_final;
+		if(file_point.bits > 7 || file_point.in > hdr.comp_size || (file_point.bits && 0 == file_point.in)) goto label_final;
+		if(fread(packed, 1, file_point.cb_packed, fp) != file_point.cb_packed) goto label_final;
+		
+		struct row_index_point *point = row_index_add_point(index);
+		point->out = file_point.out;
+		point->in = file_point.in;
+		point->bits = file_point.bits;
+		point->window = malloc(ROW_INDEX_WINDOW_SIZE);
+		assert(point->window);
+		uLong cb_window = ROW_INDEX_WINDOW_SIZE;
+		if(uncompress(point->window, &cb_window, packed, file_point.cb_packed) != Z_OK || cb_window != file_point.cb_window) goto label_final;
+		point->cb_window = cb_window;
+	}
+	
+	if(hdr.num_entries > 0) {
+		index->entries = malloc(hdr.num_entries * sizeof(*index->entries));
+		assert(index->entries);
+		index->num_entries = index->max_entries = hdr.num_entries;
+		if(fread(index->entries, sizeof(*index->entries), hdr.num_entries, fp) != hdr.num_entries) goto label_final;
+		for(uint64_t i = 0; i < hdr.num_entries; ++i) {
+			if(index->entries[i].offset > hdr.size) goto label_final;
+		}
+	}
+	ok = 1;
+
+label_final:
+	fclose(fp);
+	free(packed);
+	free(stored_name);
+	if(!ok) {
+		ooxml_row_index_free(index);
+		return NULL;
+	}
+	return index;
+}
+
+struct ooxml_row_index *ooxml_row_index_open(const char *archive_name, const char *sheet_name)
+{
+	char *path = ooxml_row_index_get_path(archive_name, sheet_name);
+	struct ooxml_row_index *index = ooxml_row_index_load(path, archive_name, sheet_name);
+	if(NULL == index) {
+		index = ooxml_row_index_build(archive_name, sheet_name, 0, 0);
+		if(index) ooxml_row_index_save(index, path);	// a read-only directory only costs the rebuild next time
+	}
+	free(path);
+	return index;
+}
+
+
+#if defined(TEST_OOXML_ROW_INDEX_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
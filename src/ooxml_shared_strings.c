@@ -0,0 +1,526 @@
+/*
+ * ooxml_shared_strings.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <libxml/parser.h>
+
+#include "ooxml_context.h"
+#include "ooxml_shared_strings.h"
+
+#define SST_BLOCK_SIZE (64 * 1024)
+
+/******************************************************************************
+ * string blocks (lazy mode)
+ * decoded strings are never moved, so the returned pointers stay valid
+******************************************************************************/
+struct string_block
+{
+	struct string_block *next;
+	size_t cb_used;
+	size_t max_size;
+	char data[];
+};
+
+struct ooxml_shared_strings_private
+{
+	pthread_mutex_t mutex;
+	
+	// lazy mode
+	char *raw;			// inflated sharedStrings.xml
+	size_t cb_raw;
+	uint64_t *raw_offsets;	// start of each <si> in raw, count + 1 items
+	const char **strings;	// decoded strings, NULL until the first lookup
+	uint32_t *lengths;
+	struct string_block *blocks;
+};
+
+static char *string_blocks_alloc(struct ooxml_shared_strings_private *priv, size_t size)
+{
+	struct string_block *block = priv->blocks;
+	if(NULL == block || (block->cb_used + size) > block->max_size) {
+		size_t max_size = SST_BLOCK_SIZE;
+		if(size > max_size) max_size = size;
+		block = malloc(sizeof(*block) + max_size);
+		assert(block);
+		block->next = priv->blocks;
+		block->cb_used = 0;
+		block->max_size = max_size;
+		priv->blocks = block;
+	}
+	char *p = block->data + block->cb_used;
+	block->cb_used += size;
+	return p;
+}
+
+/******************************************************************************
+ * eager mode: SAX2 parser
+******************************************************************************/
+struct sst_parser
+{
+	struct ooxml_shared_strings *sst;
+	size_t max_arena;
+	ssize_t max_items;
+	
+	int in_item;
+	int in_text;
+	int in_phonetic;
+};
+
+static void sst_arena_append(struct sst_parser *parser, const char *text, size_t length)
+{
+	struct ooxml_shared_strings *sst = parser->sst;
+	if((sst->cb_arena + length) > parser->max_arena) {
+		size_t new_size = parser->max_arena * 2;
+		if(new_size < SST_BLOCK_SIZE) new_size = SST_BLOCK_SIZE;
+		while(new_size < (sst->cb_arena + length)) new_size *= 2;
+		
+		char *arena = realloc(sst->arena, new_size);
+		assert(arena);
+		sst->arena = arena;
+		parser->max_arena = new_size;
+	}
+	memcpy(sst->arena + sst->cb_arena, text, length);
+	sst->cb_arena += length;
+}
+
+static void sst_on_start_element(void *ctx,
+	const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI,
+	int nb_namespaces, const xmlChar **namespaces,
+	int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+	struct sst_parser *parser = ((xmlParserCtxtPtr)ctx)->_private;
+	struct ooxml_shared_strings *sst = parser->sst;
+	const char *name = (const char *)localname;
+	
+	if(strcmp(name, "si") == 0) {
+		if((sst->count + 1) >= parser->max_items) {
+			ssize_t new_size = parser->max_items * 2;
+			if(new_size < 1024) new_size = 1024;
+			uint64_t *offsets = realloc(sst->offsets, new_size * sizeof(*offsets));
+			assert(offsets);
+			sst->offsets = offsets;
+			parser->max_items = new_size;
+		}
+		sst->offsets[sst->count] = sst->cb_arena;
+		parser->in_item = 1;
+		return;
+	}
+	if(!parser->in_item) return;
+	
+	if(strcmp(name, "rPh") == 0) parser->in_phonetic = 1;
+	else if(strcmp(name, "t") == 0 && !parser->in_phonetic) parser->in_text = 1;
+}
+
+static void sst_on_end_element(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI)
+{
+	struct sst_parser *parser = ((xmlParserCtxtPtr)ctx)->_private;
+	struct ooxml_shared_strings *sst = parser->sst;
+	const char *name = (const char *)localname;
+	if(!parser->in_item) return;
+	
+	if(strcmp(name, "si") == 0) {
+		sst_arena_append(parser, "", 1);
+		++sst->count;
+		sst->offsets[sst->count] = sst->cb_arena;
+		parser->in_item = 0;
+		parser->in_text = 0;
+		parser->in_phonetic = 0;
+	}else if(strcmp(name, "rPh") == 0) {
+		parser->in_phonetic = 0;
+	}else if(strcmp(name, "t") == 0) {
+		parser->in_text = 0;
+	}
+}
+
+static void sst_on_characters(void *ctx, const xmlChar *text, int length)
+{
+	struct sst_parser *parser = ((xmlParserCtxtPtr)ctx)->_private;
+	if(parser->in_text) sst_arena_append(parser, (const char *)text, length);
+}
+
+static int sst_load_eager(struct ooxml_shared_strings *sst, zip_t *zip, const char *part_name)
+{
+	xmlSAXHandler sax;
+	memset(&sax, 0, sizeof(sax));
+	sax.initialized = XML_SAX2_MAGIC;
+	sax.startElementNs = sst_on_start_element;
+	sax.endElementNs = sst_on_end_element;
+	sax.characters = sst_on_characters;
+	sax.cdataBlock = sst_on_characters;
+	
+	struct sst_parser parser;
+	memset(&parser, 0, sizeof(parser));
+	parser.sst = sst;
+	
+	int rc = parse_zip_xml_stream(zip, part_name, &sax, &parser, NULL);
+	if(rc) return rc;
+	
+	// shrink to fit
+	if(sst->cb_arena > 0) {
+		char *arena = realloc(sst->arena, sst->cb_arena);
+		if(arena) sst->arena = arena;
+	}
+	if(NULL == sst->offsets) {
+		sst->offsets = calloc(1, sizeof(*sst->offsets));
+		assert(sst->offsets);
+	}
+	return 0;
+}
+
+/******************************************************************************
+ * lazy mode: index <si> offsets in the raw xml, decode on lookup
+******************************************************************************/
+/*
+ * p at "<!" or "<?": the position after the comment (-->), cdata section (]]>), pi (?>) or declaration (>),
+ * or NULL if it is not terminated
+ */
+static const char *skip_markup(const char *p, const char *p_end)
+{
+	const char *terminator = ">";
+	size_t cb_prefix = 2;
+	if((p_end - p) >= 4 && memcmp(p, "<!--", 4) == 0) { terminator = "-->"; cb_prefix = 4; }
+	else if((p_end - p) >= 9 && memcmp(p, "<![CDATA[", 9) == 0) { terminator = "]]>"; cb_prefix = 9; }
+	else if(p[1] == '?') terminator = "?>";
+	
+	size_t cb_terminator = strlen(terminator);
+	for(p += cb_prefix; p < p_end; ++p) {
+		p = memchr(p, terminator[0], p_end - p);
+		if(NULL == p) return NULL;
+		if((size_t)(p_end - p) >= cb_terminator && memcmp(p, terminator, cb_terminator) == 0) return p + cb_terminator;
+	}
+	return NULL;
+}
+
+/*
+ * scan the next tag in [p, p_end)
+ * returns the position after '>', or NULL if no more tags.
+ * *p_name, *p_cb_name: the local name (prefix stripped),
+ * *p_closing: </name>, *p_empty: <name/>
+ */
+static const char *scan_tag(const char *p, const char *p_end,
+	const char **p_tag_start, const char **p_name, size_t *p_cb_name, int *p_closing, int *p_empty)
+{
+	while(p < p_end) {
+		p = memchr(p, '<', p_end - p);
+		if(NULL == p) return NULL;
+		
+		const char *tag_start = p++;
+		if(p < p_end && (*p == '?' || *p == '!')) {	// pi, comment, cdata: skip
+			p = skip_markup(tag_start, p_end);
+			if(NULL == p) return NULL;
+			continue;
+		}
+		
+		int closing = 0;
+		if(p < p_end && *p == '/') { closing = 1; ++p; }
+		
+		const char *name = p;
+		while(p < p_end && *p != '>' && *p != '/' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+			if(*p == ':') name = p + 1;
+			++p;
+		}
+		size_t cb_name = p - name;
+		
+		const char *end = memchr(p, '>', p_end - p);
+		if(NULL == end) return NULL;
+		
+		*p_tag_start = tag_start;
+		*p_name = name;
+		*p_cb_name = cb_name;
+		*p_closing = closing;
+		*p_empty = (end > tag_start && end[-1] == '/');
+		return end + 1;
+	}
+	return NULL;
+}
+
+static size_t utf8_encode(uint32_t code, char *out)
+{
+	if(code < 0x80) { out[0] = code; return 1; }
+	if(code < 0x800) {
+		out[0] = 0xC0 | (code >> 6);
+		out[1] = 0x80 | (code & 0x3F);
+		return 2;
+	}
+	if(code < 0x10000) {
+		out[0] = 0xE0 | (code >> 12);
+		out[1] = 0x80 | ((code >> 6) & 0x3F);
+		out[2] = 0x80 | (code & 0x3F);
+		return 3;
+	}
+	out[0] = 0xF0 | (code >> 18);
+	out[1] = 0x80 | ((code >> 12) & 0x3F);
+	out[2] = 0x80 | ((code >> 6) & 0x3F);
+	out[3] = 0x80 | (code & 0x3F);
+	return 4;
+}
+
+/* the payload of a cdata section: no entities, only line ends are normalized */
+static size_t copy_cdata(const char *p, const char *p_end, char *out)
+{
+	char *dst = out;
+	while(p < p_end) {
+		char c = *p++;
+		if(c == '\r') {
+			*dst++ = '\n';
+			if(p < p_end && *p == '\n') ++p;
+			continue;
+		}
+		*dst++ = c;
+	}
+	return dst - out;
+}
+
+/* decode character data (entities, line ends) into out, returns the number of bytes written */
+static size_t decode_text(const char *p, const char *p_end, char *out)
+{
+	char *dst = out;
+	while(p < p_end) {
+		char c = *p++;
+		if(c == '\r') {
+			*dst++ = '\n';
+			if(p < p_end && *p == '\n') ++p;
+			continue;
+		}
+		if(c != '&') {
+			*dst++ = c;
+			continue;
+		}
+		
+		const char *semicolon = memchr(p, ';', p_end - p);
+		if(NULL == semicolon) { *dst++ = c; continue; }
+		size_t length = semicolon - p;
+		
+		if(length >= 2 && p[0] == '#') {
+			uint32_t code = 0;
+			if(p[1] == 'x' || p[1] == 'X') code = strtoul(p + 2, NULL, 16);
+			else code = strtoul(p + 1, NULL, 10);
+			dst += utf8_encode(code, dst);
+		}
+		else if(length == 2 && memcmp(p, "lt", 2) == 0) *dst++ = '<';
+		else if(length == 2 && memcmp(p, "gt", 2) == 0) *dst++ = '>';
+		else if(length == 3 && memcmp(p, "amp", 3) == 0) *dst++ = '&';
+		else if(length == 4 && memcmp(p, "quot", 4) == 0) *dst++ = '"';
+		else if(length == 4 && memcmp(p, "apos", 4) == 0) *dst++ = '\'';
+		else { *dst++ = c; continue; }
+		p = semicolon + 1;
+	}
+	return dst - out;
+}
+
+static int sst_load_lazy(struct ooxml_shared_strings *sst, zip_t *zip, const char *part_name)
+{
+	struct ooxml_shared_strings_private *priv = sst->priv;
+	zip_stat_t stats;
+	memset(&stats, 0, sizeof(stats));
+	if(zip_stat(zip, part_name, ZIP_FL_UNCHANGED, &stats) != 0 || !(stats.valid & ZIP_STAT_SIZE)) {
+		fprintf(stderr, "zip_stat(%s) failed: %s\n", part_name, zip_strerror(zip));
+		return -1;
+	}
+	
+	zip_file_t *zfp = zip_fopen(zip, part_name, ZIP_FL_UNCHANGED);
+	if(NULL == zfp) {
+		fprintf(stderr, "zip_fopen(%s) failed: %s\n", part_name, zip_strerror(zip));
+		return -1;
+	}
+	char *raw = malloc(stats.size + 1);
+	assert(raw);
+	ssize_t cb_raw = zip_fread(zfp, raw, stats.size);
+	zip_fclose(zfp);
+	if(cb_raw != (ssize_t)stats.size) {
+		free(raw);
+		return -1;
+	}
+	raw[cb_raw] = '\0';
+	
+	// only utf-8 can be scanned in place
+	if(cb_raw >= 2 && ((unsigned char)raw[0] == 0xFF || (unsigned char)raw[0] == 0xFE)) {
+		free(raw);
+		return 1;
+	}
+	priv->raw = raw;
+	priv->cb_raw = cb_raw;
+	
+	ssize_t max_items = 0;
+	const char *p = raw;
+	const char *p_end = raw + cb_raw;
+	const char *tag_start = NULL, *name = NULL;
+	size_t cb_name = 0;
+	int closing = 0, empty = 0;
+	
+	while((p = scan_tag(p, p_end, &tag_start, &name, &cb_name, &closing, &empty))) {
+		if(closing || cb_name != 2 || memcmp(name, "si", 2) != 0) continue;
+		if((sst->count + 1) >= max_items) {
+			ssize_t new_size = max_items * 2;
+			if(new_size < 1024) new_size = 1024;
+			uint64_t *offsets = realloc(priv->raw_offsets, new_size * sizeof(*offsets));
+			assert(offsets);
+			priv->raw_offsets = offsets;
+			max_items = new_size;
+		}
+		priv->raw_offsets[sst->count++] = tag_start - raw;
+	}
+	if(NULL == priv->raw_offsets) {
+		priv->raw_offsets = calloc(1, sizeof(*priv->raw_offsets));
+		assert(priv->raw_offsets);
+	}
+	priv->raw_offsets[sst->count] = cb_raw;
+	
+	priv->strings = calloc(sst->count + 1, sizeof(*priv->strings));
+	priv->lengths = calloc(sst->count + 1, sizeof(*priv->lengths));
+	assert(priv->strings && priv->lengths);
+	return 0;
+}
+
+static const char *sst_decode_item(struct ooxml_shared_strings *sst, ssize_t index)
+{
+	struct ooxml_shared_strings_private *priv = sst->priv;
+	const char *p = priv->raw + priv->raw_offsets[index];
+	const char *p_end = priv->raw + priv->raw_offsets[index + 1];
+	
+	// the decoded text is never longer than the raw item
+	char *text = string_blocks_alloc(priv, (p_end - p) + 1);
+	size_t cb_text = 0;
+	
+	const char *tag_start = NULL, *name = NULL;
+	size_t cb_name = 0;
+	int closing = 0, empty = 0;
+	int in_phonetic = 0;
+	
+	p = scan_tag(p, p_end, &tag_start, &name, &cb_name, &closing, &empty);	// <si>
+	if(p && !empty) {
+		while((p = scan_tag(p, p_end, &tag_start, &name, &cb_name, &closing, &empty))) {
+			if(cb_name == 2 && memcmp(name, "si", 2) == 0) break;
+			if(cb_name == 3 && memcmp(name, "rPh", 3) == 0) { in_phonetic = !closing && !empty; continue; }
+			if(closing || empty || in_phonetic) continue;
+			if(cb_name != 1 || name[0] != 't') continue;
+			
+			// <t>...</t>: character data, cdata sections (copied as is) and comments up to the next tag
+			while(p < p_end) {
+				const char *text_end = memchr(p, '<', p_end - p);
+				if(NULL == text_end) text_end = p_end;
+				cb_text += decode_text(p, text_end, text + cb_text);
+				p = text_end;
+				if((p_end - p) < 2 || (p[1] != '!' && p[1] != '?')) break;
+				
+				const char *markup_end = skip_markup(p, p_end);
+				if((p_end - p) >= 9 && memcmp(p, "<![CDATA[", 9) == 0) {
+					cb_text += copy_cdata(p + 9, markup_end?(markup_end - 3):p_end, text + cb_text);
+				}
+				p = markup_end?markup_end:p_end;
+			}
+		}
+	}
+	text[cb_text] = '\0';
+	
+	priv->lengths[index] = cb_text;
+	__sync_synchronize();
+	priv->strings[index] = text;
+	return text;
+}
+
+/******************************************************************************
+ * public functions
+******************************************************************************/
+struct ooxml_shared_strings *ooxml_shared_strings_load(zip_t *zip, const char *part_name, int lazy_mode)
+{
+	assert(zip);
+	if(NULL == part_name) part_name = "xl/sharedStrings.xml";
+	
+	struct ooxml_shared_strings *sst = calloc(1, sizeof(*sst));
+	assert(sst);
+	struct ooxml_shared_strings_private *priv = calloc(1, sizeof(*priv));
+	assert(priv);
+	pthread_mutex_init(&priv->mutex, NULL);
+	sst->priv = priv;
+	sst->lazy_mode = lazy_mode;
+	
+	int rc = -1;
+	if(lazy_mode) {
+		rc = sst_load_lazy(sst, zip, part_name);
+		if(rc > 0) {	// not scannable, use the xml parser
+			sst->lazy_mode = 0;
+			rc = sst_load_eager(sst, zip, part_name);
+		}
+	}else {
+		rc = sst_load_eager(sst, zip, part_name);
+	}
+	
+	if(rc) {
+		ooxml_shared_strings_free(sst);
+		return NULL;
+	}
+	return sst;
+}
+
+void ooxml_shared_strings_free(struct ooxml_shared_strings *sst)
+{
+	if(NULL == sst) return;
+	struct ooxml_shared_strings_private *priv = sst->priv;
+	if(priv) {
+		struct string_block *block = priv->blocks;
+		while(block) {
+			struct string_block *next = block->next;
+			free(block);
+			block = next;
+		}
+		free(priv->raw);
+		free(priv->raw_offsets);
+		free(priv->strings);
+		free(priv->lengths);
+		pthread_mutex_destroy(&priv->mutex);
+		free(priv);
+	}
+	free(sst->arena);
+	free(sst->offsets);
+	free(sst);
+}
+
+const char *ooxml_shared_strings_get(struct ooxml_shared_strings *sst, ssize_t index, size_t *p_length)
+{
+	if(NULL == sst || index < 0 || index >= sst->count) return NULL;
+	
+	if(!sst->lazy_mode) {
+		if(p_length) *p_length = sst->offsets[index + 1] - sst->offsets[index] - 1;
+		return sst->arena + sst->offsets[index];
+	}
+	
+	struct ooxml_shared_strings_private *priv = sst->priv;
+	const char *text = priv->strings[index];
+	if(NULL == text) {
+		pthread_mutex_lock(&priv->mutex);
+		text = priv->strings[index];
+		if(NULL == text) text = sst_decode_item(sst, index);
+		pthread_mutex_unlock(&priv->mutex);
+	}
+	if(p_length) *p_length = priv->lengths[index];
+	return text;
+}
@@ -0,0 +1,775 @@
+/*
+ * ooxml_sheet_scanner.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "ooxml_sheet_scanner.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHEET_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+#define SHEET_SCANNER_MAX_DEPTH	(32)
+#define SHEET_SCANNER_MAX_NAME	(62)
+#define SHEET_SCANNER_MAX_ATTRS	(32)
+
+/******************************************************************************
+ * search kernels
+******************************************************************************/
+struct scan_ops
+{
+	const char *name;
+	// first of a, b or c in [p, end), NULL if none
+	const char *(*find_any)(const char *p, const char *end, char a, char b, char c);
+	// first "</row" in [p, end), NULL if none
+	const char *(*find_row_end)(const char *p, const char *end);
+};
+
+static const char s_row_end_tag[] = "</row";
+#define ROW_END_TAG_LENGTH (sizeof(s_row_end_tag) - 1)
+
+static const char *find_any_scalar(const char *p, const char *end, char a, char b, char c)
+{
+	for(; p < end; ++p) {
+		if(*p == a || *p == b || *p == c) return p;
+	}
+	return NULL;
+}
+
+static const char *find_row_end_scalar(const char *p, const char *end)
+{
+	for(; (end - p) >= (ssize_t)ROW_END_TAG_LENGTH; ++p) {
+		if(p[0] == '<' && p[1] == '/' && memcmp(p + 2, s_row_end_tag + 2, ROW_END_TAG_LENGTH - 2) == 0) return p;
+	}
+	return NULL;
+}
+
+static const struct scan_ops s_scalar_ops = {
+	.name = "scalar",
+	.find_any = find_any_scalar,
+	.find_row_end = find_row_end_scalar,
+};
+
+#ifdef SHEET_SCANNER_X86
+__attribute__((target("sse4.2")))
+static const char *find_any_sse42(const char *p, const char *end, char a, char b, char c)
+{
+	const __m128i set = _mm_setr_epi8(a, b, c, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	while((end - p) >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *)p);
+		int index = _mm_cmpestri(set, 3, block, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+		if(index < 16) return p + index;
+		p += 16;
+	}
+	return find_any_scalar(p, end, a, b, c);
+}
+
+__attribute__((target("sse4.2")))
+static const char *find_row_end_sse42(const char *p, const char *end)
+{
+	const __m128i needle = _mm_loadu_si128((const __m128i *)"</row\0\0\0\0\0\0\0\0\0\0\0");
+	while((end - p) >= 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *)p);
+		int index = _mm_cmpestri(needle, ROW_END_TAG_LENGTH, block, 16,
+			_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ORDERED | _SIDD_LEAST_SIGNIFICANT);
+		if(index == 16) {
+			p += 16;
+			continue;
+		}
+		// a match at the end of the block may be partial, continue from its start
+		if(index > (16 - (int)ROW_END_TAG_LENGTH)) {
+			p += index;
+			continue;
+		}
+		return p + index;
+	}
+	return find_row_end_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *find_any_avx2(const char *p, const char *end, char a, char b, char c)
+{
+	const __m256i va = _mm256_set1_epi8(a);
+	const __m256i vb = _mm256_set1_epi8(b);
+	const __m256i vc = _mm256_set1_epi8(c);
+	while((end - p) >= 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i *)p);
+		__m256i match = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, va), _mm256_cmpeq_epi8(block, vb)),
+			_mm256_cmpeq_epi8(block, vc));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(match);
+		if(mask) return p + __builtin_ctz(mask);
+		p += 32;
+	}
+	return find_any_scalar(p, end, a, b, c);
+}
+
+__attribute__((target("avx2")))
+static const char *find_row_end_avx2(const char *p, const char *end)
+{
+	// "</r" at three shifted loads, the rest of the tag is compared on the candidates
+	const __m256i v0 = _mm256_set1_epi8('<');
+	const __m256i v1 = _mm256_set1_epi8('/');
+	const __m256i v2 = _mm256_set1_epi8('r');
+	while((end - p) >= (32 + (ssize_t)ROW_END_TAG_LENGTH)) {
+		__m256i match = _mm256_and_si256(
+			_mm256_and_si256(
+				_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), v0),
+				_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 1)), v1)),
+			_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 2)), v2));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(match);
+		while(mask) {
+			const char *candidate = p + __builtin_ctz(mask);
+			if(memcmp(candidate + 3, s_row_end_tag + 3, ROW_END_TAG_LENGTH - 3) == 0) return candidate;
+			mask &= mask - 1;
+		}
+		p += 32;
+	}
+	return find_row_end_scalar(p, end);
+}
+
+static const struct scan_ops s_sse42_ops = {
+	.name = "sse4.2",
+	.find_any = find_any_sse42,
+	.find_row_end = find_row_end_sse42,
+};
+
+static const struct scan_ops s_avx2_ops = {
+	.name = "avx2",
+	.find_any = find_any_avx2,
+	.find_row_end = find_row_end_avx2,
+};
+#endif
+
+/******************************************************************************
+ * dispatch
+******************************************************************************/
+static enum ooxml_row_scanner s_row_scanner = ooxml_row_scanner_auto;
+static const struct scan_ops *s_ops;
+static pthread_once_t s_detect_once = PTHREAD_ONCE_INIT;
+static const struct scan_ops *s_best_ops = &s_scalar_ops;
+
+static void detect_cpu_features(void)
+{
+#ifdef SHEET_SCANNER_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) s_best_ops = &s_avx2_ops;
+	else if(__builtin_cpu_supports("sse4.2")) s_best_ops = &s_sse42_ops;
+#endif
+}
+
+static const struct scan_ops *get_scan_ops(void)
+{
+	pthread_once(&s_detect_once, detect_cpu_features);
+	if(s_row_scanner == ooxml_row_scanner_libxml2) return NULL;
+	return s_ops?s_ops:s_best_ops;
+}
+
+int ooxml_spreadsheet_set_row_scanner(enum ooxml_row_scanner scanner)
+{
+	pthread_once(&s_detect_once, detect_cpu_features);
+	const struct scan_ops *ops = NULL;
+	switch(scanner) {
+	case ooxml_row_scanner_auto:
+	case ooxml_row_scanner_libxml2:
+		break;
+	case ooxml_row_scanner_scalar: ops = &s_scalar_ops; break;
+#ifdef SHEET_SCANNER_X86
+	case ooxml_row_scanner_sse42:
+		if(!__builtin_cpu_supports("sse4.2")) return -1;
+		ops = &s_sse42_ops;
+		break;
+	case ooxml_row_scanner_avx2:
+		if(!__builtin_cpu_supports("avx2")) return -1;
+		ops = &s_avx2_ops;
+		break;
+#endif
+	default:
+		return -1;
+	}
+	s_row_scanner = scanner;
+	s_ops = ops;
+	return 0;
+}
+
+const char *ooxml_spreadsheet_get_row_scanner_name(void)
+{
+	const struct scan_ops *ops = get_scan_ops();
+	return ops?ops->name:"libxml2";
+}
+
+/******************************************************************************
+ * scanner
+******************************************************************************/
+struct scanner_element
+{
+	unsigned char cb_name;
+	char name[SHEET_SCANNER_MAX_NAME + 1];	// qualified name
+};
+
+struct ooxml_sheet_scanner
+{
+	struct ooxml_sheet_scanner_handler handler;
+	const struct scan_ops *ops;
+	enum ooxml_sheet_scanner_status status;
+	
+	int at_start;
+	int in_sheet_data;	// the head is complete
+	
+	// the document up to <sheetData>
+	char *head;
+	size_t cb_head;
+	size_t max_head;
+	
+	// data of the previous push() from the first unparsed token or row on
+	char *pending;
+	size_t cb_pending;
+	size_t max_pending;
+	
+	int depth;
+	struct scanner_element stack[SHEET_SCANNER_MAX_DEPTH];
+	struct ooxml_xml_attr attrs[SHEET_SCANNER_MAX_ATTRS];
+};
+
+struct start_tag
+{
+	const char *qname;
+	size_t cb_qname;
+	const char *name;	// local name
+	size_t cb_name;
+	int num_attrs;
+	int is_empty;
+	const char *end;	// after '>'
+};
+
+enum token_result
+{
+	token_unsupported = -1,
+	token_ok = 0,
+	token_incomplete = 1,
+};
+
+static unsigned char s_name_end[256] = {
+	[' '] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1,
+	['/'] = 1, ['>'] = 1, ['='] = 1, ['<'] = 1,
+};
+
+static inline int is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline const char *skip_spaces(const char *p, const char *end)
+{
+	while(p < end && is_space(*p)) ++p;
+	return p;
+}
+
+static inline const char *scan_name(const char *p, const char *end)
+{
+	while(p < end && !s_name_end[(unsigned char)*p]) ++p;
+	return p;
+}
+
+static inline const char *local_name(const char *name, size_t *p_length)
+{
+	const char *colon = memchr(name, ':', *p_length);
+	if(NULL == colon) return name;
+	*p_length -= (colon + 1 - name);
+	return colon + 1;
+}
+
+#define NAME_EQUALS(name, cb_name, literal) \
+	((cb_name) == (sizeof(literal) - 1) && memcmp(name, literal, sizeof(literal) - 1) == 0)
+
+static void append_buffer(char **p_buf, size_t *p_size, size_t *p_max_size, const char *data, size_t length)
+{
+	if((*p_size + length) > *p_max_size) {
+		size_t new_size = *p_max_size * 2;
+		if(new_size < 65536) new_size = 65536;
+		while(new_size < (*p_size + length)) new_size *= 2;
+		
+		char *buf = realloc(*p_buf, new_size);
+		assert(buf);
+		*p_buf = buf;
+		*p_max_size = new_size;
+	}
+	if(length > 0) memmove(*p_buf + *p_size, data, length);
+	*p_size += length;
+}
+
+struct ooxml_sheet_scanner *ooxml_sheet_scanner_new(const struct ooxml_sheet_scanner_handler *handler)
+{
+	assert(handler && handler->on_start_element && handler->on_end_element && handler->on_characters);
+	const struct scan_ops *ops = get_scan_ops();
+	if(NULL == ops) return NULL;
+	
+	struct ooxml_sheet_scanner *scanner = calloc(1, sizeof(*scanner));
+	assert(scanner);
+	scanner->handler = *handler;
+	scanner->ops = ops;
+	scanner->at_start = 1;
+	return scanner;
+}
+
+void ooxml_sheet_scanner_free(struct ooxml_sheet_scanner *scanner)
+{
+	if(NULL == scanner) return;
+	free(scanner->head);
+	free(scanner->pending);
+	free(scanner);
+}
+
+static int encode_utf8(uint32_t code, char *out)
+{
+	if(code == 0 || (code >= 0xD800 && code <= 0xDFFF) || code > 0x10FFFF) return -1;
+	if(code < 0x80) {
+		out[0] = (char)code;
+		return 1;
+	}
+	if(code < 0x800) {
+		out[0] = (char)(0xC0 | (code >> 6));
+		out[1] = (char)(0x80 | (code & 0x3F));
+		return 2;
+	}
+	if(code < 0x10000) {
+		out[0] = (char)(0xE0 | (code >> 12));
+		out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+		out[2] = (char)(0x80 | (code & 0x3F));
+		return 3;
+	}
+	out[0] = (char)(0xF0 | (code >> 18));
+	out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+	out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+	out[3] = (char)(0x80 | (code & 0x3F));
+	return 4;
+}
+
+// p points to '&', returns the length of the decoded text in out or -1
+static int decode_entity(const char *p, const char *end, char out[4], const char **p_next)
+{
+	const char *semicolon = memchr(p, ';', ((end - p) > 12)?12:(end - p));
+	if(NULL == semicolon) return -1;
+	*p_next = semicolon + 1;
+	
+	const char *name = p + 1;
+	size_t cb_name = semicolon - name;
+	if(cb_name >= 2 && name[0] == '#') {
+		uint32_t code = 0;
+		int hex = (name[1] == 'x');
+		const char *digits = name + 1 + hex;
+		if(digits == semicolon) return -1;
+		for(const char *d = digits; d < semicolon; ++d) {
+			int value;
+			if(*d >= '0' && *d <= '9') value = *d - '0';
+			else if(hex && *d >= 'a' && *d <= 'f') value = *d - 'a' + 10;
+			else if(hex && *d >= 'A' && *d <= 'F') value = *d - 'A' + 10;
+			else return -1;
+			code = code * (hex?16:10) + value;
+			if(code > 0x10FFFF) return -1;
+		}
+		return encode_utf8(code, out);
+	}
+	
+	char c = 0;
+	if(NAME_EQUALS(name, cb_name, "lt")) c = '<';
+	else if(NAME_EQUALS(name, cb_name, "gt")) c = '>';
+	else if(NAME_EQUALS(name, cb_name, "amp")) c = '&';
+	else if(NAME_EQUALS(name, cb_name, "quot")) c = '"';
+	else if(NAME_EQUALS(name, cb_name, "apos")) c = '\'';
+	else return -1;
+	out[0] = c;
+	return 1;
+}
+
+// [p, end) contains no '<'
+static int scanner_emit_text(struct ooxml_sheet_scanner *scanner, const char *p, const char *end)
+{
+	const struct ooxml_sheet_scanner_handler *handler = &scanner->handler;
+	while(p < end) {
+		const char *special = scanner->ops->find_any(p, end, '&', '\r', '&');
+		if(NULL == special) special = end;
+		if(special > p) handler->on_characters(handler->user_data, p, special - p);
+		if(special == end) break;
+		
+		if(*special == '\r') {	// end-of-line normalization
+			handler->on_characters(handler->user_data, "\n", 1);
+			p = special + 1;
+			if(p < end && *p == '\n') ++p;
+			continue;
+		}
+		
+		char decoded[4];
+		int length = decode_entity(special, end, decoded, &p);
+		if(length <= 0) return token_unsupported;
+		handler->on_characters(handler->user_data, decoded, length);
+	}
+	return token_ok;
+}
+
+// p points to '<'
+static int scanner_parse_start_tag(struct ooxml_sheet_scanner *scanner, const char *p, const char *end, struct start_tag *tag)
+{
+	tag->qname = ++p;
+	p = scan_name(p, end);
+	if(p == end) return token_incomplete;
+	tag->cb_qname = p - tag->qname;
+	if(tag->cb_qname == 0 || tag->cb_qname > SHEET_SCANNER_MAX_NAME) return token_unsupported;
+	tag->cb_name = tag->cb_qname;
+	tag->name = local_name(tag->qname, &tag->cb_name);
+	tag->num_attrs = 0;
+	tag->is_empty = 0;
+	
+	while(1) {
+		p = skip_spaces(p, end);
+		if(p == end) return token_incomplete;
+		if(*p == '>') break;
+		if(*p == '/') {
+			if((p + 1) == end) return token_incomplete;
+			if(p[1] != '>') return token_unsupported;
+			tag->is_empty = 1;
+			++p;
+			break;
+		}
+		
+		const char *attr_name = p;
+		p = scan_name(p, end);
+		if(p == end) return token_incomplete;
+		size_t cb_attr_name = p - attr_name;
+		if(cb_attr_name == 0) return token_unsupported;
+		
+		p = skip_spaces(p, end);
+		if(p == end) return token_incomplete;
+		if(*p != '=') return token_unsupported;
+		p = skip_spaces(p + 1, end);
+		if(p == end) return token_incomplete;
+		char quote = *p++;
+		if(quote != '"' && quote != '\'') return token_unsupported;
+		
+		const char *value = p;
+		p = scanner->ops->find_any(p, end, quote, '<', '&');
+		if(NULL == p) return token_incomplete;
+		int has_entities = 0;
+		if(*p == '&') {
+			has_entities = 1;
+			p = scanner->ops->find_any(p, end, quote, '<', quote);
+			if(NULL == p) return token_incomplete;
+		}
+		if(*p == '<') return token_unsupported;
+		size_t cb_value = p++ - value;
+		
+		// namespace declarations are not attributes
+		if(cb_attr_name >= 5 && memcmp(attr_name, "xmlns", 5) == 0
+			&& (cb_attr_name == 5 || attr_name[5] == ':')) continue;
+		
+		attr_name = local_name(attr_name, &cb_attr_name);
+		if(cb_attr_name == 1) {	// r, s, t: the values are used as they are
+			if(has_entities) return token_unsupported;
+			for(size_t i = 0; i < cb_value; ++i) {
+				if((unsigned char)value[i] < 0x20) return token_unsupported;
+			}
+		}
+		
+		if(tag->num_attrs >= SHEET_SCANNER_MAX_ATTRS) return token_unsupported;
+		struct ooxml_xml_attr *attr = &scanner->attrs[tag->num_attrs++];
+		attr->name = attr_name;
+		attr->cb_name = cb_attr_name;
+		attr->value = value;
+		attr->cb_value = cb_value;
+	}
+	tag->end = p + 1;
+	return token_ok;
+}
+
+// p points to '<', *p_end is set to after '>'
+static int scanner_parse_end_tag(struct ooxml_sheet_scanner *scanner, const char *p, const char *end, const char **p_end)
+{
+	const char *qname = p + 2;
+	p = scan_name(qname, end);
+	p = skip_spaces(p, end);
+	if(p == end) return token_incomplete;
+	if(*p != '>') return token_unsupported;
+	*p_end = p + 1;
+	
+	// must match the start tag, libxml2 reports the error otherwise
+	size_t cb_qname = scan_name(qname, p) - qname;
+	if(scanner->depth <= 0) return token_unsupported;
+	const struct scanner_element *element = &scanner->stack[scanner->depth - 1];
+	if(element->cb_name != cb_qname || memcmp(element->name, qname, cb_qname) != 0) return token_unsupported;
+	return token_ok;
+}
+
+// skips a comment or a processing instruction, p points to '<'
+static int scanner_skip_markup(struct ooxml_sheet_scanner *scanner, const char *p, const char *end, const char **p_end)
+{
+	if((end - p) < 4) return token_incomplete;
+	
+	const char *body;
+	char terminator;
+	if(p[1] == '?') {
+		body = p + 2;
+		terminator = '?';
+	}else if(p[2] == '-' && p[3] == '-') {
+		body = p + 4;
+		terminator = '-';
+	}else {
+		return token_unsupported;	// cdata, doctype
+	}
+	
+	const char *q = body;
+	while(1) {
+		q = scanner->ops->find_any(q, end, '>', '>', '>');
+		if(NULL == q) return token_incomplete;
+		if(terminator == '?') {
+			if(q > body && q[-1] == '?') break;
+		}else if((q - body) >= 2 && q[-1] == '-' && q[-2] == '-') {
+			break;
+		}
+		++q;
+	}
+	*p_end = q + 1;
+	
+	// the xml declaration: only utf-8 is handled here
+	if(terminator == '?' && (q - body) > 4 && memcmp(body, "xml", 3) == 0 && is_space(body[3])) {
+		static const char encoding[] = "encoding";
+		const char *attr = body + 4;
+		while(attr < q && (attr = memchr(attr, 'e', q - attr)) != NULL) {
+			if((size_t)(q - attr) > sizeof(encoding) && memcmp(attr, encoding, sizeof(encoding) - 1) == 0) break;
+			++attr;
+		}
+		if(attr && attr < q) {
+			const char *value = skip_spaces(attr + sizeof(encoding) - 1, q);
+			if(value < q && *value == '=') value = skip_spaces(value + 1, q);
+			if(value >= q || (*value != '"' && *value != '\'')) return token_unsupported;
+			++value;
+			if((q - value) < 6 || strncasecmp(value, "utf-8", 5) != 0 || value[5] != value[-1]) return token_unsupported;
+		}
+	}
+	return token_ok;
+}
+
+static int scanner_push_element(struct ooxml_sheet_scanner *scanner, const struct start_tag *tag)
+{
+	if(scanner->depth >= SHEET_SCANNER_MAX_DEPTH) return token_unsupported;
+	struct scanner_element *element = &scanner->stack[scanner->depth++];
+	element->cb_name = (unsigned char)tag->cb_qname;
+	memcpy(element->name, tag->qname, tag->cb_qname);
+	return token_ok;
+}
+
+/*
+ * parse the tokens in [*p_cur, end) and set *p_cur to the first unparsed one.
+ * in_row: [*p_cur, end) is the body of a <row> including its end tag, nothing may be left.
+ */
+static enum ooxml_sheet_scanner_status scanner_parse(struct ooxml_sheet_scanner *scanner,
+	const char *begin, const char **p_cur, const char *end, int in_row)
+{
+	const struct ooxml_sheet_scanner_handler *handler = &scanner->handler;
+	const struct scan_ops *ops = scanner->ops;
+	const char *p = *p_cur;
+	int rc = token_ok;
+
+#define CHECK_TOKEN(rc) do { \
+			if((rc) == token_incomplete) return in_row?ooxml_sheet_scanner_fallback:ooxml_sheet_scanner_continue; \
+			if((rc) != token_ok) return ooxml_sheet_scanner_fallback; \
+		} while(0)
+	
+	while(p < end) {
+		if(*p != '<') {
+			const char *text_end = ops->find_any(p, end, '<', '<', '<');
+			if(NULL == text_end) CHECK_TOKEN(token_incomplete);
+			rc = scanner_emit_text(scanner, p, text_end);
+			CHECK_TOKEN(rc);
+			p = text_end;
+			if(!in_row) *p_cur = p;
+		}
+		if((end - p) < 2) CHECK_TOKEN(token_incomplete);
+		
+		const char *next = NULL;
+		if(p[1] == '/') {
+			rc = scanner_parse_end_tag(scanner, p, end, &next);
+			CHECK_TOKEN(rc);
+			
+			const struct scanner_element *element = &scanner->stack[--scanner->depth];
+			size_t cb_name = element->cb_name;
+			const char *name = local_name(element->name, &cb_name);
+			p = next;
+			if(!in_row) *p_cur = p;
+			if(handler->on_end_element(handler->user_data, name, cb_name)) return ooxml_sheet_scanner_stopped;
+			continue;
+		}
+		
+		if(p[1] == '?' || p[1] == '!') {
+			rc = scanner_skip_markup(scanner, p, end, &next);
+			CHECK_TOKEN(rc);
+			p = next;
+			if(!in_row) *p_cur = p;
+			continue;
+		}
+		
+		struct start_tag tag;
+		rc = scanner_parse_start_tag(scanner, p, end, &tag);
+		CHECK_TOKEN(rc);
+		
+		int is_row = scanner->in_sheet_data && NAME_EQUALS(tag.name, tag.cb_name, "row");
+		if(is_row && in_row) return ooxml_sheet_scanner_fallback;	// nested
+		
+		const char *row_end = NULL;
+		if(is_row && !tag.is_empty) {
+			// the whole row must be available: find its end tag first
+			if(tag.name != tag.qname) return ooxml_sheet_scanner_fallback;
+			const char *q = tag.end;
+			while(1) {
+				q = ops->find_row_end(q, end);
+				if(NULL == q) CHECK_TOKEN(token_incomplete);
+				const char *gt = skip_spaces(q + ROW_END_TAG_LENGTH, end);
+				if(gt == end) CHECK_TOKEN(token_incomplete);
+				if(*gt == '>' && (gt == (q + ROW_END_TAG_LENGTH) || is_space(q[ROW_END_TAG_LENGTH]))) {
+					row_end = gt + 1;
+					break;
+				}
+				++q;
+			}
+		}
+		
+		rc = scanner_push_element(scanner, &tag);
+		CHECK_TOKEN(rc);
+		handler->on_start_element(handler->user_data, tag.name, tag.cb_name, scanner->attrs, tag.num_attrs);
+		p = tag.end;
+		
+		if(!scanner->in_sheet_data && NAME_EQUALS(tag.name, tag.cb_name, "sheetData")) {
+			append_buffer(&scanner->head, &scanner->cb_head, &scanner->max_head, begin, p - begin);
+			scanner->in_sheet_data = 1;
+		}
+		
+		if(tag.is_empty) {
+			--scanner->depth;
+			if(!in_row) *p_cur = p;
+			if(handler->on_end_element(handler->user_data, tag.name, tag.cb_name)) return ooxml_sheet_scanner_stopped;
+			continue;
+		}
+		
+		if(row_end) {
+			int depth = scanner->depth;
+			enum ooxml_sheet_scanner_status status = scanner_parse(scanner, begin, &p, row_end, 1);
+			if(status != ooxml_sheet_scanner_continue) return status;
+			if(scanner->depth != (depth - 1)) return ooxml_sheet_scanner_fallback;
+			p = row_end;
+		}
+		if(!in_row) *p_cur = p;
+	}
+#undef CHECK_TOKEN
+	return ooxml_sheet_scanner_continue;
+}
+
+static const char *scanner_parse_bom(struct ooxml_sheet_scanner *scanner, const char *p, const char *end)
+{
+	if((end - p) < 4) return NULL;
+	scanner->at_start = 0;
+	
+	const unsigned char *bytes = (const unsigned char *)p;
+	if(bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) return p + 3;
+	if(bytes[0] == '<' && bytes[1] != 0) return p;
+	
+	scanner->status = ooxml_sheet_scanner_fallback;	// utf-16, utf-32, ...
+	return p;
+}
+
+enum ooxml_sheet_scanner_status ooxml_sheet_scanner_push(struct ooxml_sheet_scanner *scanner, const void *data, size_t length)
+{
+	assert(scanner);
+	if(scanner->status != ooxml_sheet_scanner_continue) return scanner->status;
+	
+	const char *begin = data;
+	const char *end = begin + length;
+	if(scanner->cb_pending > 0) {
+		append_buffer(&scanner->pending, &scanner->cb_pending, &scanner->max_pending, data, length);
+		begin = scanner->pending;
+		end = begin + scanner->cb_pending;
+	}
+	
+	const char *p = begin;
+	if(scanner->at_start) {
+		p = scanner_parse_bom(scanner, begin, end);
+		if(NULL == p) p = begin;
+	}
+	if(!scanner->at_start && scanner->status == ooxml_sheet_scanner_continue) {
+		scanner->status = scanner_parse(scanner, begin, &p, end, 0);
+	}
+	
+	// everything parsed before <sheetData> belongs to the head
+	if(!scanner->in_sheet_data) {
+		append_buffer(&scanner->head, &scanner->cb_head, &scanner->max_head, begin, p - begin);
+	}
+	
+	if(scanner->status == ooxml_sheet_scanner_continue || scanner->status == ooxml_sheet_scanner_fallback) {
+		// keep the unparsed data
+		if(begin == scanner->pending) {
+			scanner->cb_pending = 0;
+		}
+		append_buffer(&scanner->pending, &scanner->cb_pending, &scanner->max_pending, p, end - p);
+	}else {
+		scanner->cb_pending = 0;
+	}
+	return scanner->status;
+}
+
+enum ooxml_sheet_scanner_status ooxml_sheet_scanner_finish(struct ooxml_sheet_scanner *scanner)
+{
+	assert(scanner);
+	if(scanner->status == ooxml_sheet_scanner_continue) scanner->status = ooxml_sheet_scanner_fallback;
+	return scanner->status;
+}
+
+const char *ooxml_sheet_scanner_get_head(const struct ooxml_sheet_scanner *scanner, size_t *p_length)
+{
+	assert(scanner && p_length);
+	*p_length = scanner->cb_head;
+	return scanner->head;
+}
+
+const char *ooxml_sheet_scanner_get_pending(const struct ooxml_sheet_scanner *scanner, size_t *p_length)
+{
+	assert(scanner && p_length);
+	*p_length = scanner->cb_pending;
+	return scanner->pending;
+}
+
+
+#if defined(TEST_OOXML_SHEET_SCANNER_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
@@ -0,0 +1,67 @@
+#ifndef OOXML_SHEET_SCANNER_H_
+#define OOXML_SHEET_SCANNER_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "ooxml_spreadsheet.h"
+
+/*
+ * fast tokenizer for worksheet parts, used by the row reader instead of libxml2.
+ * it only understands the shape excel and most writers produce: utf-8, elements, attributes,
+ * text with the predefined and numeric entities, comments and processing instructions.
+ * anything else (a doctype, cdata, prefixed <row> elements, entities in r/s/t, ...)
+ * makes push() return ooxml_sheet_scanner_fallback, the caller then continues with libxml2
+ * from get_head() + get_pending(), which never contain a partly reported row.
+ *
+ * the data is searched for tag boundaries (the next '<', the end of the current <row>, the end of an
+ * attribute value) with sse4.2 or avx2 if the cpu supports it.
+ * well-formedness is only checked as far as the rows need it (tags are matched, utf-8 is not validated).
+ */
+struct ooxml_sheet_scanner;
+
+struct ooxml_xml_attr
+{
+	const char *name;	// local name
+	size_t cb_name;
+	const char *value;	// raw, only decoded if it contains no entities
+	size_t cb_value;
+};
+
+// same events as the SAX2 callbacks of the row reader, names are local names and not nul-terminated
+struct ooxml_sheet_scanner_handler
+{
+	void *user_data;
+	void (*on_start_element)(void *user_data, const char *name, size_t cb_name, const struct ooxml_xml_attr *attrs, int num_attrs);
+	int (*on_end_element)(void *user_data, const char *name, size_t cb_name);	// returns non-zero to stop
+	void (*on_characters)(void *user_data, const char *text, size_t length);
+};
+
+enum ooxml_sheet_scanner_status
+{
+	ooxml_sheet_scanner_error = -1,
+	ooxml_sheet_scanner_continue = 0,
+	ooxml_sheet_scanner_stopped = 1,
+	ooxml_sheet_scanner_fallback = 2,
+};
+
+// NULL if the fast path is disabled (ooxml_spreadsheet_set_row_scanner())
+struct ooxml_sheet_scanner *ooxml_sheet_scanner_new(const struct ooxml_sheet_scanner_handler *handler);
+void ooxml_sheet_scanner_free(struct ooxml_sheet_scanner *scanner);
+
+enum ooxml_sheet_scanner_status ooxml_sheet_scanner_push(struct ooxml_sheet_scanner *scanner, const void *data, size_t length);
+
+// end of the data: returns stopped, or fallback to let libxml2 handle (and report) the rest of the document
+enum ooxml_sheet_scanner_status ooxml_sheet_scanner_finish(struct ooxml_sheet_scanner *scanner);
+
+// valid after fallback: the document up to and including the <sheetData> start tag, and the unparsed data after it
+const char *ooxml_sheet_scanner_get_head(const struct ooxml_sheet_scanner *scanner, size_t *p_length);
+const char *ooxml_sheet_scanner_get_pending(const struct ooxml_sheet_scanner *scanner, size_t *p_length);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,687 @@
+/*
+ * ooxml_spreadsheet.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <libxml/parser.h>
+#include <libxml/parserInternals.h>
+
+#include "app.h"
+#include "ooxml_context.h"
+#include "ooxml_spreadsheet.h"
+#include "ooxml_sheet_scanner.h"
+#include "ooxml_cell_decode.h"
+#include "perf_trace.h"
+
+/******************************************************************************
+ * row reader
+******************************************************************************/
+enum row_reader_text_target
+{
+	row_reader_text_none,
+	row_reader_text_value,	// <c><v>
+	row_reader_text_inline,	// <c><is><t>, <c><is><r><t>
+};
+
+struct cell_offsets
+{
+	ssize_t ref;
+	ssize_t value;
+};
+
+struct row_reader
+{
+	ooxml_row_callback on_row;
+	void *user_data;
+	
+	int in_sheet_data;
+	int in_row;
+	int in_cell;
+	int in_inline_string;
+	int in_phonetic;	// <rPh>, not part of the cell text
+	enum row_reader_text_target text_target;
+	
+	struct ooxml_row row;
+	int64_t last_row_index;	// of the last reported row
+	ssize_t max_cells;
+	struct cell_offsets *offsets;
+	
+	// all strings of the current row
+	char *text;
+	size_t cb_text;
+	size_t max_text;
+};
+
+static void row_reader_cleanup(struct row_reader *reader)
+{
+	free(reader->row.cells);
+	free(reader->offsets);
+	free(reader->text);
+	memset(reader, 0, sizeof(*reader));
+}
+
+static ssize_t row_reader_append_text(struct row_reader *reader, const char *text, size_t length)
+{
+	if((reader->cb_text + length + 1) > reader->max_text) {
+		size_t new_size = reader->max_text * 2;
+		if(new_size < 4096) new_size = 4096;
+		while(new_size < (reader->cb_text + length + 1)) new_size *= 2;
+		
+		char *buf = realloc(reader->text, new_size);
+		assert(buf);
+		reader->text = buf;
+		reader->max_text = new_size;
+	}
+	
+	ssize_t offset = reader->cb_text;
+	if(length > 0) memcpy(reader->text + offset, text, length);
+	reader->cb_text += length;
+	reader->text[reader->cb_text] = '\0';
+	return offset;
+}
+
+static struct ooxml_cell *row_reader_add_cell(struct row_reader *reader)
+{
+	if(reader->row.num_cells >= reader->max_cells) {
+		ssize_t new_size = reader->max_cells * 2;
+		if(new_size < 64) new_size = 64;
+		
+		struct ooxml_cell *cells = realloc(reader->row.cells, new_size * sizeof(*cells));
+		assert(cells);
+		struct cell_offsets *offsets = realloc(reader->offsets, new_size * sizeof(*offsets));
+		assert(offsets);
+		
+		reader->row.cells = cells;
+		reader->offsets = offsets;
+		reader->max_cells = new_size;
+	}
+	
+	ssize_t index = reader->row.num_cells++;
+	struct ooxml_cell *cell = &reader->row.cells[index];
+	memset(cell, 0, sizeof(*cell));
+	reader->offsets[index].ref = -1;
+	reader->offsets[index].value = -1;
+	
+	cell->col = (index > 0)?(reader->row.cells[index - 1].col + 1):0;
+	return cell;
+}
+
+int64_t ooxml_cell_ref_to_col(const char *ref, int64_t *p_row)
+{
+	if(NULL == ref) return -1;
+	
+	int64_t col = 0;
+	const char *p = ref;
+	while(*p >= 'A' && *p <= 'Z') {
+		col = col * 26 + (*p - 'A' + 1);
+		++p;
+	}
+	if(p == ref) return -1;
+	
+	if(p_row) {
+		int64_t row = 0;
+		while(*p >= '0' && *p <= '9') row = row * 10 + (*p++ - '0');
+		*p_row = row;
+	}
+	return col - 1;
+}
+
+static enum ooxml_cell_type parse_cell_type(const char *t, size_t length)
+{
+	if(length == 1) {
+		switch(t[0]) {
+		case 's': return ooxml_cell_type_shared_string;
+		case 'b': return ooxml_cell_type_boolean;
+		case 'e': return ooxml_cell_type_error;
+		case 'd': return ooxml_cell_type_date;
+		default: break;
+		}
+	}else if(length == 3 && memcmp(t, "str", 3) == 0) {
+		return ooxml_cell_type_string;
+	}else if(length == 9 && memcmp(t, "inlineStr", 9) == 0) {
+		return ooxml_cell_type_inline_string;
+	}
+	return ooxml_cell_type_number;
+}
+
+static int64_t parse_int64(const char *value, size_t length)
+{
+	int64_t n = 0;
+	for(size_t i = 0; i < length && value[i] >= '0' && value[i] <= '9'; ++i) {
+		n = n * 10 + (value[i] - '0');
+	}
+	return n;
+}
+
+#define NAME_EQUALS(name, cb_name, literal) \
+	((cb_name) == (sizeof(literal) - 1) && memcmp(name, literal, sizeof(literal) - 1) == 0)
+
+/*
+ * the element handlers, shared by the SAX2 callbacks and the fast scanner (ooxml_sheet_scanner.h)
+ */
+static void row_reader_start_element(void *user_data, const char *name, size_t cb_name,
+	const struct ooxml_xml_attr *attrs, int num_attrs)
+{
+	struct row_reader *reader = user_data;
+	
+	if(!reader->in_sheet_data) {
+		if(NAME_EQUALS(name, cb_name, "sheetData")) reader->in_sheet_data = 1;
+		return;
+	}
+	
+	if(reader->in_cell) {
+		if(NAME_EQUALS(name, cb_name, "v")) {
+			reader->text_target = row_reader_text_value;
+		}else if(NAME_EQUALS(name, cb_name, "is")) {
+			reader->in_inline_string = 1;
+		}else if(reader->in_inline_string) {
+			if(NAME_EQUALS(name, cb_name, "rPh")) reader->in_phonetic = 1;
+			else if(NAME_EQUALS(name, cb_name, "t") && !reader->in_phonetic) reader->text_target = row_reader_text_inline;
+		}
+		return;
+	}
+	
+	if(NAME_EQUALS(name, cb_name, "row")) {
+		reader->in_row = 1;
+		reader->row.num_cells = 0;
+		reader->cb_text = 0;
+		
+		int64_t row_index = reader->row.row_index + 1;
+		for(int i = 0; i < num_attrs; ++i) {
+			if(NAME_EQUALS(attrs[i].name, attrs[i].cb_name, "r")) {
+				row_index = parse_int64(attrs[i].value, attrs[i].cb_value);
+			}
+		}
+		reader->row.row_index = row_index;
+		return;
+	}
+	
+	if(reader->in_row && NAME_EQUALS(name, cb_name, "c")) {
+		reader->in_cell = 1;
+		struct ooxml_cell *cell = row_reader_add_cell(reader);
+		ssize_t index = reader->row.num_cells - 1;
+		
+		for(int i = 0; i < num_attrs; ++i) {
+			const char *value = attrs[i].value;
+			size_t length = attrs[i].cb_value;
+			
+			if(attrs[i].cb_name != 1) continue;
+			switch(attrs[i].name[0]) {
+			case 'r':
+				reader->offsets[index].ref = row_reader_append_text(reader, value, length);
+				row_reader_append_text(reader, "", 1);	// keep the terminating '\0'
+				cell = &reader->row.cells[index];
+				cell->col = ooxml_cell_ref_to_col(reader->text + reader->offsets[index].ref, NULL);
+				break;
+			case 't': cell->type = parse_cell_type(value, length); break;
+			case 's': cell->style = (int)parse_int64(value, length); break;
+			default: break;
+			}
+		}
+	}
+}
+
+// returns non-zero to stop the parser
+static int row_reader_end_element(void *user_data, const char *name, size_t cb_name)
+{
+	struct row_reader *reader = user_data;
+	
+	if(!reader->in_sheet_data) return 0;
+	
+	if(reader->in_cell) {
+		if(NAME_EQUALS(name, cb_name, "c")) {
+			ssize_t index = reader->row.num_cells - 1;
+			if(reader->offsets[index].value >= 0) {
+				reader->row.cells[index].cb_value = reader->cb_text - reader->offsets[index].value;
+				row_reader_append_text(reader, "", 1);
+			}
+			reader->in_cell = 0;
+			reader->in_inline_string = 0;
+			reader->in_phonetic = 0;
+			reader->text_target = row_reader_text_none;
+		}else if(NAME_EQUALS(name, cb_name, "rPh")) {
+			reader->in_phonetic = 0;
+		}else if(NAME_EQUALS(name, cb_name, "is")) {
+			reader->in_inline_string = 0;
+		}else {
+			reader->text_target = row_reader_text_none;
+		}
+		return 0;
+	}
+	
+	if(reader->in_row && NAME_EQUALS(name, cb_name, "row")) {
+		reader->in_row = 0;
+		
+		// resolve string offsets (the text buffer may have been reallocated)
+		for(ssize_t i = 0; i < reader->row.num_cells; ++i) {
+			struct ooxml_cell *cell = &reader->row.cells[i];
+			struct cell_offsets *offsets = &reader->offsets[i];
+			cell->ref = (offsets->ref >= 0)?(reader->text + offsets->ref):NULL;
+			cell->value = (offsets->value >= 0)?(reader->text + offsets->value):NULL;
+		}
+		
+		PERF_TRACE_COUNT(rows_streamed, 1);
+		reader->last_row_index = reader->row.row_index;
+		return reader->on_row(reader->user_data, &reader->row);
+	}
+	
+	if(NAME_EQUALS(name, cb_name, "sheetData")) {
+		reader->in_sheet_data = 0;
+		return 1;	// skip the rest of the worksheet
+	}
+	return 0;
+}
+
+static void row_reader_characters(void *user_data, const char *text, size_t length)
+{
+	struct row_reader *reader = user_data;
+	if(reader->text_target == row_reader_text_none) return;
+	
+	ssize_t index = reader->row.num_cells - 1;
+	assert(index >= 0);
+	ssize_t offset = row_reader_append_text(reader, text, length);
+	if(reader->offsets[index].value < 0) reader->offsets[index].value = offset;
+}
+
+/*
+ * forget a partly reported row, the parser that takes over restarts from the document head
+ * and numbers the rows from the last complete one.
+ */
+static void row_reader_rewind(struct row_reader *reader)
+{
+	reader->in_sheet_data = 0;
+	reader->in_row = 0;
+	reader->in_cell = 0;
+	reader->in_inline_string = 0;
+	reader->in_phonetic = 0;
+	reader->text_target = row_reader_text_none;
+	reader->row.row_index = reader->last_row_index;
+	reader->row.num_cells = 0;
+	reader->cb_text = 0;
+}
+
+static void on_start_element(void *ctx,
+	const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI,
+	int nb_namespaces, const xmlChar **namespaces,
+	int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+	xmlParserCtxtPtr parser = ctx;
+	
+	struct ooxml_xml_attr local_attrs[32];
+	struct ooxml_xml_attr *attrs = local_attrs;
+	if(nb_attributes > 32) {
+		attrs = calloc(nb_attributes, sizeof(*attrs));
+		assert(attrs);
+	}
+	for(int i = 0; i < nb_attributes; ++i) {
+		const xmlChar **attr = &attributes[i * 5];
+		attrs[i].name = (const char *)attr[0];
+		attrs[i].cb_name = strlen((const char *)attr[0]);
+		attrs[i].value = (const char *)attr[3];
+		attrs[i].cb_value = attr[4] - attr[3];
+	}
+	
+	row_reader_start_element(parser->_private, (const char *)localname, strlen((const char *)localname),
+		attrs, nb_attributes);
+	if(attrs != local_attrs) free(attrs);
+}
+
+static void on_end_element(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI)
+{
+	xmlParserCtxtPtr parser = ctx;
+	int rc = row_reader_end_element(parser->_private, (const char *)localname, strlen((const char *)localname));
+	if(rc) xmlStopParser(parser);
+}
+
+static void on_characters(void *ctx, const xmlChar *text, int length)
+{
+	xmlParserCtxtPtr parser = ctx;
+	row_reader_characters(parser->_private, (const char *)text, length);
+}
+
+static void row_reader_init_sax(xmlSAXHandler *sax)
+{
+	memset(sax, 0, sizeof(*sax));
+	sax->initialized = XML_SAX2_MAGIC;
+	sax->startElementNs = on_start_element;
+	sax->endElementNs = on_end_element;
+	sax->characters = on_characters;
+}
+
+/******************************************************************************
+ * row stream (push parser)
+******************************************************************************/
+struct ooxml_row_stream
+{
+	struct ooxml_sheet_scanner *scanner;	// NULL once the data is handed over to libxml2
+	
+	xmlSAXHandler sax;
+	xmlParserCtxtPtr parser;
+	struct row_reader reader;
+	char *name;
+	int stopped;
+};
+
+static int row_stream_create_parser(struct ooxml_row_stream *stream)
+{
+	row_reader_init_sax(&stream->sax);
+	stream->parser = xmlCreatePushParserCtxt(&stream->sax, NULL, NULL, 0, stream->name);
+	if(NULL == stream->parser) {
+		fprintf(stderr, "xmlCreatePushParserCtxt() failed\n");
+		return -1;
+	}
+	stream->parser->_private = &stream->reader;
+	return 0;
+}
+
+struct ooxml_row_stream *ooxml_row_stream_new(ooxml_row_callback on_row, void *user_data, int64_t prev_row_index, const char *name)
+{
+	assert(on_row);
+	struct ooxml_row_stream *stream = calloc(1, sizeof(*stream));
+	assert(stream);
+	
+	stream->reader.on_row = on_row;
+	stream->reader.user_data = user_data;
+	stream->reader.row.row_index = prev_row_index;
+	stream->reader.last_row_index = prev_row_index;
+	if(name) stream->name = strdup(name);
+	
+	struct ooxml_sheet_scanner_handler handler = {
+		.user_data = &stream->reader,
+		.on_start_element = row_reader_start_element,
+		.on_end_element = row_reader_end_element,
+		.on_characters = row_reader_characters,
+	};
+	stream->scanner = ooxml_sheet_scanner_new(&handler);
+	if(NULL == stream->scanner && row_stream_create_parser(stream) != 0) {
+		ooxml_row_stream_free(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+void ooxml_row_stream_free(struct ooxml_row_stream *stream)
+{
+	if(NULL == stream) return;
+	ooxml_sheet_scanner_free(stream->scanner);
+	if(stream->parser) {
+		if(stream->parser->myDoc) xmlFreeDoc(stream->parser->myDoc);
+		xmlFreeParserCtxt(stream->parser);
+	}
+	row_reader_cleanup(&stream->reader);
+	free(stream->name);
+	free(stream);
+}
+
+static int row_stream_parse_chunk(struct ooxml_row_stream *stream, const char *data, size_t length, int terminate)
+{
+	do {
+		int cb = (length > 0x40000000)?0x40000000:(int)length;
+		xmlParserErrors err_code = xmlParseChunk(stream->parser, data, cb, terminate && ((size_t)cb == length));
+		if(err_code == XML_ERR_USER_STOP) {
+			stream->stopped = 1;
+			return 1;
+		}
+		if(err_code != XML_ERR_OK) {
+			fprintf(stderr, "xmlParseChunk() failed.\n");
+			return -1;
+		}
+		data += cb;
+		length -= cb;
+	}while(length > 0);
+	return 0;
+}
+
+/*
+ * continue with libxml2 from the head of the document and the first row the scanner has not reported
+ */
+static int row_stream_fallback(struct ooxml_row_stream *stream, int terminate)
+{
+	debug_printf("%s: continue with libxml2", stream->name?stream->name:"");
+	PERF_TRACE_COUNT(scanner_fallbacks, 1);
+	
+	row_reader_rewind(&stream->reader);
+	if(row_stream_create_parser(stream) != 0) return -1;
+	
+	size_t cb_head = 0, cb_pending = 0;
+	const char *head = ooxml_sheet_scanner_get_head(stream->scanner, &cb_head);
+	const char *pending = ooxml_sheet_scanner_get_pending(stream->scanner, &cb_pending);
+	
+	int rc = 0;
+	if(cb_head > 0) rc = row_stream_parse_chunk(stream, head, cb_head, 0);
+	if(0 == rc) rc = row_stream_parse_chunk(stream, pending, cb_pending, terminate);
+	
+	ooxml_sheet_scanner_free(stream->scanner);
+	stream->scanner = NULL;
+	return rc;
+}
+
+int ooxml_row_stream_push(struct ooxml_row_stream *stream, const void *data, size_t length)
+{
+	assert(stream);
+	if(stream->stopped) return 1;
+	
+	if(stream->scanner) {
+		enum ooxml_sheet_scanner_status status = ooxml_sheet_scanner_push(stream->scanner, data, length);
+		switch(status) {
+		case ooxml_sheet_scanner_continue: return 0;
+		case ooxml_sheet_scanner_stopped:
+			stream->stopped = 1;
+			return 1;
+		case ooxml_sheet_scanner_fallback: return row_stream_fallback(stream, 0);
+		default: return -1;
+		}
+	}
+	return row_stream_parse_chunk(stream, data, length, 0);
+}
+
+// end of the data, returns -1 if the document is not well-formed
+static int row_stream_finish(struct ooxml_row_stream *stream)
+{
+	if(stream->stopped) return 1;
+	if(stream->scanner) {
+		enum ooxml_sheet_scanner_status status = ooxml_sheet_scanner_finish(stream->scanner);
+		if(status == ooxml_sheet_scanner_stopped) return 1;
+		if(status != ooxml_sheet_scanner_fallback) return -1;
+		int rc = row_stream_fallback(stream, 1);
+		if(rc) return rc;
+	}else {
+		int rc = row_stream_parse_chunk(stream, "", 0, 1);
+		if(rc) return rc;
+	}
+	return stream->parser->wellFormed?0:-1;
+}
+
+int ooxml_spreadsheet_stream_rows(zip_t *zip, const char *sheet_name, ooxml_row_callback on_row, void *user_data)
+{
+	assert(zip && sheet_name && on_row);
+	
+	zip_file_t *zfp = zip_fopen(zip, sheet_name, ZIP_FL_UNCHANGED);
+	if(!zfp) {
+		fprintf(stderr, "zip_fopen(%s) failed: \n%s\n", 
+			sheet_name, 
+			zip_strerror(zip));
+		return -1;
+	}
+	
+	struct ooxml_row_stream *stream = ooxml_row_stream_new(on_row, user_data, 0, sheet_name);
+	if(NULL == stream) {
+		zip_fclose(zfp);
+		return -1;
+	}
+	
+	PERF_TRACE_BEGIN(span);
+	
+	char buffer[65536];
+	zip_int64_t cb_data = 0;
+	int rc = 0;
+	while(0 == rc && (cb_data = zip_fread(zfp, buffer, sizeof(buffer))) > 0) {
+		rc = ooxml_row_stream_push(stream, buffer, cb_data);
+	}
+	if(cb_data < 0) rc = -1;
+	if(0 == rc) rc = row_stream_finish(stream);
+	zip_fclose(zfp);
+	
+	PERF_TRACE_END(span, "stream_rows", sheet_name);
+	
+	ooxml_row_stream_free(stream);
+	return (rc < 0)?-1:0;
+}
+
+
+// "A1:J50001" or "B7"
+static int parse_cell_range(const char *ref, size_t length, struct ooxml_cell_range *range)
+{
+	const char *colon = memchr(ref, ':', length);
+	size_t cb_first = colon?(size_t)(colon - ref):length;
+	if(ooxml_decode_cell_ref(ref, cb_first, &range->first_row, &range->first_col) != ooxml_decode_ok) return -1;
+	if(NULL == colon) {
+		range->last_row = range->first_row;
+		range->last_col = range->first_col;
+		return 0;
+	}
+	if(ooxml_decode_cell_ref(colon + 1, length - cb_first - 1, &range->last_row, &range->last_col) != ooxml_decode_ok) return -1;
+	if(range->last_row < range->first_row || range->last_col < range->first_col) return -1;
+	return 0;
+}
+
+// head: nul-terminated
+// the value of attribute in the first <tag ...> (any prefix) of head
+static const char *find_tag_attribute(const char *head, size_t length, const char *tag, const char *attribute, size_t *p_length)
+{
+	size_t cb_tag = strlen(tag);
+	size_t cb_attribute = strlen(attribute);
+	const char *p = head;
+	const char *end = head + length;
+	while(p < end && (p = strstr(p, tag))) {
+		const char *name_end = p + cb_tag;
+		int is_tag = (p > head) && (p[-1] == '<' || p[-1] == ':')
+			&& name_end < end && (*name_end == ' ' || *name_end == '\t' || *name_end == '\r' || *name_end == '\n');
+		p = name_end;
+		if(!is_tag) continue;
+		
+		const char *tag_end = memchr(p, '>', end - p);
+		if(NULL == tag_end) return NULL;
+		for(const char *attr = p; attr && attr < tag_end; ++attr) {
+			attr = strstr(attr, attribute);
+			if(NULL == attr || attr >= tag_end) break;
+			if(attr[-1] != ' ' && attr[-1] != '\t' && attr[-1] != '\r' && attr[-1] != '\n') continue;
+			if(attr[cb_attribute] != '=') continue;
+			char quote = attr[cb_attribute + 1];
+			if(quote != '"' && quote != '\'') return NULL;
+			const char *value = attr + cb_attribute + 2;
+			const char *value_end = memchr(value, quote, tag_end - value);
+			if(NULL == value_end) return NULL;
+			*p_length = value_end - value;
+			return value;
+		}
+		return NULL;
+	}
+	return NULL;
+}
+
+/*
+ * copy the value of attribute in <tag> at the head of a part, only the head is inflated:
+ * the search stops once stop_tag is seen (e.g. <sheetData>, which follows the tags of interest).
+ * returns 0, or -1 if the part has no such attribute
+ */
+static int read_head_attribute(zip_t *zip, const char *part_name, const char *tag, const char *attribute,
+	const char *stop_tag, char *value, size_t size)
+{
+	zip_file_t *zfp = zip_fopen(zip, part_name, ZIP_FL_UNCHANGED);
+	if(!zfp) {
+		fprintf(stderr, "zip_fopen(%s) failed: \n%s\n", 
+			part_name, 
+			zip_strerror(zip));
+		return -1;
+	}
+	
+	static const size_t max_head_size = 1024 * 1024;
+	char *head = NULL;
+	size_t cb_head = 0;
+	size_t max_size = 0;
+	zip_int64_t cb_data = 0;
+	int rc = -1;
+	while(cb_head < max_head_size) {
+		if(cb_head + 65536 + 1 > max_size) {
+			max_size = cb_head + 65536 + 1;
+			head = realloc(head, max_size);
+			assert(head);
+		}
+		cb_data = zip_fread(zfp, head + cb_head, 65536);
+		if(cb_data <= 0) break;
+		cb_head += cb_data;
+		head[cb_head] = '\0';
+		
+		size_t cb_value = 0;
+		const char *found = find_tag_attribute(head, cb_head, tag, attribute, &cb_value);
+		if(found) {
+			if(cb_value < size) {
+				memcpy(value, found, cb_value);
+				value[cb_value] = '\0';
+				rc = 0;
+			}
+			break;
+		}
+		if(strstr(head, stop_tag)) break;
+	}
+	zip_fclose(zfp);
+	free(head);
+	return rc;
+}
+
+int ooxml_spreadsheet_get_dimension(zip_t *zip, const char *sheet_name, struct ooxml_cell_range *range)
+{
+	assert(zip && sheet_name && range);
+	
+	// <dimension> precedes <sheetData>
+	char ref[64] = "";
+	if(read_head_attribute(zip, sheet_name, "dimension", "ref", "sheetData", ref, sizeof(ref))) return -1;
+	return parse_cell_range(ref, strlen(ref), range);
+}
+
+int ooxml_spreadsheet_is_date1904(zip_t *zip, const char *workbook_name)
+{
+	assert(zip);
+	if(NULL == workbook_name) workbook_name = "xl/workbook.xml";
+	if(zip_name_locate(zip, workbook_name, 0) < 0) return 0;
+	
+	// <workbookPr> precedes <sheets>
+	char value[16] = "";
+	if(read_head_attribute(zip, workbook_name, "workbookPr", "date1904", "sheets>", value, sizeof(value))) return 0;
+	return strcmp(value, "1") == 0 || strcmp(value, "true") == 0;
+}
+
+#if defined(TEST_OOXML_SPREADSHEET_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
@@ -0,0 +1,113 @@
+/*
+ * ooxml_string_pool.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ooxml_string_pool.h"
+
+static uint64_t hash_string(const char *text, size_t length)
+{
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(size_t i = 0; i < length; ++i) {
+		hash ^= (unsigned char)text[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+void ooxml_string_pool_cleanup(struct ooxml_string_pool *pool)
+{
+	free(pool->arena);
+	free(pool->offsets);
+	free(pool->slots);
+	memset(pool, 0, sizeof(*pool));
+}
+
+static void string_pool_rehash(struct ooxml_string_pool *pool, uint32_t num_slots)
+{
+	free(pool->slots);
+	pool->slots = calloc(num_slots, sizeof(*pool->slots));
+	assert(pool->slots);
+	pool->num_slots = num_slots;
+	
+	for(uint32_t i = 0; i < pool->count; ++i) {
+		const char *text = pool->arena + pool->offsets[i];
+		size_t length = pool->offsets[i + 1] - pool->offsets[i] - 1;
+		uint32_t slot = (uint32_t)hash_string(text, length) & (num_slots - 1);
+		while(pool->slots[slot]) slot = (slot + 1) & (num_slots - 1);
+		pool->slots[slot] = i + 1;
+	}
+}
+
+uint32_t ooxml_string_pool_intern(struct ooxml_string_pool *pool, const char *text, size_t length)
+{
+	if(pool->count * 2 >= pool->num_slots) string_pool_rehash(pool, pool->num_slots?(pool->num_slots * 2):1024);
+	
+	uint32_t mask = pool->num_slots - 1;
+	uint32_t slot = (uint32_t)hash_string(text, length) & mask;
+	for(; pool->slots[slot]; slot = (slot + 1) & mask) {
+		uint32_t index = pool->slots[slot] - 1;
+		size_t cb_item = pool->offsets[index + 1] - pool->offsets[index] - 1;
+		if(cb_item == length && memcmp(pool->arena + pool->offsets[index], text, length) == 0) return index;
+	}
+	
+	if(pool->cb_arena + length + 1 > pool->max_arena) {
+		size_t new_size = pool->max_arena?(pool->max_arena * 2):65536;
+		while(new_size < pool->cb_arena + length + 1) new_size *= 2;
+		pool->arena = realloc(pool->arena, new_size);
+		assert(pool->arena);
+		pool->max_arena = new_size;
+	}
+	if(pool->count + 2 > pool->max_count) {
+		uint32_t new_size = pool->max_count?(pool->max_count * 2):1024;
+		pool->offsets = realloc(pool->offsets, new_size * sizeof(*pool->offsets));
+		assert(pool->offsets);
+		pool->max_count = new_size;
+	}
+	
+	uint32_t index = pool->count++;
+	pool->offsets[index] = pool->cb_arena;
+	memcpy(pool->arena + pool->cb_arena, text, length);
+	pool->cb_arena += length;
+	pool->arena[pool->cb_arena++] = '\0';
+	pool->offsets[index + 1] = pool->cb_arena;
+	pool->slots[slot] = index + 1;
+	return index;
+}
+
+
+
+#if defined(TEST_OOXML_STRING_POOL_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
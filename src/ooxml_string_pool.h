@@ -0,0 +1,45 @@
+#ifndef OOXML_STRING_POOL_H_
+#define OOXML_STRING_POOL_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * interned strings, numbered in insertion order.
+ * same layout as the eager shared strings table: string[i] = arena + offsets[i], nul-terminated,
+ * found by an open-addressing hash table, so memory depends on the number of distinct strings only.
+ */
+struct ooxml_string_pool
+{
+	char *arena;
+	size_t cb_arena;
+	size_t max_arena;
+	
+	uint64_t *offsets;	// count + 1 items
+	uint32_t count;
+	uint32_t max_count;
+	
+	uint32_t *slots;	// string index + 1
+	uint32_t num_slots;
+};
+
+void ooxml_string_pool_cleanup(struct ooxml_string_pool *pool);
+
+// returns the index of the string, adding it if it is new
+uint32_t ooxml_string_pool_intern(struct ooxml_string_pool *pool, const char *text, size_t length);
+
+static inline const char *ooxml_string_pool_get(const struct ooxml_string_pool *pool, uint32_t index, size_t *p_length)
+{
+	if(index >= pool->count) return NULL;
+	if(p_length) *p_length = pool->offsets[index + 1] - pool->offsets[index] - 1;
+	return pool->arena + pool->offsets[index];
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,167 @@
+/*
+ * ooxml_styles.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include "ooxml_context.h"
+#include "ooxml_styles.h"
+
+int ooxml_number_format_is_date(int num_fmt_id, const char *format_code)
+{
+	if((num_fmt_id >= 14 && num_fmt_id <= 22)
+		|| (num_fmt_id >= 27 && num_fmt_id <= 36)
+		|| (num_fmt_id >= 45 && num_fmt_id <= 47)
+		|| (num_fmt_id >= 50 && num_fmt_id <= 58)) return 1;
+	if(NULL == format_code) return 0;
+	
+	for(const char *p = format_code; *p; ++p) {
+		switch(*p) {
+		case '"':	// literal text
+			p = strchr(p + 1, '"');
+			if(NULL == p) return 0;
+			break;
+		case '\\': case '_': case '*':	// the next character is literal / padding
+			if(p[1] == '\0') return 0;
+			++p;
+			break;
+		case '[':	// colors and conditions, but [h], [mm], [ss] are elapsed times
+			if(p[1] == 'h' || p[1] == 'H' || p[1] == 'm' || p[1] == 'M' || p[1] == 's' || p[1] == 'S') return 1;
+			p = strchr(p + 1, ']');
+			if(NULL == p) return 0;
+			break;
+		case 'y': case 'Y': case 'm': case 'M': case 'd': case 'D':
+		case 'h': case 'H': case 's': case 'S':
+			return 1;
+		default:
+			break;
+		}
+	}
+	return 0;
+}
+
+static int get_int_prop(xmlNodePtr node, const char *name, int default_value)
+{
+	xmlChar *value = xmlGetProp(node, BAD_CAST name);
+	if(NULL == value) return default_value;
+	int n = atoi((const char *)value);
+	xmlFree(value);
+	return n;
+}
+
+static xmlNodePtr find_child(xmlNodePtr parent, const char *name)
+{
+	for(xmlNodePtr node = parent?parent->children:NULL; node; node = node->next) {
+		if(node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, BAD_CAST name) == 0) return node;
+	}
+	return NULL;
+}
+
+struct ooxml_styles *ooxml_styles_load(zip_t *zip, const char *part_name)
+{
+	assert(zip && part_name);
+	xmlDocPtr doc = NULL;
+	if(parse_zip_xml_file(zip, part_name, &doc) != 0 || NULL == doc) return NULL;
+	
+	xmlNodePtr root = xmlDocGetRootElement(doc);
+	
+	// custom formats: numFmtId => is_date
+	ssize_t num_formats = 0;
+	int *format_ids = NULL;
+	uint8_t *format_is_date = NULL;
+	xmlNodePtr num_fmts = find_child(root, "numFmts");
+	for(xmlNodePtr node = num_fmts?num_fmts->children:NULL; node; node = node->next) {
+		if(node->type != XML_ELEMENT_NODE || xmlStrcmp(node->name, BAD_CAST "numFmt") != 0) continue;
+		
+		format_ids = realloc(format_ids, (num_formats + 1) * sizeof(*format_ids));
+		format_is_date = realloc(format_is_date, (num_formats + 1) * sizeof(*format_is_date));
+		assert(format_ids && format_is_date);
+		
+		int id = get_int_prop(node, "numFmtId", -1);
+		xmlChar *code = xmlGetProp(node, BAD_CAST "formatCode");
+		format_ids[num_formats] = id;
+		format_is_date[num_formats] = (uint8_t)ooxml_number_format_is_date(id, (const char *)code);
+		++num_formats;
+		if(code) xmlFree(code);
+	}
+	
+	struct ooxml_styles *styles = calloc(1, sizeof(*styles));
+	assert(styles);
+	
+	xmlNodePtr cell_xfs = find_child(root, "cellXfs");
+	for(xmlNodePtr node = cell_xfs?cell_xfs->children:NULL; node; node = node->next) {
+		if(node->type != XML_ELEMENT_NODE || xmlStrcmp(node->name, BAD_CAST "xf") != 0) continue;
+		
+		ssize_t index = styles->num_xfs++;
+		styles->num_fmt_ids = realloc(styles->num_fmt_ids, styles->num_xfs * sizeof(*styles->num_fmt_ids));
+		styles->is_date = realloc(styles->is_date, styles->num_xfs * sizeof(*styles->is_date));
+		assert(styles->num_fmt_ids && styles->is_date);
+		
+		int id = get_int_prop(node, "numFmtId", 0);
+		int is_date = ooxml_number_format_is_date(id, NULL);
+		for(ssize_t i = 0; i < num_formats; ++i) {
+			if(format_ids[i] == id) {
+				is_date = format_is_date[i];
+				break;
+			}
+		}
+		styles->num_fmt_ids[index] = id;
+		styles->is_date[index] = (uint8_t)is_date;
+	}
+	
+	free(format_ids);
+	free(format_is_date);
+	xmlFreeDoc(doc);
+	return styles;
+}
+
+void ooxml_styles_free(struct ooxml_styles *styles)
+{
+	if(NULL == styles) return;
+	free(styles->num_fmt_ids);
+	free(styles->is_date);
+	free(styles);
+}
+
+int ooxml_styles_is_date(const struct ooxml_styles *styles, int style)
+{
+	if(NULL == styles || style < 0 || style >= styles->num_xfs) return 0;
+	return styles->is_date[style];
+}
+
+
+#if defined(TEST_OOXML_STYLES_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
@@ -0,0 +1,947 @@
+/*
+ * ooxml_table.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "app.h"
+#include "ooxml_spreadsheet.h"
+#include "ooxml_shared_strings.h"
+#include "ooxml_styles.h"
+#include "ooxml_cell_decode.h"
+#include "ooxml_table.h"
+#include "ooxml_string_pool.h"
+#include "perf_trace.h"
+
+// staging memory presized from <dimension>, the columns grow beyond it on demand
+#define TABLE_PRESIZE_BUDGET	(64 * 1024 * 1024)
+#define TABLE_DEFAULT_SPARSE_RATIO	(0.25)
+#define DATE1904_OFFSET_DAYS	(1462)	// 1904-01-01 is serial 1462 in the 1900 date system
+
+// strings of the table which are not in the shared strings table (inline strings, formula results, numbers of mixed columns)
+struct ooxml_table_private
+{
+	struct ooxml_string_pool strings;
+	uint32_t sst_count;	// ids of the table's own strings start here
+	
+	// for ooxml_table_read_batches()
+	const struct ooxml_styles *styles;
+	int date1904;
+	int is_schema;
+};
+
+/*
+ * column builder: (row, value) pairs in worksheet order, converted to the final layout by column_finalize()
+ */
+union cell_value
+{
+	double f64;
+	int64_t i64;	// int64, bool, string ids
+};
+
+struct column_builder
+{
+	int64_t col;
+	enum ooxml_column_type type;
+	int is_unsorted;	// rows did not arrive in ascending order
+	int64_t num_errors;
+	
+	int64_t count;
+	int64_t capacity;
+	int64_t *rows;
+	union cell_value *values;
+	
+	int64_t last_row;	// scan_only: the values are only counted
+};
+
+struct table_builder
+{
+	struct ooxml_table *table;
+	const struct ooxml_styles *styles;
+	int date1904;		// number dates are 1904 serials
+	int64_t header_row;
+	int64_t presize_rows;
+	
+	int64_t last_row;	// last table row with a value
+	int has_first_row;
+	
+	int64_t num_builders;	// indexed by worksheet column
+	struct column_builder **builders;
+	char **names;		// header cells, indexed by worksheet column
+	int64_t num_names;
+	
+	int scan_only;		// ooxml_table_scan(): types and counts, no values
+	
+	// ooxml_table_read_batches(): table is the schema, the builders have its types
+	int64_t batch_rows;
+	int64_t batch_first;	// table row of the current batch
+	struct ooxml_column *batch_columns;
+	ooxml_table_batch_callback on_batch;
+	void *user_data;
+	int stopped;
+};
+
+static void column_builder_free(struct column_builder *builder)
+{
+	if(NULL == builder) return;
+	free(builder->rows);
+	free(builder->values);
+	free(builder);
+}
+
+static struct column_builder *table_builder_get_column(struct table_builder *tb, int64_t col)
+{
+	if(col >= tb->num_builders) {
+		int64_t new_size = tb->num_builders?tb->num_builders:16;
+		while(new_size <= col) new_size *= 2;
+		tb->builders = realloc(tb->builders, new_size * sizeof(*tb->builders));
+		assert(tb->builders);
+		memset(tb->builders + tb->num_builders, 0, (new_size - tb->num_builders) * sizeof(*tb->builders));
+		tb->num_builders = new_size;
+	}
+	
+	struct column_builder *builder = tb->builders[col];
+	if(NULL == builder) {
+		builder = calloc(1, sizeof(*builder));
+		assert(builder);
+		builder->col = col;
+		if(tb->batch_rows > 0) builder->type = tb->table->columns[col - tb->table->first_col].type;
+		builder->capacity = tb->presize_rows;
+		if(builder->capacity > 0) {
+			builder->rows = malloc(builder->capacity * sizeof(*builder->rows));
+			builder->values = malloc(builder->capacity * sizeof(*builder->values));
+			assert(builder->rows && builder->values);
+		}
+		tb->builders[col] = builder;
+	}
+	return builder;
+}
+
+static uint32_t table_intern(struct ooxml_table *table, const char *text, size_t length)
+{
+	struct ooxml_table_private *priv = table->priv;
+	return priv->sst_count + ooxml_string_pool_intern(&priv->strings, text, length);
+}
+
+// the text of a value of a non-string column, for mixed columns
+static uint32_t table_intern_value(struct ooxml_table *table, enum ooxml_column_type type, union cell_value value)
+{
+	char text[32] = "";
+	size_t length = 0;
+	switch(type) {
+	case ooxml_column_type_int64:
+		length = ooxml_encode_int64(value.i64, text);
+		break;
+	case ooxml_column_type_bool:
+		length = snprintf(text, sizeof(text), "%s", value.i64?"TRUE":"FALSE");
+		break;
+	case ooxml_column_type_double: case ooxml_column_type_date:
+		length = ooxml_encode_double(value.f64, text);
+		break;
+	default:
+		return (uint32_t)value.i64;
+	}
+	return table_intern(table, text, length);
+}
+
+static enum ooxml_column_type merge_types(enum ooxml_column_type a, enum ooxml_column_type b)
+{
+	if(a == ooxml_column_type_empty || a == b) return b;
+	if(b == ooxml_column_type_empty) return a;
+	
+	int a_is_number = (a == ooxml_column_type_double || a == ooxml_column_type_int64 || a == ooxml_column_type_date);
+	int b_is_number = (b == ooxml_column_type_double || b == ooxml_column_type_int64 || b == ooxml_column_type_date);
+	if(a_is_number && b_is_number) return ooxml_column_type_double;
+	return ooxml_column_type_mixed;
+}
+
+static union cell_value convert_value(struct ooxml_table *table, enum ooxml_column_type from, enum ooxml_column_type to, union cell_value value)
+{
+	if(from == to) return value;
+	if(to == ooxml_column_type_double) {
+		if(from == ooxml_column_type_int64) value.f64 = (double)value.i64;
+		return value;	// date => double keeps the serial
+	}
+	assert(to == ooxml_column_type_mixed);
+	value.i64 = table_intern_value(table, from, value);
+	return value;
+}
+
+static void column_builder_append(struct table_builder *tb, struct column_builder *builder, int64_t row,
+	enum ooxml_column_type type, union cell_value value)
+{
+	if(tb->scan_only) {
+		builder->type = merge_types(builder->type, type);
+		if(builder->count == 0 || row != builder->last_row) ++builder->count;
+		builder->last_row = row;
+		return;
+	}
+	
+	if(tb->batch_rows > 0 && merge_types(builder->type, type) != builder->type) {
+		// the part has changed since the scan
+		++builder->num_errors;
+		return;
+	}
+	
+	if(builder->type != type) {
+		enum ooxml_column_type target = merge_types(builder->type, type);
+		if(target != builder->type) {
+			for(int64_t i = 0; i < builder->count; ++i) {
+				builder->values[i] = convert_value(tb->table, builder->type, target, builder->values[i]);
+			}
+			builder->type = target;
+		}
+		value = convert_value(tb->table, type, target, value);
+	}
+	
+	if(builder->count > 0) {
+		int64_t last_row = builder->rows[builder->count - 1];
+		if(row == last_row) {	// the same cell again: the last one wins
+			builder->values[builder->count - 1] = value;
+			return;
+		}
+		if(row < last_row) builder->is_unsorted = 1;
+	}
+	
+	if(builder->count >= builder->capacity) {
+		int64_t new_size = builder->capacity?(builder->capacity * 2):1024;
+		builder->rows = realloc(builder->rows, new_size * sizeof(*builder->rows));
+		builder->values = realloc(builder->values, new_size * sizeof(*builder->values));
+		assert(builder->rows && builder->values);
+		builder->capacity = new_size;
+	}
+	builder->rows[builder->count] = row;
+	builder->values[builder->count] = value;
+	++builder->count;
+}
+
+static int64_t days_from_civil(int64_t y, int64_t m, int64_t d)
+{
+	// days since 1970-01-01 of a proleptic gregorian date
+	y -= (m <= 2);
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	int64_t yoe = y - era * 400;
+	int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+static int parse_digits(const char *p, int n, int64_t *p_value)
+{
+	int64_t value = 0;
+	for(int i = 0; i < n; ++i) {
+		if(p[i] < '0' || p[i] > '9') return -1;
+		value = value * 10 + (p[i] - '0');
+	}
+	*p_value = value;
+	return 0;
+}
+
+// t="d": "2024-01-31", "2024-01-31T12:30:00.5", "12:30:00", a timezone suffix is ignored
+static int parse_iso_date(const char *text, size_t length, double *p_serial)
+{
+	while(length > 0 && (*text == ' ' || *text == '\t' || *text == '\r' || *text == '\n')) { ++text; --length; }
+	
+	const char *p = text;
+	const char *end = text + length;
+	double serial = 0;
+	int64_t y, m, d, hh, mm, ss;
+	
+	if(end - p >= 10 && p[4] == '-' && p[7] == '-') {
+		if(parse_digits(p, 4, &y) || parse_digits(p + 5, 2, &m) || parse_digits(p + 8, 2, &d)) return -1;
+		if(m < 1 || m > 12 || d < 1 || d > 31) return -1;
+		serial = (double)(days_from_civil(y, m, d) - days_from_civil(1899, 12, 30));
+		p += 10;
+		if(p < end && *p == 'T') ++p;
+		else if(p < end && *p != ' ' && *p != 'Z' && *p != '+' && *p != '-') return -1;
+	}
+	
+	if(end - p >= 8 && p[2] == ':' && p[5] == ':') {
+		if(parse_digits(p, 2, &hh) || parse_digits(p + 3, 2, &mm) || parse_digits(p + 6, 2, &ss)) return -1;
+		if(hh > 24 || mm > 59 || ss > 60) return -1;
+		double seconds = (double)(hh * 3600 + mm * 60 + ss);
+		p += 8;
+		if(p < end && *p == '.') {
+			const char *fraction = p;
+			++p;
+			while(p < end && *p >= '0' && *p <= '9') ++p;
+			double value = 0;
+			if(ooxml_decode_double(fraction, p - fraction, &value) != ooxml_decode_ok) return -1;
+			seconds += value;
+		}
+		serial += seconds / 86400.0;
+	}else if(p == text) {
+		return -1;
+	}
+	*p_serial = serial;
+	return 0;
+}
+
+/*
+ * the type and value of a cell: 0 on success, 1 if the cell has no value, -1 for errors
+ */
+static int decode_cell(struct table_builder *tb, const struct ooxml_cell *cell,
+	enum ooxml_column_type *p_type, union cell_value *p_value)
+{
+	struct ooxml_table *table = tb->table;
+	if(cell->type == ooxml_cell_type_error) return -1;
+	if(NULL == cell->value) return 1;
+	
+	switch(cell->type) {
+	case ooxml_cell_type_number:
+		if(ooxml_styles_is_date(tb->styles, cell->style)) {
+			if(ooxml_decode_double(cell->value, cell->cb_value, &p_value->f64) != ooxml_decode_ok) return -1;
+			if(tb->date1904) p_value->f64 += DATE1904_OFFSET_DAYS;
+			*p_type = ooxml_column_type_date;
+			return 0;
+		}
+		if(ooxml_decode_int64(cell->value, cell->cb_value, &p_value->i64) == ooxml_decode_ok) {
+			*p_type = ooxml_column_type_int64;
+			return 0;
+		}
+		if(ooxml_decode_double(cell->value, cell->cb_value, &p_value->f64) != ooxml_decode_ok) return -1;
+		*p_type = ooxml_column_type_double;
+		return 0;
+	case ooxml_cell_type_shared_string:
+		if(ooxml_decode_int64(cell->value, cell->cb_value, &p_value->i64) != ooxml_decode_ok) return -1;
+		if(p_value->i64 < 0 || p_value->i64 >= table->priv->sst_count) return -1;
+		*p_type = ooxml_column_type_string;
+		return 0;
+	case ooxml_cell_type_inline_string: case ooxml_cell_type_string:
+		p_value->i64 = table_intern(table, cell->value, cell->cb_value);
+		*p_type = ooxml_column_type_string;
+		return 0;
+	case ooxml_cell_type_boolean:
+		if(ooxml_decode_int64(cell->value, cell->cb_value, &p_value->i64) != ooxml_decode_ok) return -1;
+		p_value->i64 = (p_value->i64 != 0);
+		*p_type = ooxml_column_type_bool;
+		return 0;
+	case ooxml_cell_type_date:
+		if(parse_iso_date(cell->value, cell->cb_value, &p_value->f64)) return -1;
+		*p_type = ooxml_column_type_date;
+		return 0;
+	default:
+		break;
+	}
+	return -1;
+}
+
+static void table_builder_set_names(struct table_builder *tb, const struct ooxml_row *row)
+{
+	struct ooxml_table *table = tb->table;
+	for(ssize_t i = 0; i < row->num_cells; ++i) {
+		const struct ooxml_cell *cell = &row->cells[i];
+		if(NULL == cell->value || cell->col < 0) continue;
+		
+		const char *text = cell->value;
+		size_t length = cell->cb_value;
+		if(cell->type == ooxml_cell_type_shared_string) {
+			int64_t index = -1;
+			if(ooxml_decode_int64(cell->value, cell->cb_value, &index) != ooxml_decode_ok
+				|| index < 0 || index >= table->priv->sst_count) continue;
+			text = ooxml_shared_strings_get(table->sst, index, &length);
+			if(NULL == text) continue;
+		}
+		
+		if(cell->col >= tb->num_names) {
+			int64_t new_size = cell->col + 1;
+			tb->names = realloc(tb->names, new_size * sizeof(*tb->names));
+			assert(tb->names);
+			memset(tb->names + tb->num_names, 0, (new_size - tb->num_names) * sizeof(*tb->names));
+			tb->num_names = new_size;
+		}
+		free(tb->names[cell->col]);
+		tb->names[cell->col] = strndup(text, length);
+		assert(tb->names[cell->col]);
+	}
+}
+
+static int table_builder_flush_batch(struct table_builder *tb);
+
+static int on_table_row(void *user_data, const struct ooxml_row *row)
+{
+	struct table_builder *tb = user_data;
+	struct ooxml_table *table = tb->table;
+	
+	if(tb->batch_rows > 0) {
+		// rows of batches already delivered (out of order) are lost
+		int64_t table_row = row->row_index - table->first_row;
+		if(table_row < tb->batch_first || table_row >= table->num_rows) return 0;
+		while(table_row >= tb->batch_first + tb->batch_rows) {
+			if(table_builder_flush_batch(tb)) return 1;
+		}
+	}else if(tb->header_row > 0) {
+		if(row->row_index == tb->header_row) {
+			table_builder_set_names(tb, row);
+			return 0;
+		}
+		if(row->row_index < tb->header_row) return 0;
+	}
+	if(!tb->has_first_row) {
+		table->first_row = (tb->header_row > 0)?(tb->header_row + 1):row->row_index;
+		tb->has_first_row = 1;
+	}
+	if(row->row_index < table->first_row) return 0;
+	
+	int64_t table_row = row->row_index - table->first_row - tb->batch_first;
+	for(ssize_t i = 0; i < row->num_cells; ++i) {
+		const struct ooxml_cell *cell = &row->cells[i];
+		if(cell->col < 0) continue;
+		if(tb->batch_rows > 0 && (cell->col < table->first_col || cell->col >= table->first_col + table->num_columns)) continue;
+		
+		enum ooxml_column_type type = ooxml_column_type_empty;
+		union cell_value value = { .i64 = 0 };
+		int rc = decode_cell(tb, cell, &type, &value);
+		if(rc > 0) continue;
+		
+		struct column_builder *builder = table_builder_get_column(tb, cell->col);
+		if(table_row > tb->last_row) tb->last_row = table_row;
+		if(rc < 0) {
+			++builder->num_errors;
+			continue;
+		}
+		column_builder_append(tb, builder, table_row, type, value);
+	}
+	return 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	const int64_t *x = a;
+	const int64_t *y = b;
+	if(x[0] != y[0]) return (x[0] < y[0])?-1:1;
+	return (x[1] < y[1])?-1:(x[1] > y[1]);
+}
+
+// rows arrived out of order: sort by row (keeping the worksheet order of duplicates), the last one wins
+static void column_builder_sort(struct column_builder *builder)
+{
+	int64_t (*entries)[2] = malloc(builder->count * sizeof(*entries));
+	union cell_value *values = malloc(builder->capacity * sizeof(*values));
+	assert(entries && values);
+	for(int64_t i = 0; i < builder->count; ++i) {
+		entries[i][0] = builder->rows[i];
+		entries[i][1] = i;
+	}
+	qsort(entries, builder->count, sizeof(*entries), compare_entries);
+	
+	int64_t count = 0;
+	for(int64_t i = 0; i < builder->count; ++i) {
+		if(count > 0 && builder->rows[count - 1] == entries[i][0]) --count;
+		builder->rows[count] = entries[i][0];
+		values[count] = builder->values[entries[i][1]];
+		++count;
+	}
+	free(entries);
+	free(builder->values);
+	builder->values = values;
+	builder->count = count;
+	builder->is_unsorted = 0;
+}
+
+static size_t column_type_width(enum ooxml_column_type type)
+{
+	switch(type) {
+	case ooxml_column_type_double: case ooxml_column_type_date: return sizeof(double);
+	case ooxml_column_type_int64: return sizeof(int64_t);
+	case ooxml_column_type_string: case ooxml_column_type_mixed: return sizeof(uint32_t);
+	default: break;
+	}
+	return 0;
+}
+
+static void column_store_value(struct ooxml_column *column, int64_t index, union cell_value value)
+{
+	switch(column->type) {
+	case ooxml_column_type_double: case ooxml_column_type_date: column->values.f64[index] = value.f64; break;
+	case ooxml_column_type_int64: column->values.i64[index] = value.i64; break;
+	case ooxml_column_type_string: case ooxml_column_type_mixed: column->values.ids[index] = (uint32_t)value.i64; break;
+	case ooxml_column_type_bool:
+		if(value.i64) column->values.bits[index >> 3] |= (uint8_t)(1 << (index & 7));
+		break;
+	default:
+		break;
+	}
+}
+
+static void column_finalize(struct ooxml_column *column, struct column_builder *builder, int64_t num_rows, double sparse_ratio)
+{
+	column->col = builder->col;
+	column->num_errors = builder->num_errors;
+	column->type = builder->type;
+	column->null_count = num_rows;
+	if(builder->type == ooxml_column_type_empty) return;
+	if(NULL == builder->values) {	// scan_only
+		column->null_count = num_rows - builder->count;
+		return;
+	}
+	if(builder->is_unsorted) column_builder_sort(builder);
+	column->null_count = num_rows - builder->count;
+	
+	column->is_sparse = (builder->count < (double)num_rows * sparse_ratio);
+	column->length = column->is_sparse?builder->count:num_rows;
+	
+	size_t width = column_type_width(column->type);
+	size_t size = width?(column->length * width):((column->length + 7) / 8);
+	column->values.data = calloc(size?size:1, 1);
+	assert(column->values.data);
+	
+	if(column->is_sparse) {
+		// the staged rows are already the final ones, without the presized capacity
+		column->rows = realloc(builder->rows, builder->count * sizeof(*column->rows));
+		assert(column->rows);
+		builder->rows = NULL;
+		for(int64_t i = 0; i < builder->count; ++i) column_store_value(column, i, builder->values[i]);
+		return;
+	}
+	
+	if(column->null_count > 0) {
+		column->validity = calloc((num_rows + 7) / 8, 1);
+		assert(column->validity);
+	}
+	for(int64_t i = 0; i < builder->count; ++i) {
+		int64_t row = builder->rows[i];
+		column_store_value(column, row, builder->values[i]);
+		if(column->validity) column->validity[row >> 3] |= (uint8_t)(1 << (row & 7));
+	}
+}
+
+static char *column_letters(int64_t col)
+{
+	char letters[16];
+	int n = 0;
+	for(++col; col > 0 && n < (int)sizeof(letters); col = (col - 1) / 26) {
+		letters[n++] = 'A' + (col - 1) % 26;
+	}
+	char *name = calloc(n + 1, 1);
+	assert(name);
+	for(int i = 0; i < n; ++i) name[i] = letters[n - 1 - i];
+	return name;
+}
+
+static void table_builder_cleanup(struct table_builder *tb)
+{
+	for(int64_t i = 0; i < tb->num_builders; ++i) column_builder_free(tb->builders[i]);
+	free(tb->builders);
+	for(int64_t i = 0; i < tb->num_names; ++i) free(tb->names[i]);
+	free(tb->names);
+	memset(tb, 0, sizeof(*tb));
+}
+
+static struct ooxml_table *table_new(const char *sheet_name, struct ooxml_shared_strings *sst)
+{
+	struct ooxml_table *table = calloc(1, sizeof(*table));
+	assert(table);
+	table->sheet_name = strdup(sheet_name);
+	table->sst = sst;
+	table->priv = calloc(1, sizeof(*table->priv));
+	assert(table->sheet_name && table->priv);
+	table->priv->sst_count = (sst && sst->count > 0)?(uint32_t)sst->count:0;
+	return table;
+}
+
+static void table_free_columns(struct ooxml_column *columns, int64_t num_columns, int free_names)
+{
+	for(int64_t i = 0; i < num_columns; ++i) {
+		struct ooxml_column *column = &columns[i];
+		if(free_names) free(column->name);
+		free(column->rows);
+		free(column->validity);
+		free(column->values.data);
+	}
+}
+
+static struct ooxml_table *table_build(zip_t *zip, const char *sheet_name,
+	struct ooxml_shared_strings *sst, const struct ooxml_styles *styles,
+	const struct ooxml_table_options *options, int scan_only)
+{
+	assert(zip && sheet_name);
+	double sparse_ratio = (options && options->sparse_ratio > 0)?options->sparse_ratio:TABLE_DEFAULT_SPARSE_RATIO;
+	
+	struct ooxml_table *table = table_new(sheet_name, sst);
+	struct table_builder tb = {
+		.table = table,
+		.styles = styles,
+		.date1904 = options?options->date1904:0,
+		.header_row = options?options->header_row:0,
+		.last_row = -1,
+		.scan_only = scan_only,
+	};
+	
+	struct ooxml_cell_range dimension;
+	if(!scan_only && ooxml_spreadsheet_get_dimension(zip, sheet_name, &dimension) == 0) {
+		int64_t num_rows = dimension.last_row - dimension.first_row + 1;
+		int64_t num_columns = dimension.last_col - dimension.first_col + 1;
+		int64_t max_rows = TABLE_PRESIZE_BUDGET / (num_columns * (int64_t)(sizeof(int64_t) + sizeof(union cell_value)));
+		tb.presize_rows = (num_rows < max_rows)?num_rows:max_rows;
+		
+		// a single cell is what writers put in when they do not know the range
+		if(num_rows == 1 && num_columns == 1) tb.presize_rows = 0;
+		debug_printf("%s: dimension=%lld:%lld rows, %lld:%lld cols, presize_rows=%lld", sheet_name,
+			(long long)dimension.first_row, (long long)dimension.last_row,
+			(long long)dimension.first_col, (long long)dimension.last_col,
+			(long long)tb.presize_rows);
+	}
+	
+	PERF_TRACE_BEGIN(span);
+	int rc = ooxml_spreadsheet_stream_rows(zip, sheet_name, on_table_row, &tb);
+	if(rc) {
+		table_builder_cleanup(&tb);
+		ooxml_table_free(table);
+		return NULL;
+	}
+	
+	// columns: from the first to the last one with a value, error or name
+	int64_t first_col = -1, last_col = -1;
+	for(int64_t col = 0; col < tb.num_builders || col < tb.num_names; ++col) {
+		int has_data = (col < tb.num_builders && tb.builders[col] && (tb.builders[col]->count || tb.builders[col]->num_errors))
+			|| (col < tb.num_names && tb.names[col]);
+		if(!has_data) continue;
+		if(first_col < 0) first_col = col;
+		last_col = col;
+	}
+	
+	table->num_rows = tb.last_row + 1;
+	if(!tb.has_first_row) table->first_row = (tb.header_row > 0)?(tb.header_row + 1):1;
+	table->first_col = (first_col < 0)?0:first_col;
+	table->num_columns = (first_col < 0)?0:(last_col - first_col + 1);
+	if(table->num_columns > 0) {
+		table->columns = calloc(table->num_columns, sizeof(*table->columns));
+		assert(table->columns);
+	}
+	
+	for(int64_t i = 0; i < table->num_columns; ++i) {
+		struct ooxml_column *column = &table->columns[i];
+		int64_t col = table->first_col + i;
+		struct column_builder *builder = (col < tb.num_builders)?tb.builders[col]:NULL;
+		if(builder) {
+			column_finalize(column, builder, table->num_rows, sparse_ratio);
+		}else {
+			column->col = col;
+			column->null_count = table->num_rows;
+		}
+		
+		if(col < tb.num_names && tb.names[col]) {
+			column->name = tb.names[col];
+			tb.names[col] = NULL;
+		}else {
+			column->name = column_letters(col);
+		}
+		
+		// release the staging memory as we go
+		column_builder_free(builder);
+		if(builder) tb.builders[col] = NULL;
+	}
+	table_builder_cleanup(&tb);
+	PERF_TRACE_END(span, scan_only?"table_scan":"table_load", sheet_name);
+	
+	debug_printf("%s: %lld rows x %lld columns, %u table strings", sheet_name,
+		(long long)table->num_rows, (long long)table->num_columns, table->priv->strings.count);
+	return table;
+}
+
+struct ooxml_table *ooxml_table_load(zip_t *zip, const char *sheet_name,
+	struct ooxml_shared_strings *sst, const struct ooxml_styles *styles,
+	const struct ooxml_table_options *options)
+{
+	return table_build(zip, sheet_name, sst, styles, options, 0);
+}
+
+struct ooxml_table *ooxml_table_scan(zip_t *zip, const char *sheet_name,
+	struct ooxml_shared_strings *sst, const struct ooxml_styles *styles,
+	const struct ooxml_table_options *options)
+{
+	struct ooxml_table *table = table_build(zip, sheet_name, sst, styles, options, 1);
+	if(table) {
+		table->priv->styles = styles;
+		table->priv->date1904 = options?options->date1904:0;
+		table->priv->is_schema = 1;
+	}
+	return table;
+}
+
+// deliver the rows [batch_first, batch_first + batch_rows) as a dense table with the schema's columns
+static int table_builder_flush_batch(struct table_builder *tb)
+{
+	struct ooxml_table *schema = tb->table;
+	int64_t num_rows = schema->num_rows - tb->batch_first;
+	if(num_rows > tb->batch_rows) num_rows = tb->batch_rows;
+	
+	struct ooxml_table batch = {
+		.sheet_name = schema->sheet_name,
+		.first_row = schema->first_row + tb->batch_first,
+		.num_rows = num_rows,
+		.first_col = schema->first_col,
+		.num_columns = schema->num_columns,
+		.columns = tb->batch_columns,
+		.sst = schema->sst,
+		.priv = schema->priv,
+	};
+	for(int64_t i = 0; i < schema->num_columns; ++i) {
+		struct ooxml_column *column = &batch.columns[i];
+		struct column_builder *builder = table_builder_get_column(tb, schema->first_col + i);
+		memset(column, 0, sizeof(*column));
+		column_finalize(column, builder, num_rows, 0);
+		column->name = schema->columns[i].name;
+	}
+	
+	int rc = tb->on_batch(tb->user_data, &batch);
+	
+	table_free_columns(batch.columns, batch.num_columns, 0);
+	for(int64_t i = 0; i < schema->num_columns; ++i) {
+		struct column_builder *builder = tb->builders[schema->first_col + i];
+		builder->count = 0;
+		builder->num_errors = 0;
+		builder->is_unsorted = 0;
+	}
+	tb->batch_first += tb->batch_rows;
+	if(rc) tb->stopped = 1;
+	return rc;
+}
+
+int ooxml_table_read_batches(struct ooxml_table *schema, zip_t *zip, int64_t batch_rows,
+	ooxml_table_batch_callback on_batch, void *user_data)
+{
+	assert(schema && schema->priv && zip && on_batch);
+	if(!schema->priv->is_schema) {
+		fprintf(stderr, "%s(%s): not a table from ooxml_table_scan()\n", __FUNCTION__, schema->sheet_name);
+		return -1;
+	}
+	if(batch_rows <= 0) batch_rows = OOXML_TABLE_DEFAULT_BATCH_ROWS;
+	
+	struct table_builder tb = {
+		.table = schema,
+		.styles = schema->priv->styles,
+		.date1904 = schema->priv->date1904,
+		.last_row = -1,
+		.has_first_row = 1,
+		.presize_rows = batch_rows,
+		.batch_rows = batch_rows,
+		.on_batch = on_batch,
+		.user_data = user_data,
+	};
+	if(schema->num_columns > 0) {
+		tb.batch_columns = calloc(schema->num_columns, sizeof(*tb.batch_columns));
+		assert(tb.batch_columns);
+	}
+	
+	PERF_TRACE_BEGIN(span);
+	int rc = ooxml_spreadsheet_stream_rows(zip, schema->sheet_name, on_table_row, &tb);
+	while(0 == rc && !tb.stopped && tb.batch_first < schema->num_rows) {
+		table_builder_flush_batch(&tb);
+	}
+	PERF_TRACE_END(span, "table_read_batches", schema->sheet_name);
+	
+	free(tb.batch_columns);
+	table_builder_cleanup(&tb);
+	return rc;
+}
+
+void ooxml_table_free(struct ooxml_table *table)
+{
+	if(NULL == table) return;
+	table_free_columns(table->columns, table->num_columns, 1);
+	free(table->columns);
+	if(table->priv) {
+		ooxml_string_pool_cleanup(&table->priv->strings);
+		free(table->priv);
+	}
+	free(table->sheet_name);
+	free(table);
+}
+
+const char *ooxml_table_get_string(const struct ooxml_table *table, uint32_t id, size_t *p_length)
+{
+	assert(table && table->priv);
+	const struct ooxml_table_private *priv = table->priv;
+	if(id < priv->sst_count) return ooxml_shared_strings_get(table->sst, id, p_length);
+	
+	id -= priv->sst_count;
+	if(id >= priv->strings.count) return NULL;
+	if(p_length) *p_length = priv->strings.offsets[id + 1] - priv->strings.offsets[id] - 1;
+	return priv->strings.arena + priv->strings.offsets[id];
+}
+
+uint32_t ooxml_table_get_num_strings(const struct ooxml_table *table)
+{
+	assert(table && table->priv);
+	return table->priv->sst_count + table->priv->strings.count;
+}
+
+int ooxml_column_find(const struct ooxml_column *column, int64_t row, int64_t *p_index)
+{
+	assert(column);
+	if(column->type == ooxml_column_type_empty || row < 0) return 0;
+	if(!column->is_sparse) {
+		if(row >= column->length || !ooxml_column_is_valid(column, row)) return 0;
+		if(p_index) *p_index = row;
+		return 1;
+	}
+	
+	int64_t lo = 0, hi = column->length;
+	while(lo < hi) {
+		int64_t mid = lo + (hi - lo) / 2;
+		if(column->rows[mid] < row) lo = mid + 1;
+		else hi = mid;
+	}
+	if(lo >= column->length || column->rows[lo] != row) return 0;
+	if(p_index) *p_index = lo;
+	return 1;
+}
+
+
+/*
+ * aggregation kernels: four independent accumulators per loop so that the adds and compares
+ * of consecutive values do not wait for each other, nulls are skipped a 64-bit word of the bitmap at a time.
+ */
+struct stats_accum
+{
+	double sum[4];
+	double min[4];
+	double max[4];
+};
+
+static void stats_accum_init(struct stats_accum *acc)
+{
+	for(int i = 0; i < 4; ++i) {
+		acc->sum[i] = 0;
+		acc->min[i] = INFINITY;
+		acc->max[i] = -INFINITY;
+	}
+}
+
+#define STATS_ACCUM_ONE(acc, k, x) do { \
+		double v_ = (x); \
+		acc->sum[k] += v_; \
+		if(v_ < acc->min[k]) acc->min[k] = v_; \
+		if(v_ > acc->max[k]) acc->max[k] = v_; \
+	} while(0)
+
+static void stats_accum_f64(struct stats_accum *acc, const double *values, int64_t begin, int64_t end)
+{
+	int64_t i = begin;
+	for(; i + 4 <= end; i += 4) {
+		STATS_ACCUM_ONE(acc, 0, values[i]);
+		STATS_ACCUM_ONE(acc, 1, values[i + 1]);
+		STATS_ACCUM_ONE(acc, 2, values[i + 2]);
+		STATS_ACCUM_ONE(acc, 3, values[i + 3]);
+	}
+	for(; i < end; ++i) STATS_ACCUM_ONE(acc, 0, values[i]);
+}
+
+static void stats_accum_i64(struct stats_accum *acc, const int64_t *values, int64_t begin, int64_t end)
+{
+	int64_t i = begin;
+	for(; i + 4 <= end; i += 4) {
+		STATS_ACCUM_ONE(acc, 0, (double)values[i]);
+		STATS_ACCUM_ONE(acc, 1, (double)values[i + 1]);
+		STATS_ACCUM_ONE(acc, 2, (double)values[i + 2]);
+		STATS_ACCUM_ONE(acc, 3, (double)values[i + 3]);
+	}
+	for(; i < end; ++i) STATS_ACCUM_ONE(acc, 0, (double)values[i]);
+}
+
+static void stats_accum_bits(struct stats_accum *acc, const uint8_t *bits, int64_t begin, int64_t end)
+{
+	for(int64_t i = begin; i < end; ++i) STATS_ACCUM_ONE(acc, 0, (double)((bits[i >> 3] >> (i & 7)) & 1));
+}
+
+static void stats_accum_range(struct stats_accum *acc, const struct ooxml_column *column, int64_t begin, int64_t end)
+{
+	switch(column->type) {
+	case ooxml_column_type_double: case ooxml_column_type_date:
+		stats_accum_f64(acc, column->values.f64, begin, end);
+		break;
+	case ooxml_column_type_int64:
+		stats_accum_i64(acc, column->values.i64, begin, end);
+		break;
+	case ooxml_column_type_bool:
+		stats_accum_bits(acc, column->values.bits, begin, end);
+		break;
+	default:
+		break;
+	}
+}
+
+int ooxml_column_get_stats(const struct ooxml_column *column, struct ooxml_column_stats *stats)
+{
+	assert(column && stats);
+	memset(stats, 0, sizeof(*stats));
+	if(column->type == ooxml_column_type_string || column->type == ooxml_column_type_mixed) return -1;
+	
+	stats->null_count = column->null_count;
+	stats->min = NAN;
+	stats->max = NAN;
+	if(column->type == ooxml_column_type_empty) return 0;
+	
+	struct stats_accum acc;
+	stats_accum_init(&acc);
+	
+	if(NULL == column->validity) {
+		stats_accum_range(&acc, column, 0, column->length);
+	}else {
+		// runs of valid slots
+		int64_t length = column->length;
+		for(int64_t word_start = 0; word_start < length; word_start += 64) {
+			int64_t word_end = (word_start + 64 < length)?(word_start + 64):length;
+			uint64_t word = 0;
+			memcpy(&word, column->validity + (word_start >> 3), (word_end - word_start + 7) / 8);
+			if(word_end - word_start < 64) word &= (1ULL << (word_end - word_start)) - 1;
+			
+			if(word == UINT64_MAX) {
+				stats_accum_range(&acc, column, word_start, word_end);
+				continue;
+			}
+			while(word) {
+				int begin = __builtin_ctzll(word);
+				uint64_t rest = ~(word >> begin);
+				int run = rest?__builtin_ctzll(rest):(64 - begin);
+				stats_accum_range(&acc, column, word_start + begin, word_start + begin + run);
+				word = (begin + run < 64)?(word & ~(((1ULL << (begin + run)) - 1))):0;
+			}
+		}
+	}
+	
+	stats->count = (column->is_sparse ? column->length : column->length - column->null_count);
+	if(stats->count > 0) {
+		stats->sum = (acc.sum[0] + acc.sum[1]) + (acc.sum[2] + acc.sum[3]);
+		stats->min = fmin(fmin(acc.min[0], acc.min[1]), fmin(acc.min[2], acc.min[3]));
+		stats->max = fmax(fmax(acc.max[0], acc.max[1]), fmax(acc.max[2], acc.max[3]));
+	}
+	return 0;
+}
+
+
+#if defined(TEST_OOXML_TABLE_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
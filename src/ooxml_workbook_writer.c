@@ -0,0 +1,765 @@
+/*
+ * ooxml_workbook_writer.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <ctype.h>
+#include <zip.h>
+
+#include "app.h"
+#include "ooxml_context.h"
+#include "ooxml_private.h"
+#include "ooxml_cell_decode.h"
+#include "ooxml_string_pool.h"
+#include "ooxml_workbook_writer.h"
+#include "zip_writer.h"
+#include "perf_trace.h"
+
+#define SPREADSHEETML_NS	"http://schemas.openxmlformats.org/spreadsheetml/2006/main"
+#define RELATIONSHIPS_NS	"http://schemas.openxmlformats.org/officeDocument/2006/relationships"
+#define PACKAGE_RELATIONSHIPS_NS	"http://schemas.openxmlformats.org/package/2006/relationships"
+#define CONTENT_TYPE_RELATIONSHIPS	"application/vnd.openxmlformats-package.relationships+xml"
+#define CONTENT_TYPE_WORKBOOK		"application/vnd.openxmlformats-officedocument.spreadsheetml.sheet.main+xml"
+#define CONTENT_TYPE_STYLES			"application/vnd.openxmlformats-officedocument.spreadsheetml.styles+xml"
+#define CONTENT_TYPE_WORKSHEET		"application/vnd.openxmlformats-officedocument.spreadsheetml.worksheet+xml"
+#define CONTENT_TYPE_SHARED_STRINGS	"application/vnd.openxmlformats-officedocument.spreadsheetml.sharedStrings+xml"
+#define XML_DECLARATION		"<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+
+#define SPOOL_BUFFER_SIZE	(256 * 1024)
+#define SOURCE_CHUNK_SIZE	(64 * 1024)
+#define DATE_STYLE_INDEX	(1)	// the <xf> with numFmtId 14 in styles.xml
+
+struct text_buffer
+{
+	char *data;
+	size_t length;
+	size_t size;
+};
+
+static void text_buffer_reserve(struct text_buffer *buf, size_t length)
+{
+	if(buf->length + length + 1 <= buf->size) return;
+	size_t new_size = buf->size?(buf->size * 2):4096;
+	while(new_size < buf->length + length + 1) new_size *= 2;
+	buf->data = realloc(buf->data, new_size);
+	assert(buf->data);
+	buf->size = new_size;
+}
+
+static void text_buffer_append(struct text_buffer *buf, const char *text, size_t length)
+{
+	text_buffer_reserve(buf, length);
+	memcpy(buf->data + buf->length, text, length);
+	buf->length += length;
+	buf->data[buf->length] = '\0';
+}
+
+static void text_buffer_puts(struct text_buffer *buf, const char *text)
+{
+	text_buffer_append(buf, text, strlen(text));
+}
+
+/*
+ * character data and attribute values: markup characters are escaped,
+ * control characters which xml 1.0 does not allow are written as _xHHHH_ like excel does,
+ * so a literal "_xHHHH_" gets its underscore escaped (_x005F_)
+ */
+static int is_escape_sequence(const char *p, const char *end)
+{
+	if(end - p < 7 || p[1] != 'x' || p[6] != '_') return 0;
+	for(int i = 2; i < 6; ++i) if(!isxdigit((unsigned char)p[i])) return 0;
+	return 1;
+}
+
+static void text_buffer_append_escaped(struct text_buffer *buf, const char *text, size_t length)
+{
+	text_buffer_reserve(buf, length);
+	const char *begin = text;
+	const char *end = text + length;
+	for(const char *p = text; p < end; ++p) {
+		const char *entity = NULL;
+		char control[8];
+		unsigned char c = *p;
+		switch(c) {
+		case '&': entity = "&amp;"; break;
+		case '<': entity = "&lt;"; break;
+		case '>': entity = "&gt;"; break;
+		case '"': entity = "&quot;"; break;
+		case '_': if(is_escape_sequence(p, end)) entity = "_x005F_"; break;
+		default:
+			if(c < 0x20 && c != '\t' && c != '\n' && c != '\r') {
+				snprintf(control, sizeof(control), "_x%04X_", c);
+				entity = control;
+			}
+			break;
+		}
+		if(NULL == entity) continue;
+		text_buffer_append(buf, begin, p - begin);
+		text_buffer_puts(buf, entity);
+		begin = p + 1;
+	}
+	text_buffer_append(buf, begin, end - begin);
+}
+
+static void text_buffer_cleanup(struct text_buffer *buf)
+{
+	free(buf->data);
+	memset(buf, 0, sizeof(*buf));
+}
+
+
+struct ooxml_workbook_writer;
+struct writer_sheet
+{
+	struct ooxml_workbook_writer *writer;
+	char *name;
+	char part_name[64];		// xl/worksheets/sheet<N>.xml
+	
+	FILE *spool;
+	int64_t cb_spool;
+	int64_t num_rows;
+	int64_t max_col;		// -1: no cells
+};
+
+/*
+ * zip source of a part which is generated while libzip reads it (sheets, shared strings)
+ */
+struct part_source
+{
+	struct ooxml_workbook_writer *writer;
+	struct writer_sheet *sheet;	// NULL: xl/sharedStrings.xml
+	zip_error_t error;
+	
+	int stage;			// head, body, tail, end
+	struct text_buffer head;
+	struct text_buffer chunk;
+	size_t pos;
+	uint32_t next_string;
+};
+
+struct ooxml_workbook_writer
+{
+	struct ooxml_context *ooxml;
+	zip_t *zip;
+	int is_finished;
+	
+	int num_sheets;
+	struct writer_sheet **sheets;
+	struct part_source *sources;
+	
+	struct ooxml_string_pool strings;
+	int64_t num_string_refs;
+	
+	struct text_buffer row;
+};
+
+struct ooxml_workbook_writer *ooxml_workbook_writer_new(struct ooxml_context *ooxml, const char *filename)
+{
+	assert(ooxml && ooxml->priv && filename);
+	struct ooxml_private *priv = ooxml->priv;
+	if(priv->archive) ooxml->close(ooxml);
+	
+	int err_code = 0;
+	zip_t *zip = zip_open(filename, ZIP_CREATE | ZIP_TRUNCATE, &err_code);
+	if(NULL == zip) {
+		fprintf(stderr, "zip_open(%s) failed, err_code=%d\n", filename, err_code);
+		return NULL;
+	}
+	priv->archive = zip;
+	priv->filename = strdup(filename);
+	ooxml->type = ooxml_file_spreadsheet;
+	
+	struct ooxml_workbook_writer *writer = calloc(1, sizeof(*writer));
+	assert(writer);
+	writer->ooxml = ooxml;
+	writer->zip = zip;
+	return writer;
+}
+
+void ooxml_workbook_writer_free(struct ooxml_workbook_writer *writer)
+{
+	if(NULL == writer) return;
+	struct ooxml_context *ooxml = writer->ooxml;
+	struct ooxml_private *priv = ooxml->priv;
+	if(!writer->is_finished && priv->archive == writer->zip) {
+		zip_discard(writer->zip);
+		priv->archive = NULL;
+	}
+	ooxml->close(ooxml);
+	
+	for(int i = 0; i < writer->num_sheets; ++i) {
+		struct writer_sheet *sheet = writer->sheets[i];
+		if(sheet->spool) fclose(sheet->spool);
+		free(sheet->name);
+		free(sheet);
+	}
+	free(writer->sheets);
+	if(writer->sources) {
+		for(int i = 0; i <= writer->num_sheets; ++i) {
+			text_buffer_cleanup(&writer->sources[i].head);
+			text_buffer_cleanup(&writer->sources[i].chunk);
+			zip_error_fini(&writer->sources[i].error);
+		}
+		free(writer->sources);
+	}
+	ooxml_string_pool_cleanup(&writer->strings);
+	text_buffer_cleanup(&writer->row);
+	free(writer);
+}
+
+static int is_valid_sheet_name(const char *name)
+{
+	size_t length = strlen(name);
+	if(length == 0 || length > 31 || name[0] == '\'' || name[length - 1] == '\'') return 0;
+	return strpbrk(name, "[]:*?/\\") == NULL;
+}
+
+int ooxml_workbook_writer_add_sheet(struct ooxml_workbook_writer *writer, const char *name)
+{
+	assert(writer && name);
+	if(writer->is_finished) return -1;
+	if(!is_valid_sheet_name(name)) {
+		fprintf(stderr, "%s(): invalid sheet name '%s'\n", __FUNCTION__, name);
+		return -1;
+	}
+	for(int i = 0; i < writer->num_sheets; ++i) {
+		// excel compares sheet names case-insensitively
+		if(strcasecmp(writer->sheets[i]->name, name) == 0) {
+			fprintf(stderr, "%s(): duplicate sheet name '%s'\n", __FUNCTION__, name);
+			return -1;
+		}
+	}
+	
+	FILE *spool = tmpfile();
+	if(NULL == spool) {
+		perror("tmpfile");
+		return -1;
+	}
+	setvbuf(spool, NULL, _IOFBF, SPOOL_BUFFER_SIZE);
+	
+	struct writer_sheet *sheet = calloc(1, sizeof(*sheet));
+	assert(sheet);
+	sheet->writer = writer;
+	sheet->name = strdup(name);
+	sheet->spool = spool;
+	sheet->max_col = -1;
+	snprintf(sheet->part_name, sizeof(sheet->part_name), "xl/worksheets/sheet%d.xml", writer->num_sheets + 1);
+	
+	writer->sheets = realloc(writer->sheets, (writer->num_sheets + 1) * sizeof(*writer->sheets));
+	assert(writer->sheets);
+	writer->sheets[writer->num_sheets] = sheet;
+	return writer->num_sheets++;
+}
+
+static void append_cell(struct ooxml_workbook_writer *writer, struct text_buffer *row,
+	int64_t row_index, int64_t col, const struct ooxml_cell_value *value)
+{
+	char ref[OOXML_ENCODE_BUFFER_SIZE];
+	char number[OOXML_ENCODE_BUFFER_SIZE];
+	const char *attrs = "";
+	const char *text = number;
+	size_t cb_text = 0;
+	
+	switch(value->type) {
+	case ooxml_value_number: case ooxml_value_date:
+		if(!isfinite(value->number)) {
+			attrs = " t=\"e\"";
+			text = "#NUM!";
+			cb_text = 5;
+			break;
+		}
+		if(value->type == ooxml_value_date) attrs = " s=\"1\"";
+		cb_text = ooxml_encode_double(value->number, number);
+		break;
+	case ooxml_value_int64:
+		cb_text = ooxml_encode_int64(value->i64, number);
+		break;
+	case ooxml_value_bool:
+		attrs = " t=\"b\"";
+		text = value->i64?"1":"0";
+		cb_text = 1;
+		break;
+	case ooxml_value_string:
+		{
+			const char *str = value->text?value->text:"";
+			size_t length = value->cb_text?value->cb_text:strlen(str);
+			uint32_t index = ooxml_string_pool_intern(&writer->strings, str, length);
+			++writer->num_string_refs;
+			attrs = " t=\"s\"";
+			cb_text = ooxml_encode_int64(index, number);
+		}
+		break;
+	default:
+		return;
+	}
+	
+	size_t cb_ref = ooxml_encode_cell_ref(row_index, col, ref);
+	text_buffer_append(row, "<c r=\"", 6);
+	text_buffer_append(row, ref, cb_ref);
+	text_buffer_append(row, "\"", 1);
+	text_buffer_puts(row, attrs);
+	text_buffer_append(row, "><v>", 4);
+	text_buffer_append(row, text, cb_text);
+	text_buffer_append(row, "</v></c>", 8);
+}
+
+int ooxml_workbook_writer_append_row(struct ooxml_workbook_writer *writer, int sheet_index,
+	const struct ooxml_cell_value *values, ssize_t num_values)
+{
+	assert(writer);
+	if(writer->is_finished || sheet_index < 0 || sheet_index >= writer->num_sheets) return -1;
+	assert(num_values <= 0 || values);
+	
+	struct writer_sheet *sheet = writer->sheets[sheet_index];
+	int64_t row_index = ++sheet->num_rows;
+	
+	char number[OOXML_ENCODE_BUFFER_SIZE];
+	struct text_buffer *row = &writer->row;
+	row->length = 0;
+	text_buffer_append(row, "<row r=\"", 8);
+	text_buffer_append(row, number, ooxml_encode_int64(row_index, number));
+	text_buffer_append(row, "\">", 2);
+	for(ssize_t col = 0; col < num_values; ++col) {
+		if(values[col].type == ooxml_value_empty) continue;
+		append_cell(writer, row, row_index, col, &values[col]);
+		if(col > sheet->max_col) sheet->max_col = col;
+	}
+	text_buffer_append(row, "</row>", 6);
+	
+	if(fwrite(row->data, 1, row->length, sheet->spool) != row->length) {
+		perror("append_row");
+		return -1;
+	}
+	sheet->cb_spool += row->length;
+	return 0;
+}
+
+
+/*
+ * the parts
+ */
+static void build_content_types(struct ooxml_workbook_writer *writer, struct text_buffer *buf)
+{
+	text_buffer_puts(buf, XML_DECLARATION
+		"<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+		"<Default Extension=\"rels\" ContentType=\"" CONTENT_TYPE_RELATIONSHIPS "\"/>"
+		"<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+		"<Override PartName=\"/xl/workbook.xml\" ContentType=\"" CONTENT_TYPE_WORKBOOK "\"/>"
+		"<Override PartName=\"/xl/styles.xml\" ContentType=\"" CONTENT_TYPE_STYLES "\"/>");
+	for(int i = 0; i < writer->num_sheets; ++i) {
+		text_buffer_puts(buf, "<Override PartName=\"/");
+		text_buffer_puts(buf, writer->sheets[i]->part_name);
+		text_buffer_puts(buf, "\" ContentType=\"" CONTENT_TYPE_WORKSHEET "\"/>");
+	}
+	if(writer->strings.count > 0) {
+		text_buffer_puts(buf, "<Override PartName=\"/xl/sharedStrings.xml\" ContentType=\"" CONTENT_TYPE_SHARED_STRINGS "\"/>");
+	}
+	text_buffer_puts(buf, "</Types>");
+}
+
+static void build_package_rels(struct text_buffer *buf)
+{
+	text_buffer_puts(buf, XML_DECLARATION
+		"<Relationships xmlns=\"" PACKAGE_RELATIONSHIPS_NS "\">"
+		"<Relationship Id=\"rId1\" Type=\"" RELATIONSHIPS_NS "/officeDocument\" Target=\"xl/workbook.xml\"/>"
+		"</Relationships>");
+}
+
+static void build_workbook(struct ooxml_workbook_writer *writer, struct text_buffer *buf)
+{
+	char number[OOXML_ENCODE_BUFFER_SIZE];
+	text_buffer_puts(buf, XML_DECLARATION
+		"<workbook xmlns=\"" SPREADSHEETML_NS "\" xmlns:r=\"" RELATIONSHIPS_NS "\"><sheets>");
+	for(int i = 0; i < writer->num_sheets; ++i) {
+		ooxml_encode_int64(i + 1, number);
+		text_buffer_puts(buf, "<sheet name=\"");
+		text_buffer_append_escaped(buf, writer->sheets[i]->name, strlen(writer->sheets[i]->name));
+		text_buffer_puts(buf, "\" sheetId=\"");
+		text_buffer_puts(buf, number);
+		text_buffer_puts(buf, "\" r:id=\"rId");
+		text_buffer_puts(buf, number);
+		text_buffer_puts(buf, "\"/>");
+	}
+	text_buffer_puts(buf, "</sheets></workbook>");
+}
+
+// rId<N> are the sheets, then styles and shared strings
+static void build_workbook_rels(struct ooxml_workbook_writer *writer, struct text_buffer *buf)
+{
+	char number[OOXML_ENCODE_BUFFER_SIZE];
+	text_buffer_puts(buf, XML_DECLARATION "<Relationships xmlns=\"" PACKAGE_RELATIONSHIPS_NS "\">");
+	for(int i = 0; i < writer->num_sheets; ++i) {
+		ooxml_encode_int64(i + 1, number);
+		text_buffer_puts(buf, "<Relationship Id=\"rId");
+		text_buffer_puts(buf, number);
+		text_buffer_puts(buf, "\" Type=\"" RELATIONSHIPS_NS "/worksheet\" Target=\"");
+		text_buffer_puts(buf, writer->sheets[i]->part_name + 3);	// relative to xl/
+		text_buffer_puts(buf, "\"/>");
+	}
+	
+	ooxml_encode_int64(writer->num_sheets + 1, number);
+	text_buffer_puts(buf, "<Relationship Id=\"rId");
+	text_buffer_puts(buf, number);
+	text_buffer_puts(buf, "\" Type=\"" RELATIONSHIPS_NS "/styles\" Target=\"styles.xml\"/>");
+	if(writer->strings.count > 0) {
+		ooxml_encode_int64(writer->num_sheets + 2, number);
+		text_buffer_puts(buf, "<Relationship Id=\"rId");
+		text_buffer_puts(buf, number);
+		text_buffer_puts(buf, "\" Type=\"" RELATIONSHIPS_NS "/sharedStrings\" Target=\"sharedStrings.xml\"/>");
+	}
+	text_buffer_puts(buf, "</Relationships>");
+}
+
+// xf 0: general, xf 1 (DATE_STYLE_INDEX): the built-in date format 14
+static void build_styles(struct text_buffer *buf)
+{
+	text_buffer_puts(buf, XML_DECLARATION
+		"<styleSheet xmlns=\"" SPREADSHEETML_NS "\">"
+		"<fonts count=\"1\"><font><sz val=\"11\"/><name val=\"Calibri\"/></font></fonts>"
+		"<fills count=\"2\"><fill><patternFill patternType=\"none\"/></fill><fill><patternFill patternType=\"gray125\"/></fill></fills>"
+		"<borders count=\"1\"><border><left/><right/><top/><bottom/><diagonal/></border></borders>"
+		"<cellStyleXfs count=\"1\"><xf numFmtId=\"0\" fontId=\"0\" fillId=\"0\" borderId=\"0\"/></cellStyleXfs>"
+		"<cellXfs count=\"2\">"
+		"<xf numFmtId=\"0\" fontId=\"0\" fillId=\"0\" borderId=\"0\" xfId=\"0\"/>"
+		"<xf numFmtId=\"14\" fontId=\"0\" fillId=\"0\" borderId=\"0\" xfId=\"0\" applyNumberFormat=\"1\"/>"
+		"</cellXfs>"
+		"<cellStyles count=\"1\"><cellStyle name=\"Normal\" xfId=\"0\" builtinId=\"0\"/></cellStyles>"
+		"</styleSheet>");
+}
+
+static void build_sheet_head(struct writer_sheet *sheet, struct text_buffer *buf)
+{
+	char ref[OOXML_ENCODE_BUFFER_SIZE];
+	text_buffer_puts(buf, XML_DECLARATION
+		"<worksheet xmlns=\"" SPREADSHEETML_NS "\" xmlns:r=\"" RELATIONSHIPS_NS "\"><dimension ref=\"A1");
+	if(sheet->num_rows > 0 && sheet->max_col >= 0) {
+		ooxml_encode_cell_ref(sheet->num_rows, sheet->max_col, ref);
+		text_buffer_puts(buf, ":");
+		text_buffer_puts(buf, ref);
+	}
+	text_buffer_puts(buf, "\"/><sheetData>");
+}
+
+static const char s_sheet_tail[] = "</sheetData></worksheet>";
+static const char s_shared_strings_tail[] = "</sst>";
+
+static void build_shared_strings_head(struct ooxml_workbook_writer *writer, struct text_buffer *buf)
+{
+	char number[OOXML_ENCODE_BUFFER_SIZE];
+	text_buffer_puts(buf, XML_DECLARATION "<sst xmlns=\"" SPREADSHEETML_NS "\" count=\"");
+	text_buffer_puts(buf, (ooxml_encode_int64(writer->num_string_refs, number), number));
+	text_buffer_puts(buf, "\" uniqueCount=\"");
+	text_buffer_puts(buf, (ooxml_encode_int64(writer->strings.count, number), number));
+	text_buffer_puts(buf, "\">");
+}
+
+static void shared_strings_fill(struct ooxml_workbook_writer *writer, struct part_source *source)
+{
+	struct text_buffer *chunk = &source->chunk;
+	while(chunk->length < SOURCE_CHUNK_SIZE && source->next_string < writer->strings.count) {
+		size_t length = 0;
+		const char *text = ooxml_string_pool_get(&writer->strings, source->next_string++, &length);
+		
+		// leading or trailing whitespace is dropped by readers unless preserved
+		int preserve = length > 0 && (strchr(" \t\r\n", text[0]) || strchr(" \t\r\n", text[length - 1]));
+		text_buffer_puts(chunk, preserve?"<si><t xml:space=\"preserve\">":"<si><t>");
+		text_buffer_append_escaped(chunk, text, length);
+		text_buffer_puts(chunk, "</t></si>");
+	}
+}
+
+// the next chunk of the part, 0 at the end, -1 on error
+static int part_source_fill(struct part_source *source)
+{
+	struct ooxml_workbook_writer *writer = source->writer;
+	struct writer_sheet *sheet = source->sheet;
+	struct text_buffer *chunk = &source->chunk;
+	chunk->length = 0;
+	source->pos = 0;
+	
+	while(0 == chunk->length) {
+		switch(source->stage) {
+		case 0:
+			text_buffer_append(chunk, source->head.data, source->head.length);
+			++source->stage;
+			break;
+		case 1:
+			if(sheet) {
+				text_buffer_reserve(chunk, SOURCE_CHUNK_SIZE);
+				chunk->length = fread(chunk->data, 1, SOURCE_CHUNK_SIZE, sheet->spool);
+				if(chunk->length == 0) {
+					if(ferror(sheet->spool)) {
+						zip_error_set(&source->error, ZIP_ER_READ, errno);
+						return -1;
+					}
+					++source->stage;
+				}
+			}else {
+				shared_strings_fill(writer, source);
+				if(source->next_string >= writer->strings.count) ++source->stage;
+			}
+			break;
+		case 2:
+			if(sheet) text_buffer_append(chunk, s_sheet_tail, sizeof(s_sheet_tail) - 1);
+			else text_buffer_append(chunk, s_shared_strings_tail, sizeof(s_shared_strings_tail) - 1);
+			++source->stage;
+			break;
+		default:
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int part_source_open(struct part_source *source)
+{
+	source->stage = 0;
+	source->pos = 0;
+	source->chunk.length = 0;
+	source->next_string = 0;
+	if(source->sheet && fseeko(source->sheet->spool, 0, SEEK_SET) != 0) {
+		zip_error_set(&source->error, ZIP_ER_READ, errno);
+		return -1;
+	}
+	return 0;
+}
+
+static ssize_t part_source_read(struct part_source *source, unsigned char *data, size_t length)
+{
+	size_t cb_read = 0;
+	while(cb_read < length) {
+		if(source->pos >= source->chunk.length) {
+			int rc = part_source_fill(source);
+			if(rc < 0) return -1;
+			if(rc == 0) break;
+		}
+		size_t cb = source->chunk.length - source->pos;
+		if(cb > length - cb_read) cb = length - cb_read;
+		memcpy(data + cb_read, source->chunk.data + source->pos, cb);
+		source->pos += cb;
+		cb_read += cb;
+	}
+	return cb_read;
+}
+
+static ssize_t on_read_part_source(void *user_data, unsigned char *buffer, size_t size)
+{
+	return part_source_read(user_data, buffer, size);
+}
+
+static zip_int64_t on_part_source(void *user_data, void *data, zip_uint64_t length, zip_source_cmd_t cmd)
+{
+	struct part_source *source = user_data;
+	switch(cmd) {
+	case ZIP_SOURCE_OPEN:
+		return part_source_open(source);
+	case ZIP_SOURCE_READ:
+		return part_source_read(source, data, length);
+	case ZIP_SOURCE_CLOSE:
+	case ZIP_SOURCE_FREE:	// owned by the writer
+		return 0;
+	case ZIP_SOURCE_STAT:
+		{
+			if(length < sizeof(zip_stat_t)) {
+				zip_error_set(&source->error, ZIP_ER_INVAL, 0);
+				return -1;
+			}
+			zip_stat_t *st = data;
+			zip_stat_init(st);
+			if(source->sheet) {
+				// known in advance, lets libzip decide on zip64 before it reads the data
+				st->size = source->head.length + source->sheet->cb_spool + sizeof(s_sheet_tail) - 1;
+				st->valid |= ZIP_STAT_SIZE;
+			}
+			return sizeof(zip_stat_t);
+		}
+	case ZIP_SOURCE_ERROR:
+		return zip_error_to_data(&source->error, data, length);
+	case ZIP_SOURCE_SUPPORTS:
+		return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE,
+			ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+	default:
+		break;
+	}
+	zip_error_set(&source->error, ZIP_ER_INVAL, 0);
+	return -1;
+}
+
+/*
+ * the parts go to libzip (ooxml->save_workers == 1), which deflates them one by one in zip_close(),
+ * or to a zip_writer which deflates them on a worker pool
+ */
+struct part_sink
+{
+	struct ooxml_private *priv;
+	zip_t *zip;
+	struct zip_writer *zip_writer;
+};
+
+static int part_sink_add(struct part_sink *sink, const char *part_name, int level, zip_source_t *src)
+{
+	zip_t *zip = sink->zip;
+	if(NULL == src) {
+		fprintf(stderr, "zip_source(%s) failed: %s\n", part_name, zip_strerror(zip));
+		return -1;
+	}
+	zip_int64_t index = zip_file_add(zip, part_name, src, ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8);
+	if(index < 0) {
+		fprintf(stderr, "zip_file_add(%s) failed: %s\n", part_name, zip_strerror(zip));
+		zip_source_free(src);
+		return -1;
+	}
+	zip_set_file_compression(zip, index, (0 == level)?ZIP_CM_STORE:ZIP_CM_DEFLATE, (level < 0)?0:level);
+	return 0;
+}
+
+// the buffer is handed over to the sink
+static int part_sink_add_buffer(struct part_sink *sink, const char *part_name, const char *content_type, struct text_buffer *buf)
+{
+	int level = ooxml_private_get_deflate_level(sink->priv, content_type);
+	int rc = -1;
+	if(sink->zip_writer) {
+		rc = zip_writer_add_buffer(sink->zip_writer, part_name, buf->data, buf->length, level, 1);
+		if(0 == rc) memset(buf, 0, sizeof(*buf));
+	}else {
+		zip_source_t *src = zip_source_buffer(sink->zip, buf->data, buf->length, 1);
+		if(src) memset(buf, 0, sizeof(*buf));
+		rc = part_sink_add(sink, part_name, level, src);
+	}
+	text_buffer_cleanup(buf);
+	return rc;
+}
+
+static int part_sink_add_source(struct part_sink *sink, const char *part_name, const char *content_type, struct part_source *source)
+{
+	int level = ooxml_private_get_deflate_level(sink->priv, content_type);
+	if(sink->zip_writer) {
+		if(part_source_open(source) != 0) return -1;
+		return zip_writer_add_stream(sink->zip_writer, part_name, on_read_part_source, source, level);
+	}
+	return part_sink_add(sink, part_name, level, zip_source_function(sink->zip, on_part_source, source));
+}
+
+int ooxml_workbook_writer_finish(struct ooxml_workbook_writer *writer)
+{
+	assert(writer);
+	if(writer->is_finished) return -1;
+	struct ooxml_context *ooxml = writer->ooxml;
+	struct ooxml_private *priv = ooxml->priv;
+	zip_t *zip = writer->zip;
+	if(priv->archive != zip) return -1;
+	
+	PERF_TRACE_BEGIN(span);
+	for(int i = 0; i < writer->num_sheets; ++i) {
+		if(fflush(writer->sheets[i]->spool) != 0) {
+			perror("fflush");
+			return -1;
+		}
+	}
+	
+	struct part_sink sink = { .priv = priv, .zip = zip };
+	if(ooxml->save_workers != 1) {
+		sink.zip_writer = zip_writer_new(priv->filename);
+		if(NULL == sink.zip_writer) return -1;
+	}
+	
+	struct text_buffer buf = { NULL };
+	int rc = 0;
+	build_content_types(writer, &buf);
+	rc = part_sink_add_buffer(&sink, "[Content_Types].xml", NULL, &buf);
+	if(0 == rc) {
+		build_package_rels(&buf);
+		rc = part_sink_add_buffer(&sink, "_rels/.rels", CONTENT_TYPE_RELATIONSHIPS, &buf);
+	}
+	if(0 == rc) {
+		build_workbook(writer, &buf);
+		rc = part_sink_add_buffer(&sink, "xl/workbook.xml", CONTENT_TYPE_WORKBOOK, &buf);
+	}
+	if(0 == rc) {
+		build_workbook_rels(writer, &buf);
+		rc = part_sink_add_buffer(&sink, "xl/_rels/workbook.xml.rels", CONTENT_TYPE_RELATIONSHIPS, &buf);
+	}
+	if(0 == rc) {
+		build_styles(&buf);
+		rc = part_sink_add_buffer(&sink, "xl/styles.xml", CONTENT_TYPE_STYLES, &buf);
+	}
+	
+	// sources[num_sheets] is the shared strings table
+	writer->sources = calloc(writer->num_sheets + 1, sizeof(*writer->sources));
+	assert(writer->sources);
+	for(int i = 0; i <= writer->num_sheets; ++i) {
+		struct part_source *source = &writer->sources[i];
+		source->writer = writer;
+		zip_error_init(&source->error);
+		if(i < writer->num_sheets) {
+			source->sheet = writer->sheets[i];
+			build_sheet_head(source->sheet, &source->head);
+		}else {
+			build_shared_strings_head(writer, &source->head);
+		}
+	}
+	for(int i = 0; 0 == rc && i <= writer->num_sheets; ++i) {
+		struct part_source *source = &writer->sources[i];
+		if(source->sheet) {
+			rc = part_sink_add_source(&sink, source->sheet->part_name, CONTENT_TYPE_WORKSHEET, source);
+		}else if(writer->strings.count > 0) {
+			rc = part_sink_add_source(&sink, "xl/sharedStrings.xml", CONTENT_TYPE_SHARED_STRINGS, source);
+		}
+	}
+	
+	// the parts are read and deflated now
+	writer->is_finished = 1;
+	priv->archive = NULL;
+	if(sink.zip_writer) {
+		if(0 == rc) rc = zip_writer_finish(sink.zip_writer, ooxml->save_workers);
+		zip_writer_free(sink.zip_writer);
+		zip_discard(zip);	// nothing has been added to it
+	}else {
+		if(0 == rc && zip_close(zip) != 0) {
+			fprintf(stderr, "zip_close(%s) failed: %s\n", priv->filename, zip_strerror(zip));
+			rc = -1;
+		}
+		if(rc) zip_discard(zip);
+	}
+	PERF_TRACE_END(span, "workbook_writer_finish", priv->filename);
+	
+	debug_printf("%s: %d sheets, %u strings (%lld references), rc=%d", priv->filename,
+		writer->num_sheets, writer->strings.count, (long long)writer->num_string_refs, rc);
+	return rc;
+}
+
+
+#if defined(TEST_OOXML_WORKBOOK_WRITER_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
@@ -0,0 +1,343 @@
+/*
+ * perf_trace.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "app.h"
+#include "perf_trace.h"
+
+#define PERF_TRACE_MAX_STAGES (64)
+
+volatile int g_perf_trace_enabled;
+
+struct perf_trace_event
+{
+	const char *stage;
+	char *detail;
+	uint64_t start_ns;
+	uint64_t duration_ns;
+	int tid;
+};
+
+struct perf_trace_stage
+{
+	const char *name;
+	int64_t count;
+	uint64_t total_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+};
+
+static const char *s_counter_names[perf_trace_counters_count] = {
+	[perf_trace_counter_parts_loaded] = "parts_loaded",
+	[perf_trace_counter_parts_cached] = "parts_cached",
+	[perf_trace_counter_bytes_inflated] = "bytes_inflated",
+	[perf_trace_counter_nodes_parsed] = "nodes_parsed",
+	[perf_trace_counter_parts_unparsed] = "parts_unparsed",
+	[perf_trace_counter_rows_streamed] = "rows_streamed",
+	[perf_trace_counter_scanner_fallbacks] = "scanner_fallbacks",
+};
+
+static struct
+{
+	pthread_mutex_t mutex;
+	uint64_t start_ns;
+	
+	int print_summary;
+	char *chrome_trace_file;
+	
+	ssize_t max_events;
+	ssize_t num_events;
+	ssize_t max_size;
+	int64_t num_dropped;
+	struct perf_trace_event *events;
+	
+	int num_stages;
+	struct perf_trace_stage stages[PERF_TRACE_MAX_STAGES];
+	
+	volatile int64_t counters[perf_trace_counters_count];
+	volatile int next_tid;
+}s_trace = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread int s_tid;
+static int get_tid(void)
+{
+	if(0 == s_tid) s_tid = __sync_add_and_fetch(&s_trace.next_tid, 1);
+	return s_tid;
+}
+
+uint64_t perf_trace_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int perf_trace_init(json_object *jconfig)
+{
+	if(NULL == jconfig) return -1;
+	
+	json_object *jvalue = NULL;
+	int enabled = 0;
+	if(json_object_object_get_ex(jconfig, "enabled", &jvalue)) enabled = json_object_get_boolean(jvalue);
+	if(!enabled) return 0;
+	
+	pthread_mutex_lock(&s_trace.mutex);
+	s_trace.print_summary = 1;
+	s_trace.max_events = 1000000;
+	if(json_object_object_get_ex(jconfig, "summary", &jvalue)) {
+		s_trace.print_summary = json_object_get_boolean(jvalue);
+	}
+	if(json_object_object_get_ex(jconfig, "chrome_trace_file", &jvalue)) {
+		const char *filename = json_object_get_string(jvalue);
+		if(filename && filename[0]) s_trace.chrome_trace_file = strdup(filename);
+	}
+	if(json_object_object_get_ex(jconfig, "max_events", &jvalue)) {
+		s_trace.max_events = json_object_get_int64(jvalue);
+	}
+	s_trace.start_ns = perf_trace_now();
+	get_tid();	// the calling (main) thread is tid 1
+	pthread_mutex_unlock(&s_trace.mutex);
+	
+	g_perf_trace_enabled = 1;
+	return 0;
+}
+
+void perf_trace_cleanup(void)
+{
+	if(!g_perf_trace_enabled) return;
+	g_perf_trace_enabled = 0;
+	
+	if(s_trace.print_summary) perf_trace_print_summary(stderr);
+	if(s_trace.chrome_trace_file) perf_trace_write_chrome_trace(s_trace.chrome_trace_file);
+	
+	pthread_mutex_lock(&s_trace.mutex);
+	for(ssize_t i = 0; i < s_trace.num_events; ++i) free(s_trace.events[i].detail);
+	free(s_trace.events);
+	s_trace.events = NULL;
+	s_trace.num_events = 0;
+	s_trace.max_size = 0;
+	
+	free(s_trace.chrome_trace_file);
+	s_trace.chrome_trace_file = NULL;
+	pthread_mutex_unlock(&s_trace.mutex);
+}
+
+static struct perf_trace_stage *find_or_add_stage(const char *name)
+{
+	for(int i = 0; i < s_trace.num_stages; ++i) {
+		struct perf_trace_stage *stage = &s_trace.stages[i];
+		if(stage->name == name || strcmp(stage->name, name) == 0) return stage;
+	}
+	if(s_trace.num_stages >= PERF_TRACE_MAX_STAGES) return NULL;
+	
+	struct perf_trace_stage *stage = &s_trace.stages[s_trace.num_stages++];
+	stage->name = name;
+	return stage;
+}
+
+void perf_trace_add_span(const char *stage_name, const char *detail, uint64_t start_ns, uint64_t end_ns)
+{
+	if(!g_perf_trace_enabled || NULL == stage_name) return;
+	uint64_t duration = (end_ns > start_ns)?(end_ns - start_ns):0;
+	int tid = get_tid();
+	
+	pthread_mutex_lock(&s_trace.mutex);
+	struct perf_trace_stage *stage = find_or_add_stage(stage_name);
+	if(stage) {
+		if(0 == stage->count || duration < stage->min_ns) stage->min_ns = duration;
+		if(duration > stage->max_ns) stage->max_ns = duration;
+		stage->total_ns += duration;
+		++stage->count;
+	}
+	
+	if(s_trace.num_events >= s_trace.max_events) {
+		++s_trace.num_dropped;
+		pthread_mutex_unlock(&s_trace.mutex);
+		return;
+	}
+	if(s_trace.num_events >= s_trace.max_size) {
+		ssize_t new_size = s_trace.max_size?(s_trace.max_size * 2):4096;
+		struct perf_trace_event *events = realloc(s_trace.events, new_size * sizeof(*events));
+		assert(events);
+		s_trace.events = events;
+		s_trace.max_size = new_size;
+	}
+	struct perf_trace_event *event = &s_trace.events[s_trace.num_events++];
+	event->stage = stage_name;
+	event->detail = detail?strdup(detail):NULL;
+	event->start_ns = start_ns;
+	event->duration_ns = duration;
+	event->tid = tid;
+	pthread_mutex_unlock(&s_trace.mutex);
+}
+
+void perf_trace_count(enum perf_trace_counter counter, int64_t value)
+{
+	if(counter < 0 || counter >= perf_trace_counters_count) return;
+	__sync_fetch_and_add(&s_trace.counters[counter], value);
+}
+
+static int compare_stage_total(const void *a, const void *b)
+{
+	const struct perf_trace_stage *stage_a = a;
+	const struct perf_trace_stage *stage_b = b;
+	if(stage_a->total_ns == stage_b->total_ns) return 0;
+	return (stage_a->total_ns > stage_b->total_ns)?-1:1;
+}
+
+static int compare_event_duration(const void *a, const void *b)
+{
+	const struct perf_trace_event *event_a = *(const struct perf_trace_event **)a;
+	const struct perf_trace_event *event_b = *(const struct perf_trace_event **)b;
+	if(event_a->duration_ns == event_b->duration_ns) return 0;
+	return (event_a->duration_ns > event_b->duration_ns)?-1:1;
+}
+
+void perf_trace_print_summary(FILE *fp)
+{
+	if(NULL == fp) fp = stderr;
+	
+	pthread_mutex_lock(&s_trace.mutex);
+	int num_stages = s_trace.num_stages;
+	struct perf_trace_stage stages[PERF_TRACE_MAX_STAGES];
+	memcpy(stages, s_trace.stages, sizeof(stages[0]) * num_stages);
+	qsort(stages, num_stages, sizeof(stages[0]), compare_stage_total);
+	
+	double elapsed_ms = (double)(perf_trace_now() - s_trace.start_ns) / 1000000.0;
+	fprintf(fp, "==== perf trace: %.3f ms ====\n", elapsed_ms);
+	fprintf(fp, "%-32s %10s %12s %10s %10s %10s\n", "stage", "count", "total(ms)", "avg(ms)", "min(ms)", "max(ms)");
+	for(int i = 0; i < num_stages; ++i) {
+		const struct perf_trace_stage *stage = &stages[i];
+		fprintf(fp, "%-32s %10ld %12.3f %10.3f %10.3f %10.3f\n",
+			stage->name, (long)stage->count,
+			stage->total_ns / 1000000.0,
+			stage->count?(stage->total_ns / 1000000.0 / stage->count):0.0,
+			stage->min_ns / 1000000.0,
+			stage->max_ns / 1000000.0);
+	}
+	
+	fprintf(fp, "-- counters --\n");
+	for(int i = 0; i < perf_trace_counters_count; ++i) {
+		fprintf(fp, "%-32s %10ld\n", s_counter_names[i], (long)s_trace.counters[i]);
+	}
+	
+	// slowest single spans, with the part name
+	ssize_t num_events = s_trace.num_events;
+	if(num_events > 0) {
+		const struct perf_trace_event **events = calloc(num_events, sizeof(*events));
+		assert(events);
+		for(ssize_t i = 0; i < num_events; ++i) events[i] = &s_trace.events[i];
+		qsort(events, num_events, sizeof(*events), compare_event_duration);
+		
+		fprintf(fp, "-- slowest spans --\n");
+		for(ssize_t i = 0; i < num_events && i < 10; ++i) {
+			fprintf(fp, "%10.3f ms  %-24s %s\n",
+				events[i]->duration_ns / 1000000.0,
+				events[i]->stage,
+				events[i]->detail?events[i]->detail:"");
+		}
+		free(events);
+	}
+	if(s_trace.num_dropped > 0) {
+		fprintf(fp, "(%ld spans were not recorded, max_events=%ld)\n", (long)s_trace.num_dropped, (long)s_trace.max_events);
+	}
+	pthread_mutex_unlock(&s_trace.mutex);
+}
+
+static void write_json_string(FILE *fp, const char *text)
+{
+	fputc('"', fp);
+	for(const unsigned char *p = (const unsigned char *)text; *p; ++p) {
+		switch(*p) {
+		case '"': fputs("\\\"", fp); break;
+		case '\\': fputs("\\\\", fp); break;
+		default:
+			if(*p < 0x20) fprintf(fp, "\\u%.4x", *p);
+			else fputc(*p, fp);
+		}
+	}
+	fputc('"', fp);
+}
+
+int perf_trace_write_chrome_trace(const char *filename)
+{
+	assert(filename);
+	FILE *fp = fopen(filename, "w");
+	if(NULL == fp) {
+		perror(filename);
+		return -1;
+	}
+	
+	long pid = getpid();
+	pthread_mutex_lock(&s_trace.mutex);
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for(ssize_t i = 0; i < s_trace.num_events; ++i) {
+		const struct perf_trace_event *event = &s_trace.events[i];
+		fprintf(fp, "{\"name\":");
+		write_json_string(fp, event->stage);
+		fprintf(fp, ",\"cat\":\"ooxml\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%d",
+			(double)(event->start_ns - s_trace.start_ns) / 1000.0,
+			(double)event->duration_ns / 1000.0,
+			pid, event->tid);
+		if(event->detail) {
+			fprintf(fp, ",\"args\":{\"part\":");
+			write_json_string(fp, event->detail);
+			fputc('}', fp);
+		}
+		fprintf(fp, "},\n");
+	}
+	
+	// final counter values
+	fprintf(fp, "{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%ld,\"tid\":1,\"args\":{",
+		(double)(perf_trace_now() - s_trace.start_ns) / 1000.0, pid);
+	for(int i = 0; i < perf_trace_counters_count; ++i) {
+		fprintf(fp, "%s\"%s\":%ld", (i > 0)?",":"", s_counter_names[i], (long)s_trace.counters[i]);
+	}
+	fprintf(fp, "}}\n]}\n");
+	pthread_mutex_unlock(&s_trace.mutex);
+	
+	fclose(fp);
+	return 0;
+}
+
+
+#if defined(TEST_PERF_TRACE_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
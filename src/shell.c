@@ -36,7 +36,11 @@
 #include "shell_private.h"
 #include "app.h"
 #include "ooxml_context.h"
+#include "perf_trace.h"
 
+#include "ui/archive_tree_model.c"
+#include "ui/text_viewer.c"
+#include "ui/archive_loader.c"
 #include "ui/main_window.c"
 
 static int shell_init(struct shell_context *shell, json_object *jconfig);
@@ -55,6 +59,12 @@ static void shell_private_free(struct shell_private *priv)
 {
 	if(NULL == priv) return;
 	
+	archive_loader_free(priv->loader);
+	priv->loader = NULL;
+	free(priv->pending_filename);
+	priv->pending_filename = NULL;
+	text_viewer_free(priv->viewer);
+	priv->viewer = NULL;
 	///< @todo
 	free(priv);
 	return;
@@ -87,6 +97,11 @@ void shell_context_cleanup(struct shell_context *shell)
 static int shell_init(struct shell_context *shell, json_object *jconfig)
 {
 	init_windows(shell);
+	
+	json_object *jviewer = NULL;
+	if(jconfig && json_object_object_get_ex(jconfig, "viewer", &jviewer)) {
+		text_viewer_load_config(shell->priv->viewer, jviewer);
+	}
 	return 0;
 }
 static int shell_run(struct shell_context *shell)
@@ -98,113 +113,35 @@ static int shell_run(struct shell_context *shell)
 }
 static int shell_stop(struct shell_context *shell)
 {
+	// no background work may outlive the main loop
+	if(shell->priv) {
+		archive_loader_wait(shell->priv->loader);
+		text_viewer_cancel(shell->priv->viewer);
+	}
 	gtk_main_quit();
 	return 0;
 }
 
-static void ooxml_zip_file_free_array(ssize_t num_entries, struct ooxml_zip_file *files)
-{
-	if(files) {
-		for(ssize_t i = 0; i < num_entries; ++i) {
-			ooxml_zip_file_clear(&files[i]);
-		}
-		free(files);
-	}
-}
-
-struct dir_info {
-	char *path;
-	GtkTreeIter iter;
-};
-void dir_info_free_array(ssize_t num_dirs, struct dir_info *folders)
-{
-	for(ssize_t i = 0; i < num_dirs; ++i) {
-		if(folders[i].path && strcmp(folders[i].path, ".") != 0) free(folders[i].path);
-	}
-	free(folders);
-}
-
-struct dir_info *find_dir_by_name(ssize_t num_dirs, struct dir_info *folders, const char *dir_name)
-{
-	assert(dir_name);
-	for(ssize_t i = 0; i < num_dirs; ++i) {
-		if(NULL == folders[i].path) continue;
-		if(strcmp(folders[i].path, dir_name) == 0) return &folders[i];
-	}
-	return NULL;
-}
-
 static void shell_update_archive_list(struct shell_context *shell)
 {
 	assert(shell && shell->priv);
 	struct shell_private *priv = shell->priv;
-	
-	GtkTreeStore *store = gtk_tree_store_new(ARCHIVE_FILES_LIST_COLUMNS_COUNT, 
-		G_TYPE_STRING, // file name
-		G_TYPE_INT64, // file size
-		G_TYPE_UINT64, // index
-		G_TYPE_STRING, // modification datetime
-		G_TYPE_INT, // row_type
-		G_TYPE_POINTER
-	);
-	
-	GtkTreeIter root, item;
-	// set root item
-	gtk_tree_store_append(store, &root, NULL);
-	gtk_tree_store_set(store, &root, 
-		ARCHIVE_FILES_LIST_COLUMN_name, priv->archive_name, 
-		ARCHIVE_FILES_LIST_COLUMN_row_type, -1,
-		-1);
-	
-	int num_dirs = 0;
-	int max_dirs = 4096;
-	struct dir_info *folders = calloc(max_dirs, sizeof(*folders));
-	assert(folders);
-	
-	folders[0].path = ".";
-	folders[0].iter = root;
-	++num_dirs;
-	
-	for(ssize_t i = 0; i < priv->num_entries; ++i) {
-		struct ooxml_zip_file *file = &priv->files[i];
-		char path_name[PATH_MAX] = "";
-		strncpy(path_name, file->filename, sizeof(path_name));
-		
-		char *file_name = basename(path_name);
-		char *dir_name = dirname(path_name);
-		
-		struct dir_info *folder = find_dir_by_name(num_dirs, folders, dir_name);
-		if(NULL == folder) {
-			assert(num_dirs < max_dirs);
-			folder = &folders[num_dirs++];
-			folder->path = strdup(dir_name);
-			gtk_tree_store_append(store, &folder->iter, &root);
-			gtk_tree_store_set(store, &folder->iter, 
-				ARCHIVE_FILES_LIST_COLUMN_name, dir_name, 
-				ARCHIVE_FILES_LIST_COLUMN_row_type, 1,
-				-1);
-		}
-		gtk_tree_store_append(store, &item, &folder->iter);
-		
-		struct tm t[1];
-		char sz_time[100] = "";
-		memset(t, 0, sizeof(t));
-		localtime_r((time_t *)&file->mtime, t);
-		strftime(sz_time, sizeof(sz_time), "%Y/%m/%d %H:%M:%S", t);
-		
-		gtk_tree_store_set(store, &item, 
-			ARCHIVE_FILES_LIST_COLUMN_name, file_name,
-			ARCHIVE_FILES_LIST_COLUMN_size, file->file_length,
-			ARCHIVE_FILES_LIST_COLUMN_index, file->index,
-			ARCHIVE_FILES_LIST_COLUMN_mtime, sz_time,
-			ARCHIVE_FILES_LIST_COLUMN_row_type, 0,
-			ARCHIVE_FILES_LIST_COLUMN_data_ptr, file,
-			-1);
-	}
-	dir_info_free_array(num_dirs, folders);
-	gtk_tree_view_set_model(GTK_TREE_VIEW(priv->archive_files_list), GTK_TREE_MODEL(store));
-	
-	gtk_tree_view_expand_all(GTK_TREE_VIEW(priv->archive_files_list));
+	PERF_TRACE_BEGIN(span);
+	
+	// rows are served from the entry table on demand, nothing is copied here
+	struct ooxml_context *ooxml = app_get_ooxml_context(shell->app);
+	const struct ooxml_dir_node *dir_tree = priv->files?ooxml->get_dir_tree(ooxml):NULL;
+	GtkTreeModel *model = archive_tree_model_new(priv->archive_name, dir_tree, priv->files);
+	
+	GtkTreeView *tree = GTK_TREE_VIEW(priv->archive_files_list);
+	gtk_tree_view_set_model(tree, model);
+	g_object_unref(model);
+	
+	// only expand the archive row, expanding everything would realize every entry
+	GtkTreePath *path = gtk_tree_path_new_first();
+	gtk_tree_view_expand_row(tree, path, FALSE);
+	gtk_tree_path_free(path);
+	PERF_TRACE_END(span, "shell_update_archive_list", priv->archive_name);
 	return;
 	
 }
@@ -229,16 +166,29 @@ int shell_load_ooxml_file(struct shell_context *shell, const char *filename)
 	
 	
 	gdk_window_set_cursor(window, cursor_wait);
-	// reset data
-	if(priv->files)
-	{
-		ooxml_zip_file_free_array(priv->num_entries, priv->files);
-		priv->num_entries = 0;
-		priv->files = NULL;
+	// the loader, the list model and the viewer's reader use the current archive, stop them before it is closed
+	if(archive_loader_cancel(priv->loader)) {
+		// its workers are finishing their last parts, on_archive_loader_stopped() opens the file
+		char *pending = strdup(filename);
+		assert(pending);
+		free(priv->pending_filename);
+		priv->pending_filename = pending;
+		return 0;
 	}
+	gtk_tree_view_set_model(GTK_TREE_VIEW(priv->archive_files_list), NULL);
+	text_viewer_show(priv->viewer, ooxml, NULL);
+	
+	// reset data (the entries are owned by the ooxml context)
+	priv->num_entries = 0;
+	priv->files = NULL;
 	
+	// open() only reads the central directory here, 
+	// the parts are loaded in the background whatever lazy_mode is
 	const int readonly = 1;
+	int lazy_mode = ooxml->lazy_mode;
+	ooxml->lazy_mode = 1;
 	int rc = ooxml->open(ooxml, filename, readonly);
+	ooxml->lazy_mode = lazy_mode;
 	assert(0 == rc);
 	
 	strncpy(priv->archive_name, filename, sizeof(priv->archive_name));
@@ -246,30 +196,11 @@ int shell_load_ooxml_file(struct shell_context *shell, const char *filename)
 	debug_printf("num_entries: %ld", (long)num_entries);
 	
 	priv->num_entries = num_entries;
-	if(num_entries > 0) {
-		struct ooxml_zip_file *files = calloc(num_entries, sizeof(*files));
-		assert(files);
-		priv->files = files;
-		
-		for(ssize_t i = 0; i < num_entries; ++i) {
-			struct ooxml_zip_file *file = &files[i];
-			int rc = ooxml->get_file(ooxml, i, file, 1);
-			
-			printf("==== %s(cb=%ld) ====\n", file->filename, (long)file->file_length);
-			if(0 == rc && file->cb_data > 0) {
-				if(file->doc) {
-					printf("xml: \n");
-					xmlDocDump(stdout, file->doc);
-				}else {
-					printf("raw_data: \n");
-					fwrite(file->data, 1, file->cb_data, stdout);
-				}
-			}
-		}
-	}
+	if(num_entries > 0) priv->files = ooxml->get_entry(ooxml, 0, 0);
 	
 	// update ui
 	shell_update_archive_list(shell);
+	if(num_entries > 0) archive_loader_start(priv->loader, ooxml, filename);
 	
 	gdk_window_set_cursor(window, cursor_default);
 	return 0;
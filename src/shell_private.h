@@ -22,6 +22,9 @@ struct shell_private
 	GtkWidget *archive_files_list;
 	GtkWidget *stack;
 	GtkWidget *textview;
+	struct text_viewer *viewer;
+	struct archive_loader *loader;
+	char *pending_filename;		// chosen while the loader was cancelling
 	
 	char archive_name[PATH_MAX];
 	ssize_t num_entries;
@@ -0,0 +1,247 @@
+/*
+ * archive_loader.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <gtk/gtk.h>
+#include "ooxml_context.h"
+#include "perf_trace.h"
+
+/*
+ * background loading of all parts of the open archive (ooxml->load_entries() on a worker pool).
+ * the workers post progress messages to the main loop, each message carries the generation
+ * of its job so that messages of an older job are ignored.
+ * a cancelled job keeps reading the archive until its final message, which frees it and
+ * calls on_stopped(): the archive may only be closed from there (or once archive_loader_cancel() returns 0).
+ */
+struct archive_loader_job
+{
+	struct archive_loader *loader;
+	unsigned int generation;
+	pthread_t th;
+	volatile int cancel;
+	
+	struct ooxml_context *ooxml;
+	int num_workers;
+	char *filename;
+	uint64_t start_ns;
+	
+	volatile int last_permille;	// progress posted so far, shared by the workers
+};
+
+struct archive_loader_message
+{
+	struct archive_loader *loader;
+	unsigned int generation;
+	ssize_t num_done;
+	ssize_t num_entries;
+	ssize_t num_loaded;	// set in the final message
+	int finished;
+};
+
+struct archive_loader
+{
+	GtkWidget *progress_bar;
+	GtkWidget *cancel_button;
+	unsigned int generation;	// main thread only
+	struct archive_loader_job *job;	// running, cancelled or not
+	
+	void (*on_stopped)(void *user_data);	// after the final message of a job
+	void *user_data;
+};
+
+static gboolean on_archive_loader_message(gpointer user_data);
+
+static void archive_loader_post(struct archive_loader_job *job,
+	ssize_t num_done, ssize_t num_entries, ssize_t num_loaded, int finished)
+{
+	struct archive_loader_message *msg = calloc(1, sizeof(*msg));
+	assert(msg);
+	msg->loader = job->loader;
+	msg->generation = job->generation;
+	msg->num_done = num_done;
+	msg->num_entries = num_entries;
+	msg->num_loaded = num_loaded;
+	msg->finished = finished;
+	g_idle_add(on_archive_loader_message, msg);
+}
+
+// worker threads: post at most one message per 0.1%
+static void on_archive_loader_progress(void *user_data, ssize_t num_done, ssize_t num_entries)
+{
+	struct archive_loader_job *job = user_data;
+	if(num_entries <= 0) return;
+	
+	int permille = (int)(num_done * 1000 / num_entries);
+	int last = job->last_permille;
+	if(permille <= last) return;
+	if(!__sync_bool_compare_and_swap(&job->last_permille, last, permille)) return;
+	
+	archive_loader_post(job, num_done, num_entries, 0, 0);
+}
+
+static void *archive_loader_thread(void *user_data)
+{
+	struct archive_loader_job *job = user_data;
+	struct ooxml_context *ooxml = job->ooxml;
+	
+	ssize_t num_loaded = ooxml->load_entries(ooxml, job->num_workers, on_archive_loader_progress, job, &job->cancel);
+	ssize_t num_entries = ooxml->get_num_entries(ooxml);
+	archive_loader_post(job, -1, num_entries, num_loaded, 1);
+	pthread_exit((void *)(long)0);
+}
+
+static void archive_loader_job_free(struct archive_loader_job *job)
+{
+	if(NULL == job) return;
+	free(job->filename);
+	free(job);
+}
+
+static gboolean on_archive_loader_message(gpointer user_data)
+{
+	struct archive_loader_message *msg = user_data;
+	struct archive_loader *loader = msg->loader;
+	struct archive_loader_job *job = loader->job;
+	
+	if(NULL == job || msg->generation != loader->generation) {
+		free(msg);	// from a cancelled job
+		return G_SOURCE_REMOVE;
+	}
+	
+	char text[200] = "";
+	if(msg->finished) {
+		pthread_join(job->th, NULL);
+		loader->job = NULL;
+		
+		debug_printf("%s: %ld of %ld parts loaded%s", job->filename,
+			(long)msg->num_loaded, (long)msg->num_entries, job->cancel?" (cancelled)":"");
+		PERF_TRACE_END(job->start_ns, "archive_loader", job->filename);
+		archive_loader_job_free(job);
+		
+		gtk_widget_hide(loader->progress_bar);
+		gtk_widget_hide(loader->cancel_button);
+		if(loader->on_stopped) loader->on_stopped(loader->user_data);
+	}else if(!job->cancel) {
+		snprintf(text, sizeof(text), "loading parts: %ld / %ld", (long)msg->num_done, (long)msg->num_entries);
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(loader->progress_bar), (gdouble)msg->num_done / (gdouble)msg->num_entries);
+		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(loader->progress_bar), text);
+	}
+	free(msg);
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * ask the current job to stop, its workers finish at most one part each.
+ * does not block the ui, the final message cleans up.
+ * returns 1 while a job still uses the archive, 0 if none
+ */
+static int archive_loader_cancel(struct archive_loader *loader)
+{
+	struct archive_loader_job *job = loader->job;
+	if(NULL == job) return 0;
+	
+	if(!job->cancel) {
+		job->cancel = 1;
+		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(loader->progress_bar), "cancelling ...");
+		gtk_widget_set_sensitive(loader->cancel_button, FALSE);
+	}
+	return 1;
+}
+
+static void on_archive_loader_cancel_clicked(GtkWidget *button, struct archive_loader *loader)
+{
+	archive_loader_cancel(loader);
+}
+
+static void archive_loader_start(struct archive_loader *loader, struct ooxml_context *ooxml, const char *filename)
+{
+	assert(NULL == loader->job);	// the archive was re-opened after on_stopped()
+	
+	struct archive_loader_job *job = calloc(1, sizeof(*job));
+	assert(job);
+	job->loader = loader;
+	job->generation = ++loader->generation;
+	job->ooxml = ooxml;
+	job->num_workers = ooxml->num_workers;
+	job->filename = strdup(filename);
+	job->start_ns = g_perf_trace_enabled?perf_trace_now():0;
+	
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(loader->progress_bar), 0.0);
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(loader->progress_bar), "loading parts ...");
+	gtk_widget_set_sensitive(loader->cancel_button, TRUE);
+	gtk_widget_show(loader->progress_bar);
+	gtk_widget_show(loader->cancel_button);
+	
+	int rc = pthread_create(&job->th, NULL, archive_loader_thread, job);
+	assert(0 == rc);
+	loader->job = job;
+}
+
+static struct archive_loader *archive_loader_new(GtkHeaderBar *header_bar)
+{
+	struct archive_loader *loader = calloc(1, sizeof(*loader));
+	assert(loader);
+	
+	GtkWidget *cancel_button = gtk_button_new_from_icon_name("process-stop", GTK_ICON_SIZE_BUTTON);
+	GtkWidget *progress_bar = gtk_progress_bar_new();
+	gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(progress_bar), TRUE);
+	g_signal_connect(cancel_button, "clicked", G_CALLBACK(on_archive_loader_cancel_clicked), loader);
+	
+	// only shown while a job runs
+	gtk_widget_set_no_show_all(progress_bar, TRUE);
+	gtk_widget_set_no_show_all(cancel_button, TRUE);
+	gtk_header_bar_pack_end(header_bar, cancel_button);
+	gtk_header_bar_pack_end(header_bar, progress_bar);
+	
+	loader->progress_bar = progress_bar;
+	loader->cancel_button = cancel_button;
+	return loader;
+}
+
+// when quitting: the final message will not be handled any more, stop and wait for the job here
+static void archive_loader_wait(struct archive_loader *loader)
+{
+	struct archive_loader_job *job = loader->job;
+	if(NULL == job) return;
+	
+	job->cancel = 1;
+	pthread_join(job->th, NULL);
+	loader->job = NULL;
+	++loader->generation;	// drop its pending messages
+	archive_loader_job_free(job);
+}
+
+static void archive_loader_free(struct archive_loader *loader)
+{
+	if(NULL == loader) return;
+	archive_loader_wait(loader);
+	free(loader);
+}
@@ -0,0 +1,370 @@
+/*
+ * archive_tree_model.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include <gtk/gtk.h>
+#include "shell_private.h"
+#include "ooxml_context.h"
+
+/*
+ * read-only GtkTreeModel over the directory index and the entry table of an ooxml context.
+ * nothing is copied: rows are addressed by (containing directory, position),
+ * column values (e.g. the mtime string) are built only when the view asks for them.
+ *
+ * the model borrows the dir tree and the entries,
+ * it must be detached from the view before the archive is closed.
+ */
+typedef struct _ArchiveTreeModel ArchiveTreeModel;
+typedef struct _ArchiveTreeModelClass ArchiveTreeModelClass;
+struct _ArchiveTreeModel
+{
+	GObject parent;
+	gint stamp;
+	
+	char *archive_name;
+	const struct ooxml_dir_node *tree;	// root dir, NULL: empty model
+	struct ooxml_zip_file *files;		// entry table
+};
+struct _ArchiveTreeModelClass
+{
+	GObjectClass parent_class;
+};
+
+#define ARCHIVE_TYPE_TREE_MODEL		(archive_tree_model_get_type())
+#define ARCHIVE_TREE_MODEL(obj)		(G_TYPE_CHECK_INSTANCE_CAST((obj), ARCHIVE_TYPE_TREE_MODEL, ArchiveTreeModel))
+
+static void archive_tree_model_iface_init(GtkTreeModelIface *iface);
+G_DEFINE_TYPE_WITH_CODE(ArchiveTreeModel, archive_tree_model, G_TYPE_OBJECT,
+	G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, archive_tree_model_iface_init))
+
+/*
+ * iter:
+ *   user_data:  the directory that contains the row, NULL for the archive (top-level) row
+ *   user_data2: position in that directory, sub-directories first, then files
+ */
+#define ITER_DIR(iter)		((const struct ooxml_dir_node *)(iter)->user_data)
+#define ITER_POS(iter)		GPOINTER_TO_INT((iter)->user_data2)
+
+static inline gint dir_num_children(const struct ooxml_dir_node *dir)
+{
+	return (gint)(dir->num_dirs + dir->num_files);
+}
+
+static inline void archive_iter_set(ArchiveTreeModel *model, GtkTreeIter *iter, const struct ooxml_dir_node *dir, gint pos)
+{
+	iter->stamp = model->stamp;
+	iter->user_data = (gpointer)dir;
+	iter->user_data2 = GINT_TO_POINTER(pos);
+	iter->user_data3 = NULL;
+}
+
+// the directory a row stands for, NULL for file rows
+static const struct ooxml_dir_node *archive_iter_get_node(ArchiveTreeModel *model, GtkTreeIter *iter)
+{
+	const struct ooxml_dir_node *dir = ITER_DIR(iter);
+	if(NULL == dir) return model->tree;
+	
+	gint pos = ITER_POS(iter);
+	if(pos < dir->num_dirs) return dir->dirs[pos];
+	return NULL;
+}
+
+static struct ooxml_zip_file *archive_iter_get_file(ArchiveTreeModel *model, GtkTreeIter *iter)
+{
+	const struct ooxml_dir_node *dir = ITER_DIR(iter);
+	if(NULL == dir || NULL == model->files) return NULL;
+	
+	gint pos = ITER_POS(iter);
+	if(pos < dir->num_dirs) return NULL;
+	return &model->files[dir->files[pos - dir->num_dirs]];
+}
+
+// position of a sub-directory in its parent
+static gint dir_get_position(const struct ooxml_dir_node *dir)
+{
+	const struct ooxml_dir_node *parent = dir->parent;
+	for(ssize_t i = 0; i < parent->num_dirs; ++i) {
+		if(parent->dirs[i] == dir) return (gint)i;
+	}
+	assert(0);
+	return -1;
+}
+
+/******************************************************************************
+ * GtkTreeModel interface
+******************************************************************************/
+static GtkTreeModelFlags archive_tree_model_get_flags(GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint archive_tree_model_get_n_columns(GtkTreeModel *tree_model)
+{
+	return ARCHIVE_FILES_LIST_COLUMNS_COUNT;
+}
+
+static GType archive_tree_model_get_column_type(GtkTreeModel *tree_model, gint index)
+{
+	switch(index) {
+	case ARCHIVE_FILES_LIST_COLUMN_name: return G_TYPE_STRING;
+	case ARCHIVE_FILES_LIST_COLUMN_size: return G_TYPE_INT64;
+	case ARCHIVE_FILES_LIST_COLUMN_index: return G_TYPE_UINT64;
+	case ARCHIVE_FILES_LIST_COLUMN_mtime: return G_TYPE_STRING;
+	case ARCHIVE_FILES_LIST_COLUMN_row_type: return G_TYPE_INT;
+	case ARCHIVE_FILES_LIST_COLUMN_data_ptr: return G_TYPE_POINTER;
+	default: break;
+	}
+	return G_TYPE_INVALID;
+}
+
+static gboolean archive_tree_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+	ArchiveTreeModel *model = ARCHIVE_TREE_MODEL(tree_model);
+	gint depth = gtk_tree_path_get_depth(path);
+	gint *indices = gtk_tree_path_get_indices(path);
+	if(NULL == model->tree || depth < 1 || indices[0] != 0) return FALSE;
+	
+	if(depth == 1) {
+		archive_iter_set(model, iter, NULL, 0);
+		return TRUE;
+	}
+	
+	const struct ooxml_dir_node *dir = model->tree;
+	for(gint i = 1; i < depth; ++i) {
+		gint pos = indices[i];
+		if(pos < 0 || pos >= dir_num_children(dir)) return FALSE;
+		if(i == (depth - 1)) {
+			archive_iter_set(model, iter, dir, pos);
+			return TRUE;
+		}
+		if(pos >= dir->num_dirs) return FALSE;	// files have no children
+		dir = dir->dirs[pos];
+	}
+	return FALSE;
+}
+
+static GtkTreePath *archive_tree_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	ArchiveTreeModel *model = ARCHIVE_TREE_MODEL(tree_model);
+	g_return_val_if_fail(iter->stamp == model->stamp, NULL);
+	
+	GtkTreePath *path = gtk_tree_path_new();
+	const struct ooxml_dir_node *dir = ITER_DIR(iter);
+	if(dir) {
+		gtk_tree_path_prepend_index(path, ITER_POS(iter));
+		for(; dir != model->tree; dir = dir->parent) {
+			gtk_tree_path_prepend_index(path, dir_get_position(dir));
+		}
+	}
+	gtk_tree_path_prepend_index(path, 0);	// the archive row
+	return path;
+}
+
+static void archive_tree_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value)
+{
+	ArchiveTreeModel *model = ARCHIVE_TREE_MODEL(tree_model);
+	g_return_if_fail(iter->stamp == model->stamp);
+	g_return_if_fail(column >= 0 && column < ARCHIVE_FILES_LIST_COLUMNS_COUNT);
+	
+	g_value_init(value, archive_tree_model_get_column_type(tree_model, column));
+	
+	const struct ooxml_dir_node *dir = ITER_DIR(iter);
+	const struct ooxml_dir_node *node = archive_iter_get_node(model, iter);
+	struct ooxml_zip_file *file = archive_iter_get_file(model, iter);
+	
+	switch(column) {
+	case ARCHIVE_FILES_LIST_COLUMN_name:
+		if(NULL == dir) {
+			g_value_set_string(value, model->archive_name);
+		}else if(node) {
+			g_value_set_string(value, node->name);
+		}else if(file) {
+			const char *file_name = strrchr(file->filename, '/');
+			g_value_set_string(value, file_name?(file_name + 1):file->filename);
+		}
+		break;
+	case ARCHIVE_FILES_LIST_COLUMN_size:
+		if(file) g_value_set_int64(value, file->file_length);
+		break;
+	case ARCHIVE_FILES_LIST_COLUMN_index:
+		if(file) g_value_set_uint64(value, file->index);
+		break;
+	case ARCHIVE_FILES_LIST_COLUMN_mtime:
+		if(file) {
+			struct tm t[1];
+			char sz_time[100] = "";
+			memset(t, 0, sizeof(t));
+			localtime_r((time_t *)&file->mtime, t);
+			strftime(sz_time, sizeof(sz_time), "%Y/%m/%d %H:%M:%S", t);
+			g_value_set_string(value, sz_time);
+		}
+		break;
+	case ARCHIVE_FILES_LIST_COLUMN_row_type:
+		g_value_set_int(value, (NULL == dir)?-1:(node?1:0));
+		break;
+	case ARCHIVE_FILES_LIST_COLUMN_data_ptr:
+		g_value_set_pointer(value, file);
+		break;
+	default:
+		break;
+	}
+}
+
+static gboolean archive_tree_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	ArchiveTreeModel *model = ARCHIVE_TREE_MODEL(tree_model);
+	g_return_val_if_fail(iter->stamp == model->stamp, FALSE);
+	
+	const struct ooxml_dir_node *dir = ITER_DIR(iter);
+	gint pos = ITER_POS(iter) + 1;
+	if(NULL == dir || pos >= dir_num_children(dir)) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+	iter->user_data2 = GINT_TO_POINTER(pos);
+	return TRUE;
+}
+
+static gboolean archive_tree_model_iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	ArchiveTreeModel *model = ARCHIVE_TREE_MODEL(tree_model);
+	g_return_val_if_fail(iter->stamp == model->stamp, FALSE);
+	
+	const struct ooxml_dir_node *dir = ITER_DIR(iter);
+	gint pos = ITER_POS(iter) - 1;
+	if(NULL == dir || pos < 0) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+	iter->user_data2 = GINT_TO_POINTER(pos);
+	return TRUE;
+}
+
+static gboolean archive_tree_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+	ArchiveTreeModel *model = ARCHIVE_TREE_MODEL(tree_model);
+	if(NULL == parent) {
+		if(NULL == model->tree || n != 0) return FALSE;
+		archive_iter_set(model, iter, NULL, 0);
+		return TRUE;
+	}
+	g_return_val_if_fail(parent->stamp == model->stamp, FALSE);
+	
+	const struct ooxml_dir_node *node = archive_iter_get_node(model, parent);
+	if(NULL == node || n < 0 || n >= dir_num_children(node)) return FALSE;
+	archive_iter_set(model, iter, node, n);
+	return TRUE;
+}
+
+static gboolean archive_tree_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+	return archive_tree_model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+static gint archive_tree_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	ArchiveTreeModel *model = ARCHIVE_TREE_MODEL(tree_model);
+	if(NULL == iter) return model->tree?1:0;
+	g_return_val_if_fail(iter->stamp == model->stamp, 0);
+	
+	const struct ooxml_dir_node *node = archive_iter_get_node(model, iter);
+	return node?dir_num_children(node):0;
+}
+
+static gboolean archive_tree_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+	return archive_tree_model_iter_n_children(tree_model, iter) > 0;
+}
+
+static gboolean archive_tree_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+	ArchiveTreeModel *model = ARCHIVE_TREE_MODEL(tree_model);
+	g_return_val_if_fail(child->stamp == model->stamp, FALSE);
+	
+	const struct ooxml_dir_node *dir = ITER_DIR(child);
+	if(NULL == dir) return FALSE;
+	if(dir == model->tree) {
+		archive_iter_set(model, iter, NULL, 0);
+	}else {
+		archive_iter_set(model, iter, dir->parent, dir_get_position(dir));
+	}
+	return TRUE;
+}
+
+static void archive_tree_model_iface_init(GtkTreeModelIface *iface)
+{
+	iface->get_flags = archive_tree_model_get_flags;
+	iface->get_n_columns = archive_tree_model_get_n_columns;
+	iface->get_column_type = archive_tree_model_get_column_type;
+	iface->get_iter = archive_tree_model_get_iter;
+	iface->get_path = archive_tree_model_get_path;
+	iface->get_value = archive_tree_model_get_value;
+	iface->iter_next = archive_tree_model_iter_next;
+	iface->iter_previous = archive_tree_model_iter_previous;
+	iface->iter_children = archive_tree_model_iter_children;
+	iface->iter_has_child = archive_tree_model_iter_has_child;
+	iface->iter_n_children = archive_tree_model_iter_n_children;
+	iface->iter_nth_child = archive_tree_model_iter_nth_child;
+	iface->iter_parent = archive_tree_model_iter_parent;
+}
+
+/******************************************************************************
+ * GObject
+******************************************************************************/
+static void archive_tree_model_finalize(GObject *object)
+{
+	ArchiveTreeModel *model = ARCHIVE_TREE_MODEL(object);
+	g_free(model->archive_name);
+	model->archive_name = NULL;
+	G_OBJECT_CLASS(archive_tree_model_parent_class)->finalize(object);
+}
+
+static void archive_tree_model_class_init(ArchiveTreeModelClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS(klass);
+	object_class->finalize = archive_tree_model_finalize;
+}
+
+static void archive_tree_model_init(ArchiveTreeModel *model)
+{
+	model->stamp = g_random_int();
+}
+
+static GtkTreeModel *archive_tree_model_new(const char *archive_name,
+	const struct ooxml_dir_node *tree, struct ooxml_zip_file *files)
+{
+	ArchiveTreeModel *model = g_object_new(ARCHIVE_TYPE_TREE_MODEL, NULL);
+	assert(model);
+	model->archive_name = g_strdup(archive_name?archive_name:"");
+	model->tree = tree;
+	model->files = files;
+	return GTK_TREE_MODEL(model);
+}
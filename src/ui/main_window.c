@@ -32,6 +32,8 @@
 #include <gtk/gtk.h>
 #include "shell.h"
 #include "shell_private.h"
+#include "app.h"
+#include "ooxml_context.h"
 
 static void on_file_selected(GtkWidget *file_chooser, struct shell_context *shell)
 {
@@ -53,6 +55,19 @@ static void on_file_selected(GtkWidget *file_chooser, struct shell_context *shel
 	return;
 }
 
+// the archive is free again: open the file chosen while the loader was cancelling
+static void on_archive_loader_stopped(void *user_data)
+{
+	struct shell_context *shell = user_data;
+	struct shell_private *priv = shell->priv;
+	char *filename = priv->pending_filename;
+	if(NULL == filename) return;
+	
+	priv->pending_filename = NULL;
+	shell_load_ooxml_file(shell, filename);
+	free(filename);
+}
+
 static void on_archive_file_selection_changed(GtkTreeSelection *selection, struct shell_context *shell)
 {
 	assert(shell && shell->priv);
@@ -69,13 +84,10 @@ static void on_archive_file_selection_changed(GtkTreeSelection *selection, struc
 	
 	gtk_tree_model_get(model, &iter, ARCHIVE_FILES_LIST_COLUMN_data_ptr, &file, -1);
 	if(file) {
-		GtkTextView *textview = GTK_TEXT_VIEW(priv->textview);
-		assert(textview);
-		GtkTextBuffer *buffer = gtk_text_buffer_new(NULL);
-		if(file->data && file->doc) {
-			gtk_text_buffer_set_text(buffer, (const char *)file->data, file->cb_data);
-		}
-		gtk_text_view_set_buffer(textview, buffer);
+		// the part is streamed into the view on a background thread, it is not loaded
+		struct ooxml_context *ooxml = app_get_ooxml_context(shell->app);
+		assert(ooxml);
+		text_viewer_show(priv->viewer, ooxml, file);
 	}
 	
 }
@@ -101,6 +113,8 @@ static void init_archive_files_list(GtkTreeView *tree, struct shell_context *she
 	
 	cr = gtk_cell_renderer_text_new();
 	col = gtk_tree_view_column_new_with_attributes("name", cr, "text", 0, NULL);
+	gtk_tree_view_column_set_sizing(col, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width(col, 240);
 	gtk_tree_view_column_set_resizable(col, TRUE);
 	gtk_tree_view_append_column(tree, col);
 	
@@ -108,31 +122,34 @@ static void init_archive_files_list(GtkTreeView *tree, struct shell_context *she
 	col = gtk_tree_view_column_new_with_attributes("size", cr, "text", ARCHIVE_FILES_LIST_COLUMN_size, NULL);
 	gtk_tree_view_column_set_cell_data_func(col, cr, 
 		on_update_cell_column, GINT_TO_POINTER(ARCHIVE_FILES_LIST_COLUMN_size), NULL);
+	gtk_tree_view_column_set_sizing(col, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width(col, 80);
 	gtk_tree_view_append_column(tree, col);
 	
 	cr = gtk_cell_renderer_text_new();
 	col = gtk_tree_view_column_new_with_attributes("index", cr, "text", ARCHIVE_FILES_LIST_COLUMN_index, NULL);
 	gtk_tree_view_column_set_cell_data_func(col, cr, 
 		on_update_cell_column, GINT_TO_POINTER(ARCHIVE_FILES_LIST_COLUMN_index), NULL);
+	gtk_tree_view_column_set_sizing(col, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width(col, 60);
 	gtk_tree_view_append_column(tree, col);
 	
 	cr = gtk_cell_renderer_text_new();
 	col = gtk_tree_view_column_new_with_attributes("mtime", cr, "text", ARCHIVE_FILES_LIST_COLUMN_mtime, NULL);
 	gtk_tree_view_column_set_cell_data_func(col, cr, 
 		on_update_cell_column, GINT_TO_POINTER(ARCHIVE_FILES_LIST_COLUMN_mtime), NULL);
+	gtk_tree_view_column_set_sizing(col, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width(col, 150);
 	gtk_tree_view_append_column(tree, col);
 	
 	gtk_tree_view_set_grid_lines(tree, GTK_TREE_VIEW_GRID_LINES_VERTICAL);
 	
-	GtkTreeStore *store = gtk_tree_store_new(ARCHIVE_FILES_LIST_COLUMNS_COUNT, 
-		G_TYPE_STRING, // file name
-		G_TYPE_INT64, // file size
-		G_TYPE_UINT64, // index
-		G_TYPE_STRING, // modification datetime
-		G_TYPE_INT,
-		G_TYPE_POINTER
-	);
-	gtk_tree_view_set_model(tree, GTK_TREE_MODEL(store));
+	// fixed row heights: the view does not need to measure every row of large archives
+	gtk_tree_view_set_fixed_height_mode(tree, TRUE);
+	
+	GtkTreeModel *model = archive_tree_model_new(NULL, NULL, NULL);
+	gtk_tree_view_set_model(tree, model);
+	g_object_unref(model);
 	
 	GtkTreeSelection *selection = gtk_tree_view_get_selection(tree);
 	g_signal_connect(selection, "changed", G_CALLBACK(on_archive_file_selection_changed), shell);
@@ -150,6 +167,9 @@ static int init_windows(struct shell_context *shell)
 	gtk_window_set_default_size(GTK_WINDOW(window), 1280, 720);
 	gtk_window_set_titlebar(GTK_WINDOW(window), header_bar);
 	gtk_header_bar_set_show_close_button(GTK_HEADER_BAR(header_bar), TRUE);
+	priv->loader = archive_loader_new(GTK_HEADER_BAR(header_bar));
+	priv->loader->on_stopped = on_archive_loader_stopped;
+	priv->loader->user_data = shell;
 	
 	GtkWidget *grid = gtk_grid_new();
 	gtk_container_add(GTK_CONTAINER(window), grid);
@@ -209,5 +229,6 @@ static int init_windows(struct shell_context *shell)
 	priv->archive_files_list = archive_files_list;
 	priv->stack = stack;
 	priv->textview = textview;
+	priv->viewer = text_viewer_new(GTK_TEXT_VIEW(textview));
 	return 0;
 }
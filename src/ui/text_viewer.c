@@ -0,0 +1,524 @@
+/*
+ * text_viewer.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <gtk/gtk.h>
+#include <json-c/json.h>
+#include "ooxml_context.h"
+#include "perf_trace.h"
+
+/*
+ * text viewer for (large) xml parts:
+ * a reader thread streams the part through ooxml->read_entry(), optionally pretty-prints it,
+ * and queues utf-8 chunks; the main loop appends them to the text buffer from an idle handler.
+ *
+ * memory is bounded by max_queued (pending chunks, the reader blocks beyond it)
+ * and max_bytes (text shown per part, the rest of the part is not read).
+ */
+#define TEXT_VIEWER_CHUNK_SIZE		(64 * 1024)
+#define TEXT_VIEWER_IDLE_BYTES		(256 * 1024)	// appended per idle call, keeps the ui responsive
+#define TEXT_VIEWER_MAX_INDENT		(64)
+
+struct text_viewer_chunk
+{
+	struct text_viewer_chunk *next;
+	size_t length;
+	char data[];
+};
+
+struct xml_pretty_printer
+{
+	int depth;
+	int in_tag;
+	int tag_start;		// '<' seen, waiting for the next char to know the tag kind
+	int is_end_tag;
+	int is_decl;		// <?...?>, <!...>
+	char quote;			// inside an attribute value
+	char last;			// last char of the current tag
+	int after_tag;		// only whitespace since the last '>'
+	int started;
+	size_t cb_ws;
+	char ws[64];		// whitespace after a tag, dropped if a tag follows
+};
+
+struct text_viewer_job
+{
+	int refs;	// main thread only
+	int idle_ref;	// the chain of idle calls holds a reference until the job is finished or cancelled
+	volatile int cancelled;
+	pthread_t th;
+	int joined;
+	
+	struct ooxml_context *ooxml;
+	int index;
+	char *filename;
+	size_t max_bytes;
+	size_t max_queued;
+	int pretty_print;
+	
+	// reader thread
+	struct xml_pretty_printer pp;
+	struct text_viewer_chunk *out;
+	size_t cb_output;
+	int truncated;
+	
+	// shared, guarded by mutex
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct text_viewer_chunk *head;
+	struct text_viewer_chunk *tail;
+	size_t cb_queued;
+	int idle_pending;
+	int finished;
+	ssize_t cb_read;	// result of read_entry()
+	
+	// main thread
+	GtkTextBuffer *buffer;
+	uint64_t start_ns;
+	size_t cb_shown;
+};
+
+struct text_viewer
+{
+	GtkTextView *textview;
+	size_t max_bytes;	// 0: unlimited
+	size_t max_queued;
+	int pretty_print;
+	struct text_viewer_job *job;
+};
+
+static void text_viewer_job_unref(struct text_viewer_job *job)
+{
+	if(NULL == job || --job->refs > 0) return;
+	assert(job->joined);
+	
+	struct text_viewer_chunk *chunk = job->head;
+	while(chunk) {
+		struct text_viewer_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	free(job->out);
+	if(job->buffer) g_object_unref(job->buffer);
+	free(job->filename);
+	pthread_cond_destroy(&job->cond);
+	pthread_mutex_destroy(&job->mutex);
+	free(job);
+}
+
+/******************************************************************************
+ * reader thread
+******************************************************************************/
+static gboolean on_text_viewer_idle(gpointer user_data);
+
+// hand the current output chunk to the main loop, blocks while too much is queued
+static void text_viewer_job_flush(struct text_viewer_job *job, int finished)
+{
+	struct text_viewer_chunk *chunk = job->out;
+	job->out = NULL;
+	if(chunk && chunk->length == 0) {
+		free(chunk);
+		chunk = NULL;
+	}
+	
+	pthread_mutex_lock(&job->mutex);
+	while(chunk && !job->cancelled && job->cb_queued >= job->max_queued) {
+		pthread_cond_wait(&job->cond, &job->mutex);
+	}
+	if(chunk) {
+		if(job->tail) job->tail->next = chunk;
+		else job->head = chunk;
+		job->tail = chunk;
+		job->cb_queued += chunk->length;
+	}
+	if(finished) job->finished = 1;
+	if(!job->idle_pending && (chunk || finished)) {
+		job->idle_pending = 1;
+		g_idle_add(on_text_viewer_idle, job);
+	}
+	pthread_mutex_unlock(&job->mutex);
+}
+
+static void text_viewer_job_write(struct text_viewer_job *job, const char *data, size_t length)
+{
+	while(length > 0) {
+		if(NULL == job->out) {
+			job->out = malloc(sizeof(*job->out) + TEXT_VIEWER_CHUNK_SIZE);
+			assert(job->out);
+			job->out->next = NULL;
+			job->out->length = 0;
+		}
+		struct text_viewer_chunk *chunk = job->out;
+		size_t cb = TEXT_VIEWER_CHUNK_SIZE - chunk->length;
+		if(cb > length) cb = length;
+		memcpy(chunk->data + chunk->length, data, cb);
+		chunk->length += cb;
+		job->cb_output += cb;
+		data += cb;
+		length -= cb;
+		
+		if(chunk->length == TEXT_VIEWER_CHUNK_SIZE) {
+			// never split a utf-8 sequence between two chunks
+			const unsigned char *end = (const unsigned char *)chunk->data + chunk->length;
+			const unsigned char *lead = end - 1;
+			while(lead > (const unsigned char *)chunk->data && (end - lead) < 4 && (*lead & 0xC0) == 0x80) --lead;
+			
+			size_t tail = 0;
+			if(*lead >= 0xC0) {
+				size_t cb_char = (*lead >= 0xF0)?4:((*lead >= 0xE0)?3:2);
+				if((size_t)(end - lead) < cb_char) tail = end - lead;
+			}
+			
+			char carry[4];
+			if(tail > 0) {
+				chunk->length -= tail;
+				memcpy(carry, chunk->data + chunk->length, tail);
+			}
+			text_viewer_job_flush(job, 0);
+			if(tail > 0) {
+				job->cb_output -= tail;
+				text_viewer_job_write(job, carry, tail);
+			}
+		}
+	}
+}
+
+static void pp_newline(struct text_viewer_job *job, struct xml_pretty_printer *pp)
+{
+	static const char spaces[TEXT_VIEWER_MAX_INDENT * 2] = {
+		[0 ... (TEXT_VIEWER_MAX_INDENT * 2 - 1)] = ' '
+	};
+	int depth = pp->depth;
+	if(depth < 0) depth = 0;
+	if(depth > TEXT_VIEWER_MAX_INDENT) depth = TEXT_VIEWER_MAX_INDENT;
+	
+	if(pp->started) text_viewer_job_write(job, "\n", 1);
+	text_viewer_job_write(job, spaces, depth * 2);
+	pp->started = 1;
+}
+
+/*
+ * streaming indenter: puts every tag that follows another tag on its own line
+ * and keeps text content inline (<v>1</v>). comments and cdata are not parsed.
+ */
+static void xml_pretty_print(struct text_viewer_job *job, const char *data, size_t length)
+{
+	struct xml_pretty_printer *pp = &job->pp;
+	const char *p_end = data + length;
+	const char *text = data;	// start of the pending run of chars to copy
+	
+	for(const char *p = data; p < p_end; ++p) {
+		char c = *p;
+		if(pp->tag_start) {
+			pp->tag_start = 0;
+			pp->is_end_tag = (c == '/');
+			pp->is_decl = (c == '?' || c == '!');
+			if(pp->is_end_tag) --pp->depth;
+			
+			if(pp->after_tag) pp_newline(job, pp);
+			pp->cb_ws = 0;
+			
+			text_viewer_job_write(job, "<", 1);
+			if(!pp->is_end_tag && !pp->is_decl) ++pp->depth;
+			text = p;
+			pp->last = c;
+			continue;
+		}
+		
+		if(pp->in_tag) {
+			if(pp->quote) {
+				if(c == pp->quote) pp->quote = 0;
+			}else if(c == '"' || c == '\'') {
+				pp->quote = c;
+			}else if(c == '>') {
+				if(!pp->is_end_tag && !pp->is_decl && pp->last == '/') --pp->depth;
+				pp->in_tag = 0;
+				pp->after_tag = 1;
+				text_viewer_job_write(job, text, p + 1 - text);
+				text = p + 1;
+				continue;
+			}
+			pp->last = c;
+			continue;
+		}
+		
+		if(c == '<') {
+			if(p > text) text_viewer_job_write(job, text, p - text);
+			pp->in_tag = 1;
+			pp->tag_start = 1;
+			pp->quote = 0;
+			text = p + 1;
+			continue;
+		}
+		
+		if(pp->after_tag) {
+			if(c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+				if(pp->cb_ws == sizeof(pp->ws)) {
+					text_viewer_job_write(job, pp->ws, pp->cb_ws);
+					pp->cb_ws = 0;
+				}
+				pp->ws[pp->cb_ws++] = c;
+				text = p + 1;
+				continue;
+			}
+			// text content: keep its leading whitespace
+			if(pp->cb_ws) text_viewer_job_write(job, pp->ws, pp->cb_ws);
+			pp->cb_ws = 0;
+			pp->after_tag = 0;
+			text = p;
+		}
+	}
+	if(!pp->tag_start && p_end > text) text_viewer_job_write(job, text, p_end - text);
+}
+
+static int on_text_viewer_data(void *user_data, const unsigned char *data, size_t length)
+{
+	struct text_viewer_job *job = user_data;
+	if(job->cancelled) return 1;
+	
+	if(job->pretty_print) xml_pretty_print(job, (const char *)data, length);
+	else text_viewer_job_write(job, (const char *)data, length);
+	
+	if(job->max_bytes > 0 && job->cb_output >= job->max_bytes) {
+		job->truncated = 1;
+		return 1;
+	}
+	return job->cancelled;
+}
+
+static void *text_viewer_thread(void *user_data)
+{
+	struct text_viewer_job *job = user_data;
+	ssize_t cb_read = job->ooxml->read_entry(job->ooxml, job->index, on_text_viewer_data, job);
+	
+	pthread_mutex_lock(&job->mutex);
+	job->cb_read = cb_read;
+	pthread_mutex_unlock(&job->mutex);
+	
+	text_viewer_job_flush(job, 1);
+	pthread_exit((void *)(long)0);
+}
+
+/******************************************************************************
+ * main thread
+******************************************************************************/
+static gboolean on_text_viewer_idle(gpointer user_data)
+{
+	struct text_viewer_job *job = user_data;
+	
+	struct text_viewer_chunk *chunks = NULL;
+	size_t cb_chunks = 0;
+	int finished = 0;
+	int more = 0;
+	
+	pthread_mutex_lock(&job->mutex);
+	if(!job->cancelled) {
+		struct text_viewer_chunk **p_next = &chunks;
+		while(job->head && cb_chunks < TEXT_VIEWER_IDLE_BYTES) {
+			struct text_viewer_chunk *chunk = job->head;
+			job->head = chunk->next;
+			if(NULL == job->head) job->tail = NULL;
+			chunk->next = NULL;
+			*p_next = chunk;
+			p_next = &chunk->next;
+			cb_chunks += chunk->length;
+		}
+		job->cb_queued -= cb_chunks;
+		pthread_cond_broadcast(&job->cond);
+	}
+	more = !job->cancelled && (NULL != job->head);
+	finished = job->finished && !more;
+	if(!more) job->idle_pending = 0;
+	pthread_mutex_unlock(&job->mutex);
+	
+	GtkTextIter iter;
+	while(chunks) {
+		struct text_viewer_chunk *chunk = chunks;
+		chunks = chunk->next;
+		
+		if(job->cb_shown == 0) {
+			PERF_TRACE_END(job->start_ns, "text_viewer_first_chunk", job->filename);
+		}
+		gtk_text_buffer_get_end_iter(job->buffer, &iter);
+		gtk_text_buffer_insert(job->buffer, &iter, chunk->data, chunk->length);
+		job->cb_shown += chunk->length;
+		free(chunk);
+	}
+	if(more) return G_SOURCE_CONTINUE;
+	if(!finished && !job->cancelled) return G_SOURCE_REMOVE;	// the reader schedules the next call
+	
+	if(finished && !job->cancelled) {
+		if(!job->joined) {
+			pthread_join(job->th, NULL);
+			job->joined = 1;
+		}
+		
+		char note[200] = "";
+		if(job->cb_read < 0) {
+			snprintf(note, sizeof(note), "\n\n[failed to read %s]\n", job->filename);
+		}else if(job->truncated) {
+			snprintf(note, sizeof(note), "\n\n[truncated: first %ld bytes shown, %s]\n",
+				(long)job->cb_shown, job->pretty_print?"pretty-printed":"raw");
+		}
+		if(note[0]) {
+			gtk_text_buffer_get_end_iter(job->buffer, &iter);
+			gtk_text_buffer_insert(job->buffer, &iter, note, -1);
+		}
+		PERF_TRACE_END(job->start_ns, "text_viewer_load", job->filename);
+	}
+	job->idle_ref = 0;
+	text_viewer_job_unref(job);
+	return G_SOURCE_REMOVE;
+}
+
+static void text_viewer_cancel(struct text_viewer *viewer)
+{
+	struct text_viewer_job *job = viewer->job;
+	if(NULL == job) return;
+	viewer->job = NULL;
+	
+	pthread_mutex_lock(&job->mutex);
+	job->cancelled = 1;
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->mutex);
+	
+	if(!job->joined) {
+		pthread_join(job->th, NULL);
+		job->joined = 1;
+	}
+	
+	// a pending idle call drops its reference when it sees the job cancelled
+	pthread_mutex_lock(&job->mutex);
+	int release_idle_ref = job->idle_ref && !job->idle_pending;
+	if(release_idle_ref) job->idle_ref = 0;
+	pthread_mutex_unlock(&job->mutex);
+	
+	if(release_idle_ref) text_viewer_job_unref(job);
+	text_viewer_job_unref(job);
+}
+
+static int is_text_part(const char *filename)
+{
+	static const char *exts[] = { ".xml", ".rels", ".vml", ".txt", NULL };
+	const char *ext = strrchr(filename, '.');
+	if(NULL == ext) return 0;
+	for(int i = 0; exts[i]; ++i) {
+		if(strcasecmp(ext, exts[i]) == 0) return 1;
+	}
+	return 0;
+}
+
+static void text_viewer_show(struct text_viewer *viewer, struct ooxml_context *ooxml, const struct ooxml_zip_file *file)
+{
+	assert(viewer && viewer->textview);
+	text_viewer_cancel(viewer);
+	
+	GtkTextBuffer *buffer = gtk_text_buffer_new(NULL);
+	gtk_text_view_set_buffer(viewer->textview, buffer);
+	if(NULL == file) {
+		g_object_unref(buffer);
+		return;
+	}
+	
+	if(!is_text_part(file->filename)) {
+		char note[200] = "";
+		snprintf(note, sizeof(note), "[binary part, %ld bytes]\n", (long)file->file_length);
+		gtk_text_buffer_set_text(buffer, note, -1);
+		g_object_unref(buffer);
+		return;
+	}
+	
+	struct text_viewer_job *job = calloc(1, sizeof(*job));
+	assert(job);
+	job->refs = 2;	// the viewer and the idle calls
+	job->idle_ref = 1;
+	job->ooxml = ooxml;
+	job->index = file->index;
+	job->filename = strdup(file->filename);
+	job->max_bytes = viewer->max_bytes;
+	job->max_queued = viewer->max_queued;
+	job->pretty_print = viewer->pretty_print;
+	job->pp.after_tag = 1;	// the first tag starts a line
+	job->buffer = buffer;	// takes the reference
+	job->start_ns = g_perf_trace_enabled?perf_trace_now():0;
+	pthread_mutex_init(&job->mutex, NULL);
+	pthread_cond_init(&job->cond, NULL);
+	
+	int rc = pthread_create(&job->th, NULL, text_viewer_thread, job);
+	assert(0 == rc);
+	viewer->job = job;
+}
+
+static struct text_viewer *text_viewer_new(GtkTextView *textview)
+{
+	struct text_viewer *viewer = calloc(1, sizeof(*viewer));
+	assert(viewer);
+	viewer->textview = textview;
+	viewer->max_bytes = 16 * 1024 * 1024;
+	viewer->max_queued = 4 * 1024 * 1024;
+	viewer->pretty_print = 1;
+	return viewer;
+}
+
+static void text_viewer_free(struct text_viewer *viewer)
+{
+	if(NULL == viewer) return;
+	text_viewer_cancel(viewer);
+	free(viewer);
+}
+
+/*
+ * config ("viewer" section of the app config):
+ * {
+ *   "max_bytes": 16777216,     // text shown per part, 0: the whole part
+ *   "max_queued": 4194304,     // bytes read ahead of the text buffer
+ *   "pretty_print": true
+ * }
+ */
+static int text_viewer_load_config(struct text_viewer *viewer, json_object *jconfig)
+{
+	assert(viewer);
+	if(NULL == jconfig) return -1;
+	
+	json_object *jvalue = NULL;
+	if(json_object_object_get_ex(jconfig, "max_bytes", &jvalue)) {
+		viewer->max_bytes = json_object_get_int64(jvalue);
+	}
+	if(json_object_object_get_ex(jconfig, "max_queued", &jvalue)) {
+		int64_t max_queued = json_object_get_int64(jvalue);
+		if(max_queued >= TEXT_VIEWER_CHUNK_SIZE) viewer->max_queued = max_queued;
+	}
+	if(json_object_object_get_ex(jconfig, "pretty_print", &jvalue)) {
+		viewer->pretty_print = json_object_get_boolean(jvalue);
+	}
+	return 0;
+}
@@ -0,0 +1,261 @@
+/*
+ * zip_directory.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <zlib.h>
+#include "zip_directory.h"
+
+#define ZIP_EOCD_SIGNATURE			0x06054b50
+#define ZIP64_EOCD_LOCATOR_SIGNATURE	0x07064b50
+#define ZIP64_EOCD_SIGNATURE		0x06064b50
+#define ZIP_CDIR_SIGNATURE			0x02014b50
+#define ZIP_LOCAL_HEADER_SIGNATURE	0x04034b50
+
+#define ZIP_EOCD_SIZE				22
+#define ZIP64_EOCD_LOCATOR_SIZE		20
+#define ZIP_CDIR_HEADER_SIZE		46
+#define ZIP_LOCAL_HEADER_SIZE		30
+
+static inline uint16_t read_u16(const unsigned char *p)
+{
+	return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+static inline uint32_t read_u32(const unsigned char *p)
+{
+	return (uint32_t)read_u16(p) | ((uint32_t)read_u16(p + 2) << 16);
+}
+static inline uint64_t read_u64(const unsigned char *p)
+{
+	return (uint64_t)read_u32(p) | ((uint64_t)read_u32(p + 4) << 32);
+}
+
+static const unsigned char *find_eocd(const unsigned char *data, size_t size)
+{
+	if(size < ZIP_EOCD_SIZE) return NULL;
+	
+	// the comment at the end of the archive is at most 65535 bytes
+	size_t min_offset = (size > (ZIP_EOCD_SIZE + 0xFFFF))?(size - ZIP_EOCD_SIZE - 0xFFFF):0;
+	for(size_t offset = size - ZIP_EOCD_SIZE; ; --offset) {
+		if(read_u32(data + offset) == ZIP_EOCD_SIGNATURE) return data + offset;
+		if(offset == min_offset) break;
+	}
+	return NULL;
+}
+
+ssize_t zip_directory_parse(const unsigned char *data, size_t size, struct zip_directory_entry **p_entries)
+{
+	assert(data && p_entries);
+	const unsigned char *eocd = find_eocd(data, size);
+	if(NULL == eocd) return -1;
+	
+	uint64_t num_entries = read_u16(eocd + 10);
+	uint64_t cdir_size = read_u32(eocd + 12);
+	uint64_t cdir_offset = read_u32(eocd + 16);
+	
+	// zip64
+	size_t eocd_offset = eocd - data;
+	if(eocd_offset >= ZIP64_EOCD_LOCATOR_SIZE) {
+		const unsigned char *locator = eocd - ZIP64_EOCD_LOCATOR_SIZE;
+		if(read_u32(locator) == ZIP64_EOCD_LOCATOR_SIGNATURE) {
+			uint64_t eocd64_offset = read_u64(locator + 8);
+			if(eocd64_offset + 56 > size) return -1;
+			const unsigned char *eocd64 = data + eocd64_offset;
+			if(read_u32(eocd64) != ZIP64_EOCD_SIGNATURE) return -1;
+			
+			num_entries = read_u64(eocd64 + 32);
+			cdir_size = read_u64(eocd64 + 40);
+			cdir_offset = read_u64(eocd64 + 48);
+		}
+	}
+	if(cdir_offset + cdir_size > size) return -1;
+	
+	struct zip_directory_entry *entries = calloc(num_entries + 1, sizeof(*entries));
+	assert(entries);
+	
+	const unsigned char *p = data + cdir_offset;
+	const unsigned char *p_end = p + cdir_size;
+	for(uint64_t i = 0; i < num_entries; ++i) {
+		if((p + ZIP_CDIR_HEADER_SIZE) > p_end || read_u32(p) != ZIP_CDIR_SIGNATURE) {
+			free(entries);
+			return -1;
+		}
+		
+		struct zip_directory_entry *entry = &entries[i];
+		entry->version_needed = read_u16(p + 6);
+		entry->flags = read_u16(p + 8);
+		entry->method = read_u16(p + 10);
+		entry->dos_time = read_u16(p + 12);
+		entry->dos_date = read_u16(p + 14);
+		entry->crc = read_u32(p + 16);
+		entry->comp_size = read_u32(p + 20);
+		entry->size = read_u32(p + 24);
+		
+		size_t cb_name = read_u16(p + 28);
+		size_t cb_extra = read_u16(p + 30);
+		size_t cb_comment = read_u16(p + 32);
+		entry->local_header_offset = read_u32(p + 42);
+		entry->name = (const char *)p + ZIP_CDIR_HEADER_SIZE;
+		entry->cb_name = cb_name;
+		
+		const unsigned char *extra = p + ZIP_CDIR_HEADER_SIZE + cb_name;
+		const unsigned char *extra_end = extra + cb_extra;
+		if(extra_end > p_end) {
+			free(entries);
+			return -1;
+		}
+		
+		// zip64 extended information: only the fields set to 0xFFFFFFFF are present, in this order
+		while((extra + 4) <= extra_end) {
+			uint16_t id = read_u16(extra);
+			uint16_t cb_data = read_u16(extra + 2);
+			const unsigned char *field = extra + 4;
+			const unsigned char *field_end = field + cb_data;
+			if(field_end > extra_end) break;
+			
+			if(id == 0x0001) {
+				if(entry->size == 0xFFFFFFFF && (field + 8) <= field_end) { entry->size = read_u64(field); field += 8; }
+				if(entry->comp_size == 0xFFFFFFFF && (field + 8) <= field_end) { entry->comp_size = read_u64(field); field += 8; }
+				if(entry->local_header_offset == 0xFFFFFFFF && (field + 8) <= field_end) { entry->local_header_offset = read_u64(field); }
+				break;
+			}
+			extra = field_end;
+		}
+		
+		p += ZIP_CDIR_HEADER_SIZE + cb_name + cb_extra + cb_comment;
+	}
+	
+	*p_entries = entries;
+	return num_entries;
+}
+
+const unsigned char *zip_directory_get_data(const unsigned char *data, size_t size, const struct zip_directory_entry *entry)
+{
+	assert(data && entry);
+	uint64_t offset = entry->local_header_offset;
+	if(offset + ZIP_LOCAL_HEADER_SIZE > size) return NULL;
+	
+	const unsigned char *header = data + offset;
+	if(read_u32(header) != ZIP_LOCAL_HEADER_SIGNATURE) return NULL;
+	
+	// the local header can have a different extra field than the central directory
+	uint64_t data_offset = offset + ZIP_LOCAL_HEADER_SIZE + read_u16(header + 26) + read_u16(header + 28);
+	if(data_offset + entry->comp_size > size) return NULL;
+	return data + data_offset;
+}
+
+int zip_directory_inflate(const unsigned char *comp_data, const struct zip_directory_entry *entry, unsigned char *output)
+{
+	assert(comp_data && entry && output);
+	if(entry->method != 8) return -1;
+	
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	int rc = inflateInit2(&strm, -MAX_WBITS);	// raw deflate
+	if(rc != Z_OK) return -1;
+	
+	// avail_in / avail_out are 32-bit
+	const unsigned char *p = comp_data;
+	uint64_t comp_left = entry->comp_size;
+	uint64_t out_left = entry->size;
+	strm.next_out = output;
+	do {
+		if(strm.avail_in == 0 && comp_left > 0) {
+			strm.next_in = (unsigned char *)p;
+			strm.avail_in = (comp_left > 0x40000000)?0x40000000:comp_left;
+			p += strm.avail_in;
+			comp_left -= strm.avail_in;
+		}
+		if(strm.avail_out == 0 && out_left > 0) {
+			strm.avail_out = (out_left > 0x40000000)?0x40000000:out_left;
+			out_left -= strm.avail_out;
+		}
+		rc = inflate(&strm, Z_NO_FLUSH);
+	}while(rc == Z_OK && (strm.avail_in > 0 || comp_left > 0) && (strm.avail_out > 0 || out_left > 0));
+	
+	uint64_t total_out = strm.total_out;
+	inflateEnd(&strm);
+	
+	if(rc != Z_STREAM_END && rc != Z_OK) return -1;
+	if(total_out != entry->size) return -1;
+	
+	// crc32() takes a 32-bit length
+	uLong crc = crc32(0L, Z_NULL, 0);
+	for(uint64_t offset = 0; offset < total_out; ) {
+		uInt length = ((total_out - offset) > 0x40000000)?0x40000000:(total_out - offset);
+		crc = crc32(crc, output + offset, length);
+		offset += length;
+	}
+	if(crc != entry->crc) return -1;
+	return 0;
+}
+
+ssize_t zip_directory_inflate_chunks(const unsigned char *comp_data, const struct zip_directory_entry *entry, 
+	unsigned char *buffer, size_t cb_buffer, zip_directory_data_callback on_data, void *user_data)
+{
+	assert(comp_data && entry && buffer && cb_buffer > 0 && on_data);
+	if(entry->method != 8) return -1;
+	if(cb_buffer > 0x40000000) cb_buffer = 0x40000000;
+	
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	int rc = inflateInit2(&strm, -MAX_WBITS);	// raw deflate
+	if(rc != Z_OK) return -1;
+	
+	const unsigned char *p = comp_data;
+	uint64_t comp_left = entry->comp_size;
+	uLong crc = crc32(0L, Z_NULL, 0);
+	int stopped = 0;
+	do {
+		if(strm.avail_in == 0 && comp_left > 0) {
+			strm.next_in = (unsigned char *)p;
+			strm.avail_in = (comp_left > 0x40000000)?0x40000000:comp_left;
+			p += strm.avail_in;
+			comp_left -= strm.avail_in;
+		}
+		strm.next_out = buffer;
+		strm.avail_out = cb_buffer;
+		rc = inflate(&strm, Z_NO_FLUSH);
+		if(rc != Z_OK && rc != Z_STREAM_END) break;
+		
+		size_t length = cb_buffer - strm.avail_out;
+		if(length > 0) {
+			crc = crc32(crc, buffer, length);
+			if(on_data(user_data, buffer, length)) stopped = 1;
+		}
+	}while(rc == Z_OK && !stopped && (strm.avail_in > 0 || comp_left > 0 || strm.avail_out == 0));
+	
+	uint64_t total_out = strm.total_out;
+	inflateEnd(&strm);
+	
+	if(stopped) return total_out;
+	if(rc != Z_STREAM_END) return -1;
+	if(total_out != entry->size || crc != entry->crc) return -1;
+	return total_out;
+}
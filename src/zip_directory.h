@@ -0,0 +1,52 @@
+#ifndef OOXML_ZIP_DIRECTORY_H_
+#define OOXML_ZIP_DIRECTORY_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * central directory of an in-memory (mmap-ed) zip archive.
+ * entries are in central directory order, which is the libzip index order of an unchanged archive.
+ */
+struct zip_directory_entry
+{
+	const char *name;	// not nul-terminated
+	size_t cb_name;
+	
+	uint16_t version_needed;
+	uint16_t flags;		// general purpose bit flags, bit 0: encrypted
+	uint16_t method;	// 0: stored, 8: deflated
+	uint16_t dos_time;	// last modification, ms-dos format
+	uint16_t dos_date;
+	uint32_t crc;
+	uint64_t comp_size;
+	uint64_t size;
+	uint64_t local_header_offset;
+};
+
+ssize_t zip_directory_parse(const unsigned char *data, size_t size, struct zip_directory_entry **p_entries);
+
+// returns a pointer to the (compressed) data of the entry, or NULL if the local header is invalid
+const unsigned char *zip_directory_get_data(const unsigned char *data, size_t size, const struct zip_directory_entry *entry);
+
+// inflate a deflated entry into output (entry->size bytes) and verify its crc
+int zip_directory_inflate(const unsigned char *comp_data, const struct zip_directory_entry *entry, unsigned char *output);
+
+/*
+ * inflate a deflated entry through a caller-provided window of cb_buffer bytes,
+ * on_data returns non-zero to stop early (the crc is only verified when the whole entry was read).
+ * returns the number of bytes passed to on_data, or -1 on error.
+ */
+typedef int (*zip_directory_data_callback)(void *user_data, const unsigned char *data, size_t length);
+ssize_t zip_directory_inflate_chunks(const unsigned char *comp_data, const struct zip_directory_entry *entry, 
+	unsigned char *buffer, size_t cb_buffer, zip_directory_data_callback on_data, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
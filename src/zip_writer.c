@@ -0,0 +1,625 @@
+/*
+ * zip_writer.c
+ * 
+ * Copyright 2022 chehw <hongwei.che@gmail.com>
+ * 
+ * The MIT License (MIT)
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to deal 
+ * in the Software without restriction, including without limitation the rights 
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all 
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS 
+ * IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+#include "app.h"
+#include "zip_writer.h"
+#include "perf_trace.h"
+
+#define ZIP_EOCD_SIGNATURE			0x06054b50
+#define ZIP64_EOCD_LOCATOR_SIGNATURE	0x07064b50
+#define ZIP64_EOCD_SIGNATURE		0x06064b50
+#define ZIP_CDIR_SIGNATURE			0x02014b50
+#define ZIP_LOCAL_HEADER_SIGNATURE	0x04034b50
+
+#define ZIP_LOCAL_HEADER_SIZE		30
+#define ZIP_CDIR_HEADER_SIZE		46
+#define ZIP_EOCD_SIZE				22
+#define ZIP64_EOCD_SIZE				56
+#define ZIP64_EOCD_LOCATOR_SIZE		20
+
+#define ZIP_FLAG_DATA_DESCRIPTOR	0x0008
+#define ZIP_FLAG_UTF8				0x0800
+#define ZIP_VERSION_DEFAULT			20
+#define ZIP_VERSION_ZIP64			45
+#define ZIP_MAX_32					0xFFFFFFFFULL
+
+#define DEFLATE_CHUNK_SIZE	(256 * 1024)
+#define SPILL_THRESHOLD		(16 * 1024 * 1024)	// compressed parts larger than this go to a temporary file
+
+static inline unsigned char *write_u16(unsigned char *p, uint16_t value)
+{
+	p[0] = value & 0xFF;
+	p[1] = value >> 8;
+	return p + 2;
+}
+static inline unsigned char *write_u32(unsigned char *p, uint32_t value)
+{
+	p = write_u16(p, value & 0xFFFF);
+	return write_u16(p, value >> 16);
+}
+static inline unsigned char *write_u64(unsigned char *p, uint64_t value)
+{
+	p = write_u32(p, value & 0xFFFFFFFF);
+	return write_u32(p, value >> 32);
+}
+
+/*
+ * compressed data of a part, kept in memory up to SPILL_THRESHOLD
+ */
+struct deflate_output
+{
+	unsigned char *data;
+	size_t length;
+	size_t size;
+	FILE *spill;
+	uint64_t total;
+};
+
+static int deflate_output_append(struct deflate_output *output, const unsigned char *data, size_t length)
+{
+	output->total += length;
+	if(NULL == output->spill && (output->length + length) > SPILL_THRESHOLD) {
+		output->spill = tmpfile();
+		if(NULL == output->spill) return -1;
+		if(output->length > 0 && fwrite(output->data, 1, output->length, output->spill) != output->length) return -1;
+		free(output->data);
+		output->data = NULL;
+		output->length = output->size = 0;
+	}
+	if(output->spill) return (fwrite(data, 1, length, output->spill) == length)?0:-1;
+	
+	if((output->length + length) > output->size) {
+		size_t new_size = output->size?(output->size * 2):(64 * 1024);
+		while(new_size < (output->length + length)) new_size *= 2;
+		output->data = realloc(output->data, new_size);
+		assert(output->data);
+		output->size = new_size;
+	}
+	memcpy(output->data + output->length, data, length);
+	output->length += length;
+	return 0;
+}
+
+static void deflate_output_cleanup(struct deflate_output *output)
+{
+	free(output->data);
+	if(output->spill) fclose(output->spill);
+	memset(output, 0, sizeof(*output));
+}
+
+enum zip_writer_part_type
+{
+	zip_writer_part_buffer,
+	zip_writer_part_stream,
+	zip_writer_part_raw,
+};
+
+struct zip_writer_part
+{
+	enum zip_writer_part_type type;
+	char *name;
+	size_t cb_name;
+	int level;
+	
+	// input
+	const unsigned char *data;	// buffer: uncompressed, raw: compressed
+	size_t length;
+	int free_data;
+	zip_writer_read_callback read;
+	void *user_data;
+	
+	// entry
+	uint16_t version_needed;
+	uint16_t flags;
+	uint16_t method;
+	uint16_t dos_time;
+	uint16_t dos_date;
+	uint32_t crc;
+	uint64_t comp_size;
+	uint64_t size;
+	uint64_t local_header_offset;
+	
+	struct deflate_output output;
+	int is_done;	// guarded by the writer's mutex
+	int err_code;
+};
+
+struct zip_writer
+{
+	char *filename;
+	char *temp_filename;
+	FILE *fp;
+	uint64_t offset;
+	int is_finished;
+	
+	ssize_t num_parts;
+	ssize_t max_parts;
+	struct zip_writer_part *parts;
+	uint16_t dos_time;
+	uint16_t dos_date;
+	
+	// finish(): the workers claim parts from jobs[] and signal cond when one is done
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	ssize_t num_jobs;
+	ssize_t *jobs;
+	volatile ssize_t next_job;
+	volatile int cancel;
+};
+
+struct zip_writer *zip_writer_new(const char *filename)
+{
+	assert(filename);
+	size_t cb_filename = strlen(filename);
+	char *temp_filename = malloc(cb_filename + sizeof(".XXXXXX"));
+	assert(temp_filename);
+	memcpy(temp_filename, filename, cb_filename);
+	memcpy(temp_filename + cb_filename, ".XXXXXX", sizeof(".XXXXXX"));
+	
+	int fd = mkstemp(temp_filename);
+	if(fd == -1) {
+		perror(temp_filename);
+		free(temp_filename);
+		return NULL;
+	}
+	
+	// mkstemp() creates the file with 0600, keep the mode of the file that gets replaced
+	struct stat st;
+	if(stat(filename, &st) == 0) {
+		fchmod(fd, st.st_mode & 07777);
+	}else {
+		mode_t mask = umask(0);
+		umask(mask);
+		fchmod(fd, 0666 & ~mask);
+	}
+	
+	FILE *fp = fdopen(fd, "wb");
+	assert(fp);
+	setvbuf(fp, NULL, _IOFBF, 1024 * 1024);
+	
+	struct zip_writer *writer = calloc(1, sizeof(*writer));
+	assert(writer);
+	writer->filename = strdup(filename);
+	writer->temp_filename = temp_filename;
+	writer->fp = fp;
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+	
+	time_t now = time(NULL);
+	struct tm t;
+	localtime_r(&now, &t);
+	if(t.tm_year < 80) t.tm_year = 80;
+	writer->dos_time = (t.tm_hour << 11) | (t.tm_min << 5) | (t.tm_sec / 2);
+	writer->dos_date = ((t.tm_year - 80) << 9) | ((t.tm_mon + 1) << 5) | t.tm_mday;
+	return writer;
+}
+
+void zip_writer_free(struct zip_writer *writer)
+{
+	if(NULL == writer) return;
+	if(writer->fp) fclose(writer->fp);
+	if(!writer->is_finished) unlink(writer->temp_filename);
+	
+	for(ssize_t i = 0; i < writer->num_parts; ++i) {
+		struct zip_writer_part *part = &writer->parts[i];
+		if(part->free_data) free((void *)part->data);
+		deflate_output_cleanup(&part->output);
+		free(part->name);
+	}
+	free(writer->parts);
+	free(writer->jobs);
+	pthread_mutex_destroy(&writer->mutex);
+	pthread_cond_destroy(&writer->cond);
+	free(writer->filename);
+	free(writer->temp_filename);
+	free(writer);
+}
+
+static struct zip_writer_part *zip_writer_new_part(struct zip_writer *writer, const char *name, size_t cb_name)
+{
+	if(writer->is_finished || cb_name == 0 || cb_name > 0xFFFF) return NULL;
+	if(writer->num_parts >= writer->max_parts) {
+		ssize_t new_size = writer->max_parts?(writer->max_parts * 2):64;
+		writer->parts = realloc(writer->parts, new_size * sizeof(*writer->parts));
+		assert(writer->parts);
+		writer->max_parts = new_size;
+	}
+	struct zip_writer_part *part = &writer->parts[writer->num_parts++];
+	memset(part, 0, sizeof(*part));
+	part->name = malloc(cb_name + 1);
+	assert(part->name);
+	memcpy(part->name, name, cb_name);
+	part->name[cb_name] = '\0';
+	part->cb_name = cb_name;
+	part->version_needed = ZIP_VERSION_DEFAULT;
+	part->dos_time = writer->dos_time;
+	part->dos_date = writer->dos_date;
+	for(size_t i = 0; i < cb_name; ++i) {
+		if((unsigned char)name[i] >= 0x80) {
+			part->flags |= ZIP_FLAG_UTF8;
+			break;
+		}
+	}
+	return part;
+}
+
+int zip_writer_add_buffer(struct zip_writer *writer, const char *name, const void *data, size_t length, int level, int free_data)
+{
+	assert(writer && name);
+	assert(data || length == 0);
+	struct zip_writer_part *part = zip_writer_new_part(writer, name, strlen(name));
+	if(NULL == part) return -1;
+	part->type = zip_writer_part_buffer;
+	part->data = data;
+	part->length = length;
+	part->free_data = free_data;
+	part->level = level;
+	return 0;
+}
+
+int zip_writer_add_stream(struct zip_writer *writer, const char *name, zip_writer_read_callback read, void *user_data, int level)
+{
+	assert(writer && name && read);
+	struct zip_writer_part *part = zip_writer_new_part(writer, name, strlen(name));
+	if(NULL == part) return -1;
+	part->type = zip_writer_part_stream;
+	part->read = read;
+	part->user_data = user_data;
+	part->level = level;
+	return 0;
+}
+
+int zip_writer_add_raw(struct zip_writer *writer, const struct zip_directory_entry *entry, const unsigned char *comp_data)
+{
+	assert(writer && entry);
+	assert(comp_data || entry->comp_size == 0);
+	struct zip_writer_part *part = zip_writer_new_part(writer, entry->name, entry->cb_name);
+	if(NULL == part) return -1;
+	part->type = zip_writer_part_raw;
+	part->data = comp_data;
+	part->length = entry->comp_size;
+	
+	// the local header is rewritten with the sizes, no data descriptor follows the data
+	part->version_needed = entry->version_needed;
+	part->flags = entry->flags & ~ZIP_FLAG_DATA_DESCRIPTOR;
+	part->method = entry->method;
+	part->dos_time = entry->dos_time;
+	part->dos_date = entry->dos_date;
+	part->crc = entry->crc;
+	part->comp_size = entry->comp_size;
+	part->size = entry->size;
+	part->is_done = 1;
+	return 0;
+}
+
+/*
+ * runs on a worker: crc and compressed data of a buffer or stream part
+ */
+static int zip_writer_part_compress(struct zip_writer_part *part)
+{
+	int is_stored = (0 == part->level);
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	if(!is_stored && deflateInit2(&strm, part->level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+	
+	unsigned char *input = part->read?malloc(DEFLATE_CHUNK_SIZE):NULL;
+	unsigned char *buffer = is_stored?NULL:malloc(DEFLATE_CHUNK_SIZE);
+	assert(!part->read || input);
+	assert(is_stored || buffer);
+	
+	const unsigned char *p = part->data;
+	size_t cb_left = part->length;
+	uLong crc = crc32(0L, Z_NULL, 0);
+	uint64_t size = 0;
+	int rc = 0;
+	int is_eof = 0;
+	while(!is_eof && 0 == rc) {
+		const unsigned char *chunk = NULL;
+		size_t cb_chunk = 0;
+		if(part->read) {
+			ssize_t cb = part->read(part->user_data, input, DEFLATE_CHUNK_SIZE);
+			if(cb < 0) {
+				rc = -1;
+				break;
+			}
+			chunk = input;
+			cb_chunk = cb;
+			is_eof = (cb == 0);
+		}else {
+			chunk = p;
+			cb_chunk = (cb_left > DEFLATE_CHUNK_SIZE)?DEFLATE_CHUNK_SIZE:cb_left;
+			p += cb_chunk;
+			cb_left -= cb_chunk;
+			is_eof = (cb_left == 0);
+		}
+		if(cb_chunk > 0) crc = crc32(crc, chunk, cb_chunk);
+		size += cb_chunk;
+		
+		if(is_stored) {
+			if(cb_chunk > 0) rc = deflate_output_append(&part->output, chunk, cb_chunk);
+			continue;
+		}
+		strm.next_in = (Bytef *)chunk;
+		strm.avail_in = cb_chunk;
+		do {
+			strm.next_out = buffer;
+			strm.avail_out = DEFLATE_CHUNK_SIZE;
+			if(deflate(&strm, is_eof?Z_FINISH:Z_NO_FLUSH) == Z_STREAM_ERROR) {
+				rc = -1;
+				break;
+			}
+			size_t cb = DEFLATE_CHUNK_SIZE - strm.avail_out;
+			if(cb > 0 && deflate_output_append(&part->output, buffer, cb) != 0) {
+				rc = -1;
+				break;
+			}
+		}while(strm.avail_out == 0);
+	}
+	if(!is_stored) deflateEnd(&strm);
+	free(input);
+	free(buffer);
+	if(rc) return -1;
+	
+	part->method = is_stored?0:8;
+	part->crc = crc;
+	part->size = size;
+	part->comp_size = part->output.total;
+	if(part->output.spill && fflush(part->output.spill) != 0) return -1;
+	return 0;
+}
+
+static void *deflate_worker_thread(void *user_data)
+{
+	struct zip_writer *writer = user_data;
+	while(!writer->cancel) {
+		ssize_t job = __sync_fetch_and_add(&writer->next_job, 1);
+		if(job >= writer->num_jobs) break;
+		
+		struct zip_writer_part *part = &writer->parts[writer->jobs[job]];
+		PERF_TRACE_BEGIN(span);
+		int err_code = zip_writer_part_compress(part);
+		PERF_TRACE_END(span, "zip_writer_deflate", part->name);
+		
+		pthread_mutex_lock(&writer->mutex);
+		part->err_code = err_code;
+		part->is_done = 1;
+		pthread_cond_broadcast(&writer->cond);
+		pthread_mutex_unlock(&writer->mutex);
+	}
+	return NULL;
+}
+
+static int zip_writer_write(struct zip_writer *writer, const void *data, size_t length)
+{
+	if(length > 0 && fwrite(data, 1, length, writer->fp) != length) return -1;
+	writer->offset += length;
+	return 0;
+}
+
+static int zip_writer_write_part(struct zip_writer *writer, struct zip_writer_part *part)
+{
+	unsigned char header[ZIP_LOCAL_HEADER_SIZE + 20];
+	int is_zip64 = (part->size >= ZIP_MAX_32 || part->comp_size >= ZIP_MAX_32);
+	if(is_zip64 && part->version_needed < ZIP_VERSION_ZIP64) part->version_needed = ZIP_VERSION_ZIP64;
+	part->local_header_offset = writer->offset;
+	
+	unsigned char *p = header;
+	p = write_u32(p, ZIP_LOCAL_HEADER_SIGNATURE);
+	p = write_u16(p, part->version_needed);
+	p = write_u16(p, part->flags);
+	p = write_u16(p, part->method);
+	p = write_u16(p, part->dos_time);
+	p = write_u16(p, part->dos_date);
+	p = write_u32(p, part->crc);
+	p = write_u32(p, is_zip64?ZIP_MAX_32:part->comp_size);
+	p = write_u32(p, is_zip64?ZIP_MAX_32:part->size);
+	p = write_u16(p, part->cb_name);
+	p = write_u16(p, is_zip64?20:0);
+	if(zip_writer_write(writer, header, p - header)) return -1;
+	if(zip_writer_write(writer, part->name, part->cb_name)) return -1;
+	if(is_zip64) {
+		p = header;
+		p = write_u16(p, 0x0001);
+		p = write_u16(p, 16);
+		p = write_u64(p, part->size);
+		p = write_u64(p, part->comp_size);
+		if(zip_writer_write(writer, header, p - header)) return -1;
+	}
+	
+	if(part->type == zip_writer_part_raw) return zip_writer_write(writer, part->data, part->length);
+	if(NULL == part->output.spill) return zip_writer_write(writer, part->output.data, part->output.length);
+	
+	unsigned char *buffer = malloc(DEFLATE_CHUNK_SIZE);
+	assert(buffer);
+	int rc = 0;
+	uint64_t cb_copied = 0;
+	rewind(part->output.spill);
+	while(0 == rc && cb_copied < part->output.total) {
+		size_t cb = fread(buffer, 1, DEFLATE_CHUNK_SIZE, part->output.spill);
+		if(cb == 0) rc = -1;
+		else rc = zip_writer_write(writer, buffer, cb);
+		cb_copied += cb;
+	}
+	free(buffer);
+	return rc;
+}
+
+static int zip_writer_write_directory(struct zip_writer *writer)
+{
+	unsigned char header[ZIP_CDIR_HEADER_SIZE + 28];
+	uint64_t cdir_offset = writer->offset;
+	for(ssize_t i = 0; i < writer->num_parts; ++i) {
+		struct zip_writer_part *part = &writer->parts[i];
+		
+		// zip64 extended information: only the fields which do not fit, in this order
+		unsigned char extra[28];
+		unsigned char *x = extra + 4;
+		if(part->size >= ZIP_MAX_32) x = write_u64(x, part->size);
+		if(part->comp_size >= ZIP_MAX_32) x = write_u64(x, part->comp_size);
+		if(part->local_header_offset >= ZIP_MAX_32) x = write_u64(x, part->local_header_offset);
+		size_t cb_extra = (x == extra + 4)?0:(x - extra);
+		if(cb_extra) {
+			write_u16(extra, 0x0001);
+			write_u16(extra + 2, cb_extra - 4);
+			if(part->version_needed < ZIP_VERSION_ZIP64) part->version_needed = ZIP_VERSION_ZIP64;
+		}
+		
+		unsigned char *p = header;
+		p = write_u32(p, ZIP_CDIR_SIGNATURE);
+		p = write_u16(p, part->version_needed);	// made by: ms-dos, same version
+		p = write_u16(p, part->version_needed);
+		p = write_u16(p, part->flags);
+		p = write_u16(p, part->method);
+		p = write_u16(p, part->dos_time);
+		p = write_u16(p, part->dos_date);
+		p = write_u32(p, part->crc);
+		p = write_u32(p, (part->comp_size >= ZIP_MAX_32)?ZIP_MAX_32:part->comp_size);
+		p = write_u32(p, (part->size >= ZIP_MAX_32)?ZIP_MAX_32:part->size);
+		p = write_u16(p, part->cb_name);
+		p = write_u16(p, cb_extra);
+		p = write_u16(p, 0);	// comment
+		p = write_u16(p, 0);	// disk
+		p = write_u16(p, 0);	// internal attributes
+		p = write_u32(p, 0);	// external attributes
+		p = write_u32(p, (part->local_header_offset >= ZIP_MAX_32)?ZIP_MAX_32:part->local_header_offset);
+		if(zip_writer_write(writer, header, p - header)) return -1;
+		if(zip_writer_write(writer, part->name, part->cb_name)) return -1;
+		if(cb_extra && zip_writer_write(writer, extra, cb_extra)) return -1;
+	}
+	
+	uint64_t num_entries = writer->num_parts;
+	uint64_t cdir_size = writer->offset - cdir_offset;
+	int is_zip64 = (num_entries >= 0xFFFF || cdir_size >= ZIP_MAX_32 || cdir_offset >= ZIP_MAX_32);
+	unsigned char eocd[ZIP64_EOCD_SIZE + ZIP64_EOCD_LOCATOR_SIZE + ZIP_EOCD_SIZE];
+	unsigned char *p = eocd;
+	if(is_zip64) {
+		uint64_t eocd64_offset = writer->offset;
+		p = write_u32(p, ZIP64_EOCD_SIGNATURE);
+		p = write_u64(p, ZIP64_EOCD_SIZE - 12);
+		p = write_u16(p, ZIP_VERSION_ZIP64);
+		p = write_u16(p, ZIP_VERSION_ZIP64);
+		p = write_u32(p, 0);
+		p = write_u32(p, 0);
+		p = write_u64(p, num_entries);
+		p = write_u64(p, num_entries);
+		p = write_u64(p, cdir_size);
+		p = write_u64(p, cdir_offset);
+		
+		p = write_u32(p, ZIP64_EOCD_LOCATOR_SIGNATURE);
+		p = write_u32(p, 0);
+		p = write_u64(p, eocd64_offset);
+		p = write_u32(p, 1);
+	}
+	p = write_u32(p, ZIP_EOCD_SIGNATURE);
+	p = write_u16(p, 0);
+	p = write_u16(p, 0);
+	p = write_u16(p, (num_entries >= 0xFFFF)?0xFFFF:num_entries);
+	p = write_u16(p, (num_entries >= 0xFFFF)?0xFFFF:num_entries);
+	p = write_u32(p, (cdir_size >= ZIP_MAX_32)?ZIP_MAX_32:cdir_size);
+	p = write_u32(p, (cdir_offset >= ZIP_MAX_32)?ZIP_MAX_32:cdir_offset);
+	p = write_u16(p, 0);
+	return zip_writer_write(writer, eocd, p - eocd);
+}
+
+int zip_writer_finish(struct zip_writer *writer, int num_workers)
+{
+	assert(writer);
+	if(writer->is_finished || NULL == writer->fp) return -1;
+	
+	PERF_TRACE_BEGIN(span);
+	writer->jobs = calloc(writer->num_parts + 1, sizeof(*writer->jobs));
+	assert(writer->jobs);
+	for(ssize_t i = 0; i < writer->num_parts; ++i) {
+		if(writer->parts[i].type != zip_writer_part_raw) writer->jobs[writer->num_jobs++] = i;
+	}
+	
+	if(num_workers <= 0) num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if(num_workers <= 0) num_workers = 1;
+	if(num_workers > writer->num_jobs) num_workers = writer->num_jobs;
+	pthread_t *workers = calloc(num_workers + 1, sizeof(*workers));
+	assert(workers);
+	for(int i = 0; i < num_workers; ++i) {
+		int rc = pthread_create(&workers[i], NULL, deflate_worker_thread, writer);
+		assert(0 == rc);
+	}
+	
+	// parts are written in order, each one as soon as its worker is done with it
+	int rc = 0;
+	for(ssize_t i = 0; 0 == rc && i < writer->num_parts; ++i) {
+		struct zip_writer_part *part = &writer->parts[i];
+		pthread_mutex_lock(&writer->mutex);
+		while(!part->is_done) pthread_cond_wait(&writer->cond, &writer->mutex);
+		pthread_mutex_unlock(&writer->mutex);
+		
+		if(part->err_code) {
+			fprintf(stderr, "%s(%s): compress part '%s' failed\n", __FUNCTION__, writer->filename, part->name);
+			rc = -1;
+			break;
+		}
+		rc = zip_writer_write_part(writer, part);
+		deflate_output_cleanup(&part->output);
+	}
+	if(rc) writer->cancel = 1;
+	for(int i = 0; i < num_workers; ++i) pthread_join(workers[i], NULL);
+	free(workers);
+	
+	if(0 == rc) rc = zip_writer_write_directory(writer);
+	if(fclose(writer->fp) != 0) rc = -1;
+	writer->fp = NULL;
+	if(0 == rc && rename(writer->temp_filename, writer->filename) != 0) {
+		perror("rename");
+		rc = -1;
+	}
+	if(rc) {
+		fprintf(stderr, "%s(%s) failed: %s\n", __FUNCTION__, writer->filename, strerror(errno));
+	}else {
+		writer->is_finished = 1;
+	}
+	PERF_TRACE_END(span, "zip_writer_finish", writer->filename);
+	debug_printf("%s: %ld parts (%ld compressed), %d workers, %lu bytes, rc=%d", writer->filename,
+		(long)writer->num_parts, (long)writer->num_jobs, num_workers, (unsigned long)writer->offset, rc);
+	return rc;
+}
+
+
+#if defined(TEST_ZIP_WRITER_) && defined(_STAND_ALONE)
+int main(int argc, char **argv)
+{
+
+	return 0;
+}
+#endif
@@ -0,0 +1,47 @@
+#ifndef OOXML_ZIP_WRITER_H_
+#define OOXML_ZIP_WRITER_H_
+
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "zip_directory.h"
+
+/*
+ * writes a zip archive whose new parts are deflated in parallel:
+ * the parts are collected first, finish() compresses them on a worker pool into independent buffers
+ * (spilled to temporary files when large) and writes them in the order they were added,
+ * each one as soon as it is ready, followed by the central directory. zip64 records are written when needed.
+ * the archive is written to a temporary file next to filename, which replaces filename on success.
+ */
+struct zip_writer;
+
+// pulls the uncompressed data of a part, returns the number of bytes (0 at the end) or -1 on error
+typedef ssize_t (*zip_writer_read_callback)(void *user_data, unsigned char *buffer, size_t size);
+
+struct zip_writer *zip_writer_new(const char *filename);
+
+// removes the temporary file if finish() has not succeeded
+void zip_writer_free(struct zip_writer *writer);
+
+/*
+ * level: 0 stores the part, 1-9 or -1 (zlib default) deflate it.
+ * add_buffer: data must stay valid until finish(), free_data: the writer frees it.
+ * add_stream: read is called on a worker thread, once per part.
+ */
+int zip_writer_add_buffer(struct zip_writer *writer, const char *name, const void *data, size_t length, int level, int free_data);
+int zip_writer_add_stream(struct zip_writer *writer, const char *name, zip_writer_read_callback read, void *user_data, int level);
+
+// copy an entry of another archive as it is (compressed data, crc, timestamp), comp_data: entry->comp_size bytes
+int zip_writer_add_raw(struct zip_writer *writer, const struct zip_directory_entry *entry, const unsigned char *comp_data);
+
+// num_workers <= 0: number of online cpus. returns 0 or -1
+int zip_writer_finish(struct zip_writer *writer, int num_workers);
+
+#ifdef __cplusplus
+}
+#endif
+#endif